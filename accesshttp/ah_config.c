@@ -7,6 +7,25 @@
 
 struct settings settings;
 
+static int read_listener_mode(json_t *root, const char *key)
+{
+    char *mode;
+    ERR_RET(read_cfg_str(root, key, &mode, "random"));
+    if (strcmp(mode, "random") == 0) {
+        settings.listener_mode = LISTENER_MODE_RANDOM;
+    } else if (strcmp(mode, "least_load") == 0) {
+        settings.listener_mode = LISTENER_MODE_LEAST_LOAD;
+    } else if (strcmp(mode, "reuseport") == 0) {
+        settings.listener_mode = LISTENER_MODE_REUSEPORT;
+    } else {
+        free(mode);
+        return -__LINE__;
+    }
+    free(mode);
+
+    return 0;
+}
+
 static int read_config_from_json(json_t *root)
 {
     int ret;
@@ -53,6 +72,8 @@ static int read_config_from_json(json_t *root)
 
     ERR_RET(read_cfg_real(root, "timeout", &settings.timeout, false, 1.0));
     ERR_RET(read_cfg_int(root, "worker_num", &settings.worker_num, false, 1));
+    ERR_RET(read_listener_mode(root, "listener_mode"));
+    ERR_RET(read_cfg_bool(root, "matchengine_binary", &settings.matchengine_binary, false, false));
 
     return 0;
 }
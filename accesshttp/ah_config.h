@@ -35,8 +35,17 @@
 # include "ut_rpc_clt.h"
 # include "ut_rpc_svr.h"
 # include "ut_rpc_cmd.h"
+# include "ut_rpc_bin.h"
 # include "ut_http_svr.h"
 
+# define AH_LISTENER_CMD_LOAD       1
+# define AH_LISTENER_LOAD_INTERVAL  1.0
+
+/* how the listener hands connections to the workers */
+# define LISTENER_MODE_RANDOM       0
+# define LISTENER_MODE_LEAST_LOAD   1
+# define LISTENER_MODE_REUSEPORT    2
+
 # define AH_LISTENER_BIND   "seqpacket@/tmp/accesshttp_listener.sock"
 
 struct settings {
@@ -50,6 +59,8 @@ struct settings {
     rpc_clt_cfg         readhistory;
     double              timeout;
     int                 worker_num;
+    int                 listener_mode;
+    bool                matchengine_binary;
 };
 
 extern struct settings settings;
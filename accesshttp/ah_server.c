@@ -10,6 +10,7 @@ static http_svr *svr;
 static nw_state *state;
 static dict_t *methods;
 static rpc_clt *listener;
+static nw_timer load_timer;
 
 static rpc_clt *matchengine;
 static rpc_clt *marketprice;
@@ -62,6 +63,30 @@ static void reply_time_out(nw_ses *ses, int64_t id)
     reply_error(ses, id, 5, "service timeout", 504);
 }
 
+// hot commands sent to matchengine in the compact binary encoding
+static bool is_binary_command(rpc_clt *clt, uint32_t cmd)
+{
+    if (!settings.matchengine_binary || clt != matchengine)
+        return false;
+
+    switch (cmd) {
+    case CMD_BALANCE_QUERY:
+    case CMD_BALANCE_UPDATE:
+    case CMD_ORDER_PUT_LIMIT:
+    case CMD_ORDER_PUT_MARKET:
+    case CMD_ORDER_PUT_AON:
+    case CMD_ORDER_PUT_FOK:
+    case CMD_ORDER_PUT_BATCH:
+    case CMD_ORDER_QUERY:
+    case CMD_ORDER_CANCEL:
+    case CMD_ORDER_CANCEL_ALL:
+    case CMD_ORDER_AMEND:
+        return true;
+    default:
+        return false;
+    }
+}
+
 static int on_http_request(nw_ses *ses, http_request_t *request)
 {
     log_trace("new http request, url: %s, method: %u", request->url, request->method);
@@ -111,13 +136,9 @@ static int on_http_request(nw_ses *ses, http_request_t *request)
         pkg.command   = req->cmd;
         pkg.sequence  = entry->id;
         pkg.req_id    = json_integer_value(id);
-        pkg.body      = json_dumps(params, 0);
-        pkg.body_size = strlen(pkg.body);
-
-        rpc_clt_send(req->clt, &pkg);
+        rpc_clt_send_body(req->clt, &pkg, params, is_binary_command(req->clt, req->cmd));
         log_debug("send request to %s, cmd: %u, sequence: %u",
                 nw_sock_human_addr(rpc_clt_peer_addr(req->clt)), pkg.command, pkg.sequence);
-        free(pkg.body);
     }
 
     json_decref(body);
@@ -193,12 +214,45 @@ static void on_backend_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
         struct state_info *info = entry->data;
         if (info->ses->id == info->ses_id) {
             log_trace("send response to: %s", nw_sock_human_addr(&info->ses->peer_addr));
-            send_http_response_simple(info->ses, 200, pkg->body, pkg->body_size);
+            if (rpc_pkg_is_binary(pkg)) {
+                sds text = rpc_pkg_body_text(pkg);
+                if (text) {
+                    send_http_response_simple(info->ses, 200, text, sdslen(text));
+                    sdsfree(text);
+                } else {
+                    log_error("invalid binary reply from: %s, cmd: %u", nw_sock_human_addr(&ses->peer_addr), pkg->command);
+                    reply_internal_error(info->ses);
+                }
+            } else {
+                send_http_response_simple(info->ses, 200, pkg->body, pkg->body_size);
+            }
         }
         nw_state_del(state, pkg->sequence);
     }
 }
 
+static void report_load(void)
+{
+    if (!rpc_clt_connected(listener))
+        return;
+
+    json_t *body = json_object();
+    json_object_set_new(body, "sessions", json_integer(svr->raw_svr->clt_count));
+    json_object_set_new(body, "subscriptions", json_integer(0));
+
+    rpc_pkg pkg;
+    memset(&pkg, 0, sizeof(pkg));
+    pkg.pkg_type = RPC_PKG_TYPE_REQUEST;
+    pkg.command  = AH_LISTENER_CMD_LOAD;
+    rpc_clt_send_body(listener, &pkg, body, false);
+    json_decref(body);
+}
+
+static void on_load_timer(nw_timer *timer, void *privdata)
+{
+    report_load();
+}
+
 static void on_listener_connect(nw_ses *ses, bool result)
 {
     if (result) {
@@ -269,7 +323,10 @@ static int init_methods_handler(void)
     ERR_RET_LN(add_handler("order.put_market", matchengine, CMD_ORDER_PUT_MARKET));
     ERR_RET_LN(add_handler("order.put_aon", matchengine, CMD_ORDER_PUT_AON));
     ERR_RET_LN(add_handler("order.put_fok", matchengine, CMD_ORDER_PUT_FOK));
+    ERR_RET_LN(add_handler("order.put_batch", matchengine, CMD_ORDER_PUT_BATCH));
     ERR_RET_LN(add_handler("order.cancel", matchengine, CMD_ORDER_CANCEL));
+    ERR_RET_LN(add_handler("order.cancel_all", matchengine, CMD_ORDER_CANCEL_ALL));
+    ERR_RET_LN(add_handler("order.amend", matchengine, CMD_ORDER_AMEND));
     ERR_RET_LN(add_handler("order.book", matchengine, CMD_ORDER_BOOK));
     ERR_RET_LN(add_handler("order.depth", matchengine, CMD_ORDER_BOOK_DEPTH));
     ERR_RET_LN(add_handler("order.pending", matchengine, CMD_ORDER_QUERY));
@@ -341,7 +398,18 @@ int init_server(void)
         return -__LINE__;
 
     ERR_RET(init_methods_handler());
-    ERR_RET(init_listener_clt());
+    if (settings.listener_mode == LISTENER_MODE_REUSEPORT) {
+        if (nw_svr_set_reuse_port(svr->raw_svr) < 0)
+            return -__LINE__;
+        if (http_svr_start(svr) < 0)
+            return -__LINE__;
+    } else {
+        ERR_RET(init_listener_clt());
+    }
+    if (settings.listener_mode == LISTENER_MODE_LEAST_LOAD) {
+        nw_timer_set(&load_timer, AH_LISTENER_LOAD_INTERVAL, true, on_load_timer, NULL);
+        nw_timer_start(&load_timer);
+    }
 
     return 0;
 }
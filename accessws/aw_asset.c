@@ -95,7 +95,10 @@ static int on_balance_query_reply(struct state_data *state, json_t *result)
 
 static void on_backend_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
 {
-    sds reply_str = sdsnewlen(pkg->body, pkg->body_size);
+    sds reply_str = rpc_pkg_body_text(pkg);
+    if (reply_str == NULL) {
+        reply_str = sdsempty();
+    }
     log_trace("recv pkg from: %s, cmd: %u, sequence: %u, reply: %s",
             nw_sock_human_addr(&ses->peer_addr), pkg->command, pkg->sequence, reply_str);
     nw_state_entry *entry = nw_state_get(state_context, pkg->sequence);
@@ -105,7 +108,7 @@ static void on_backend_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
     }
     struct state_data *state = entry->data;
 
-    json_t *reply = json_loadb(pkg->body, pkg->body_size, 0, NULL);
+    json_t *reply = rpc_pkg_body_json(pkg);
     if (reply == NULL) {
         sds hex = hexdump(pkg->body, pkg->body_size);
         log_fatal("invalid reply from: %s, cmd: %u, reply: \n%s", nw_sock_human_addr(&ses->peer_addr), pkg->command, hex);
@@ -270,13 +273,10 @@ int asset_on_update(uint32_t user_id, const char *asset)
     pkg.pkg_type  = RPC_PKG_TYPE_REQUEST;
     pkg.command   = CMD_BALANCE_QUERY;
     pkg.sequence  = state_entry->id;
-    pkg.body      = json_dumps(trade_params, 0);
-    pkg.body_size = strlen(pkg.body);
 
-    rpc_clt_send(matchengine, &pkg);
-    log_trace("send request to %s, cmd: %u, sequence: %u, params: %s",
-            nw_sock_human_addr(rpc_clt_peer_addr(matchengine)), pkg.command, pkg.sequence, (char *)pkg.body);
-    free(pkg.body);
+    rpc_clt_send_body(matchengine, &pkg, trade_params, settings.matchengine_binary);
+    log_trace("send request to %s, cmd: %u, sequence: %u",
+            nw_sock_human_addr(rpc_clt_peer_addr(matchengine)), pkg.command, pkg.sequence);
     json_decref(trade_params);
 
     return 0;
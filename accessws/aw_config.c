@@ -43,6 +43,25 @@ static int read_depth_merge_cfg(json_t *root, const char *key)
     return 0;
 }
 
+static int read_listener_mode(json_t *root, const char *key)
+{
+    char *mode;
+    ERR_RET(read_cfg_str(root, key, &mode, "random"));
+    if (strcmp(mode, "random") == 0) {
+        settings.listener_mode = LISTENER_MODE_RANDOM;
+    } else if (strcmp(mode, "least_load") == 0) {
+        settings.listener_mode = LISTENER_MODE_LEAST_LOAD;
+    } else if (strcmp(mode, "reuseport") == 0) {
+        settings.listener_mode = LISTENER_MODE_REUSEPORT;
+    } else {
+        free(mode);
+        return -__LINE__;
+    }
+    free(mode);
+
+    return 0;
+}
+
 static int read_config_from_json(json_t *root)
 {
     int ret;
@@ -96,11 +115,21 @@ static int read_config_from_json(json_t *root)
         printf("load kafka balances config fail: %d\n", ret);
         return -__LINE__;
     }
+    if (json_object_get(root, "depth")) {
+        ret = load_cfg_kafka_consumer(root, "depth", &settings.depth);
+        if (ret < 0) {
+            printf("load kafka depth config fail: %d\n", ret);
+            return -__LINE__;
+        }
+        settings.depth_feed = true;
+    }
 
     ERR_RET(read_cfg_int(root, "worker_num", &settings.worker_num, false, 1));
+    ERR_RET(read_listener_mode(root, "listener_mode"));
     ERR_RET(read_cfg_str(root, "auth_url", &settings.auth_url, NULL));
     ERR_RET(read_cfg_str(root, "sign_url", &settings.sign_url, NULL));
     ERR_RET(read_cfg_real(root, "backend_timeout", &settings.backend_timeout, false, 1.0));
+    ERR_RET(read_cfg_bool(root, "matchengine_binary", &settings.matchengine_binary, false, false));
     ERR_RET(read_cfg_real(root, "cache_timeout", &settings.cache_timeout, false, 0.5));
 
     ERR_RET(read_cfg_real(root, "deals_interval", &settings.deals_interval, false, 0.5));
@@ -109,6 +138,7 @@ static int read_config_from_json(json_t *root)
     ERR_RET(read_cfg_real(root, "today_interval", &settings.today_interval, false, 0.5));
     ERR_RET(read_cfg_real(root, "kline_interval", &settings.kline_interval, false, 0.5));
     ERR_RET(read_cfg_real(root, "depth_interval", &settings.depth_interval, false, 0.5));
+    ERR_RET(read_cfg_int(root, "depth_book_limit", &settings.depth_book_limit, false, 100));
 
     ERR_RET(read_depth_limit_cfg(root, "depth_limit"));
     ERR_RET(read_depth_merge_cfg(root, "depth_merge"));
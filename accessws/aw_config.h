@@ -28,12 +28,15 @@
 # include "ut_cli.h"
 # include "ut_misc.h"
 # include "ut_list.h"
+# include "ut_skiplist.h"
 # include "ut_kafka.h"
 # include "ut_signal.h"
 # include "ut_config.h"
 # include "ut_decimal.h"
+# include "ut_fixed.h"
 # include "ut_rpc_clt.h"
 # include "ut_rpc_svr.h"
+# include "ut_rpc_bin.h"
 # include "ut_rpc_cmd.h"
 # include "ut_ws_svr.h"
 
@@ -44,6 +47,14 @@
 
 # define GATEWAY_USER_ID        1
 
+# define AW_LISTENER_CMD_LOAD       1
+# define AW_LISTENER_LOAD_INTERVAL  1.0
+
+/* how the listener hands connections to the workers */
+# define LISTENER_MODE_RANDOM       0
+# define LISTENER_MODE_LEAST_LOAD   1
+# define LISTENER_MODE_REUSEPORT    2
+
 # define AW_LISTENER_BIND   "seqpacket@/tmp/accessws_listener.sock"
 
 typedef struct depth_limit_cfg {
@@ -67,11 +78,15 @@ struct settings {
     rpc_clt_cfg         readhistory;
     kafka_consumer_cfg  orders;
     kafka_consumer_cfg  balances;
+    kafka_consumer_cfg  depth;
+    bool                depth_feed;
 
     int                 worker_num;
+    int                 listener_mode;
     char                *auth_url;
     char                *sign_url;
     double              backend_timeout;
+    bool                matchengine_binary;
     double              cache_timeout;
 
     double              deals_interval;
@@ -80,6 +95,7 @@ struct settings {
     double              today_interval;
     double              kline_interval;
     double              depth_interval;
+    int                 depth_book_limit;
 
     depth_limit_cfg     depth_limit;
     depth_merge_cfg     depth_merge;
@@ -11,6 +11,7 @@ int init_deals(void);
 int deals_subscribe(nw_ses *ses, const char *market);
 int deals_send_full(nw_ses *ses, const char *market);
 int deals_unsubscribe(nw_ses *ses);
+size_t deals_subscribe_number(void);
 
 # endif
 
@@ -1,5 +1,5 @@
 /*
- * Description: 
+ * Description:
  *     History: yang@haipo.me, 2017/04/27, create
  */
 
@@ -9,8 +9,10 @@
 
 static nw_timer timer;
 static dict_t *dict_depth;
+static dict_t *dict_book;
 static rpc_clt *matchengine;
 static nw_state *state_context;
+static kafka_consumer_t *kafka_depth;
 
 # define CLEAN_INTERVAL 60
 
@@ -20,14 +22,53 @@ struct depth_key {
     uint32_t limit;
 };
 
+struct depth_level {
+    int64_t price;
+    int64_t amount;
+};
+
+/* one side of a depth view, best price first */
+struct depth_side {
+    size_t count;
+    struct depth_level *levels;
+};
+
 struct depth_val {
     dict_t *sessions;
-    json_t *last;
+    struct depth_side asks;
+    struct depth_side bids;
+    bool    ready;
+    /* the local book does not reach deep enough for this view, query the engine */
+    bool    polled;
+    int     price_prec;
+    int     amount_prec;
     time_t  last_clean;
 };
 
+/*
+ * The local book of a market, loaded from an order.depth snapshot and kept
+ * up to date by the depth deltas of the engine. Levels deeper than the
+ * snapshot edge are only known when they changed, views stop there.
+ */
+struct market_book {
+    skiplist_t  *asks;
+    skiplist_t  *bids;
+    uint64_t    seq;
+    int         price_prec;
+    int         amount_prec;
+    bool        ready;
+    bool        loading;
+    bool        ask_truncated;
+    bool        bid_truncated;
+    int64_t     ask_edge;
+    int64_t     bid_edge;
+    /* deltas received while the snapshot is loading */
+    list_t      *pending;
+};
+
 struct state_data {
     struct depth_key key;
+    bool book;
 };
 
 static uint32_t dict_ses_hash_func(const void *key)
@@ -73,11 +114,68 @@ static void dict_depth_val_free(void *val)
 {
     struct depth_val *obj = val;
     dict_release(obj->sessions);
-    if (obj->last)
-        json_decref(obj->last);
+    free(obj->asks.levels);
+    free(obj->bids.levels);
     free(obj);
 }
 
+static uint32_t dict_book_hash_func(const void *key)
+{
+    return dict_generic_hash_function(key, strlen(key));
+}
+
+static int dict_book_key_compare(const void *key1, const void *key2)
+{
+    return strcmp(key1, key2);
+}
+
+static void *dict_book_key_dup(const void *key)
+{
+    return strdup(key);
+}
+
+static void dict_book_key_free(void *key)
+{
+    free(key);
+}
+
+static void dict_book_val_free(void *val)
+{
+    struct market_book *book = val;
+    skiplist_release(book->asks);
+    skiplist_release(book->bids);
+    list_release(book->pending);
+    free(book);
+}
+
+static int level_ask_compare(const void *value1, const void *value2)
+{
+    const struct depth_level *level1 = value1;
+    const struct depth_level *level2 = value2;
+    if (level1->price == level2->price)
+        return 0;
+    return level1->price > level2->price ? 1 : -1;
+}
+
+static int level_bid_compare(const void *value1, const void *value2)
+{
+    const struct depth_level *level1 = value1;
+    const struct depth_level *level2 = value2;
+    if (level1->price == level2->price)
+        return 0;
+    return level1->price < level2->price ? 1 : -1;
+}
+
+static void level_free(void *value)
+{
+    free(value);
+}
+
+static void pending_free(void *value)
+{
+    json_decref(value);
+}
+
 static void on_backend_connect(nw_ses *ses, bool result)
 {
     rpc_clt *clt = ses->privdata;
@@ -88,86 +186,114 @@ static void on_backend_connect(nw_ses *ses, bool result)
     }
 }
 
-static json_t *get_list_diff(json_t *list1, json_t *list2, uint32_t limit, int side)
+// the engine formats every price of a market with the same number of decimals
+static int decimal_prec(const char *str)
 {
-    if (list1 == NULL || list2 == NULL)
-        return NULL;
+    const char *dot = strchr(str, '.');
+    return dot ? strlen(dot + 1) : 0;
+}
+
+static int parse_level(json_t *unit, int price_prec, int amount_prec, struct depth_level *level)
+{
+    const char *price  = json_string_value(json_array_get(unit, 0));
+    const char *amount = json_string_value(json_array_get(unit, 1));
+    if (price == NULL || amount == NULL)
+        return -__LINE__;
+    if (fixed_parse(price, price_prec, &level->price) < 0)
+        return -__LINE__;
+    if (fixed_parse(amount, amount_prec, &level->amount) < 0)
+        return -__LINE__;
+    return 0;
+}
+
+static int parse_side(json_t *list, int price_prec, int amount_prec, struct depth_side *side)
+{
+    size_t size = json_array_size(list);
+    side->count = 0;
+    side->levels = realloc(side->levels, sizeof(struct depth_level) * (size ? size : 1));
+    for (size_t i = 0; i < size; ++i) {
+        if (parse_level(json_array_get(list, i), price_prec, amount_prec, &side->levels[i]) < 0)
+            return -__LINE__;
+        side->count += 1;
+    }
+    return 0;
+}
 
+// learn the precision of a market from the first level of a reply or delta
+static void learn_prec(json_t *result, int *price_prec, int *amount_prec)
+{
+    json_t *unit = json_array_get(json_object_get(result, "asks"), 0);
+    if (unit == NULL)
+        unit = json_array_get(json_object_get(result, "bids"), 0);
+    if (unit == NULL)
+        return;
+
+    const char *price  = json_string_value(json_array_get(unit, 0));
+    const char *amount = json_string_value(json_array_get(unit, 1));
+    if (price && amount) {
+        *price_prec = decimal_prec(price);
+        *amount_prec = decimal_prec(amount);
+    }
+}
+
+static json_t *format_level(int64_t price, const char *amount, int price_prec)
+{
+    char buf[FIXED_STR_MAX_LEN];
+    json_t *unit = json_array();
+    json_array_append_new(unit, json_string(fixed_format(buf, price, price_prec)));
+    json_array_append_new(unit, json_string(amount));
+    return unit;
+}
+
+static json_t *format_side(struct depth_side *side, int price_prec, int amount_prec)
+{
+    char buf[FIXED_STR_MAX_LEN];
+    json_t *list = json_array();
+    for (size_t i = 0; i < side->count; ++i) {
+        fixed_format(buf, side->levels[i].amount, amount_prec);
+        json_array_append_new(list, format_level(side->levels[i].price, buf, price_prec));
+    }
+    return list;
+}
+
+/* the same diff as the engine reply would give: changed and new levels, removed levels with amount 0 */
+static json_t *get_list_diff(struct depth_side *side1, struct depth_side *side2, uint32_t limit, int dir, int price_prec, int amount_prec)
+{
+    char buf[FIXED_STR_MAX_LEN];
     json_t *diff = json_array();
-    mpd_t *price1  = NULL;
-    mpd_t *amount1 = NULL;
-    mpd_t *price2  = NULL;
-    mpd_t *amount2 = NULL;
-
-    size_t list1_size = json_array_size(list1);
-    size_t list2_size = json_array_size(list2);
-    size_t list1_pos = 0;
-    size_t list2_pos = 0;
-
-    while (list1_pos < list1_size && list2_pos < list2_size) {
-        json_t *unit1 = json_array_get(list1, list1_pos);
-        const char *unit1_price  = json_string_value(json_array_get(unit1, 0));
-        const char *unit1_amount = json_string_value(json_array_get(unit1, 1));
-        if (unit1_price == NULL || unit1_amount == NULL)
-            goto error;
-        price1 = decimal(unit1_price, 0);
-        amount1 = decimal(unit1_amount, 0);
-        if (price1 == NULL || amount1 == NULL)
-            goto error;
-
-        json_t *unit2 = json_array_get(list2, list2_pos);
-        const char *unit2_price  = json_string_value(json_array_get(unit2, 0));
-        const char *unit2_amount = json_string_value(json_array_get(unit2, 1));
-        if (unit2_price == NULL || unit2_amount == NULL)
-            goto error;
-        price2 = decimal(unit2_price, 0);
-        amount2 = decimal(unit2_amount, 0);
-        if (price2 == NULL || amount2 == NULL)
-            goto error;
-
-        int cmp = mpd_cmp(price1, price2, &mpd_ctx) * side;
+    size_t pos1 = 0;
+    size_t pos2 = 0;
+
+    while (pos1 < side1->count && pos2 < side2->count) {
+        struct depth_level *level1 = &side1->levels[pos1];
+        struct depth_level *level2 = &side2->levels[pos2];
+        int cmp = level1->price == level2->price ? 0 : (level1->price > level2->price ? 1 : -1);
+        cmp *= dir;
         if (cmp == 0) {
-            list1_pos += 1;
-            list2_pos += 1;
-            if (mpd_cmp(amount1, amount2, &mpd_ctx) != 0) {
-                json_array_append(diff, unit2);
+            pos1 += 1;
+            pos2 += 1;
+            if (level1->amount != level2->amount) {
+                fixed_format(buf, level2->amount, amount_prec);
+                json_array_append_new(diff, format_level(level2->price, buf, price_prec));
             }
         } else if (cmp > 0) {
-            list2_pos += 1;
-            json_array_append(diff, unit2);
+            pos2 += 1;
+            fixed_format(buf, level2->amount, amount_prec);
+            json_array_append_new(diff, format_level(level2->price, buf, price_prec));
         } else {
-            list1_pos += 1;
-            json_t *unit = json_array();
-            json_array_append_new_mpd(unit, price1);
-            json_array_append_new(unit, json_string("0"));
-            json_array_append_new(diff, unit);
+            pos1 += 1;
+            json_array_append_new(diff, format_level(level1->price, "0", price_prec));
         }
-
-        mpd_del(price1);
-        price1  = NULL;
-        mpd_del(amount1);
-        amount1 = NULL;
-        mpd_del(price2);
-        price2  = NULL;
-        mpd_del(amount2);
-        amount2 = NULL;
     }
 
-    while (list2_size < limit && list1_pos < list1_size) {
-        json_t *unit = json_array_get(list1, list1_pos);
-        const char *price = json_string_value(json_array_get(unit, 0));
-        const char *amount = json_string_value(json_array_get(unit, 1));
-        if (price == NULL || amount == NULL)
-            goto error;
-        json_t *new = json_array();
-        json_array_append_new(new, json_string(price));
-        json_array_append_new(new, json_string("0"));
-        json_array_append_new(diff, new);
-        list1_pos += 1;
+    while (side2->count < limit && pos1 < side1->count) {
+        json_array_append_new(diff, format_level(side1->levels[pos1].price, "0", price_prec));
+        pos1 += 1;
     }
 
-    for (;list2_pos < list2_size; ++list2_pos) {
-        json_array_append(diff, json_array_get(list2, list2_pos));
+    for (; pos2 < side2->count; ++pos2) {
+        fixed_format(buf, side2->levels[pos2].amount, amount_prec);
+        json_array_append_new(diff, format_level(side2->levels[pos2].price, buf, price_prec));
     }
 
     if (json_array_size(diff) == 0) {
@@ -176,53 +302,422 @@ static json_t *get_list_diff(json_t *list1, json_t *list2, uint32_t limit, int s
     }
 
     return diff;
+}
 
-error:
-    json_decref(diff);
-    if (price1)
-        mpd_del(price1);
-    if (amount1)
-        mpd_del(amount1);
-    if (price2)
-        mpd_del(price2);
-    if (amount2)
-        mpd_del(amount2);
+static int broadcast_update(const char *market, dict_t *sessions, bool clean, json_t *result)
+{
+    json_t *params = json_array();
+    json_array_append_new(params, json_boolean(clean));
+    json_array_append(params, result);
+    json_array_append_new(params, json_string(market));
 
-    return NULL;
+    int ret = broadcast_notify(sessions, "depth.update", params);
+    json_decref(params);
+
+    return ret;
 }
 
-static json_t *get_depth_diff(json_t *first, json_t *second, uint32_t limit)
+static struct market_book *get_book(const char *market)
 {
-    json_t *asks = get_list_diff(json_object_get(first, "asks"), json_object_get(second, "asks"), limit,  1);
-    json_t *bids = get_list_diff(json_object_get(first, "bids"), json_object_get(second, "bids"), limit, -1);
-    if (asks == NULL && bids == NULL)
+    dict_entry *entry = dict_find(dict_book, market);
+    if (entry == NULL)
         return NULL;
-    json_t *diff = json_object();
-    if (asks)
-        json_object_set_new(diff, "asks", asks);
-    if (bids)
-        json_object_set_new(diff, "bids", bids);
-    return diff;
+    return entry->val;
 }
 
-static int broadcast_update(const char *market, dict_t *sessions, bool clean, json_t *result)
+/* send the new view of a depth key, the first one and one per CLEAN_INTERVAL in full */
+static void view_update(struct depth_key *key, struct depth_val *val, struct depth_side *asks, struct depth_side *bids,
+        int price_prec, int amount_prec)
 {
+    time_t now = time(NULL);
+    bool clean = !val->ready || now - val->last_clean >= CLEAN_INTERVAL;
+
+    json_t *diff = NULL;
+    if (!clean) {
+        json_t *ask_diff = get_list_diff(&val->asks, asks, key->limit,  1, price_prec, amount_prec);
+        json_t *bid_diff = get_list_diff(&val->bids, bids, key->limit, -1, price_prec, amount_prec);
+        if (ask_diff == NULL && bid_diff == NULL)
+            return;
+        diff = json_object();
+        if (ask_diff)
+            json_object_set_new(diff, "asks", ask_diff);
+        if (bid_diff)
+            json_object_set_new(diff, "bids", bid_diff);
+    }
+
+    struct depth_side tmp;
+    tmp = val->asks;
+    val->asks = *asks;
+    *asks = tmp;
+    tmp = val->bids;
+    val->bids = *bids;
+    *bids = tmp;
+    val->ready = true;
+    val->price_prec = price_prec;
+    val->amount_prec = amount_prec;
+
+    if (clean) {
+        val->last_clean = now;
+        json_t *result = json_object();
+        json_object_set_new(result, "asks", format_side(&val->asks, price_prec, amount_prec));
+        json_object_set_new(result, "bids", format_side(&val->bids, price_prec, amount_prec));
+        broadcast_update(key->market, val->sessions, true, result);
+        json_decref(result);
+    } else {
+        broadcast_update(key->market, val->sessions, false, diff);
+        json_decref(diff);
+    }
+}
+
+/*
+ * Fold the book into limit buckets of interval, the same way the engine
+ * merges depth. Return false when the book does not cover the view.
+ */
+static bool book_view_side(struct market_book *book, bool is_ask, int64_t interval, uint32_t limit, struct depth_side *side)
+{
+    skiplist_t *list = is_ask ? book->asks : book->bids;
+    bool truncated = is_ask ? book->ask_truncated : book->bid_truncated;
+    int64_t edge = is_ask ? book->ask_edge : book->bid_edge;
+
+    side->count = 0;
+    side->levels = realloc(side->levels, sizeof(struct depth_level) * (limit ? limit : 1));
+
+    skiplist_iter *iter = skiplist_get_iterator(list);
+    skiplist_node *node = skiplist_next(iter);
+    while (node && side->count < limit) {
+        struct depth_level *level = node->value;
+        int64_t price = level->price;
+        if (interval) {
+            price = level->price / interval * interval;
+            if (is_ask && price != level->price) {
+                price += interval;
+            }
+        }
+        // levels past the edge may miss ones that never changed since the snapshot
+        if (truncated && (is_ask ? price > edge : price < edge))
+            break;
+
+        int64_t amount = level->amount;
+        while ((node = skiplist_next(iter)) != NULL) {
+            level = node->value;
+            if (is_ask ? price >= level->price : price <= level->price) {
+                amount += level->amount;
+            } else {
+                break;
+            }
+        }
+        side->levels[side->count].price = price;
+        side->levels[side->count].amount = amount;
+        side->count += 1;
+    }
+    skiplist_release_iterator(iter);
+
+    return !truncated || side->count == limit;
+}
+
+static void book_request(const char *market);
+
+/* derive the views of a market from its book, views the book can not cover fall back to polling */
+static void book_update_views(const char *market, struct market_book *book, bool reset)
+{
+    struct depth_side asks = { 0, NULL };
+    struct depth_side bids = { 0, NULL };
+    bool need_reload = false;
+
+    dict_iterator *iter = dict_get_iterator(dict_depth);
+    dict_entry *entry;
+    while ((entry = dict_next(iter)) != NULL) {
+        struct depth_key *key = entry->key;
+        struct depth_val *val = entry->val;
+        if (strcmp(key->market, market) != 0)
+            continue;
+        if (val->polled && !reset)
+            continue;
+
+        int64_t interval;
+        if (fixed_parse(key->interval, book->price_prec, &interval) < 0 || interval < 0) {
+            val->polled = true;
+            continue;
+        }
+        bool covered = book_view_side(book, true, interval, key->limit, &asks);
+        covered = book_view_side(book, false, interval, key->limit, &bids) && covered;
+        if (!covered) {
+            if (!val->polled && !reset)
+                need_reload = true;
+            val->polled = true;
+            continue;
+        }
+
+        val->polled = false;
+        view_update(key, val, &asks, &bids, book->price_prec, book->amount_prec);
+    }
+    dict_release_iterator(iter);
+
+    free(asks.levels);
+    free(bids.levels);
+
+    if (need_reload) {
+        book_request(market);
+    }
+}
+
+static int book_set_level(struct market_book *book, bool is_ask, json_t *unit)
+{
+    struct depth_level key;
+    if (parse_level(unit, book->price_prec, book->amount_prec, &key) < 0)
+        return -__LINE__;
+
+    skiplist_t *list = is_ask ? book->asks : book->bids;
+    skiplist_node *node = skiplist_find(list, &key);
+    if (node) {
+        if (key.amount == 0) {
+            skiplist_delete(list, node);
+        } else {
+            ((struct depth_level *)node->value)->amount = key.amount;
+        }
+        return 0;
+    }
+    if (key.amount == 0)
+        return 0;
+
+    struct depth_level *level = malloc(sizeof(struct depth_level));
+    memcpy(level, &key, sizeof(key));
+    if (skiplist_insert(list, level) == NULL) {
+        free(level);
+        return -__LINE__;
+    }
+    return 0;
+}
+
+/* apply a delta, return 1 if the book changed, 0 if the delta is old, < 0 on a gap */
+static int book_apply_delta(struct market_book *book, json_t *delta)
+{
+    uint64_t prev_seq = json_integer_value(json_object_get(delta, "prev_seq"));
+    uint64_t seq = json_integer_value(json_object_get(delta, "seq"));
+    if (seq <= book->seq)
+        return 0;
+    if (prev_seq > book->seq)
+        return -__LINE__;
+
+    if (book->price_prec < 0) {
+        learn_prec(delta, &book->price_prec, &book->amount_prec);
+        if (book->price_prec < 0)
+            return -__LINE__;
+    }
+
+    json_t *asks = json_object_get(delta, "asks");
+    for (size_t i = 0; i < json_array_size(asks); ++i) {
+        if (book_set_level(book, true, json_array_get(asks, i)) < 0)
+            return -__LINE__;
+    }
+    json_t *bids = json_object_get(delta, "bids");
+    for (size_t i = 0; i < json_array_size(bids); ++i) {
+        if (book_set_level(book, false, json_array_get(bids, i)) < 0)
+            return -__LINE__;
+    }
+    book->seq = seq;
+
+    return 1;
+}
+
+static void book_request(const char *market)
+{
+    struct market_book *book = get_book(market);
+    if (book == NULL || book->loading)
+        return;
+
+    book->loading = true;
+    book->ready = false;
+
     json_t *params = json_array();
-    json_array_append_new(params, json_boolean(clean));
-    json_array_append(params, result);
     json_array_append_new(params, json_string(market));
+    json_array_append_new(params, json_integer(settings.depth_book_limit));
+    json_array_append_new(params, json_string("0"));
+
+    nw_state_entry *state_entry = nw_state_add(state_context, settings.backend_timeout, 0);
+    struct state_data *state = state_entry->data;
+    memset(state, 0, sizeof(struct state_data));
+    strncpy(state->key.market, market, MARKET_NAME_MAX_LEN - 1);
+    state->book = true;
+
+    rpc_pkg pkg;
+    memset(&pkg, 0, sizeof(pkg));
+    pkg.pkg_type  = RPC_PKG_TYPE_REQUEST;
+    pkg.command   = CMD_ORDER_BOOK_DEPTH;
+    pkg.sequence  = state_entry->id;
+
+    rpc_clt_send_body(matchengine, &pkg, params, settings.matchengine_binary);
+    log_trace("send book request to %s, market: %s, sequence: %u",
+            nw_sock_human_addr(rpc_clt_peer_addr(matchengine)), market, pkg.sequence);
+    json_decref(params);
+}
 
-    dict_iterator *iter = dict_get_iterator(sessions);
+/* the book can not be loaded now, its views poll the engine until the timer retries the load */
+static void book_load_fail(const char *market)
+{
+    struct market_book *book = get_book(market);
+    if (book == NULL)
+        return;
+    book->loading = false;
+    book->ready = false;
+    list_clear(book->pending);
+
+    dict_iterator *iter = dict_get_iterator(dict_depth);
     dict_entry *entry;
     while ((entry = dict_next(iter)) != NULL) {
-        send_notify(entry->key, "depth.update", params);
+        struct depth_key *key = entry->key;
+        struct depth_val *val = entry->val;
+        if (strcmp(key->market, market) == 0)
+            val->polled = true;
     }
     dict_release_iterator(iter);
-    json_decref(params);
+}
+
+static struct market_book *book_create(const char *market)
+{
+    struct market_book *book = malloc(sizeof(struct market_book));
+    memset(book, 0, sizeof(struct market_book));
+    book->price_prec = -1;
+    book->amount_prec = -1;
+
+    skiplist_type st;
+    memset(&st, 0, sizeof(st));
+    st.free = level_free;
+    st.compare = level_ask_compare;
+    book->asks = skiplist_create(&st);
+    st.compare = level_bid_compare;
+    book->bids = skiplist_create(&st);
+
+    list_type lt;
+    memset(&lt, 0, sizeof(lt));
+    lt.free = pending_free;
+    book->pending = list_create(&lt);
+
+    if (book->asks == NULL || book->bids == NULL || book->pending == NULL) {
+        dict_book_val_free(book);
+        return NULL;
+    }
+    if (dict_add(dict_book, (void *)market, book) == NULL) {
+        dict_book_val_free(book);
+        return NULL;
+    }
+
+    return book;
+}
+
+static int book_load_side(struct market_book *book, bool is_ask, json_t *list)
+{
+    skiplist_t *side = is_ask ? book->asks : book->bids;
+    skiplist_node *node;
+    skiplist_iter *iter = skiplist_get_iterator(side);
+    while ((node = skiplist_next(iter)) != NULL) {
+        skiplist_delete(side, node);
+    }
+    skiplist_release_iterator(iter);
+
+    size_t size = json_array_size(list);
+    for (size_t i = 0; i < size; ++i) {
+        if (book_set_level(book, is_ask, json_array_get(list, i)) < 0)
+            return -__LINE__;
+    }
+
+    bool truncated = size >= (size_t)settings.depth_book_limit;
+    int64_t edge = 0;
+    if (size > 0) {
+        struct depth_level last;
+        if (parse_level(json_array_get(list, size - 1), book->price_prec, book->amount_prec, &last) < 0)
+            return -__LINE__;
+        edge = last.price;
+    }
+    if (is_ask) {
+        book->ask_truncated = truncated;
+        book->ask_edge = edge;
+    } else {
+        book->bid_truncated = truncated;
+        book->bid_edge = edge;
+    }
+
+    return 0;
+}
+
+static int on_book_reply(struct state_data *state, json_t *result)
+{
+    struct market_book *book = get_book(state->key.market);
+    if (book == NULL)
+        return 0;
+    book->loading = false;
+
+    json_t *seq = json_object_get(result, "seq");
+    if (!json_is_integer(seq))
+        return -__LINE__;
+
+    learn_prec(result, &book->price_prec, &book->amount_prec);
+    if (book->price_prec < 0) {
+        // empty book, any precision reads the same
+        book->price_prec = 0;
+        book->amount_prec = 0;
+    }
+    if (book_load_side(book, true, json_object_get(result, "asks")) < 0)
+        return -__LINE__;
+    if (book_load_side(book, false, json_object_get(result, "bids")) < 0)
+        return -__LINE__;
+    book->seq = json_integer_value(seq);
+    book->ready = true;
+
+    list_node *node;
+    list_iter *iter = list_get_iterator(book->pending, LIST_START_HEAD);
+    while ((node = list_next(iter)) != NULL) {
+        if (book_apply_delta(book, node->value) < 0) {
+            log_error("depth gap of market: %s after snapshot", state->key.market);
+            list_release_iterator(iter);
+            list_clear(book->pending);
+            book_request(state->key.market);
+            return 0;
+        }
+    }
+    list_release_iterator(iter);
+    list_clear(book->pending);
+
+    book_update_views(state->key.market, book, true);
 
     return 0;
 }
 
+static void on_depth_message(sds message, int64_t offset)
+{
+    json_t *delta = json_loads(message, 0, NULL);
+    if (delta == NULL) {
+        log_error("invalid depth message: %s", message);
+        return;
+    }
+
+    const char *market = json_string_value(json_object_get(delta, "market"));
+    struct market_book *book = market ? get_book(market) : NULL;
+    if (book == NULL) {
+        json_decref(delta);
+        return;
+    }
+
+    if (!book->ready) {
+        if (book->loading) {
+            list_add_node_tail(book->pending, delta);
+            return;
+        }
+        json_decref(delta);
+        book_request(market);
+        return;
+    }
+
+    int ret = book_apply_delta(book, delta);
+    if (ret < 0) {
+        log_error("depth gap of market: %s, seq: %"PRIu64", message: %s", market, book->seq, message);
+        book_request(market);
+    } else if (ret > 0) {
+        book_update_views(market, book, false);
+    }
+    json_decref(delta);
+}
+
 static int on_market_depth_reply(struct state_data *state, json_t *result)
 {
     dict_entry *entry = dict_find(dict_depth, &state->key);
@@ -230,37 +725,35 @@ static int on_market_depth_reply(struct state_data *state, json_t *result)
         return -__LINE__;
     struct depth_key *key = entry->key;
     struct depth_val *val = entry->val;
-    if (val->last == NULL) {
-        val->last = result;
-        val->last_clean = time(NULL);
-        json_incref(result);
-        return broadcast_update(state->key.market, val->sessions, true, result);
-    }
 
-    json_t *diff = get_depth_diff(val->last, result, key->limit);
-    if (diff == NULL) {
-        return 0;
+    int price_prec = -1;
+    int amount_prec = -1;
+    learn_prec(result, &price_prec, &amount_prec);
+    if (price_prec < 0) {
+        price_prec = 0;
+        amount_prec = 0;
     }
 
-    json_decref(val->last);
-    val->last = result;
-    json_incref(result);
-
-    time_t now = time(NULL);
-    if (now - val->last_clean >= CLEAN_INTERVAL) {
-        val->last_clean = now;
-        broadcast_update(state->key.market, val->sessions, true, result);
+    struct depth_side asks = { 0, NULL };
+    struct depth_side bids = { 0, NULL };
+    int ret = 0;
+    if (parse_side(json_object_get(result, "asks"), price_prec, amount_prec, &asks) < 0 ||
+            parse_side(json_object_get(result, "bids"), price_prec, amount_prec, &bids) < 0) {
+        ret = -__LINE__;
     } else {
-        broadcast_update(state->key.market, val->sessions, false, diff);
+        view_update(key, val, &asks, &bids, price_prec, amount_prec);
     }
-    json_decref(diff);
+    free(asks.levels);
+    free(bids.levels);
 
-    return 0;
+    return ret;
 }
 
 static void on_backend_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
 {
-    sds reply_str = sdsnewlen(pkg->body, pkg->body_size);
+    sds reply_str = rpc_pkg_body_text(pkg);
+    if (reply_str == NULL)
+        reply_str = sdsempty();
     log_trace("recv pkg from: %s, cmd: %u, sequence: %u, reply: %s",
             nw_sock_human_addr(&ses->peer_addr), pkg->command, pkg->sequence, reply_str);
     nw_state_entry *entry = nw_state_get(state_context, pkg->sequence);
@@ -270,19 +763,26 @@ static void on_backend_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
     }
     struct state_data *state = entry->data;
 
-    json_t *reply = json_loadb(pkg->body, pkg->body_size, 0, NULL);
+    json_t *reply = rpc_pkg_body_json(pkg);
     if (reply == NULL) {
         sds hex = hexdump(pkg->body, pkg->body_size);
         log_fatal("invalid reply from: %s, cmd: %u, reply: \n%s", nw_sock_human_addr(&ses->peer_addr), pkg->command, hex);
         sdsfree(hex);
         sdsfree(reply_str);
+        if (state->book) {
+            book_load_fail(state->key.market);
+        }
         nw_state_del(state_context, pkg->sequence);
         return;
     }
 
     json_t *error = json_object_get(reply, "error");
     if (error && !json_is_null(error)) {
-        dict_delete(dict_depth, &state->key);
+        if (state->book) {
+            book_load_fail(state->key.market);
+        } else {
+            dict_delete(dict_depth, &state->key);
+        }
     }
     json_t *result = json_object_get(reply, "result");
     if (error == NULL || !json_is_null(error) || result == NULL) {
@@ -296,16 +796,24 @@ static void on_backend_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
     int ret;
     switch (pkg->command) {
     case CMD_ORDER_BOOK_DEPTH:
-        ret = on_market_depth_reply(state, result);
-        if (ret < 0) {
-            log_error("on_market_depth_reply: %d, reply: %s", ret, reply_str);
+        if (state->book) {
+            ret = on_book_reply(state, result);
+            if (ret < 0) {
+                log_error("on_book_reply: %d, reply: %s", ret, reply_str);
+                book_load_fail(state->key.market);
+            }
+        } else {
+            ret = on_market_depth_reply(state, result);
+            if (ret < 0) {
+                log_error("on_market_depth_reply: %d, reply: %s", ret, reply_str);
+            }
         }
         break;
     default:
         log_error("recv unknown command: %u from: %s", pkg->command, nw_sock_human_addr(&ses->peer_addr));
         break;
     }
-    
+
     sdsfree(reply_str);
     json_decref(reply);
     nw_state_del(state_context, pkg->sequence);
@@ -314,6 +822,26 @@ static void on_backend_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
 static void on_timeout(nw_state_entry *entry)
 {
     log_fatal("query depth timeout, state id: %u", entry->id);
+    struct state_data *state = entry->data;
+    if (state->book) {
+        book_load_fail(state->key.market);
+    }
+}
+
+static bool market_has_view(const char *market)
+{
+    bool found = false;
+    dict_iterator *iter = dict_get_iterator(dict_depth);
+    dict_entry *entry;
+    while ((entry = dict_next(iter)) != NULL) {
+        struct depth_key *key = entry->key;
+        if (strcmp(key->market, market) == 0) {
+            found = true;
+            break;
+        }
+    }
+    dict_release_iterator(iter);
+    return found;
 }
 
 static void on_timer(nw_timer *timer, void *privdata)
@@ -327,6 +855,10 @@ static void on_timer(nw_timer *timer, void *privdata)
             continue;
         }
 
+        // views of the depth feed are pushed as the book changes
+        if (kafka_depth && !obj->polled)
+            continue;
+
         struct depth_key *key = entry->key;
         json_t *params = json_array();
         json_array_append_new(params, json_string(key->market));
@@ -335,6 +867,7 @@ static void on_timer(nw_timer *timer, void *privdata)
 
         nw_state_entry *state_entry = nw_state_add(state_context, settings.backend_timeout, 0);
         struct state_data *state = state_entry->data;
+        memset(state, 0, sizeof(struct state_data));
         memcpy(&state->key, key, sizeof(struct depth_key));
 
         rpc_pkg pkg;
@@ -342,16 +875,29 @@ static void on_timer(nw_timer *timer, void *privdata)
         pkg.pkg_type  = RPC_PKG_TYPE_REQUEST;
         pkg.command   = CMD_ORDER_BOOK_DEPTH;
         pkg.sequence  = state_entry->id;
-        pkg.body      = json_dumps(params, 0);
-        pkg.body_size = strlen(pkg.body);
 
-        rpc_clt_send(matchengine, &pkg);
-        log_trace("send request to %s, cmd: %u, sequence: %u, params: %s",
-                nw_sock_human_addr(rpc_clt_peer_addr(matchengine)), pkg.command, pkg.sequence, (char *)pkg.body);
-        free(pkg.body);
+        rpc_clt_send_body(matchengine, &pkg, params, settings.matchengine_binary);
+        log_trace("send request to %s, cmd: %u, sequence: %u, market: %s, limit: %u, interval: %s",
+                nw_sock_human_addr(rpc_clt_peer_addr(matchengine)), pkg.command, pkg.sequence,
+                key->market, key->limit, key->interval);
         json_decref(params);
     }
     dict_release_iterator(iter);
+
+    if (kafka_depth == NULL)
+        return;
+
+    iter = dict_get_iterator(dict_book);
+    while ((entry = dict_next(iter)) != NULL) {
+        struct market_book *book = entry->val;
+        if (!market_has_view(entry->key)) {
+            dict_delete(dict_book, entry->key);
+        } else if (!book->ready && !book->loading) {
+            // a failed load is retried here, the views are polled meanwhile
+            book_request(entry->key);
+        }
+    }
+    dict_release_iterator(iter);
 }
 
 int init_depth(void)
@@ -369,6 +915,17 @@ int init_depth(void)
     if (dict_depth == NULL)
         return -__LINE__;
 
+    memset(&dt, 0, sizeof(dt));
+    dt.hash_function = dict_book_hash_func;
+    dt.key_compare = dict_book_key_compare;
+    dt.key_dup = dict_book_key_dup;
+    dt.key_destructor = dict_book_key_free;
+    dt.val_destructor = dict_book_val_free;
+
+    dict_book = dict_create(&dt, 64);
+    if (dict_book == NULL)
+        return -__LINE__;
+
     rpc_clt_type ct;
     memset(&ct, 0, sizeof(ct));
     ct.on_connect = on_backend_connect;
@@ -388,6 +945,13 @@ int init_depth(void)
     if (state_context == NULL)
         return -__LINE__;
 
+    if (settings.depth_feed) {
+        settings.depth.offset = RD_KAFKA_OFFSET_END;
+        kafka_depth = kafka_consumer_create(&settings.depth, on_depth_message);
+        if (kafka_depth == NULL)
+            return -__LINE__;
+    }
+
     nw_timer_set(&timer, settings.depth_interval, true, on_timer, NULL);
     nw_timer_start(&timer);
 
@@ -439,6 +1003,8 @@ int depth_subscribe(nw_ses *ses, const char *market, uint32_t limit, const char
     if (entry == NULL) {
         struct depth_val val;
         memset(&val, 0, sizeof(val));
+        // polled until the book of the market covers it
+        val.polled = true;
 
         dict_types dt;
         memset(&dt, 0, sizeof(dt));
@@ -451,23 +1017,45 @@ int depth_subscribe(nw_ses *ses, const char *market, uint32_t limit, const char
         entry = dict_add(dict_depth, &key, &val);
         if (entry == NULL)
             return -__LINE__;
+
+        if (kafka_depth) {
+            struct market_book *book = get_book(key.market);
+            if (book == NULL) {
+                book = book_create(key.market);
+                if (book == NULL)
+                    return -__LINE__;
+                book_request(key.market);
+            } else if (book->ready) {
+                book_update_views(key.market, book, true);
+            }
+        }
     }
 
     struct depth_val *obj = entry->val;
-    dict_add(obj->sessions, ses, NULL);
+    if (dict_add(obj->sessions, ses, NULL) != NULL) {
+        ses_sub_add(ses, SUB_DEPTH, &key, sizeof(key));
+    }
 
     return 0;
 }
 
 int depth_unsubscribe(nw_ses *ses)
 {
-    dict_iterator *iter = dict_get_iterator(dict_depth);
-    dict_entry *entry;
-    while ((entry = dict_next(iter)) != NULL) {
-        struct depth_val *obj = entry->val;
-        dict_delete(obj->sessions, ses);
+    list_t *list = ses_sub_list(ses, SUB_DEPTH);
+    if (list == NULL)
+        return 0;
+
+    list_iter *iter = list_get_iterator(list, LIST_START_HEAD);
+    list_node *node;
+    while ((node = list_next(iter)) != NULL) {
+        dict_entry *entry = dict_find(dict_depth, node->value);
+        if (entry) {
+            struct depth_val *obj = entry->val;
+            dict_delete(obj->sessions, ses);
+        }
     }
-    dict_release_iterator(iter);
+    list_release_iterator(iter);
+    list_clear(list);
 
     return 0;
 }
@@ -485,11 +1073,15 @@ int depth_send_clean(nw_ses *ses, const char *market, uint32_t limit, const char
         return 0;
 
     struct depth_val *obj = entry->val;
-    if (obj->last) {
+    if (obj->ready) {
+        json_t *result = json_object();
+        json_object_set_new(result, "asks", format_side(&obj->asks, obj->price_prec, obj->amount_prec));
+        json_object_set_new(result, "bids", format_side(&obj->bids, obj->price_prec, obj->amount_prec));
+
         json_t *params = json_array();
         json_array_append_new(params, json_boolean(true));
-        json_array_append(params, obj->last);
-        json_array_append(params, json_string(market));
+        json_array_append_new(params, result);
+        json_array_append_new(params, json_string(market));
         send_notify(ses, "depth.update", params);
         json_decref(params);
     }
@@ -497,3 +1089,17 @@ int depth_send_clean(nw_ses *ses, const char *market, uint32_t limit, const char
     return 0;
 }
 
+size_t depth_subscribe_number(void)
+{
+    size_t count = 0;
+    dict_iterator *iter = dict_get_iterator(dict_depth);
+    dict_entry *entry;
+    while ((entry = dict_next(iter)) != NULL) {
+        const struct depth_val *obj = entry->val;
+        count += dict_size(obj->sessions);
+    }
+    dict_release_iterator(iter);
+
+    return count;
+}
+
@@ -86,14 +86,7 @@ static void on_backend_connect(nw_ses *ses, bool result)
 
 static int broadcast_update(dict_t *sessions, json_t *result)
 {
-    dict_iterator *iter = dict_get_iterator(sessions);
-    dict_entry *entry;
-    while ((entry = dict_next(iter)) != NULL) {
-        send_notify(entry->key, "kline.update", result);
-    }
-    dict_release_iterator(iter);
-
-    return 0;
+    return broadcast_notify(sessions, "kline.update", result);
 }
 
 static int kline_compare(json_t *first, json_t *second)
@@ -294,21 +287,45 @@ int kline_subscribe(nw_ses *ses, const char *market, int interval)
     }
 
     struct kline_val *obj = entry->val;
-    dict_add(obj->sessions, ses, NULL);
+    if (dict_add(obj->sessions, ses, NULL) != NULL) {
+        ses_sub_add(ses, SUB_KLINE, &key, sizeof(key));
+    }
 
     return 0;
 }
 
 int kline_unsubscribe(nw_ses *ses)
 {
+    list_t *list = ses_sub_list(ses, SUB_KLINE);
+    if (list == NULL)
+        return 0;
+
+    list_iter *iter = list_get_iterator(list, LIST_START_HEAD);
+    list_node *node;
+    while ((node = list_next(iter)) != NULL) {
+        dict_entry *entry = dict_find(dict_kline, node->value);
+        if (entry) {
+            struct kline_val *obj = entry->val;
+            dict_delete(obj->sessions, ses);
+        }
+    }
+    list_release_iterator(iter);
+    list_clear(list);
+
+    return 0;
+}
+
+size_t kline_subscribe_number(void)
+{
+    size_t count = 0;
     dict_iterator *iter = dict_get_iterator(dict_kline);
     dict_entry *entry;
     while ((entry = dict_next(iter)) != NULL) {
-        struct kline_val *obj = entry->val;
-        dict_delete(obj->sessions, ses);
+        const struct kline_val *obj = entry->val;
+        count += dict_size(obj->sessions);
     }
     dict_release_iterator(iter);
 
-    return 0;
+    return count;
 }
 
@@ -10,6 +10,7 @@ int init_kline(void);
 
 int kline_subscribe(nw_ses *ses, const char *market, int interval);
 int kline_unsubscribe(nw_ses *ses);
+size_t kline_subscribe_number(void);
 
 # endif
 
@@ -9,6 +9,46 @@
 static nw_svr *listener_svr;
 static nw_svr *monitor_svr;
 static rpc_svr *worker_svr;
+static dict_t *worker_load;
+
+/* reported by the worker, assigned counts the connections sent since the last report */
+struct load_val {
+    uint32_t sessions;
+    uint32_t subscriptions;
+    uint32_t assigned;
+};
+
+static uint32_t dict_ses_hash_func(const void *key)
+{
+    return dict_generic_hash_function(key, sizeof(void *));
+}
+
+static int dict_ses_key_compare(const void *key1, const void *key2)
+{
+    return key1 == key2 ? 0 : 1;
+}
+
+static void dict_load_val_free(void *val)
+{
+    free(val);
+}
+
+static struct load_val *get_load(nw_ses *ses)
+{
+    dict_entry *entry = dict_find(worker_load, ses);
+    if (entry)
+        return entry->val;
+
+    struct load_val *load = malloc(sizeof(struct load_val));
+    if (load == NULL)
+        return NULL;
+    memset(load, 0, sizeof(struct load_val));
+    if (dict_add(worker_load, ses, load) == NULL) {
+        free(load);
+        return NULL;
+    }
+    return load;
+}
 
 static int listener_decode_pkg(nw_ses *ses, void *data, size_t max)
 {
@@ -22,16 +62,49 @@ static void listener_on_error_msg(nw_ses *ses, const char *msg)
 {
     log_error("listener error, peer: %s, msg: %s", nw_sock_human_addr(&ses->peer_addr), msg);
 }
+
+static nw_ses *choice_random_worker(void)
+{
+    int worker = rand() % worker_svr->raw_svr->clt_count;
+    nw_ses *curr = worker_svr->raw_svr->clt_list_head;
+    for (int i = 0; i < worker && curr; ++i) {
+        curr = curr->next;
+    }
+    return curr;
+}
+
+static nw_ses *choice_least_load_worker(void)
+{
+    nw_ses *best = NULL;
+    uint64_t best_load = 0;
+    nw_ses *curr = worker_svr->raw_svr->clt_list_head;
+    for (; curr; curr = curr->next) {
+        struct load_val *load = get_load(curr);
+        if (load == NULL)
+            continue;
+        uint64_t value = (uint64_t)load->sessions + load->subscriptions + load->assigned;
+        if (best == NULL || value < best_load) {
+            best = curr;
+            best_load = value;
+        }
+    }
+    if (best) {
+        get_load(best)->assigned += 1;
+    }
+    return best;
+}
+
 static int listener_on_accept(nw_ses *ses, int sockfd, nw_addr_t *peer_addr)
 {
     if (worker_svr->raw_svr->clt_count == 0) {
         log_error("no available worker");
         return -1;
     }
-    int worker = rand() % worker_svr->raw_svr->clt_count;
-    nw_ses *curr = worker_svr->raw_svr->clt_list_head;
-    for (int i = 0; i < worker && curr; ++i) {
-        curr = curr->next;
+    nw_ses *curr;
+    if (settings.listener_mode == LISTENER_MODE_LEAST_LOAD) {
+        curr = choice_least_load_worker();
+    } else {
+        curr = choice_random_worker();
     }
     if (!curr) {
         log_error("choice worker fail");
@@ -67,7 +140,21 @@ static int init_listener_svr(void)
 
 static void worker_on_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
 {
-    return;
+    if (pkg->command != AW_LISTENER_CMD_LOAD)
+        return;
+
+    json_t *body = json_loadb(pkg->body, pkg->body_size, 0, NULL);
+    if (body == NULL) {
+        log_error("invalid load report from worker");
+        return;
+    }
+    struct load_val *load = get_load(ses);
+    if (load) {
+        load->sessions = json_integer_value(json_object_get(body, "sessions"));
+        load->subscriptions = json_integer_value(json_object_get(body, "subscriptions"));
+        load->assigned = 0;
+    }
+    json_decref(body);
 }
 static void worker_on_new_connection(nw_ses *ses)
 {
@@ -75,6 +162,7 @@ static void worker_on_new_connection(nw_ses *ses)
 }
 static void worker_on_connection_close(nw_ses *ses)
 {
+    dict_delete(worker_load, ses);
     log_info("worker close, current worker number: %u", worker_svr->raw_svr->clt_count - 1);
 }
 
@@ -90,6 +178,15 @@ static int init_worker_svr(void)
     cfg.max_pkg_size = 1024;
     cfg.heartbeat_check = true;
 
+    dict_types dt;
+    memset(&dt, 0, sizeof(dt));
+    dt.hash_function = dict_ses_hash_func;
+    dt.key_compare = dict_ses_key_compare;
+    dt.val_destructor = dict_load_val_free;
+    worker_load = dict_create(&dt, 64);
+    if (worker_load == NULL)
+        return -__LINE__;
+
     rpc_svr_type type;
     type.on_recv_pkg = worker_on_recv_pkg;
     type.on_new_connection = worker_on_new_connection;
@@ -132,12 +229,15 @@ static int init_monitor_svr(void)
 int init_listener(void)
 {
     int ret;
-    ret = init_listener_svr();
-    if (ret < 0)
-        return ret;
-    ret = init_worker_svr();
-    if (ret < 0)
-        return ret;
+    // with reuseport, every worker accepts on its own socket
+    if (settings.listener_mode != LISTENER_MODE_REUSEPORT) {
+        ret = init_listener_svr();
+        if (ret < 0)
+            return ret;
+        ret = init_worker_svr();
+        if (ret < 0)
+            return ret;
+    }
     ret = init_monitor_svr();
     if (ret < 0)
         return ret;
@@ -20,6 +20,7 @@ static ws_svr *svr;
 static dict_t *method_map;
 static dict_t *backend_cache;
 static rpc_clt *listener;
+static nw_timer load_timer;
 static nw_state *state_context;
 static nw_cache *privdata_cache;
 static nw_timer cache_timer;
@@ -137,6 +138,84 @@ int send_notify(nw_ses *ses, const char *method, json_t *params)
     return ret;
 }
 
+ws_msg *notify_msg(const char *method, json_t *params)
+{
+    json_t *notify = json_object();
+    json_object_set_new(notify, "method", json_string(method));
+    json_object_set    (notify, "params", params);
+    json_object_set_new(notify, "id", json_null());
+
+    char *message_data = json_dumps(notify, 0);
+    json_decref(notify);
+    if (message_data == NULL)
+        return NULL;
+    log_trace("notify msg, size: %zu, message: %s", strlen(message_data), message_data);
+    ws_msg *msg = ws_msg_text(message_data, strlen(message_data));
+    free(message_data);
+
+    return msg;
+}
+
+int send_msg(nw_ses *ses, ws_msg *msg)
+{
+    log_trace("send to: %"PRIu64", msg size: %zu", ses->id, msg->size);
+    return ws_send_msg(ses, msg);
+}
+
+int broadcast_notify(dict_t *sessions, const char *method, json_t *params)
+{
+    if (dict_size(sessions) == 0)
+        return 0;
+    ws_msg *msg = notify_msg(method, params);
+    if (msg == NULL)
+        return -__LINE__;
+
+    dict_iterator *iter = dict_get_iterator(sessions);
+    dict_entry *entry;
+    while ((entry = dict_next(iter)) != NULL) {
+        send_msg(entry->key, msg);
+    }
+    dict_release_iterator(iter);
+    ws_msg_release(msg);
+
+    return 0;
+}
+
+static void sub_key_free(void *value)
+{
+    free(value);
+}
+
+int ses_sub_add(nw_ses *ses, int type, const void *key, size_t key_size)
+{
+    struct clt_info *info = ws_ses_privdata(ses);
+    if (info->subs[type] == NULL) {
+        list_type lt;
+        memset(&lt, 0, sizeof(lt));
+        lt.free = sub_key_free;
+        info->subs[type] = list_create(&lt);
+        if (info->subs[type] == NULL)
+            return -__LINE__;
+    }
+
+    void *copy = malloc(key_size);
+    if (copy == NULL)
+        return -__LINE__;
+    memcpy(copy, key, key_size);
+    if (list_add_node_tail(info->subs[type], copy) == NULL) {
+        free(copy);
+        return -__LINE__;
+    }
+
+    return 0;
+}
+
+list_t *ses_sub_list(nw_ses *ses, int type)
+{
+    struct clt_info *info = ws_ses_privdata(ses);
+    return info->subs[type];
+}
+
 static int on_method_server_ping(nw_ses *ses, uint64_t id, struct clt_info *info, json_t *params)
 {
     json_t *result = json_string("pong");
@@ -609,13 +688,10 @@ static int on_method_order_query(nw_ses *ses, uint64_t id, struct clt_info *info
     pkg.command   = CMD_ORDER_QUERY;
     pkg.sequence  = entry->id;
     pkg.req_id    = id;
-    pkg.body      = json_dumps(trade_params, 0);
-    pkg.body_size = strlen(pkg.body);
 
-    rpc_clt_send(matchengine, &pkg);
-    log_trace("send request to %s, cmd: %u, sequence: %u, params: %s",
-            nw_sock_human_addr(rpc_clt_peer_addr(matchengine)), pkg.command, pkg.sequence, (char *)pkg.body);
-    free(pkg.body);
+    rpc_clt_send_body(matchengine, &pkg, trade_params, settings.matchengine_binary);
+    log_trace("send request to %s, cmd: %u, sequence: %u",
+            nw_sock_human_addr(rpc_clt_peer_addr(matchengine)), pkg.command, pkg.sequence);
     json_decref(trade_params);
 
     return 0;
@@ -710,13 +786,10 @@ static int on_method_asset_query(nw_ses *ses, uint64_t id, struct clt_info *info
     pkg.command   = CMD_BALANCE_QUERY;
     pkg.sequence  = entry->id;
     pkg.req_id    = id;
-    pkg.body      = json_dumps(trade_params, 0);
-    pkg.body_size = strlen(pkg.body);
 
-    rpc_clt_send(matchengine, &pkg);
-    log_trace("send request to %s, cmd: %u, sequence: %u, params: %s",
-            nw_sock_human_addr(rpc_clt_peer_addr(matchengine)), pkg.command, pkg.sequence, (char *)pkg.body);
-    free(pkg.body);
+    rpc_clt_send_body(matchengine, &pkg, trade_params, settings.matchengine_binary);
+    log_trace("send request to %s, cmd: %u, sequence: %u",
+            nw_sock_human_addr(rpc_clt_peer_addr(matchengine)), pkg.command, pkg.sequence);
     json_decref(trade_params);
 
     return 0;
@@ -865,11 +938,12 @@ static void on_close(nw_ses *ses, const char *remote)
 {
     log_trace("remote: %"PRIu64":%s websocket connection close", ses->id, remote);
 
-    //kline_unsubscribe(ses);
-    //depth_unsubscribe(ses);
-    //price_unsubscribe(ses);
-    //today_unsubscribe(ses);
-    //deals_unsubscribe(ses);
+    kline_unsubscribe(ses);
+    depth_unsubscribe(ses);
+    price_unsubscribe(ses);
+    state_unsubscribe(ses);
+    today_unsubscribe(ses);
+    deals_unsubscribe(ses);
 
     struct clt_info *info = ws_ses_privdata(ses);
     if (info->auth) {
@@ -888,6 +962,10 @@ static void on_privdata_free(void *svr, void *privdata)
     struct clt_info *info = privdata;
     if (info->source)
         free(info->source);
+    for (int i = 0; i < SUB_TYPE_MAX; ++i) {
+        if (info->subs[i])
+            list_release(info->subs[i]);
+    }
     nw_cache_free(privdata_cache, privdata);
 }
 
@@ -1036,13 +1114,17 @@ static void on_backend_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
 
     struct state_data *state = entry->data;
     if (state->ses->id == state->ses_id) {
-        sds message = sdsnewlen(pkg->body, pkg->body_size);
-        log_trace("send response to: %"PRIu64", size: %zu, message: %s", state->ses->id, sdslen(message), message);
-        ws_send_text(state->ses, message);
-        sdsfree(message);
+        sds message = rpc_pkg_body_text(pkg);
+        if (message) {
+            log_trace("send response to: %"PRIu64", size: %zu, message: %s", state->ses->id, sdslen(message), message);
+            ws_send_text(state->ses, message);
+            sdsfree(message);
+        } else {
+            log_error("invalid reply from: %s, cmd: %u", nw_sock_human_addr(&ses->peer_addr), pkg->command);
+        }
     }
     if (state->cache_key) {
-        json_t *reply = json_loadb(pkg->body, pkg->body_size, 0, NULL);
+        json_t *reply = rpc_pkg_body_json(pkg);
         if (reply && json_is_object(reply)) {
             json_t *result = json_object_get(reply, "result");
             if (result && !json_is_null(result)) {
@@ -1143,6 +1225,30 @@ static int init_backend(void)
     return 0;
 }
 
+static void report_load(void)
+{
+    if (!rpc_clt_connected(listener))
+        return;
+
+    size_t subscriptions = kline_subscribe_number() + depth_subscribe_number() + price_subscribe_number() +
+        state_subscribe_number() + today_subscribe_number() + deals_subscribe_number();
+    json_t *body = json_object();
+    json_object_set_new(body, "sessions", json_integer(svr->raw_svr->clt_count));
+    json_object_set_new(body, "subscriptions", json_integer(subscriptions));
+
+    rpc_pkg pkg;
+    memset(&pkg, 0, sizeof(pkg));
+    pkg.pkg_type = RPC_PKG_TYPE_REQUEST;
+    pkg.command  = AW_LISTENER_CMD_LOAD;
+    rpc_clt_send_body(listener, &pkg, body, false);
+    json_decref(body);
+}
+
+static void on_load_timer(nw_timer *timer, void *privdata)
+{
+    report_load();
+}
+
 static void on_listener_connect(nw_ses *ses, bool result)
 {
     if (result) {
@@ -1196,7 +1302,18 @@ int init_server(void)
 {
     ERR_RET(init_svr());
     ERR_RET(init_backend());
-    ERR_RET(init_listener_clt());
+    if (settings.listener_mode == LISTENER_MODE_REUSEPORT) {
+        if (nw_svr_set_reuse_port(svr->raw_svr) < 0)
+            return -__LINE__;
+        if (ws_svr_start(svr) < 0)
+            return -__LINE__;
+    } else {
+        ERR_RET(init_listener_clt());
+    }
+    if (settings.listener_mode == LISTENER_MODE_LEAST_LOAD) {
+        nw_timer_set(&load_timer, AW_LISTENER_LOAD_INTERVAL, true, on_load_timer, NULL);
+        nw_timer_start(&load_timer);
+    }
 
     return 0;
 }
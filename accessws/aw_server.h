@@ -8,10 +8,23 @@
 
 # include "aw_config.h"
 
+/* market data a session subscribes, indexed so close only visits its own */
+enum {
+    SUB_KLINE,
+    SUB_DEPTH,
+    SUB_PRICE,
+    SUB_STATE,
+    SUB_TODAY,
+    SUB_DEALS,
+    SUB_TYPE_MAX,
+};
+
 struct clt_info {
     bool        auth;
     uint32_t    user_id;
     char        *source;
+    /* copies of the module dict keys, created on the first subscribe */
+    list_t      *subs[SUB_TYPE_MAX];
 };
 
 int init_server(void);
@@ -26,5 +39,14 @@ int send_result(nw_ses *ses, uint64_t id, json_t *result);
 int send_success(nw_ses *ses, uint64_t id);
 int send_notify(nw_ses *ses, const char *method, json_t *params);
 
+/* record the dict key a session subscribes, for the unsubscribe of the module */
+int ses_sub_add(nw_ses *ses, int type, const void *key, size_t key_size);
+list_t *ses_sub_list(nw_ses *ses, int type);
+
+/* encode a notify once, for sending to many sessions */
+ws_msg *notify_msg(const char *method, json_t *params);
+int send_msg(nw_ses *ses, ws_msg *msg);
+int broadcast_notify(dict_t *sessions, const char *method, json_t *params);
+
 # endif
 
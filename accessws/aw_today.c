@@ -100,12 +100,7 @@ static int on_market_status_today_reply(struct state_data *state, json_t *result
         json_array_append_new(params, json_string(state->market));
         json_array_append(params, result);
 
-        dict_iterator *iter = dict_get_iterator(obj->sessions);
-        dict_entry *entry;
-        while ((entry = dict_next(iter)) != NULL) {
-            send_notify(entry->key, "today.update", params);
-        }
-        dict_release_iterator(iter);
+        broadcast_notify(obj->sessions, "today.update", params);
         json_decref(params);
     }
 
@@ -270,20 +265,30 @@ int today_subscribe(nw_ses *ses, const char *market)
     }
 
     struct market_val *obj = entry->val;
-    dict_add(obj->sessions, ses, NULL);
+    if (dict_add(obj->sessions, ses, NULL) != NULL) {
+        ses_sub_add(ses, SUB_TODAY, market, strlen(market) + 1);
+    }
 
     return 0;
 }
 
 int today_unsubscribe(nw_ses *ses)
 {
-    dict_iterator *iter = dict_get_iterator(dict_market);
-    dict_entry *entry;
-    while ((entry = dict_next(iter)) != NULL) {
-        struct market_val *obj = entry->val;
-        dict_delete(obj->sessions, ses);
+    list_t *list = ses_sub_list(ses, SUB_TODAY);
+    if (list == NULL)
+        return 0;
+
+    list_iter *iter = list_get_iterator(list, LIST_START_HEAD);
+    list_node *node;
+    while ((node = list_next(iter)) != NULL) {
+        dict_entry *entry = dict_find(dict_market, node->value);
+        if (entry) {
+            struct market_val *obj = entry->val;
+            dict_delete(obj->sessions, ses);
+        }
     }
-    dict_release_iterator(iter);
+    list_release_iterator(iter);
+    list_clear(list);
 
     return 0;
 }
@@ -307,3 +312,17 @@ int today_send_last(nw_ses *ses, const char *market)
     return 0;
 }
 
+size_t today_subscribe_number(void)
+{
+    size_t count = 0;
+    dict_iterator *iter = dict_get_iterator(dict_market);
+    dict_entry *entry;
+    while ((entry = dict_next(iter)) != NULL) {
+        const struct market_val *obj = entry->val;
+        count += dict_size(obj->sessions);
+    }
+    dict_release_iterator(iter);
+
+    return count;
+}
+
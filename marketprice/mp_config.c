@@ -46,9 +46,13 @@ static int read_config_from_json(json_t *root)
         return -__LINE__;
     }
 
+    ERR_RET_LN(read_cfg_int(root, "deal_shards", &settings.deal_shards, false, 1));
+    if (settings.deal_shards <= 0)
+        return -__LINE__;
     ERR_RET_LN(read_cfg_int(root, "sec_max", &settings.sec_max, false, 86400 * 7));
     ERR_RET_LN(read_cfg_int(root, "min_max", &settings.min_max, false, 60 * 24 * 365));
     ERR_RET_LN(read_cfg_int(root, "hour_max", &settings.hour_max, false, 24 * 365 * 10));
+    ERR_RET_LN(read_cfg_int(root, "day_max", &settings.day_max, false, 366 * 20));
     ERR_RET_LN(read_cfg_real(root, "cache_timeout", &settings.cache_timeout, false, 0.45));
     ERR_RET_LN(read_cfg_str(root, "accesshttp", &settings.accesshttp, NULL));
 
@@ -44,11 +44,13 @@ struct settings {
     alert_cfg           alert;
     rpc_svr_cfg         svr;
     kafka_consumer_cfg  deals;
+    int                 deal_shards;
     redis_sentinel_cfg  redis;
     int                 timezone;
     int                 sec_max;
     int                 min_max;
     int                 hour_max;
+    int                 day_max;
     double              cache_timeout;
     char                *accesshttp;
 };
@@ -134,3 +134,325 @@ char *kline_to_str(struct kline_info *info)
     return str;
 }
 
+static void kline_info_reset(struct kline_info *info, mpd_t *open)
+{
+    if (info->open == NULL) {
+        info->open      = mpd_qncopy(open);
+        info->close     = mpd_qncopy(open);
+        info->high      = mpd_qncopy(open);
+        info->low       = mpd_qncopy(open);
+        info->volume    = mpd_qncopy(mpd_zero);
+        info->deal      = mpd_qncopy(mpd_zero);
+        return;
+    }
+
+    mpd_copy(info->open, open, &mpd_ctx);
+    mpd_copy(info->close, open, &mpd_ctx);
+    mpd_copy(info->high, open, &mpd_ctx);
+    mpd_copy(info->low, open, &mpd_ctx);
+    mpd_copy(info->volume, mpd_zero, &mpd_ctx);
+    mpd_copy(info->deal, mpd_zero, &mpd_ctx);
+}
+
+kline_ring *kline_ring_create(int interval, uint32_t count)
+{
+    kline_ring *ring = malloc(sizeof(kline_ring));
+    if (ring == NULL)
+        return NULL;
+    memset(ring, 0, sizeof(kline_ring));
+    ring->interval = interval;
+    ring->page_count = (count + KLINE_PAGE_SIZE - 1) / KLINE_PAGE_SIZE;
+    if (ring->page_count == 0)
+        ring->page_count = 1;
+    ring->size = ring->page_count * KLINE_PAGE_SIZE;
+    ring->pages = calloc(ring->page_count, sizeof(struct kline_slot *));
+    if (ring->pages == NULL) {
+        free(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+static struct kline_slot *kline_ring_slot(kline_ring *ring, time_t timestamp, bool create)
+{
+    int64_t index = timestamp / ring->interval;
+    if (timestamp < 0 && timestamp % ring->interval)
+        index -= 1;
+    uint32_t pos = (uint64_t)index % ring->size;
+
+    struct kline_slot **page = &ring->pages[pos / KLINE_PAGE_SIZE];
+    if (*page == NULL) {
+        if (!create)
+            return NULL;
+        *page = calloc(KLINE_PAGE_SIZE, sizeof(struct kline_slot));
+        if (*page == NULL)
+            return NULL;
+    }
+
+    return &(*page)[pos % KLINE_PAGE_SIZE];
+}
+
+struct kline_info *kline_ring_get(kline_ring *ring, time_t timestamp)
+{
+    struct kline_slot *slot = kline_ring_slot(ring, timestamp, false);
+    if (slot == NULL || slot->info.open == NULL || slot->timestamp != timestamp)
+        return NULL;
+    return &slot->info;
+}
+
+struct kline_info *kline_ring_open(kline_ring *ring, time_t timestamp, mpd_t *open)
+{
+    struct kline_slot *slot = kline_ring_slot(ring, timestamp, true);
+    if (slot == NULL)
+        return NULL;
+    if (slot->info.open && slot->timestamp == timestamp)
+        return &slot->info;
+    if (slot->info.open && slot->timestamp > timestamp)
+        return NULL;
+
+    kline_info_reset(&slot->info, open);
+    slot->timestamp = timestamp;
+
+    return &slot->info;
+}
+
+int kline_ring_set(kline_ring *ring, time_t timestamp, struct kline_info *info)
+{
+    struct kline_info *kinfo = kline_ring_open(ring, timestamp, info->open);
+    if (kinfo == NULL)
+        return -__LINE__;
+
+    mpd_copy(kinfo->open, info->open, &mpd_ctx);
+    mpd_copy(kinfo->close, info->close, &mpd_ctx);
+    mpd_copy(kinfo->high, info->high, &mpd_ctx);
+    mpd_copy(kinfo->low, info->low, &mpd_ctx);
+    mpd_copy(kinfo->volume, info->volume, &mpd_ctx);
+    mpd_copy(kinfo->deal, info->deal, &mpd_ctx);
+
+    return 0;
+}
+
+void kline_ring_release(kline_ring *ring)
+{
+    for (uint32_t i = 0; i < ring->page_count; ++i) {
+        struct kline_slot *page = ring->pages[i];
+        if (page == NULL)
+            continue;
+        for (uint32_t j = 0; j < KLINE_PAGE_SIZE; ++j) {
+            struct kline_info *info = &page[j].info;
+            if (info->open == NULL)
+                continue;
+            mpd_del(info->open);
+            mpd_del(info->close);
+            mpd_del(info->high);
+            mpd_del(info->low);
+            mpd_del(info->volume);
+            mpd_del(info->deal);
+        }
+        free(page);
+    }
+    free(ring->pages);
+    free(ring);
+}
+
+static int deque_init(kline_deque *deque, uint32_t size)
+{
+    deque->size = size;
+    deque->head = 0;
+    deque->len = 0;
+    deque->items = malloc(sizeof(time_t) * size);
+    if (deque->items == NULL)
+        return -__LINE__;
+    return 0;
+}
+
+static time_t deque_front(kline_deque *deque)
+{
+    return deque->items[deque->head];
+}
+
+static time_t deque_back(kline_deque *deque)
+{
+    return deque->items[(deque->head + deque->len - 1) % deque->size];
+}
+
+static void deque_push_back(kline_deque *deque, time_t item)
+{
+    if (deque->len == deque->size) {
+        deque->head = (deque->head + 1) % deque->size;
+        deque->len -= 1;
+    }
+    deque->items[(deque->head + deque->len) % deque->size] = item;
+    deque->len += 1;
+}
+
+static void deque_pop_front(kline_deque *deque)
+{
+    deque->head = (deque->head + 1) % deque->size;
+    deque->len -= 1;
+}
+
+static void deque_pop_back(kline_deque *deque)
+{
+    deque->len -= 1;
+}
+
+// the first minute of the window, the partial minute at the start is not counted
+static time_t window_start(kline_window *window, time_t now)
+{
+    return (now - window->period) / 60 * 60 + 60;
+}
+
+static void window_push(kline_window *window, time_t minute, struct kline_info *kinfo)
+{
+    if (window->minutes.len == 0 || deque_back(&window->minutes) != minute) {
+        deque_push_back(&window->minutes, minute);
+    }
+
+    while (window->highs.len) {
+        struct kline_info *back = kline_ring_get(window->ring, deque_back(&window->highs));
+        if (back && mpd_cmp(back->high, kinfo->high, &mpd_ctx) > 0)
+            break;
+        deque_pop_back(&window->highs);
+    }
+    deque_push_back(&window->highs, minute);
+
+    while (window->lows.len) {
+        struct kline_info *back = kline_ring_get(window->ring, deque_back(&window->lows));
+        if (back && mpd_cmp(back->low, kinfo->low, &mpd_ctx) < 0)
+            break;
+        deque_pop_back(&window->lows);
+    }
+    deque_push_back(&window->lows, minute);
+
+    window->last = minute;
+}
+
+static void window_expire(kline_window *window, time_t now)
+{
+    time_t start = window_start(window, now);
+    while (window->minutes.len && deque_front(&window->minutes) < start) {
+        struct kline_info *kinfo = kline_ring_get(window->ring, deque_front(&window->minutes));
+        if (kinfo) {
+            mpd_sub(window->volume, window->volume, kinfo->volume, &mpd_ctx);
+            mpd_sub(window->deal, window->deal, kinfo->deal, &mpd_ctx);
+        }
+        deque_pop_front(&window->minutes);
+    }
+    while (window->highs.len && deque_front(&window->highs) < start) {
+        deque_pop_front(&window->highs);
+    }
+    while (window->lows.len && deque_front(&window->lows) < start) {
+        deque_pop_front(&window->lows);
+    }
+}
+
+static void window_rebuild(kline_window *window, time_t now)
+{
+    window->minutes.len = 0;
+    window->highs.len = 0;
+    window->lows.len = 0;
+    window->last = 0;
+    mpd_copy(window->volume, mpd_zero, &mpd_ctx);
+    mpd_copy(window->deal, mpd_zero, &mpd_ctx);
+
+    for (time_t minute = window_start(window, now); minute <= now; minute += 60) {
+        struct kline_info *kinfo = kline_ring_get(window->ring, minute);
+        if (kinfo == NULL)
+            continue;
+        mpd_add(window->volume, window->volume, kinfo->volume, &mpd_ctx);
+        mpd_add(window->deal, window->deal, kinfo->deal, &mpd_ctx);
+        window_push(window, minute, kinfo);
+    }
+    window->ready = true;
+}
+
+kline_window *kline_window_create(kline_ring *ring, int period)
+{
+    kline_window *window = malloc(sizeof(kline_window));
+    if (window == NULL)
+        return NULL;
+    memset(window, 0, sizeof(kline_window));
+    window->ring = ring;
+    window->period = period;
+
+    uint32_t size = period / 60 + 1;
+    if (deque_init(&window->minutes, size) < 0 || deque_init(&window->highs, size) < 0 || deque_init(&window->lows, size) < 0) {
+        kline_window_release(window);
+        return NULL;
+    }
+    window->volume = mpd_qncopy(mpd_zero);
+    window->deal = mpd_qncopy(mpd_zero);
+
+    return window;
+}
+
+void kline_window_update(kline_window *window, time_t timestamp, mpd_t *price, mpd_t *amount, time_t now)
+{
+    time_t minute = timestamp / 60 * 60;
+    if (minute < window_start(window, now))
+        return;
+    // a deal out of order is rare, start over instead of fixing up the deques
+    if (!window->ready || minute < window->last) {
+        window_rebuild(window, now);
+        return;
+    }
+
+    struct kline_info *kinfo = kline_ring_get(window->ring, minute);
+    if (kinfo == NULL)
+        return;
+
+    window_expire(window, now);
+    mpd_t *deal = mpd_new(&mpd_ctx);
+    mpd_mul(deal, price, amount, &mpd_ctx);
+    mpd_add(window->volume, window->volume, amount, &mpd_ctx);
+    mpd_add(window->deal, window->deal, deal, &mpd_ctx);
+    mpd_del(deal);
+    window_push(window, minute, kinfo);
+}
+
+struct kline_info *kline_window_get(kline_window *window, time_t now)
+{
+    if (!window->ready) {
+        window_rebuild(window, now);
+    } else {
+        window_expire(window, now);
+    }
+    if (window->minutes.len == 0)
+        return NULL;
+
+    struct kline_info *first = kline_ring_get(window->ring, deque_front(&window->minutes));
+    struct kline_info *last  = kline_ring_get(window->ring, deque_back(&window->minutes));
+    struct kline_info *high  = kline_ring_get(window->ring, deque_front(&window->highs));
+    struct kline_info *low   = kline_ring_get(window->ring, deque_front(&window->lows));
+    if (first == NULL || last == NULL || high == NULL || low == NULL) {
+        // the minute ring is shorter than the window
+        window->ready = false;
+        return NULL;
+    }
+
+    struct kline_info *info = kline_info_new(first->open);
+    if (info == NULL)
+        return NULL;
+    mpd_copy(info->close, last->close, &mpd_ctx);
+    mpd_copy(info->high, high->high, &mpd_ctx);
+    mpd_copy(info->low, low->low, &mpd_ctx);
+    mpd_copy(info->volume, window->volume, &mpd_ctx);
+    mpd_copy(info->deal, window->deal, &mpd_ctx);
+
+    return info;
+}
+
+void kline_window_release(kline_window *window)
+{
+    free(window->minutes.items);
+    free(window->highs.items);
+    free(window->lows.items);
+    if (window->volume)
+        mpd_del(window->volume);
+    if (window->deal)
+        mpd_del(window->deal);
+    free(window);
+}
+
@@ -7,6 +7,7 @@
 # define _MP_KLINE_H_
 
 # include <stdint.h>
+# include <time.h>
 # include "ut_decimal.h"
 
 struct kline_info {
@@ -18,6 +19,50 @@ struct kline_info {
     mpd_t *deal;
 };
 
+/*
+ * Klines of one resolution in a circular array, the slot of a timestamp
+ * is (timestamp / interval) % size. A slot holding an older timestamp is
+ * reused in place, so klines out of the window expire without a scan.
+ * Slots are allocated by page on the first write.
+ */
+# define KLINE_PAGE_SIZE    1024
+
+struct kline_slot {
+    time_t timestamp;
+    struct kline_info info;
+};
+
+typedef struct kline_ring {
+    int interval;
+    uint32_t size;
+    uint32_t page_count;
+    struct kline_slot **pages;
+} kline_ring;
+
+/*
+ * Aggregate of the minute klines in the last period seconds, updated as
+ * deals arrive and expired by minute. open and close come from the oldest
+ * and newest minute, high and low from monotonic deques of minutes.
+ */
+typedef struct kline_deque {
+    uint32_t size;
+    uint32_t head;
+    uint32_t len;
+    time_t *items;
+} kline_deque;
+
+typedef struct kline_window {
+    kline_ring *ring;
+    int period;
+    bool ready;
+    time_t last;
+    kline_deque minutes;
+    kline_deque highs;
+    kline_deque lows;
+    mpd_t *volume;
+    mpd_t *deal;
+} kline_window;
+
 struct kline_info *kline_info_new(mpd_t *open);
 struct kline_info *kline_from_str(char *str);
 void kline_info_update(struct kline_info *info, mpd_t *price, mpd_t *amount);
@@ -25,5 +70,21 @@ void kline_info_merge(struct kline_info *info, struct kline_info *update);
 void kline_info_free(struct kline_info *info);
 char *kline_to_str(struct kline_info *info);
 
+/* keep at least count klines of interval seconds */
+kline_ring *kline_ring_create(int interval, uint32_t count);
+struct kline_info *kline_ring_get(kline_ring *ring, time_t timestamp);
+/* the kline of timestamp, a new one starts at open. NULL if the slot holds a newer kline */
+struct kline_info *kline_ring_open(kline_ring *ring, time_t timestamp, mpd_t *open);
+int kline_ring_set(kline_ring *ring, time_t timestamp, struct kline_info *info);
+void kline_ring_release(kline_ring *ring);
+
+/* ring holds the minute klines, it should keep at least period / 60 + 1 of them */
+kline_window *kline_window_create(kline_ring *ring, int period);
+/* call after the minute kline of timestamp is updated */
+void kline_window_update(kline_window *window, time_t timestamp, mpd_t *price, mpd_t *amount, time_t now);
+/* the aggregate as a new kline_info, NULL if no deal in the window */
+struct kline_info *kline_window_get(kline_window *window, time_t now);
+void kline_window_release(kline_window *window);
+
 # endif
 
@@ -12,10 +12,11 @@
 struct market_info {
     char   *name;
     mpd_t  *last;
-    dict_t *sec;
-    dict_t *min;
-    dict_t *hour;
-    dict_t *day;
+    kline_ring *sec;
+    kline_ring *min;
+    kline_ring *hour;
+    kline_ring *day;
+    kline_window *window;
     dict_t *update;
     list_t *deals;
     list_t *deals_json;
@@ -34,16 +35,37 @@ struct update_key {
     time_t timestamp;
 };
 
+struct deal_shard {
+    int32_t partition;
+    int64_t last_offset;
+    kafka_consumer_t *consumer;
+};
+
+struct flush_batch {
+    sds     cmds;
+    int     count;
+    int     error;
+    double  create_time;
+    double  start_time;
+    double  finish_time;
+};
+
+/* the writer thread has its own sentinel, the main loop reorders the shared one */
+struct flush_conn {
+    redis_sentinel_t *redis;
+    redisContext *context;
+};
+
 static redis_sentinel_t *redis;
-static kafka_consumer_t *deals;
+static struct deal_shard *shards;
 static dict_t *dict_market;
 
 static double   last_flush;
-static int64_t  last_offset;
 static nw_timer market_timer;
-static nw_timer clear_timer;
 static nw_timer redis_timer;
 static nw_periodic config_periodic;
+static nw_job  *flush_job;
+static int      flush_pending;
 
 static uint32_t dict_sds_key_hash_func(const void *key)
 {
@@ -60,33 +82,6 @@ static void dict_sds_key_free(void *key)
     sdsfree(key);
 }
 
-static uint32_t dict_time_key_hash_func(const void *key)
-{
-    return dict_generic_hash_function(key, sizeof(time_t));
-}
-
-static int dict_time_key_compare(const void *key1, const void *key2)
-{
-    return *(time_t *)key1 - *(time_t *)key2;
-}
-
-static void *dict_time_key_dup(const void *key)
-{
-    time_t *obj = malloc(sizeof(time_t));
-    *obj = *(time_t *)key;
-    return obj;
-}
-
-static void dict_time_key_free(void *key)
-{
-    free(key);
-}
-
-static void dict_kline_val_free(void *val)
-{
-    kline_info_free(val);
-}
-
 static uint32_t dict_update_key_hash_func(const void *key)
 {
     return dict_generic_hash_function(key, sizeof(struct update_key));
@@ -119,7 +114,7 @@ static void list_deals_json_free(void *val)
     json_decref(val);
 }
 
-static int load_market_kline(redisContext *context, sds key, dict_t *dict, time_t start)
+static int load_market_kline(redisContext *context, sds key, kline_ring *ring, time_t start)
 {
     redisReply *reply = redisCmd(context, "HGETALL %s", key);
     if (reply == NULL) {
@@ -131,7 +126,8 @@ static int load_market_kline(redisContext *context, sds key, dict_t *dict, time_
             continue;
         struct kline_info *info = kline_from_str(reply->element[i + 1]->str);
         if (info) {
-            dict_add(dict, &timestamp, info);
+            kline_ring_set(ring, timestamp, info);
+            kline_info_free(info);
         }
     }
     freeReplyObject(reply);
@@ -145,12 +141,20 @@ static int load_market_deals(redisContext *context, sds key, struct market_info
     if (reply == NULL) {
         return -__LINE__;
     }
+    // newest first, a batch pushed again after a lost EXEC reply shows up as ids out of order
+    uint64_t last_id = 0;
     for (size_t i = 0; i < reply->elements; ++i) {
         json_t *deal = json_loadb(reply->element[i]->str, reply->element[i]->len, 0, NULL);
         if (deal == NULL) {
             freeReplyObject(reply);
             return -__LINE__;
         }
+        uint64_t id = json_integer_value(json_object_get(deal, "id"));
+        if (last_id != 0 && id >= last_id) {
+            json_decref(deal);
+            continue;
+        }
+        last_id = id;
         list_add_node_tail(info->deals_json, deal);
     }
     freeReplyObject(reply);
@@ -236,22 +240,17 @@ static struct market_info *create_market(const char *market)
     memset(info, 0, sizeof(struct market_info));
     info->name = strdup(market);
     info->last = mpd_qncopy(mpd_zero);
-    dict_types dt;
-
-    memset(&dt, 0, sizeof(dt));
-    dt.hash_function = dict_time_key_hash_func;
-    dt.key_compare = dict_time_key_compare;
-    dt.key_dup = dict_time_key_dup;
-    dt.key_destructor = dict_time_key_free;
-    dt.val_destructor = dict_kline_val_free;
-
-    info->sec = dict_create(&dt, 1024);
-    info->min = dict_create(&dt, 1024);
-    info->hour = dict_create(&dt, 1024);
-    info->day = dict_create(&dt, 1024);
+    info->sec = kline_ring_create(1, settings.sec_max + 1);
+    info->min = kline_ring_create(60, (settings.min_max > STATUS_PERIOD / 60 ? settings.min_max : STATUS_PERIOD / 60) + 1);
+    info->hour = kline_ring_create(3600, settings.hour_max + 1);
+    info->day = kline_ring_create(86400, settings.day_max + 1);
     if (info->sec == NULL || info->min == NULL || info->hour == NULL || info->day == NULL)
         return NULL;
+    info->window = kline_window_create(info->min, STATUS_PERIOD);
+    if (info->window == NULL)
+        return NULL;
 
+    dict_types dt;
     memset(&dt, 0, sizeof(dt));
     dt.hash_function = dict_update_key_hash_func;
     dt.key_compare = dict_update_key_compare;
@@ -412,12 +411,9 @@ static struct market_info *market_query(const char *market)
     return NULL;
 }
 
-static struct kline_info *kline_query(dict_t *dict, time_t timestamp)
+static struct kline_info *kline_query(kline_ring *ring, time_t timestamp)
 {
-    dict_entry *entry = dict_find(dict, &timestamp);
-    if (entry == NULL)
-        return NULL;
-    return entry->val;
+    return kline_ring_get(ring, timestamp);
 }
 
 static void add_update(struct market_info *info, int type, time_t timestamp)
@@ -451,61 +447,36 @@ static int market_update(const char *market, double timestamp, mpd_t *price, mpd
 
     // update sec
     time_t time_sec = (time_t)timestamp;
-    dict_entry *entry;
-    struct kline_info *kinfo = NULL;
-    entry = dict_find(info->sec, &time_sec);
-    if (entry) {
-        kinfo = entry->val;
-    } else {
-        kinfo = kline_info_new(price);
-        if (kinfo == NULL)
-            return -__LINE__;
-        dict_add(info->sec, &time_sec, kinfo);
+    struct kline_info *kinfo = kline_ring_open(info->sec, time_sec, price);
+    if (kinfo) {
+        kline_info_update(kinfo, price, amount);
+        add_update(info, KLINE_SEC, time_sec);
     }
-    kline_info_update(kinfo, price, amount);
-    add_update(info, KLINE_SEC, time_sec);
 
     // update min
     time_t time_min = time_sec / 60 * 60;
-    entry = dict_find(info->min, &time_min);
-    if (entry) {
-        kinfo = entry->val;
-    } else {
-        kinfo = kline_info_new(price);
-        if (kinfo == NULL)
-            return -__LINE__;
-        dict_add(info->min, &time_min, kinfo);
+    kinfo = kline_ring_open(info->min, time_min, price);
+    if (kinfo) {
+        kline_info_update(kinfo, price, amount);
+        add_update(info, KLINE_MIN, time_min);
+        kline_window_update(info->window, time_sec, price, amount, time(NULL));
     }
-    kline_info_update(kinfo, price, amount);
-    add_update(info, KLINE_MIN, time_min);
 
     // update hour
     time_t time_hour = time_sec / 3600 * 3600;
-    entry = dict_find(info->hour, &time_hour);
-    if (entry) {
-        kinfo = entry->val;
-    } else {
-        kinfo = kline_info_new(price);
-        if (kinfo == NULL)
-            return -__LINE__;
-        dict_add(info->hour, &time_hour, kinfo);
+    kinfo = kline_ring_open(info->hour, time_hour, price);
+    if (kinfo) {
+        kline_info_update(kinfo, price, amount);
+        add_update(info, KLINE_HOUR, time_hour);
     }
-    kline_info_update(kinfo, price, amount);
-    add_update(info, KLINE_HOUR, time_hour);
 
     // update day
     time_t time_day = get_day_start(time_sec);
-    entry = dict_find(info->day, &time_day);
-    if (entry) {
-        kinfo = entry->val;
-    } else {
-        kinfo = kline_info_new(price);
-        if (kinfo == NULL)
-            return -__LINE__;
-        dict_add(info->day, &time_day, kinfo);
+    kinfo = kline_ring_open(info->day, time_day, price);
+    if (kinfo) {
+        kline_info_update(kinfo, price, amount);
+        add_update(info, KLINE_DAY, time_day);
     }
-    kline_info_update(kinfo, price, amount);
-    add_update(info, KLINE_DAY, time_day);
 
     // update last
     mpd_copy(info->last, price, &mpd_ctx);
@@ -539,13 +510,13 @@ static int market_update(const char *market, double timestamp, mpd_t *price, mpd
     return 0;
 }
 
-static void on_deals_message(sds message, int64_t offset)
+static int apply_deals_message(sds message, int64_t offset)
 {
     log_trace("deals message: %s, offset: %"PRIi64, message, offset);
     json_t *obj = json_loadb(message, sdslen(message), 0, NULL);
     if (obj == NULL) {
         log_error("invalid message: %s, offset: %"PRIi64, message, offset);
-        return;
+        return -__LINE__;
     }
 
     mpd_t *price = NULL;
@@ -584,12 +555,11 @@ static void on_deals_message(sds message, int64_t offset)
         log_error("market_update fail %d, message: %s", ret, message);
         goto cleanup;
     }
-    last_offset = offset;
 
     mpd_del(price);
     mpd_del(amount);
     json_decref(obj);
-    return;
+    return 0;
 
 cleanup:
     log_error("invalid message: %s, offset: %"PRIi64, message, offset);
@@ -598,9 +568,29 @@ cleanup:
     if (amount)
         mpd_del(amount);
     json_decref(obj);
+    return -__LINE__;
 }
 
-static int flush_deals(redisContext *context, const char *market, list_t *list)
+static void on_deals_batch(int32_t partition, kafka_message *messages, size_t count)
+{
+    struct deal_shard *shard = &shards[partition - settings.deals.partition];
+    for (size_t i = 0; i < count; ++i) {
+        if (apply_deals_message(messages[i].message, messages[i].offset) == 0) {
+            shard->last_offset = messages[i].offset;
+        }
+    }
+}
+
+static void batch_append(struct flush_batch *batch, char *cmd, int len)
+{
+    if (len < 0)
+        return;
+    batch->cmds = sdscatlen(batch->cmds, cmd, len);
+    batch->count += 1;
+    redisFreeCommand(cmd);
+}
+
+static int flush_deals(struct flush_batch *batch, const char *market, list_t *list)
 {
     int argc = 2 + list->len;
     const char **argv = malloc(sizeof(char *) * argc);
@@ -624,28 +614,23 @@ static int flush_deals(redisContext *context, const char *market, list_t *list)
     }
     list_release_iterator(iter);
 
-    redisReply *reply = redisCommandArgv(context, argc, argv, argvlen);
-    if (reply == NULL) {
-        sdsfree(key);
-        free(argv);
-        free(argvlen);
-        return -__LINE__;
-    }
+    char *cmd = NULL;
+    int len = redisFormatCommandArgv(&cmd, argc, argv, argvlen);
     sdsfree(key);
     free(argv);
     free(argvlen);
-    freeReplyObject(reply);
+    if (len < 0)
+        return -__LINE__;
+    batch_append(batch, cmd, len);
 
-    reply = redisCmd(context, "LTRIM k:%s:deals 0 %d", market, MARKET_DEALS_MAX - 1);
-    if (reply) {
-        freeReplyObject(reply);
-    }
+    len = redisFormatCommand(&cmd, "LTRIM k:%s:deals 0 %d", market, MARKET_DEALS_MAX - 1);
+    batch_append(batch, cmd, len);
 
     list_clear(list);
     return 0;
 }
 
-static int flush_kline(redisContext *context, struct market_info *info, struct update_key *ukey)
+static int flush_kline(struct flush_batch *batch, struct market_info *info, struct update_key *ukey)
 {
     sds key = sdsempty();
     struct kline_info *kinfo = NULL;
@@ -673,53 +658,57 @@ static int flush_kline(redisContext *context, struct market_info *info, struct u
         return -__LINE__;
     }
 
-    redisReply *reply = redisCmd(context, "HSET %s %ld %s", key, ukey->timestamp, str);
-    if (reply == NULL) {
-        free(str);
-        sdsfree(key);
-        return -__LINE__;
-    }
+    char *cmd = NULL;
+    int len = redisFormatCommand(&cmd, "HSET %s %ld %s", key, ukey->timestamp, str);
     free(str);
     sdsfree(key);
-    freeReplyObject(reply);
+    if (len < 0)
+        return -__LINE__;
+    batch_append(batch, cmd, len);
 
     return 0;
 }
 
-static int flush_offset(redisContext *context, int64_t offset)
+// the first partition keeps k:offset whatever the shard count, so a switch back to one shard carries on
+static int flush_offset(struct flush_batch *batch, struct deal_shard *shard)
 {
-    redisReply *reply = redisCmd(context, "SET k:offset %"PRIi64, offset);
-    if (reply == NULL) {
-        return -__LINE__;
+    char *cmd = NULL;
+    int len;
+    if (shard->partition == settings.deals.partition) {
+        len = redisFormatCommand(&cmd, "SET k:offset %"PRIi64, shard->last_offset);
+    } else {
+        len = redisFormatCommand(&cmd, "SET k:offset:%"PRIi32" %"PRIi64, shard->partition, shard->last_offset);
     }
-    freeReplyObject(reply);
+    if (len < 0)
+        return -__LINE__;
+    batch_append(batch, cmd, len);
 
     return 0;
 }
 
-static int flush_last(redisContext *context, const char *market, mpd_t *last)
+static int flush_last(struct flush_batch *batch, const char *market, mpd_t *last)
 {
     char *last_str = mpd_to_sci(last, 0);
     if (last_str == NULL)
         return -__LINE__;
-    redisReply *reply = redisCmd(context, "SET k:%s:last %s", market, last_str);
-    if (reply == NULL) {
-        free(last_str);
-        return -__LINE__;
-    }
+    char *cmd = NULL;
+    int len = redisFormatCommand(&cmd, "SET k:%s:last %s", market, last_str);
     free(last_str);
-    freeReplyObject(reply);
+    if (len < 0)
+        return -__LINE__;
+    batch_append(batch, cmd, len);
 
     return 0;
 }
-static int flush_update(redisContext *context, struct market_info *info)
+
+static int flush_update(struct flush_batch *batch, struct market_info *info)
 {
     dict_iterator *iter = dict_get_iterator(info->update);
     dict_entry *entry;
     while ((entry = dict_next(iter)) != NULL) {
         struct update_key *key = entry->key;
         log_trace("flush_kline type: %d, timestamp: %ld", key->kline_type, key->timestamp);
-        int ret = flush_kline(context, info, key);
+        int ret = flush_kline(batch, info, key);
         if (ret < 0) {
             log_fatal("flush_kline fail: %d, type: %d, timestamp: %ld", ret, key->kline_type, key->timestamp);
         }
@@ -730,11 +719,15 @@ static int flush_update(redisContext *context, struct market_info *info)
     return 0;
 }
 
+// render every pending write of this tick into one pipeline, the writer thread sends it
 static int flush_market(void)
 {
-    redisContext *context = redis_sentinel_connect_master(redis);
-    if (context == NULL)
+    struct flush_batch *batch = malloc(sizeof(struct flush_batch));
+    if (batch == NULL)
         return -__LINE__;
+    memset(batch, 0, sizeof(struct flush_batch));
+    batch->cmds = sdsempty();
+    batch->create_time = current_timestamp();
 
     int ret;
     dict_iterator *iter = dict_get_iterator(dict_market);
@@ -743,66 +736,149 @@ static int flush_market(void)
         struct market_info *info = entry->val;
         if (info->update_time < last_flush)
             continue;
-        ret = flush_update(context, info);
-        if (ret < 0) {
-            redisFree(context);
-            dict_release_iterator(iter);
-            return ret;
-        }
-        ret = flush_last(context, info->name, info->last);
+        flush_update(batch, info);
+        ret = flush_last(batch, info->name, info->last);
         if (ret < 0) {
-            redisFree(context);
-            dict_release_iterator(iter);
-            return ret;
+            log_fatal("flush_last fail: %d, market: %s", ret, info->name);
         }
         if (info->deals->len == 0)
             continue;
-        ret = flush_deals(context, info->name, info->deals);
+        ret = flush_deals(batch, info->name, info->deals);
         if (ret < 0) {
-            redisFree(context);
-            dict_release_iterator(iter);
-            return ret;
+            log_fatal("flush_deals fail: %d, market: %s", ret, info->name);
         }
     }
     dict_release_iterator(iter);
 
-    ret = flush_offset(context, last_offset);
-    if (ret < 0) {
-        redisFree(context);
-        return -__LINE__;
+    // the offsets go last, so they are only saved after the writes before them
+    for (int i = 0; i < settings.deal_shards; ++i) {
+        ret = flush_offset(batch, &shards[i]);
+        if (ret < 0) {
+            sdsfree(batch->cmds);
+            free(batch);
+            return -__LINE__;
+        }
     }
 
-    last_flush = current_timestamp();
-    redisFree(context);
+    last_flush = batch->create_time;
+    flush_pending += batch->count;
+    nw_job_add(flush_job, 0, batch);
+    if (flush_job->request_count > 1) {
+        log_error("flush backlog, batch: %d, command: %d", flush_job->request_count, flush_pending);
+    }
 
     return 0;
 }
 
-static void clear_dict(dict_t *dict, time_t start)
+static int reply_error_count(redisReply *reply)
 {
-    dict_iterator *iter = dict_get_iterator(dict);
-    dict_entry *entry;
-    while ((entry = dict_next(iter)) != NULL) {
-        time_t timestamp = *(time_t *)entry->key;
-        if (timestamp < start) {
-            dict_delete(dict, entry->key);
+    if (reply->type == REDIS_REPLY_ERROR) {
+        log_error("redis command error: %s", reply->str);
+        return 1;
+    }
+    int count = 0;
+    if (reply->type == REDIS_REPLY_ARRAY) {
+        for (size_t i = 0; i < reply->elements; ++i) {
+            count += reply_error_count(reply->element[i]);
         }
     }
-    dict_release_iterator(iter);
+    return count;
 }
 
-static void clear_kline(void)
+/*
+ * the batch runs in MULTI/EXEC, a connection lost before EXEC applies none of it
+ * and the retry sends it whole. only a reply lost after EXEC pushes the deals twice,
+ * LTRIM bounds the list and load_market_deals drops the repeated ids.
+ */
+static int flush_batch_exec(struct flush_conn *conn, struct flush_batch *batch)
 {
-    time_t now = time(NULL);
-    dict_iterator *iter = dict_get_iterator(dict_market);
-    dict_entry *entry;
-    while ((entry = dict_next(iter)) != NULL) {
-        struct market_info *info = entry->val;
-        clear_dict(info->sec, now - settings.sec_max);
-        clear_dict(info->min, now / 60 * 60 - settings.min_max * 60);
-        clear_dict(info->hour, now / 3600 * 3600 - settings.hour_max * 3600);
+    if (conn->context == NULL) {
+        conn->context = redis_sentinel_connect_master(conn->redis);
+        if (conn->context == NULL)
+            return -__LINE__;
     }
-    dict_release_iterator(iter);
+
+    redisContext *context = conn->context;
+    if (redisAppendCommand(context, "MULTI") != REDIS_OK)
+        return -__LINE__;
+    if (redisAppendFormattedCommand(context, batch->cmds, sdslen(batch->cmds)) != REDIS_OK)
+        return -__LINE__;
+    if (redisAppendCommand(context, "EXEC") != REDIS_OK)
+        return -__LINE__;
+
+    int error = 0;
+    for (int i = 0; i < batch->count + 2; ++i) {
+        redisReply *reply = NULL;
+        if (redisGetReply(context, (void **)&reply) != REDIS_OK) {
+            log_error("redisGetReply fail: %d: %s", context->err, context->errstr);
+            return -__LINE__;
+        }
+        error += reply_error_count(reply);
+        freeReplyObject(reply);
+    }
+    batch->error = error;
+
+    return 0;
+}
+
+static void *on_flush_init(void)
+{
+    struct flush_conn *conn = malloc(sizeof(struct flush_conn));
+    if (conn == NULL)
+        return NULL;
+    conn->redis = redis_sentinel_create(&settings.redis);
+    if (conn->redis == NULL) {
+        free(conn);
+        return NULL;
+    }
+    conn->context = redis_sentinel_connect_master(conn->redis);
+    return conn;
+}
+
+static void on_flush_job(nw_job_entry *entry, void *privdata)
+{
+    struct flush_conn *conn = privdata;
+    struct flush_batch *batch = entry->request;
+    batch->start_time = current_timestamp();
+    while (true) {
+        int ret = flush_batch_exec(conn, batch);
+        if (ret < 0) {
+            log_fatal("flush batch fail: %d, command: %d", ret, batch->count);
+            if (conn->context) {
+                redisFree(conn->context);
+                conn->context = NULL;
+            }
+            usleep(1000 * 1000);
+            continue;
+        }
+        break;
+    }
+    batch->finish_time = current_timestamp();
+}
+
+static void on_flush_finish(nw_job_entry *entry)
+{
+    struct flush_batch *batch = entry->request;
+    flush_pending -= batch->count;
+    log_info("flush market command: %d, error: %d, size: %zu, wait: %.3fs, cost: %.3fs, backlog batch: %d, command: %d",
+            batch->count, batch->error, sdslen(batch->cmds), batch->start_time - batch->create_time,
+            batch->finish_time - batch->start_time, flush_job->request_count, flush_pending);
+}
+
+static void on_flush_cleanup(nw_job_entry *entry)
+{
+    struct flush_batch *batch = entry->request;
+    sdsfree(batch->cmds);
+    free(batch);
+}
+
+static void on_flush_release(void *privdata)
+{
+    struct flush_conn *conn = privdata;
+    if (conn->context)
+        redisFree(conn->context);
+    redis_sentinel_release(conn->redis);
+    free(conn);
 }
 
 static int load_new_markets()
@@ -855,11 +931,6 @@ static void on_market_timer(nw_timer *timer, void *privdata)
     }
 }
 
-static void on_clear_timer(nw_timer *timer, void *privdata)
-{
-    clear_kline();
-}
-
 static int clear_key(redisContext *context, const char *key, time_t end)
 {
     redisReply *reply = redisCmd(context, "HGETALL %s", key);
@@ -915,12 +986,17 @@ static void on_redis_timer(nw_timer *timer, void *privdata)
     }
 }
 
-static int64_t get_message_offset(void)
+static int64_t get_message_offset(int32_t partition)
 {
     redisContext *context = redis_sentinel_connect_master(redis);
     if (context == NULL)
         return -__LINE__;
-    redisReply *reply = redisCmd(context, "GET k:offset");
+    redisReply *reply;
+    if (partition == settings.deals.partition) {
+        reply = redisCmd(context, "GET k:offset");
+    } else {
+        reply = redisCmd(context, "GET k:offset:%"PRIi32, partition);
+    }
     if (reply == NULL) {
         redisFree(context);
         return -__LINE__;
@@ -935,6 +1011,34 @@ static int64_t get_message_offset(void)
     return offset;
 }
 
+static int init_shards(void)
+{
+    shards = malloc(sizeof(struct deal_shard) * settings.deal_shards);
+    if (shards == NULL)
+        return -__LINE__;
+    memset(shards, 0, sizeof(struct deal_shard) * settings.deal_shards);
+
+    // markets are keyed to partitions by the engine, so each shard owns the markets of its partition
+    for (int i = 0; i < settings.deal_shards; ++i) {
+        struct deal_shard *shard = &shards[i];
+        shard->partition = settings.deals.partition + i;
+        shard->last_offset = get_message_offset(shard->partition);
+        if (shard->last_offset < 0) {
+            return -__LINE__;
+        }
+
+        kafka_consumer_cfg cfg = settings.deals;
+        cfg.partition = shard->partition;
+        cfg.offset = shard->last_offset + 1;
+        shard->consumer = kafka_consumer_create_batch(&cfg, on_deals_batch);
+        if (shard->consumer == NULL) {
+            return -__LINE__;
+        }
+    }
+
+    return 0;
+}
+
 int init_message(void)
 {
     int ret;
@@ -945,13 +1049,22 @@ int init_message(void)
     if (ret < 0) {
         return ret;
     }
-    last_offset = get_message_offset();
-    if (last_offset < 0) {
-        return -__LINE__;
+    ret = init_shards();
+    if (ret < 0) {
+        return ret;
     }
-    settings.deals.offset = last_offset + 1;
-    deals = kafka_consumer_create(&settings.deals, on_deals_message);
-    if (deals == NULL) {
+
+    nw_job_type jt;
+    memset(&jt, 0, sizeof(jt));
+    jt.on_init    = on_flush_init;
+    jt.on_job     = on_flush_job;
+    jt.on_finish  = on_flush_finish;
+    jt.on_cleanup = on_flush_cleanup;
+    jt.on_release = on_flush_release;
+
+    // one writer keeps the batches in order
+    flush_job = nw_job_create(&jt, 1);
+    if (flush_job == NULL) {
         return -__LINE__;
     }
 
@@ -962,9 +1075,6 @@ int init_message(void)
     nw_periodic_set(&config_periodic, 1545067800, 180, on_config_periodic, NULL);
     nw_periodic_start(&config_periodic);
 
-    nw_timer_set(&clear_timer, 3600, true, on_clear_timer, NULL);
-    nw_timer_start(&clear_timer);
-
     nw_timer_set(&redis_timer, 86400, true, on_redis_timer, NULL);
     nw_timer_start(&redis_timer);
 
@@ -979,26 +1089,21 @@ bool market_exist(const char *market)
     return false;
 }
 
-static struct kline_info *get_last_kline(dict_t *dict, time_t start, time_t end, int interval)
+static struct kline_info *get_last_kline(kline_ring *ring, time_t start, time_t end, int interval)
 {
     for (; start >= end; start -= interval) {
-        dict_entry *entry = dict_find(dict, &start);
-        if (entry) {
-            return entry->val;
+        struct kline_info *kinfo = kline_ring_get(ring, start);
+        if (kinfo) {
+            return kinfo;
         }
     }
 
     return NULL;
 }
 
-json_t *get_market_status(const char *market, int period, time_t start)
+static struct kline_info *get_period_kline(struct market_info *info, int period, time_t start, time_t now)
 {
-    struct market_info *info = market_query(market);
-    if (info == NULL)
-        return NULL;
-
     struct kline_info *kinfo = NULL;
-    time_t now = time(NULL);
     if (start == 0)
         start = now - period;
     else if (start < now - settings.sec_max)
@@ -1006,10 +1111,9 @@ json_t *get_market_status(const char *market, int period, time_t start)
     time_t start_min = start / 60 * 60 + 60;
 
     for (time_t timestamp = start; timestamp < start_min; timestamp++) {
-        dict_entry *entry = dict_find(info->sec, &timestamp);
-        if (!entry)
+        struct kline_info *sinfo = kline_ring_get(info->sec, timestamp);
+        if (!sinfo)
             continue;
-        struct kline_info *sinfo = entry->val;
         if (kinfo == NULL) {
             kinfo = kline_info_new(sinfo->open);
         }
@@ -1017,16 +1121,31 @@ json_t *get_market_status(const char *market, int period, time_t start)
     }
 
     for (time_t timestamp = start_min; timestamp < now; timestamp += 60) {
-        dict_entry *entry = dict_find(info->min, &timestamp);
-        if (!entry)
+        struct kline_info *sinfo = kline_ring_get(info->min, timestamp);
+        if (!sinfo)
             continue;
-        struct kline_info *sinfo = entry->val;
         if (kinfo == NULL) {
             kinfo = kline_info_new(sinfo->open);
         }
         kline_info_merge(kinfo, sinfo);
     }
 
+    return kinfo;
+}
+
+json_t *get_market_status(const char *market, int period, time_t start)
+{
+    struct market_info *info = market_query(market);
+    if (info == NULL)
+        return NULL;
+
+    struct kline_info *kinfo = NULL;
+    time_t now = time(NULL);
+    if (start == 0 && period == STATUS_PERIOD) {
+        kinfo = kline_window_get(info->window, now);
+    } else {
+        kinfo = get_period_kline(info, period, start, now);
+    }
     if (kinfo == NULL)
         kinfo = kline_info_new(mpd_zero);
 
@@ -1055,9 +1174,8 @@ json_t *get_market_status_today(const char *market)
     time_t now = time(NULL);
     time_t start = get_day_start(now);
     struct kline_info *klast = get_last_kline(info->day, start - 86400, start - 86400 * 30, 86400);
-    dict_entry *entry = dict_find(info->day, &start);
-    if (entry) {
-        struct kline_info *today = entry->val;
+    struct kline_info *today = kline_ring_get(info->day, start);
+    if (today) {
         json_object_set_new_mpd(result, "open", today->open);
         json_object_set_new_mpd(result, "last", today->close);
         json_object_set_new_mpd(result, "high", today->high);
@@ -1074,34 +1192,16 @@ json_t *get_market_status_today(const char *market)
         json_object_set_new(result, "low",  json_string("0"));
     }
 
-    mpd_t *volume = mpd_qncopy(mpd_zero);
-    mpd_t *deal = mpd_qncopy(mpd_zero);
-    time_t start_24h = now - 86400;
-    time_t start_min = start_24h / 60 * 60 + 60;
-
-    for (time_t timestamp = start_24h; timestamp < start_min; timestamp++) {
-        dict_entry *entry = dict_find(info->sec, &timestamp);
-        if (!entry)
-            continue;
-        struct kline_info *info = entry->val;
-        mpd_add(volume, volume, info->volume, &mpd_ctx);
-        mpd_add(deal, deal, info->deal, &mpd_ctx);
-    }
-
-    for (time_t timestamp = start_min; timestamp < now; timestamp += 60) {
-        dict_entry *entry = dict_find(info->min, &timestamp);
-        if (!entry)
-            continue;
-        struct kline_info *info = entry->val;
-        mpd_add(volume, volume, info->volume, &mpd_ctx);
-        mpd_add(deal, deal, info->deal, &mpd_ctx);
+    struct kline_info *kinfo = kline_window_get(info->window, now);
+    if (kinfo) {
+        json_object_set_new_mpd(result, "volume", kinfo->volume);
+        json_object_set_new_mpd(result, "deal", kinfo->deal);
+        kline_info_free(kinfo);
+    } else {
+        json_object_set_new(result, "volume", json_string("0"));
+        json_object_set_new(result, "deal", json_string("0"));
     }
 
-    json_object_set_new_mpd(result, "volume", volume);
-    json_object_set_new_mpd(result, "deal", deal);
-    mpd_del(volume);
-    mpd_del(deal);
-
     return result;
 }
 
@@ -1138,10 +1238,9 @@ json_t *get_market_kline_sec(const char *market, time_t start, time_t end, int i
         struct kline_info *kinfo = NULL;
         for (int i = 0; i < interval; ++i) {
             time_t timestamp = start + i;
-            dict_entry *entry = dict_find(info->sec, &timestamp);
-            if (entry == NULL)
+            struct kline_info *item = kline_ring_get(info->sec, timestamp);
+            if (item == NULL)
                 continue;
-            struct kline_info *item = entry->val;
             if (kinfo == NULL)
                 kinfo = kline_info_new(item->open);
             kline_info_merge(kinfo, item);
@@ -1182,10 +1281,9 @@ json_t *get_market_kline_min(const char *market, time_t start, time_t end, int i
         struct kline_info *kinfo = NULL;
         for (int i = 0; i < step; ++i) {
             time_t timestamp = start + i * 60;
-            dict_entry *entry = dict_find(info->min, &timestamp);
-            if (entry == NULL)
+            struct kline_info *item = kline_ring_get(info->min, timestamp);
+            if (item == NULL)
                 continue;
-            struct kline_info *item = entry->val;
             if (kinfo == NULL)
                 kinfo = kline_info_new(item->open);
             kline_info_merge(kinfo, item);
@@ -1230,10 +1328,9 @@ json_t *get_market_kline_hour(const char *market, time_t start, time_t end, int
         struct kline_info *kinfo = NULL;
         for (int i = 0; i < step; ++i) {
             time_t timestamp = start + i * 3600;
-            dict_entry *entry = dict_find(info->hour, &timestamp);
-            if (entry == NULL)
+            struct kline_info *item = kline_ring_get(info->hour, timestamp);
+            if (item == NULL)
                 continue;
-            struct kline_info *item = entry->val;
             if (kinfo == NULL)
                 kinfo = kline_info_new(item->open);
             kline_info_merge(kinfo, item);
@@ -1271,10 +1368,9 @@ json_t *get_market_kline_day(const char *market, time_t start, time_t end, int i
         struct kline_info *kinfo = NULL;
         for (int i = 0; i < step; ++i) {
             time_t timestamp = start + i * 86400;
-            dict_entry *entry = dict_find(info->day, &timestamp);
-            if (entry == NULL)
+            struct kline_info *item = kline_ring_get(info->day, timestamp);
+            if (item == NULL)
                 continue;
-            struct kline_info *item = entry->val;
             if (kinfo == NULL)
                 kinfo = kline_info_new(item->open);
             kline_info_merge(kinfo, item);
@@ -1315,10 +1411,9 @@ json_t *get_market_kline_week(const char *market, time_t start, time_t end, int
         struct kline_info *kinfo = NULL;
         for (int i = 0; i < step; ++i) {
             time_t timestamp = start + i * 86400;
-            dict_entry *entry = dict_find(info->day, &timestamp);
-            if (entry == NULL)
+            struct kline_info *item = kline_ring_get(info->day, timestamp);
+            if (item == NULL)
                 continue;
-            struct kline_info *item = entry->val;
             if (kinfo == NULL)
                 kinfo = kline_info_new(item->open);
             kline_info_merge(kinfo, item);
@@ -1385,10 +1480,9 @@ json_t *get_market_kline_month(const char *market, time_t start, time_t end, int
         time_t mon_next = get_next_month(&tm_year, &tm_mon);
         time_t timestamp = mon_start;
         for (; timestamp < mon_next && timestamp <= end; timestamp += 86400) {
-            dict_entry *entry = dict_find(info->day, &timestamp);
-            if (entry == NULL)
+            struct kline_info *item = kline_ring_get(info->day, timestamp);
+            if (item == NULL)
                 continue;
-            struct kline_info *item = entry->val;
             if (kinfo == NULL)
                 kinfo = kline_info_new(item->open);
             kline_info_merge(kinfo, item);
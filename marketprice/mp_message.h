@@ -10,6 +10,8 @@
 
 # define MARKET_DEALS_MAX   10000
 # define MARKET_NAME_MAX    12
+/* the period of the market status kept up to date as deals arrive */
+# define STATUS_PERIOD      86400
 
 int init_message(void);
 bool market_exist(const char *market);
@@ -6,16 +6,40 @@
 # include "me_config.h"
 # include "me_balance.h"
 
-dict_t *dict_balance;
+dict_t *dict_balance_dirty;
 static dict_t *dict_asset;
+static dict_t *dict_user;
 
 struct asset_type {
     uint32_t id;
+    uint32_t index;
     int prec_save;
     int prec_show;
     mpd_t *min_amount;
+    const char *name;
+
+    /* running totals of all users, kept by every slot change */
+    mpd_t *available;
+    mpd_t *freeze;
+    size_t available_count;
+    size_t freeze_count;
 };
 
+/*
+ * balances of one user, assets are numbered by a dense index in the order
+ * they are registered. slot 2 * index is available, 2 * index + 1 is freeze,
+ * NULL is a zero balance.
+ */
+struct user_balance {
+    uint32_t user_id;
+    uint32_t size;
+    uint32_t used;
+    mpd_t **slots;
+};
+
+static struct asset_type **asset_list;
+static uint32_t asset_count;
+
 static uint32_t asset_dict_hash_function(const void *key)
 {
     return dict_generic_hash_function(key, strlen(key));
@@ -50,6 +74,28 @@ static void asset_dict_val_free(void *val)
     free(val);
 }
 
+static uint32_t user_dict_hash_function(const void *key)
+{
+    return dict_generic_hash_function(key, sizeof(uint32_t));
+}
+
+static int user_dict_key_compare(const void *key1, const void *key2)
+{
+    return *(const uint32_t *)key1 == *(const uint32_t *)key2 ? 0 : 1;
+}
+
+static void user_dict_val_free(void *val)
+{
+    struct user_balance *user = val;
+    for (uint32_t i = 0; i < user->size * 2; ++i) {
+        if (user->slots[i]) {
+            mpd_del(user->slots[i]);
+        }
+    }
+    free(user->slots);
+    free(user);
+}
+
 static uint32_t balance_dict_hash_function(const void *key)
 {
     return dict_generic_hash_function(key, sizeof(struct balance_key));
@@ -64,11 +110,6 @@ static void *balance_dict_key_dup(const void *key)
     return obj;
 }
 
-static void *balance_dict_val_dup(const void *val)
-{
-    return mpd_qncopy(val);
-}
-
 static int balance_dict_key_compare(const void *key1, const void *key2)
 {
     return memcmp(key1, key2, sizeof(struct balance_key));
@@ -79,11 +120,6 @@ static void balance_dict_key_free(void *key)
     free(key);
 }
 
-static void balance_dict_val_free(void *val)
-{
-    mpd_del(val);
-}
-
 static int init_dict(void)
 {
     dict_types type;
@@ -99,50 +135,67 @@ static int init_dict(void)
     if (dict_asset == NULL)
         return -__LINE__;
 
+    memset(&type, 0, sizeof(type));
+    type.hash_function  = user_dict_hash_function;
+    type.key_compare    = user_dict_key_compare;
+    type.val_destructor = user_dict_val_free;
+
+    dict_user = dict_create(&type, 1024);
+    if (dict_user == NULL)
+        return -__LINE__;
+
     memset(&type, 0, sizeof(type));
     type.hash_function  = balance_dict_hash_function;
     type.key_compare    = balance_dict_key_compare;
     type.key_dup        = balance_dict_key_dup;
     type.key_destructor = balance_dict_key_free;
-    type.val_dup        = balance_dict_val_dup;
-    type.val_destructor = balance_dict_val_free;
 
-    dict_balance = dict_create(&type, 64);
-    if (dict_balance == NULL)
+    dict_balance_dirty = dict_create(&type, 64);
+    if (dict_balance_dirty == NULL)
         return -__LINE__;
 
     return 0;
 }
 
+static int add_asset(const char *name, struct asset_type *type)
+{
+    struct asset_type **list = realloc(asset_list, sizeof(struct asset_type *) * (asset_count + 1));
+    if (list == NULL)
+        return -__LINE__;
+    asset_list = list;
+
+    type->index = asset_count;
+    type->available = mpd_qncopy(mpd_zero);
+    type->freeze = mpd_qncopy(mpd_zero);
+    dict_entry *entry = dict_add(dict_asset, (void *)name, type);
+    if (entry == NULL)
+        return -__LINE__;
+    struct asset_type *at = entry->val;
+    at->name = entry->key;
+    asset_list[asset_count++] = at;
+
+    return 0;
+}
+
 int init_balance()
 {
     ERR_RET(init_dict());
 
     for (size_t i = 0; i < settings.asset_num; ++i) {
         struct asset_type type;
+        memset(&type, 0, sizeof(type));
         type.id = settings.assets[i].id;
         type.prec_save = settings.assets[i].prec_save;
         type.prec_show = settings.assets[i].prec_show;
         type.min_amount = settings.assets[i].min_amount;
 
-        if (dict_add(dict_asset, settings.assets[i].name, &type) == NULL)
+        if (add_asset(settings.assets[i].name, &type) < 0)
             return -__LINE__;
     }
 
     return 0;
 }
 
-void update_asset(asset_info_t *asset)
-{
-    struct asset_type type;
-    type.prec_save = asset->prec_save;
-    type.prec_show = asset->prec_show;
-    type.min_amount = asset->min_amount;
-    type.id = asset->id;
-
-    dict_add(dict_asset, asset->name, &type);
-}
-
 static struct asset_type *get_asset_type(const char *asset)
 {
     dict_entry *entry = dict_find(dict_asset, asset);
@@ -182,178 +235,284 @@ mpd_t *asset_min_amount(const char *asset)
     return at->min_amount;
 }
 
-mpd_t *balance_get(uint32_t user_id, uint32_t type, const char *asset)
+void update_asset(asset_info_t *asset)
 {
-    struct balance_key key;
-    key.user_id = user_id;
-    key.type = type;
-    strncpy(key.asset, asset, sizeof(key.asset));
+    struct asset_type type;
+    memset(&type, 0, sizeof(type));
+    type.prec_save = asset->prec_save;
+    type.prec_show = asset->prec_show;
+    type.min_amount = asset->min_amount;
+    type.id = asset->id;
 
-    dict_entry *entry = dict_find(dict_balance, &key);
-    if (entry) {
-        return entry->val;
+    if (get_asset_type(asset->name) == NULL) {
+        add_asset(asset->name, &type);
     }
-
-    return NULL;
 }
 
-void balance_del(uint32_t user_id, uint32_t type, const char *asset)
+static void balance_dirty(struct asset_type *at, uint32_t user_id, uint32_t type)
 {
     struct balance_key key;
+    memset(&key, 0, sizeof(key));
     key.user_id = user_id;
     key.type = type;
-    strncpy(key.asset, asset, sizeof(key.asset));
-    dict_delete(dict_balance, &key);
+    strncpy(key.asset, at->name, sizeof(key.asset) - 1);
+    if (dict_find(dict_balance_dirty, &key) == NULL) {
+        dict_add(dict_balance_dirty, &key, NULL);
+    }
 }
 
-mpd_t *balance_set(uint32_t user_id, uint32_t type, const char *asset, mpd_t *amount)
+void balance_clear_dirty(void)
 {
-    struct asset_type *at = get_asset_type(asset);
-    if (at == NULL)
+    dict_clear(dict_balance_dirty);
+}
+
+static struct user_balance *get_user(uint32_t user_id)
+{
+    dict_entry *entry = dict_find(dict_user, &user_id);
+    if (entry == NULL)
         return NULL;
+    return entry->val;
+}
 
-    int ret = mpd_cmp(amount, mpd_zero, &mpd_ctx);
-    if (ret < 0) {
+static mpd_t **get_slot(struct user_balance *user, struct asset_type *at, uint32_t type)
+{
+    if (user == NULL || at->index >= user->size)
         return NULL;
-    } else if (ret == 0) {
-        balance_del(user_id, type, asset);
-        return mpd_zero;
+    return &user->slots[at->index * 2 + (type == BALANCE_TYPE_FREEZE ? 1 : 0)];
+}
+
+/* the slot of the balance, the user record is created or grown on demand */
+static mpd_t **make_slot(uint32_t user_id, struct asset_type *at, uint32_t type)
+{
+    struct user_balance *user = get_user(user_id);
+    if (user == NULL) {
+        user = malloc(sizeof(struct user_balance));
+        if (user == NULL)
+            return NULL;
+        memset(user, 0, sizeof(struct user_balance));
+        user->user_id = user_id;
+        if (dict_add(dict_user, &user->user_id, user) == NULL) {
+            free(user);
+            return NULL;
+        }
     }
 
-    struct balance_key key;
-    key.user_id = user_id;
-    key.type = type;
-    strncpy(key.asset, asset, sizeof(key.asset));
+    if (at->index >= user->size) {
+        uint32_t size = asset_count > at->index ? asset_count : at->index + 1;
+        mpd_t **slots = realloc(user->slots, sizeof(mpd_t *) * size * 2);
+        if (slots == NULL)
+            return NULL;
+        memset(slots + user->size * 2, 0, sizeof(mpd_t *) * (size - user->size) * 2);
+        user->slots = slots;
+        user->size = size;
+    }
 
-    mpd_t *result;
-    dict_entry *entry;
-    entry = dict_find(dict_balance, &key);
-    if (entry) {
-        result = entry->val;
-        mpd_rescale(result, amount, -at->prec_save, &mpd_ctx);
-        return result;
+    return &user->slots[at->index * 2 + (type == BALANCE_TYPE_FREEZE ? 1 : 0)];
+}
+
+static void total_sub(struct asset_type *at, uint32_t type, mpd_t *val)
+{
+    if (type == BALANCE_TYPE_FREEZE) {
+        mpd_sub(at->freeze, at->freeze, val, &mpd_ctx);
+    } else {
+        mpd_sub(at->available, at->available, val, &mpd_ctx);
     }
+}
 
-    entry = dict_add(dict_balance, &key, amount);
-    if (entry == NULL)
-        return NULL;
-    result = entry->val;
-    mpd_rescale(result, amount, -at->prec_save, &mpd_ctx);
+static void total_add(struct asset_type *at, uint32_t type, mpd_t *val)
+{
+    if (type == BALANCE_TYPE_FREEZE) {
+        mpd_add(at->freeze, at->freeze, val, &mpd_ctx);
+    } else {
+        mpd_add(at->available, at->available, val, &mpd_ctx);
+    }
+}
 
-    return result;
+static void total_count(struct asset_type *at, uint32_t type, int change)
+{
+    if (type == BALANCE_TYPE_FREEZE) {
+        at->freeze_count += change;
+    } else {
+        at->available_count += change;
+    }
 }
 
-mpd_t *balance_add(uint32_t user_id, uint32_t type, const char *asset, mpd_t *amount)
+static void slot_clear(uint32_t user_id, struct asset_type *at, uint32_t type)
 {
-    struct asset_type *at = get_asset_type(asset);
-    if (at == NULL)
-        return NULL;
+    struct user_balance *user = get_user(user_id);
+    mpd_t **slot = get_slot(user, at, type);
+    if (slot == NULL || *slot == NULL)
+        return;
+
+    total_sub(at, type, *slot);
+    total_count(at, type, -1);
+    mpd_del(*slot);
+    *slot = NULL;
+    balance_dirty(at, user_id, type);
+    user->used -= 1;
+    if (user->used == 0) {
+        dict_delete(dict_user, &user_id);
+    }
+}
 
-    if (mpd_cmp(amount, mpd_zero, &mpd_ctx) < 0)
+static mpd_t *slot_get(uint32_t user_id, struct asset_type *at, uint32_t type)
+{
+    mpd_t **slot = get_slot(get_user(user_id), at, type);
+    return slot ? *slot : NULL;
+}
+
+static mpd_t *slot_set(uint32_t user_id, struct asset_type *at, uint32_t type, mpd_t *amount)
+{
+    int ret = mpd_cmp(amount, mpd_zero, &mpd_ctx);
+    if (ret < 0) {
         return NULL;
+    } else if (ret == 0) {
+        slot_clear(user_id, at, type);
+        return mpd_zero;
+    }
 
-    struct balance_key key;
-    key.user_id = user_id;
-    key.type = type;
-    strncpy(key.asset, asset, sizeof(key.asset));
-
-    mpd_t *result;
-    dict_entry *entry = dict_find(dict_balance, &key);
-    if (entry) {
-        result = entry->val;
-        mpd_add(result, result, amount, &mpd_ctx);
-        mpd_rescale(result, result, -at->prec_save, &mpd_ctx);
-        return result;
+    mpd_t **slot = make_slot(user_id, at, type);
+    if (slot == NULL)
+        return NULL;
+    if (*slot == NULL) {
+        *slot = mpd_qncopy(mpd_zero);
+        get_user(user_id)->used += 1;
+        total_count(at, type, 1);
     }
+    total_sub(at, type, *slot);
+    mpd_rescale(*slot, amount, -at->prec_save, &mpd_ctx);
+    total_add(at, type, *slot);
+    balance_dirty(at, user_id, type);
 
-    return balance_set(user_id, type, asset, amount);
+    return *slot;
 }
 
-mpd_t *balance_sub(uint32_t user_id, uint32_t type, const char *asset, mpd_t *amount)
+static mpd_t *slot_add(uint32_t user_id, struct asset_type *at, uint32_t type, mpd_t *amount)
 {
-    struct asset_type *at = get_asset_type(asset);
-    if (at == NULL)
+    if (mpd_cmp(amount, mpd_zero, &mpd_ctx) < 0)
         return NULL;
 
+    mpd_t *result = slot_get(user_id, at, type);
+    if (result == NULL)
+        return slot_set(user_id, at, type, amount);
+
+    total_sub(at, type, result);
+    mpd_add(result, result, amount, &mpd_ctx);
+    mpd_rescale(result, result, -at->prec_save, &mpd_ctx);
+    total_add(at, type, result);
+    balance_dirty(at, user_id, type);
+
+    return result;
+}
+
+static mpd_t *slot_sub(uint32_t user_id, struct asset_type *at, uint32_t type, mpd_t *amount)
+{
     if (mpd_cmp(amount, mpd_zero, &mpd_ctx) < 0)
         return NULL;
 
-    mpd_t *result = balance_get(user_id, type, asset);
+    mpd_t *result = slot_get(user_id, at, type);
     if (result == NULL)
         return NULL;
     if (mpd_cmp(result, amount, &mpd_ctx) < 0)
         return NULL;
 
-    mpd_sub(result, result, amount, &mpd_ctx);
-    if (mpd_cmp(result, mpd_zero, &mpd_ctx) == 0) {
-        balance_del(user_id, type, asset);
+    if (mpd_cmp(result, amount, &mpd_ctx) == 0) {
+        slot_clear(user_id, at, type);
         return mpd_zero;
     }
+    total_sub(at, type, result);
+    mpd_sub(result, result, amount, &mpd_ctx);
     mpd_rescale(result, result, -at->prec_save, &mpd_ctx);
+    total_add(at, type, result);
+    balance_dirty(at, user_id, type);
 
     return result;
 }
 
-mpd_t *balance_freeze(uint32_t user_id, const char *asset, mpd_t *amount)
+/* move amount from one type of balance to the other */
+static mpd_t *slot_move(uint32_t user_id, struct asset_type *at, uint32_t from, uint32_t to, mpd_t *amount)
 {
-    struct asset_type *at = get_asset_type(asset);
-    if (at == NULL)
-        return NULL;
-
     if (mpd_cmp(amount, mpd_zero, &mpd_ctx) < 0)
         return NULL;
-    mpd_t *available = balance_get(user_id, BALANCE_TYPE_AVAILABLE, asset);
-    if (available == NULL)
+    mpd_t *balance = slot_get(user_id, at, from);
+    if (balance == NULL)
         return NULL;
-    if (mpd_cmp(available, amount, &mpd_ctx) < 0)
+    if (mpd_cmp(balance, amount, &mpd_ctx) < 0)
         return NULL;
 
-    if (balance_add(user_id, BALANCE_TYPE_FREEZE, asset, amount) == 0)
+    if (slot_add(user_id, at, to, amount) == NULL)
         return NULL;
-    mpd_sub(available, available, amount, &mpd_ctx);
-    if (mpd_cmp(available, mpd_zero, &mpd_ctx) == 0) {
-        balance_del(user_id, BALANCE_TYPE_AVAILABLE, asset);
-        return mpd_zero;
-    }
-    mpd_rescale(available, available, -at->prec_save, &mpd_ctx);
-
-    return available;
+    return slot_sub(user_id, at, from, amount);
 }
 
-mpd_t *balance_unfreeze(uint32_t user_id, const char *asset, mpd_t *amount)
+mpd_t *balance_get(uint32_t user_id, uint32_t type, const char *asset)
 {
     struct asset_type *at = get_asset_type(asset);
     if (at == NULL)
         return NULL;
+    return slot_get(user_id, at, type);
+}
 
-    if (mpd_cmp(amount, mpd_zero, &mpd_ctx) < 0)
+void balance_del(uint32_t user_id, uint32_t type, const char *asset)
+{
+    struct asset_type *at = get_asset_type(asset);
+    if (at == NULL)
+        return;
+    slot_clear(user_id, at, type);
+}
+
+mpd_t *balance_set(uint32_t user_id, uint32_t type, const char *asset, mpd_t *amount)
+{
+    struct asset_type *at = get_asset_type(asset);
+    if (at == NULL)
         return NULL;
-    mpd_t *freeze = balance_get(user_id, BALANCE_TYPE_FREEZE, asset);
-    if (freeze == NULL)
+    return slot_set(user_id, at, type, amount);
+}
+
+mpd_t *balance_add(uint32_t user_id, uint32_t type, const char *asset, mpd_t *amount)
+{
+    struct asset_type *at = get_asset_type(asset);
+    if (at == NULL)
         return NULL;
-    if (mpd_cmp(freeze, amount, &mpd_ctx) < 0)
+    return slot_add(user_id, at, type, amount);
+}
+
+mpd_t *balance_sub(uint32_t user_id, uint32_t type, const char *asset, mpd_t *amount)
+{
+    struct asset_type *at = get_asset_type(asset);
+    if (at == NULL)
         return NULL;
+    return slot_sub(user_id, at, type, amount);
+}
 
-    if (balance_add(user_id, BALANCE_TYPE_AVAILABLE, asset, amount) == 0)
+mpd_t *balance_freeze(uint32_t user_id, const char *asset, mpd_t *amount)
+{
+    struct asset_type *at = get_asset_type(asset);
+    if (at == NULL)
         return NULL;
-    mpd_sub(freeze, freeze, amount, &mpd_ctx);
-    if (mpd_cmp(freeze, mpd_zero, &mpd_ctx) == 0) {
-        balance_del(user_id, BALANCE_TYPE_FREEZE, asset);
-        return mpd_zero;
-    }
-    mpd_rescale(freeze, freeze, -at->prec_save, &mpd_ctx);
+    return slot_move(user_id, at, BALANCE_TYPE_AVAILABLE, BALANCE_TYPE_FREEZE, amount);
+}
 
-    return freeze;
+mpd_t *balance_unfreeze(uint32_t user_id, const char *asset, mpd_t *amount)
+{
+    struct asset_type *at = get_asset_type(asset);
+    if (at == NULL)
+        return NULL;
+    return slot_move(user_id, at, BALANCE_TYPE_FREEZE, BALANCE_TYPE_AVAILABLE, amount);
 }
 
 mpd_t *balance_total(uint32_t user_id, const char *asset)
 {
     mpd_t *balance = mpd_qncopy(mpd_zero);
-    mpd_t *available = balance_get(user_id, BALANCE_TYPE_AVAILABLE, asset);
+    struct asset_type *at = get_asset_type(asset);
+    if (at == NULL)
+        return balance;
+
+    mpd_t *available = slot_get(user_id, at, BALANCE_TYPE_AVAILABLE);
     if (available) {
         mpd_add(balance, balance, available, &mpd_ctx);
     }
-    mpd_t *freeze = balance_get(user_id, BALANCE_TYPE_FREEZE, asset);
+    mpd_t *freeze = slot_get(user_id, at, BALANCE_TYPE_FREEZE);
     if (freeze) {
         mpd_add(balance, balance, freeze, &mpd_ctx);
     }
@@ -370,23 +529,119 @@ int balance_status(const char *asset, mpd_t *total, size_t *available_count, mpd
     mpd_copy(freeze, mpd_zero, &mpd_ctx);
     mpd_copy(available, mpd_zero, &mpd_ctx);
 
+    struct asset_type *at = get_asset_type(asset);
+    if (at == NULL)
+        return 0;
+
+    *available_count = at->available_count;
+    *freeze_count = at->freeze_count;
+    *total_count = at->available_count + at->freeze_count;
+    mpd_copy(available, at->available, &mpd_ctx);
+    mpd_copy(freeze, at->freeze, &mpd_ctx);
+    mpd_add(total, at->available, at->freeze, &mpd_ctx);
+
+    return 0;
+}
+
+int balance_check_status(void)
+{
+    size_t *counts = calloc(asset_count * 2, sizeof(size_t));
+    mpd_t **sums = calloc(asset_count * 2, sizeof(mpd_t *));
+    if (counts == NULL || sums == NULL) {
+        free(counts);
+        free(sums);
+        return -__LINE__;
+    }
+    for (uint32_t i = 0; i < asset_count * 2; ++i) {
+        sums[i] = mpd_qncopy(mpd_zero);
+    }
+
     dict_entry *entry;
-    dict_iterator *iter = dict_get_iterator(dict_balance);
+    dict_iterator *iter = dict_get_iterator(dict_user);
     while ((entry = dict_next(iter)) != NULL) {
-        struct balance_key *key = entry->key;
-        if (strcmp(key->asset, asset) != 0)
-            continue;
-        mpd_add(total, total, entry->val, &mpd_ctx);
-        if (key->type == BALANCE_TYPE_AVAILABLE) {
-            *available_count += 1;
-            mpd_add(available, available, entry->val, &mpd_ctx);
-        } else {
-            *freeze_count += 1;
-            mpd_add(freeze, freeze, entry->val, &mpd_ctx);
+        struct user_balance *user = entry->val;
+        for (uint32_t i = 0; i < user->size * 2; ++i) {
+            if (user->slots[i] == NULL)
+                continue;
+            counts[i] += 1;
+            mpd_add(sums[i], sums[i], user->slots[i], &mpd_ctx);
         }
-        *total_count += 1;
     }
     dict_release_iterator(iter);
 
-    return 0;
+    int mismatch = 0;
+    for (uint32_t i = 0; i < asset_count; ++i) {
+        struct asset_type *at = asset_list[i];
+        if (counts[i * 2] != at->available_count || mpd_cmp(sums[i * 2], at->available, &mpd_ctx) != 0 ||
+                counts[i * 2 + 1] != at->freeze_count || mpd_cmp(sums[i * 2 + 1], at->freeze, &mpd_ctx) != 0) {
+            char *available = mpd_to_sci(sums[i * 2], 0);
+            char *freeze = mpd_to_sci(sums[i * 2 + 1], 0);
+            char *total_available = mpd_to_sci(at->available, 0);
+            char *total_freeze = mpd_to_sci(at->freeze, 0);
+            log_fatal("asset: %s running total mismatch, available: %zu %s != %zu %s, freeze: %zu %s != %zu %s", at->name,
+                    at->available_count, total_available, counts[i * 2], available,
+                    at->freeze_count, total_freeze, counts[i * 2 + 1], freeze);
+            free(available);
+            free(freeze);
+            free(total_available);
+            free(total_freeze);
+            mismatch += 1;
+        }
+    }
+
+    for (uint32_t i = 0; i < asset_count * 2; ++i) {
+        mpd_del(sums[i]);
+    }
+    free(counts);
+    free(sums);
+
+    return mismatch;
+}
+
+balance_iterator *balance_get_iterator(void)
+{
+    balance_iterator *iter = malloc(sizeof(balance_iterator));
+    if (iter == NULL)
+        return NULL;
+    memset(iter, 0, sizeof(balance_iterator));
+    iter->user_iter = dict_get_iterator(dict_user);
+    if (iter->user_iter == NULL) {
+        free(iter);
+        return NULL;
+    }
+    return iter;
 }
+
+mpd_t *balance_next(balance_iterator *iter, struct balance_key *key)
+{
+    while (true) {
+        struct user_balance *user = iter->user;
+        if (user == NULL) {
+            dict_entry *entry = dict_next(iter->user_iter);
+            if (entry == NULL)
+                return NULL;
+            user = iter->user = entry->val;
+            iter->slot = 0;
+        }
+
+        while (iter->slot < user->size * 2) {
+            uint32_t slot = iter->slot++;
+            mpd_t *val = user->slots[slot];
+            if (val == NULL)
+                continue;
+            memset(key, 0, sizeof(struct balance_key));
+            key->user_id = user->user_id;
+            key->type = (slot & 1) ? BALANCE_TYPE_FREEZE : BALANCE_TYPE_AVAILABLE;
+            strncpy(key->asset, asset_list[slot / 2]->name, sizeof(key->asset) - 1);
+            return val;
+        }
+        iter->user = NULL;
+    }
+}
+
+void balance_release_iterator(balance_iterator *iter)
+{
+    dict_release_iterator(iter->user_iter);
+    free(iter);
+}
+
@@ -11,7 +11,8 @@
 # define BALANCE_TYPE_AVAILABLE 1
 # define BALANCE_TYPE_FREEZE    2
 
-extern dict_t *dict_balance;
+/* balance keys changed since the last slice, val is not used */
+extern dict_t *dict_balance_dirty;
 
 struct balance_key {
     uint32_t    user_id;
@@ -19,6 +20,12 @@ struct balance_key {
     char        asset[ASSET_NAME_MAX_LEN + 1];
 };
 
+typedef struct balance_iterator {
+    dict_iterator       *user_iter;
+    struct user_balance *user;
+    uint32_t            slot;
+} balance_iterator;
+
 int init_balance(void);
 
 bool asset_exist(const char *asset);
@@ -36,7 +43,16 @@ mpd_t *balance_sub(uint32_t user_id, uint32_t type, const char *asset, mpd_t *am
 mpd_t *balance_freeze(uint32_t user_id, const char *asset, mpd_t *amount);
 mpd_t *balance_unfreeze(uint32_t user_id, const char *asset, mpd_t *amount);
 
+void   balance_clear_dirty(void);
+
 mpd_t *balance_total(uint32_t user_id, const char *asset);
+/* iterate every non zero balance, the key is filled for the returned value */
+balance_iterator *balance_get_iterator(void);
+mpd_t *balance_next(balance_iterator *iter, struct balance_key *key);
+void balance_release_iterator(balance_iterator *iter);
+
 int balance_status(const char *asset, mpd_t *total, size_t *available_count, mpd_t *available, size_t *freeze_count, mpd_t *freeze, size_t *total_count);
+/* compare the running totals with a full scan, return the number of assets that differ */
+int balance_check_status(void);
 
 # endif
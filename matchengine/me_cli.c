@@ -35,22 +35,21 @@ static sds on_cmd_balance_list(const char *cmd, int argc, sds *argv)
     sds reply = sdsempty();
     reply = sdscatprintf(reply, "%-10s %-16s %-10s %s\n", "user", "asset", "type", "amount");
 
-    dict_iterator *iter = dict_get_iterator(dict_balance);
-    dict_entry *entry;
-    while ((entry = dict_next(iter)) != NULL) {
-        struct balance_key *key = entry->key;
-        if (asset && strcmp(key->asset, asset) != 0)
+    struct balance_key key;
+    mpd_t *val;
+    balance_iterator *iter = balance_get_iterator();
+    while ((val = balance_next(iter, &key)) != NULL) {
+        if (asset && strcmp(key.asset, asset) != 0)
             continue;
-        mpd_t *val = entry->val;
         char *str = mpd_to_sci(val, 0);
-        if (key->type == BALANCE_TYPE_AVAILABLE) {
-            reply = sdscatprintf(reply, "%-10u %-16s %-10s %s\n", key->user_id, key->asset, "available", str);
+        if (key.type == BALANCE_TYPE_AVAILABLE) {
+            reply = sdscatprintf(reply, "%-10u %-16s %-10s %s\n", key.user_id, key.asset, "available", str);
         } else {
-            reply = sdscatprintf(reply, "%-10u %-16s %-10s %s\n", key->user_id, key->asset, "freeze", str);
+            reply = sdscatprintf(reply, "%-10u %-16s %-10s %s\n", key.user_id, key.asset, "freeze", str);
         }
         free(str);
     }
-    dict_release_iterator(iter);
+    balance_release_iterator(iter);
 
     return reply;
 }
@@ -157,18 +156,26 @@ static sds on_cmd_market_summary(const char *cmd, int argc, sds *argv)
     return reply;
 }
 
+static sds on_cmd_market_pool(const char *cmd, int argc, sds *argv)
+{
+    sds reply = sdsempty();
+    return market_pool_status(reply);
+}
+
 static sds on_cmd_market(const char *cmd, int argc, sds *argv)
 {
     if (argc > 0) {
         if (strcmp(argv[0], "summary") == 0) {
             return on_cmd_market_summary(cmd, argc, argv);
+        } else if (strcmp(argv[0], "pool") == 0) {
+            return on_cmd_market_pool(cmd, argc, argv);
         } else {
             goto error;
         }
     }
 
 error:
-    return sdsnew("usage market summary\n");
+    return sdsnew("usage market summary/pool\n");
 }
 
 static sds on_cmd_makeslice(const char *cmd, int argc, sds *argv)
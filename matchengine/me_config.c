@@ -291,6 +291,9 @@ static int read_config_from_json(json_t *root)
         printf("load slice_keeptime fail: %d", ret);
         return -__LINE__;
     }
+    ERR_RET_LN(read_cfg_str(root, "slice_path", &settings.slice_path, "slice"));
+    ERR_RET_LN(read_cfg_int(root, "slice_base_interval", &settings.slice_base_interval, false, 86400));
+    ERR_RET_LN(read_cfg_bool(root, "balance_check", &settings.balance_check, false, false));
     ret = read_cfg_int(root, "history_thread", &settings.history_thread, false, 10);
     if (ret < 0) {
         printf("load history_thread fail: %d", ret);
@@ -298,6 +301,12 @@ static int read_config_from_json(json_t *root)
     }
 
     ERR_RET_LN(read_cfg_real(root, "cache_timeout", &settings.cache_timeout, false, 0.45));
+    ERR_RET_LN(read_cfg_bool(root, "depth_delta", &settings.depth_delta, false, false));
+    ERR_RET_LN(read_cfg_real(root, "depth_delta_interval", &settings.depth_delta_interval, false, 0.1));
+    ERR_RET_LN(read_cfg_str(root, "operlog_path", &settings.operlog_path, "operlog"));
+    ERR_RET_LN(read_cfg_int(root, "operlog_segment_size", &settings.operlog_segment_size, false, 256 * 1024 * 1024));
+    ERR_RET_LN(read_cfg_real(root, "operlog_flush_interval", &settings.operlog_flush_interval, false, 0.01));
+    ERR_RET_LN(read_cfg_int(root, "operlog_replay_thread", &settings.operlog_replay_thread, false, 4));
 
     return 0;
 }
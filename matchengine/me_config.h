@@ -33,10 +33,14 @@
 # include "ut_define.h"
 # include "ut_config.h"
 # include "ut_decimal.h"
+# include "ut_fixed.h"
 # include "ut_rpc_clt.h"
 # include "ut_rpc_svr.h"
+# include "ut_rpc_bin.h"
+# include "ut_json_writer.h"
 # include "ut_rpc_cmd.h"
 # include "ut_skiplist.h"
+# include "ut_slab.h"
 
 # define ASSET_NAME_MAX_LEN     15
 # define BUSINESS_NAME_MAX_LEN  31
@@ -89,8 +93,18 @@ struct settings {
 
     int                 slice_interval;
     int                 slice_keeptime;
+    char                *slice_path;
+    int                 slice_base_interval;
+    bool                balance_check;
     int                 history_thread;
     double              cache_timeout;
+    bool                depth_delta;
+    double              depth_delta_interval;
+
+    char                *operlog_path;
+    int                 operlog_segment_size;
+    double              operlog_flush_interval;
+    int                 operlog_replay_thread;
 
     kafka_producer_cfg  producer;
 };
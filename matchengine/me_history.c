@@ -7,7 +7,6 @@
 # include "me_history.h"
 # include "me_balance.h"
 
-static MYSQL *mysql_conn;
 static nw_job *job;
 static dict_t *dict_sql;
 static nw_timer timer;
@@ -47,15 +46,258 @@ static void dict_sql_key_free(void *key)
     free(key);
 }
 
+/*
+ * Rows are copied into the buffer of their table as plain structs on the
+ * matching thread, the job threads render them into sql. Values owned by
+ * a row are freed after the rows are rendered.
+ */
+
+struct order_row {
+    uint64_t    id;
+    double      create_time;
+    double      finish_time;
+    uint32_t    user_id;
+    const char  *market;
+    char        source[SOURCE_MAX_LEN + 1];
+    uint32_t    type;
+    uint32_t    side;
+    int64_t     price;
+    int64_t     amount;
+    int64_t     taker_fee;
+    int64_t     maker_fee;
+    int64_t     deal_stock;
+    int64_t     deal_money;
+    int64_t     deal_fee;
+    int         money_prec;
+    int         amount_prec;
+    int         fee_prec;
+    int         stock_prec;
+    int         value_prec;
+};
+
+struct deal_row {
+    double      t;
+    uint32_t    user_id;
+    const char  *market;
+    uint64_t    deal_id;
+    uint64_t    order_id;
+    uint64_t    deal_order_id;
+    int         side;
+    int         role;
+    int64_t     price;
+    int64_t     amount;
+    int64_t     deal;
+    int64_t     fee;
+    int64_t     deal_fee;
+    int         money_prec;
+    int         stock_prec;
+    int         value_prec;
+};
+
+enum {
+    BALANCE_DETAIL_TEXT,
+    BALANCE_DETAIL_TRADE,
+    BALANCE_DETAIL_TRADE_FEE,
+};
+
+struct balance_row {
+    double      t;
+    uint32_t    user_id;
+    char        asset[ASSET_NAME_MAX_LEN + 1];
+    char        business[BUSINESS_NAME_MAX_LEN + 1];
+    mpd_t       *change_mpd;    // owned, NULL for trade rows
+    int64_t     change;
+    int         change_prec;
+    mpd_t       *balance;       // owned
+    int         detail_type;
+    char        *detail;        // owned, BALANCE_DETAIL_TEXT only
+    const char  *market;
+    uint64_t    order_id;
+    int64_t     price;
+    int64_t     amount;
+    int64_t     fee_rate;
+    int         money_prec;
+    int         stock_prec;
+    int         fee_prec;
+};
+
+struct history_job {
+    struct dict_sql_key key;
+    sds                 rows;
+};
+
+static size_t row_size(uint32_t type)
+{
+    switch (type) {
+    case HISTORY_USER_BALANCE:
+        return sizeof(struct balance_row);
+    case HISTORY_USER_ORDER:
+    case HISTORY_ORDER_DETAIL:
+        return sizeof(struct order_row);
+    default:
+        return sizeof(struct deal_row);
+    }
+}
+
 static void *on_job_init(void)
 {
     return mysql_connect(&settings.db_history);
 }
 
+static sds sql_append_mpd(sds sql, mpd_t *val, bool comma)
+{
+    char *str = mpd_to_sci(val, 0);
+    sql = sdscatprintf(sql, "'%s'", str);
+    if (comma) {
+        sql = sdscatprintf(sql, ", ");
+    }
+    free(str);
+    return sql;
+}
+
+static sds sql_append_fixed(sds sql, int64_t val, int prec, bool comma)
+{
+    char buf[FIXED_STR_MAX_LEN];
+    sql = sdscatprintf(sql, "'%s'", fixed_format(buf, val, prec));
+    if (comma) {
+        sql = sdscatprintf(sql, ", ");
+    }
+    return sql;
+}
+
+static sds render_order(sds sql, const char *table, uint32_t hash, struct order_row *rows, size_t count)
+{
+    sql = sdscatprintf(sql, "INSERT INTO `%s_%u` (`id`, `create_time`, `finish_time`, `user_id`, "
+            "`market`, `source`, `t`, `side`, `price`, `amount`, `taker_fee`, `maker_fee`, `deal_stock`, `deal_money`, `deal_fee`) VALUES ", table, hash);
+    for (size_t i = 0; i < count; ++i) {
+        struct order_row *row = &rows[i];
+        if (i > 0) {
+            sql = sdscatprintf(sql, ", ");
+        }
+        sql = sdscatprintf(sql, "(%"PRIu64", %f, %f, %u, '%s', '%s', %u, %u, ", row->id,
+            row->create_time, row->finish_time, row->user_id, row->market, row->source, row->type, row->side);
+        sql = sql_append_fixed(sql, row->price, row->money_prec, true);
+        sql = sql_append_fixed(sql, row->amount, row->amount_prec, true);
+        sql = sql_append_fixed(sql, row->taker_fee, row->fee_prec, true);
+        sql = sql_append_fixed(sql, row->maker_fee, row->fee_prec, true);
+        sql = sql_append_fixed(sql, row->deal_stock, row->stock_prec, true);
+        sql = sql_append_fixed(sql, row->deal_money, row->value_prec, true);
+        sql = sql_append_fixed(sql, row->deal_fee, row->value_prec, false);
+        sql = sdscatprintf(sql, ")");
+    }
+    return sql;
+}
+
+static sds render_order_deal(sds sql, uint32_t hash, struct deal_row *rows, size_t count)
+{
+    sql = sdscatprintf(sql, "INSERT INTO `deal_history_%u` (`id`, `time`, `user_id`, `deal_id`, `order_id`, `deal_order_id`, `role`, `price`, `amount`, `deal`, `fee`, `deal_fee`) VALUES ", hash);
+    for (size_t i = 0; i < count; ++i) {
+        struct deal_row *row = &rows[i];
+        if (i > 0) {
+            sql = sdscatprintf(sql, ", ");
+        }
+        sql = sdscatprintf(sql, "(NULL, %f, %u, %"PRIu64", %"PRIu64", %"PRIu64", %d, ", row->t, row->user_id, row->deal_id, row->order_id, row->deal_order_id, row->role);
+        sql = sql_append_fixed(sql, row->price, row->money_prec, true);
+        sql = sql_append_fixed(sql, row->amount, row->stock_prec, true);
+        sql = sql_append_fixed(sql, row->deal, row->value_prec, true);
+        sql = sql_append_fixed(sql, row->fee, row->value_prec, true);
+        sql = sql_append_fixed(sql, row->deal_fee, row->value_prec, false);
+        sql = sdscatprintf(sql, ")");
+    }
+    return sql;
+}
+
+static sds render_user_deal(sds sql, uint32_t hash, struct deal_row *rows, size_t count)
+{
+    sql = sdscatprintf(sql, "INSERT INTO `user_deal_history_%u` (`id`, `time`, `user_id`, `market`, `deal_id`, `order_id`, `deal_order_id`, `side`, `role`, `price`, `amount`, `deal`, `fee`, `deal_fee`) VALUES ", hash);
+    for (size_t i = 0; i < count; ++i) {
+        struct deal_row *row = &rows[i];
+        if (i > 0) {
+            sql = sdscatprintf(sql, ", ");
+        }
+        sql = sdscatprintf(sql, "(NULL, %f, %u, '%s', %"PRIu64", %"PRIu64", %"PRIu64", %d, %d, ", row->t, row->user_id, row->market, row->deal_id, row->order_id, row->deal_order_id, row->side, row->role);
+        sql = sql_append_fixed(sql, row->price, row->money_prec, true);
+        sql = sql_append_fixed(sql, row->amount, row->stock_prec, true);
+        sql = sql_append_fixed(sql, row->deal, row->value_prec, true);
+        sql = sql_append_fixed(sql, row->fee, row->value_prec, true);
+        sql = sql_append_fixed(sql, row->deal_fee, row->value_prec, false);
+        sql = sdscatprintf(sql, ")");
+    }
+    return sql;
+}
+
+// the same text as json_dumps of the detail object with JSON_SORT_KEYS
+static sds render_trade_detail(sds detail, struct balance_row *row)
+{
+    char price[FIXED_STR_MAX_LEN];
+    char amount[FIXED_STR_MAX_LEN];
+    fixed_format(price, row->price, row->money_prec);
+    fixed_format(amount, row->amount, row->stock_prec);
+    if (row->detail_type == BALANCE_DETAIL_TRADE_FEE) {
+        char fee_rate[FIXED_STR_MAX_LEN];
+        fixed_format(fee_rate, row->fee_rate, row->fee_prec);
+        return sdscatprintf(detail, "{\"a\": \"%s\", \"f\": \"%s\", \"i\": %"PRIu64", \"m\": \"%s\", \"p\": \"%s\"}",
+                amount, fee_rate, row->order_id, row->market, price);
+    }
+    return sdscatprintf(detail, "{\"a\": \"%s\", \"i\": %"PRIu64", \"m\": \"%s\", \"p\": \"%s\"}",
+            amount, row->order_id, row->market, price);
+}
+
+static sds render_user_balance(sds sql, MYSQL *conn, uint32_t hash, struct balance_row *rows, size_t count)
+{
+    sql = sdscatprintf(sql, "INSERT INTO `balance_history_%u` (`id`, `time`, `user_id`, `asset`, `business`, `change`, `balance`, `detail`) VALUES ", hash);
+    char buf[10 * 1024];
+    sds detail = sdsempty();
+    for (size_t i = 0; i < count; ++i) {
+        struct balance_row *row = &rows[i];
+        if (i > 0) {
+            sql = sdscatprintf(sql, ", ");
+        }
+        sql = sdscatprintf(sql, "(NULL, %f, %u, '%s', '%s', ", row->t, row->user_id, row->asset, row->business);
+        if (row->change_mpd) {
+            sql = sql_append_mpd(sql, row->change_mpd, true);
+        } else {
+            sql = sql_append_fixed(sql, row->change, row->change_prec, true);
+        }
+        sql = sql_append_mpd(sql, row->balance, true);
+
+        sdsclear(detail);
+        if (row->detail_type == BALANCE_DETAIL_TEXT) {
+            detail = sdscat(detail, row->detail);
+        } else {
+            detail = render_trade_detail(detail, row);
+        }
+        mysql_real_escape_string(conn, buf, detail, sdslen(detail));
+        sql = sdscatprintf(sql, "'%s')", buf);
+    }
+    sdsfree(detail);
+    return sql;
+}
+
+static sds render_rows(MYSQL *conn, struct history_job *req)
+{
+    uint32_t hash = req->key.hash;
+    size_t count = sdslen(req->rows) / row_size(req->key.type);
+    sds sql = sdsempty();
+    switch (req->key.type) {
+    case HISTORY_USER_BALANCE:
+        return render_user_balance(sql, conn, hash, (struct balance_row *)req->rows, count);
+    case HISTORY_USER_ORDER:
+        return render_order(sql, "order_history", hash, (struct order_row *)req->rows, count);
+    case HISTORY_ORDER_DETAIL:
+        return render_order(sql, "order_detail", hash, (struct order_row *)req->rows, count);
+    case HISTORY_USER_DEAL:
+        return render_user_deal(sql, hash, (struct deal_row *)req->rows, count);
+    case HISTORY_ORDER_DEAL:
+        return render_order_deal(sql, hash, (struct deal_row *)req->rows, count);
+    }
+    return sql;
+}
+
 static void on_job(nw_job_entry *entry, void *privdata)
 {
     MYSQL *conn = privdata;
-    sds sql = entry->request;
+    sds sql = render_rows(conn, entry->request);
     log_trace("exec sql: %s", sql);
     while (true) {
         int ret = mysql_real_query(conn, sql, sdslen(sql));
@@ -66,11 +308,29 @@ static void on_job(nw_job_entry *entry, void *privdata)
         }
         break;
     }
+    sdsfree(sql);
+}
+
+static void free_rows(uint32_t type, sds rows)
+{
+    if (type == HISTORY_USER_BALANCE) {
+        struct balance_row *row = (struct balance_row *)rows;
+        size_t count = sdslen(rows) / sizeof(struct balance_row);
+        for (size_t i = 0; i < count; ++i) {
+            if (row[i].change_mpd)
+                mpd_del(row[i].change_mpd);
+            mpd_del(row[i].balance);
+            free(row[i].detail);
+        }
+    }
+    sdsfree(rows);
 }
 
 static void on_job_cleanup(nw_job_entry *entry)
 {
-    sdsfree(entry->request);
+    struct history_job *req = entry->request;
+    free_rows(req->key.type, req->rows);
+    free(req);
 }
 
 static void on_job_release(void *privdata)
@@ -84,7 +344,10 @@ static void on_timer(nw_timer *t, void *privdata)
     dict_iterator *iter = dict_get_iterator(dict_sql);
     dict_entry *entry;
     while ((entry = dict_next(iter)) != NULL) {
-        nw_job_add(job, 0, entry->val);
+        struct history_job *req = malloc(sizeof(struct history_job));
+        memcpy(&req->key, entry->key, sizeof(struct dict_sql_key));
+        req->rows = entry->val;
+        nw_job_add(job, 0, req);
         dict_delete(dict_sql, entry->key);
         count++;
     }
@@ -97,12 +360,6 @@ static void on_timer(nw_timer *t, void *privdata)
 
 int init_history(void)
 {
-    mysql_conn = mysql_init(NULL);
-    if (mysql_conn == NULL)
-        return -__LINE__;
-    if (mysql_options(mysql_conn, MYSQL_SET_CHARSET_NAME, settings.db_history.charset) != 0)
-        return -__LINE__;
-
     dict_types dt;
     memset(&dt, 0, sizeof(dt));
     dt.hash_function  = dict_sql_hash_function;
@@ -142,212 +399,147 @@ int fini_history(void)
     return 0;
 }
 
-static sds sql_append_mpd(sds sql, mpd_t *val, bool comma)
-{
-    char *str = mpd_to_sci(val, 0);
-    sql = sdscatprintf(sql, "'%s'", str);
-    if (comma) {
-        sql = sdscatprintf(sql, ", ");
-    }
-    free(str);
-    return sql;
-}
-
-static sds get_sql(struct dict_sql_key *key)
-{
-    dict_entry *entry = dict_find(dict_sql, key);
-    if (!entry) {
-        sds val = sdsempty();
-        entry = dict_add(dict_sql, key, val);
-        if (entry == NULL) {
-            sdsfree(val);
-            return NULL;
-        }
-    }
-    return entry->val;
-}
-
-static void set_sql(struct dict_sql_key *key, sds sql)
-{
-    dict_entry *entry = dict_find(dict_sql, key);
-    if (entry) {
-        entry->val = sql;
-    }
-}
-
-static int append_user_order(order_t *order)
+static int append_row(uint32_t type, uint32_t hash, const void *row, size_t size)
 {
     struct dict_sql_key key;
-    key.hash = order->user_id % HISTORY_HASH_NUM;
-    key.type = HISTORY_USER_ORDER;
-    sds sql = get_sql(&key);
-    if (sql == NULL)
-        return -__LINE__;
-
-    if (sdslen(sql) == 0) {
-        sql = sdscatprintf(sql, "INSERT INTO `order_history_%u` (`id`, `create_time`, `finish_time`, `user_id`, "
-                "`market`, `source`, `t`, `side`, `price`, `amount`, `taker_fee`, `maker_fee`, `deal_stock`, `deal_money`, `deal_fee`) VALUES ", key.hash);
-    } else {
-        sql = sdscatprintf(sql, ", ");
+    key.hash = hash;
+    key.type = type;
+    dict_entry *entry = dict_find(dict_sql, &key);
+    if (!entry) {
+        entry = dict_add(dict_sql, &key, sdsempty());
+        if (entry == NULL)
+            return -__LINE__;
     }
-
-    sql = sdscatprintf(sql, "(%"PRIu64", %f, %f, %u, '%s', '%s', %u, %u, ", order->id,
-        order->create_time, order->update_time, order->user_id, order->market, order->source, order->type, order->side);
-    sql = sql_append_mpd(sql, order->price, true);
-    sql = sql_append_mpd(sql, order->amount, true);
-    sql = sql_append_mpd(sql, order->taker_fee, true);
-    sql = sql_append_mpd(sql, order->maker_fee, true);
-    sql = sql_append_mpd(sql, order->deal_stock, true);
-    sql = sql_append_mpd(sql, order->deal_money, true);
-    sql = sql_append_mpd(sql, order->deal_fee, false);
-    sql = sdscatprintf(sql, ")");
-
-    set_sql(&key, sql);
+    entry->val = sdscatlen(entry->val, row, size);
 
     return 0;
 }
 
-static int append_order_detail(order_t *order)
+static void order_row_init(struct order_row *row, market_t *m, order_t *order)
 {
-    struct dict_sql_key key;
-    key.hash = order->id % HISTORY_HASH_NUM;
-    key.type = HISTORY_ORDER_DETAIL;
-    sds sql = get_sql(&key);
-    if (sql == NULL)
-        return -__LINE__;
-
-    if (sdslen(sql) == 0) {
-        sql = sdscatprintf(sql, "INSERT INTO `order_detail_%u` (`id`, `create_time`, `finish_time`, `user_id`, "
-                "`market`, `source`, `t`, `side`, `price`, `amount`, `taker_fee`, `maker_fee`, `deal_stock`, `deal_money`, `deal_fee`) VALUES ", key.hash);
-    } else {
-        sql = sdscatprintf(sql, ", ");
-    }
-
-    sql = sdscatprintf(sql, "(%"PRIu64", %f, %f, %u, '%s', '%s', %u, %u, ", order->id,
-        order->create_time, order->update_time, order->user_id, order->market, order->source, order->type, order->side);
-    sql = sql_append_mpd(sql, order->price, true);
-    sql = sql_append_mpd(sql, order->amount, true);
-    sql = sql_append_mpd(sql, order->taker_fee, true);
-    sql = sql_append_mpd(sql, order->maker_fee, true);
-    sql = sql_append_mpd(sql, order->deal_stock, true);
-    sql = sql_append_mpd(sql, order->deal_money, true);
-    sql = sql_append_mpd(sql, order->deal_fee, false);
-    sql = sdscatprintf(sql, ")");
-
-    set_sql(&key, sql);
-
-    return 0;
+    memset(row, 0, sizeof(struct order_row));
+    row->id          = order->id;
+    row->create_time = order->create_time;
+    row->finish_time = order->update_time;
+    row->user_id     = order->user_id;
+    row->market      = m->name;
+    strncpy(row->source, order->source, SOURCE_MAX_LEN);
+    row->type        = order->type;
+    row->side        = order->side;
+    row->price       = order->price;
+    row->amount      = order->amount;
+    row->taker_fee   = order->taker_fee;
+    row->maker_fee   = order->maker_fee;
+    row->deal_stock  = order->deal_stock;
+    row->deal_money  = order->deal_money;
+    row->deal_fee    = order->deal_fee;
+    row->money_prec  = m->money_prec;
+    row->amount_prec = order_amount_prec(m, order);
+    row->fee_prec    = m->fee_prec;
+    row->stock_prec  = m->stock_prec;
+    row->value_prec  = m->value_prec;
 }
 
-static int append_order_deal(double t, uint32_t user_id, uint64_t deal_id, uint64_t order_id, uint64_t deal_order_id, int role, mpd_t *price, mpd_t *amount, mpd_t *deal, mpd_t *fee, mpd_t *deal_fee)
+static void deal_row_init(struct deal_row *row, market_t *m, double t, uint64_t deal_id, order_t *order, order_t *deal_order, int role,
+        int64_t price, int64_t amount, int64_t deal, int64_t fee, int64_t deal_fee)
 {
-    struct dict_sql_key key;
-    key.hash = order_id % HISTORY_HASH_NUM;
-    key.type = HISTORY_ORDER_DEAL;
-    sds sql = get_sql(&key);
-    if (sql == NULL)
-        return -__LINE__;
-
-    if (sdslen(sql) == 0) {
-        sql = sdscatprintf(sql, "INSERT INTO `deal_history_%u` (`id`, `time`, `user_id`, `deal_id`, `order_id`, `deal_order_id`, `role`, `price`, `amount`, `deal`, `fee`, `deal_fee`) VALUES ", key.hash);
-    } else {
-        sql = sdscatprintf(sql, ", ");
-    }
-
-    sql = sdscatprintf(sql, "(NULL, %f, %u, %"PRIu64", %"PRIu64", %"PRIu64", %d, ", t, user_id, deal_id, order_id, deal_order_id, role);
-    sql = sql_append_mpd(sql, price, true);
-    sql = sql_append_mpd(sql, amount, true);
-    sql = sql_append_mpd(sql, deal, true);
-    sql = sql_append_mpd(sql, fee, true);
-    sql = sql_append_mpd(sql, deal_fee, false);
-    sql = sdscatprintf(sql, ")");
-
-    set_sql(&key, sql);
-
-    return 0;
+    memset(row, 0, sizeof(struct deal_row));
+    row->t             = t;
+    row->user_id       = order->user_id;
+    row->market        = m->name;
+    row->deal_id       = deal_id;
+    row->order_id      = order->id;
+    row->deal_order_id = deal_order->id;
+    row->side          = order->side;
+    row->role          = role;
+    row->price         = price;
+    row->amount        = amount;
+    row->deal          = deal;
+    row->fee           = fee;
+    row->deal_fee      = deal_fee;
+    row->money_prec    = m->money_prec;
+    row->stock_prec    = m->stock_prec;
+    row->value_prec    = m->value_prec;
 }
 
-static int append_user_deal(double t, uint32_t user_id, const char *market, uint64_t deal_id, uint64_t order_id, uint64_t deal_order_id, int side, int role, mpd_t *price, mpd_t *amount, mpd_t *deal, mpd_t *fee, mpd_t *deal_fee)
+static int append_balance_row(struct balance_row *row)
 {
-    struct dict_sql_key key;
-    key.hash = user_id % HISTORY_HASH_NUM;
-    key.type = HISTORY_USER_DEAL;
-    sds sql = get_sql(&key);
-    if (sql == NULL)
-        return -__LINE__;
-
-    if (sdslen(sql) == 0) {
-        sql = sdscatprintf(sql, "INSERT INTO `user_deal_history_%u` (`id`, `time`, `user_id`, `market`, `deal_id`, `order_id`, `deal_order_id`, `side`, `role`, `price`, `amount`, `deal`, `fee`, `deal_fee`) VALUES ", key.hash);
-    } else {
-        sql = sdscatprintf(sql, ", ");
+    int ret = append_row(HISTORY_USER_BALANCE, row->user_id % HISTORY_HASH_NUM, row, sizeof(struct balance_row));
+    if (ret < 0) {
+        if (row->change_mpd)
+            mpd_del(row->change_mpd);
+        mpd_del(row->balance);
+        free(row->detail);
     }
-
-    sql = sdscatprintf(sql, "(NULL, %f, %u, '%s', %"PRIu64", %"PRIu64", %"PRIu64", %d, %d, ", t, user_id, market, deal_id, order_id, deal_order_id, side, role);
-    sql = sql_append_mpd(sql, price, true);
-    sql = sql_append_mpd(sql, amount, true);
-    sql = sql_append_mpd(sql, deal, true);
-    sql = sql_append_mpd(sql, fee, true);
-    sql = sql_append_mpd(sql, deal_fee, false);
-    sql = sdscatprintf(sql, ")");
-
-    set_sql(&key, sql);
-
-    return 0;
+    return ret;
 }
 
-static int append_user_balance(double t, uint32_t user_id, const char *asset, const char *business, mpd_t *change, mpd_t *balance, const char *detail)
+int append_order_history(market_t *m, order_t *order)
 {
-    struct dict_sql_key key;
-    key.hash = user_id % HISTORY_HASH_NUM;
-    key.type = HISTORY_USER_BALANCE;
-    sds sql = get_sql(&key);
-    if (sql == NULL)
-        return -__LINE__;
-
-    if (sdslen(sql) == 0) {
-        sql = sdscatprintf(sql, "INSERT INTO `balance_history_%u` (`id`, `time`, `user_id`, `asset`, `business`, `change`, `balance`, `detail`) VALUES ", key.hash);
-    } else {
-        sql = sdscatprintf(sql, ", ");
-    }
-
-    char buf[10 * 1024];
-    sql = sdscatprintf(sql, "(NULL, %f, %u, '%s', '%s', ", t, user_id, asset, business);
-    sql = sql_append_mpd(sql, change, true);
-    sql = sql_append_mpd(sql, balance, true);
-    mysql_real_escape_string(mysql_conn, buf, detail, strlen(detail));
-    sql = sdscatprintf(sql, "'%s')", buf);
-
-    set_sql(&key, sql);
+    struct order_row row;
+    order_row_init(&row, m, order);
+    append_row(HISTORY_USER_ORDER, order->user_id % HISTORY_HASH_NUM, &row, sizeof(row));
+    append_row(HISTORY_ORDER_DETAIL, order->id % HISTORY_HASH_NUM, &row, sizeof(row));
 
     return 0;
 }
 
-int append_order_history(order_t *order)
+int append_order_deal_history(market_t *m, double t, uint64_t deal_id, order_t *ask, int ask_role, order_t *bid, int bid_role,
+        int64_t price, int64_t amount, int64_t deal, int64_t ask_fee, int64_t bid_fee)
 {
-    append_user_order(order);
-    append_order_detail(order);
+    struct deal_row ask_row;
+    struct deal_row bid_row;
+    deal_row_init(&ask_row, m, t, deal_id, ask, bid, ask_role, price, amount, deal, ask_fee, bid_fee);
+    deal_row_init(&bid_row, m, t, deal_id, bid, ask, bid_role, price, amount, deal, bid_fee, ask_fee);
 
-    return 0;
-}
+    append_row(HISTORY_ORDER_DEAL, ask->id % HISTORY_HASH_NUM, &ask_row, sizeof(ask_row));
+    append_row(HISTORY_ORDER_DEAL, bid->id % HISTORY_HASH_NUM, &bid_row, sizeof(bid_row));
 
-int append_order_deal_history(double t, uint64_t deal_id, order_t *ask, int ask_role, order_t *bid, int bid_role, mpd_t *price, mpd_t *amount, mpd_t *deal, mpd_t *ask_fee, mpd_t *bid_fee)
-{
-    append_order_deal(t, ask->user_id, deal_id, ask->id, bid->id, ask_role, price, amount, deal, ask_fee, bid_fee);
-    append_order_deal(t, bid->user_id, deal_id, bid->id, ask->id, bid_role, price, amount, deal, bid_fee, ask_fee);
-
-    append_user_deal(t, ask->user_id, ask->market, deal_id, ask->id, bid->id, ask->side, ask_role, price, amount, deal, ask_fee, bid_fee);
-    append_user_deal(t, bid->user_id, ask->market, deal_id, bid->id, ask->id, bid->side, bid_role, price, amount, deal, bid_fee, ask_fee);
+    append_row(HISTORY_USER_DEAL, ask->user_id % HISTORY_HASH_NUM, &ask_row, sizeof(ask_row));
+    append_row(HISTORY_USER_DEAL, bid->user_id % HISTORY_HASH_NUM, &bid_row, sizeof(bid_row));
 
     return 0;
 }
 
 int append_user_balance_history(double t, uint32_t user_id, const char *asset, const char *business, mpd_t *change, const char *detail)
 {
-    mpd_t *balance = balance_total(user_id, asset);
-    append_user_balance(t, user_id, asset, business, change, balance, detail);
-    mpd_del(balance);
+    struct balance_row row;
+    memset(&row, 0, sizeof(row));
+    row.t = t;
+    row.user_id = user_id;
+    strncpy(row.asset, asset, ASSET_NAME_MAX_LEN);
+    strncpy(row.business, business, BUSINESS_NAME_MAX_LEN);
+    row.change_mpd = mpd_qncopy(change);
+    row.balance = balance_total(user_id, asset);
+    row.detail_type = BALANCE_DETAIL_TEXT;
+    row.detail = strdup(detail);
+
+    return append_balance_row(&row);
+}
 
-    return 0;
+int append_user_balance_trade_history(market_t *m, order_t *order, const char *asset, int64_t change, int prec,
+        int64_t price, int64_t amount, bool has_fee, int64_t fee_rate)
+{
+    struct balance_row row;
+    memset(&row, 0, sizeof(row));
+    row.t = order->update_time;
+    row.user_id = order->user_id;
+    strncpy(row.asset, asset, ASSET_NAME_MAX_LEN);
+    strncpy(row.business, "trade", BUSINESS_NAME_MAX_LEN);
+    row.change = change;
+    row.change_prec = prec;
+    row.balance = balance_total(order->user_id, asset);
+    row.detail_type = has_fee ? BALANCE_DETAIL_TRADE_FEE : BALANCE_DETAIL_TRADE;
+    row.market = m->name;
+    row.order_id = order->id;
+    row.price = price;
+    row.amount = amount;
+    row.fee_rate = fee_rate;
+    row.money_prec = m->money_prec;
+    row.stock_prec = m->stock_prec;
+    row.fee_prec = m->fee_prec;
+
+    return append_balance_row(&row);
 }
 
 bool is_history_block(void)
@@ -11,9 +11,13 @@
 int init_history(void);
 int fini_history(void);
 
-int append_order_history(order_t *order);
-int append_order_deal_history(double t, uint64_t deal_id, order_t *ask, int ask_role, order_t *bid, int bid_role, mpd_t *price, mpd_t *amount, mpd_t *deal, mpd_t *ask_fee, mpd_t *bid_fee);
+int append_order_history(market_t *m, order_t *order);
+int append_order_deal_history(market_t *m, double t, uint64_t deal_id, order_t *ask, int ask_role, order_t *bid, int bid_role,
+        int64_t price, int64_t amount, int64_t deal, int64_t ask_fee, int64_t bid_fee);
 int append_user_balance_history(double t, uint32_t user_id, const char *asset, const char *business, mpd_t *change, const char *detail);
+/* the balance change of a fill, its detail is rendered by the history thread */
+int append_user_balance_trade_history(market_t *m, order_t *order, const char *asset, int64_t change, int prec,
+        int64_t price, int64_t amount, bool has_fee, int64_t fee_rate);
 
 bool is_history_block(void);
 sds history_status(sds reply);
@@ -36,33 +36,39 @@ int load_orders(MYSQL *conn, const char *table)
             if (market == NULL)
                 continue;
 
-            order_t *order = malloc(sizeof(order_t));
-            memset(order, 0, sizeof(order_t));
+            order_t *order = market_new_order(market);
+            if (order == NULL) {
+                mysql_free_result(result);
+                return -__LINE__;
+            }
             order->id = strtoull(row[0], NULL, 0);
             order->type = strtoul(row[1], NULL, 0);
             order->side = strtoul(row[2], NULL, 0);
             order->create_time = strtod(row[3], NULL);
             order->update_time = strtod(row[4], NULL);
             order->user_id = strtoul(row[5], NULL, 0);
-            order->market = strdup(row[6]);
-            order->price = decimal(row[7], market->money_prec);
-            order->amount = decimal(row[8], market->stock_prec);
-            order->taker_fee = decimal(row[9], market->fee_prec);
-            order->maker_fee = decimal(row[10], market->fee_prec);
-            order->left = decimal(row[11], market->stock_prec);
-            order->freeze = decimal(row[12], 0);
-            order->deal_stock = decimal(row[13], 0);
-            order->deal_money = decimal(row[14], 0);
-            order->deal_fee = decimal(row[15], 0);
-
-            if (!order->market || !order->price || !order->amount || !order->taker_fee || !order->maker_fee || !order->left ||
-                    !order->freeze || !order->deal_stock || !order->deal_money || !order->deal_fee) {
+            if (fixed_parse(row[7], market->money_prec, &order->price) < 0 ||
+                    fixed_parse(row[8], market->stock_prec, &order->amount) < 0 ||
+                    fixed_parse(row[9], market->fee_prec, &order->taker_fee) < 0 ||
+                    fixed_parse(row[10], market->fee_prec, &order->maker_fee) < 0 ||
+                    fixed_parse(row[11], market->stock_prec, &order->left) < 0 ||
+                    fixed_parse(row[12], market->value_prec, &order->freeze) < 0 ||
+                    fixed_parse(row[13], market->stock_prec, &order->deal_stock) < 0 ||
+                    fixed_parse(row[14], market->value_prec, &order->deal_money) < 0 ||
+                    fixed_parse(row[15], market->value_prec, &order->deal_fee) < 0) {
                 log_error("get order detail of order id: %"PRIu64" fail", order->id);
                 mysql_free_result(result);
                 return -__LINE__;
             }
 
-            market_put_order(market, order);
+            // the table has no seq, ids give the same time priority
+            order->seq = order->id;
+            ret = market_restore_order(market, order);
+            if (ret < 0) {
+                log_error("market_restore_order market: %s, order: %"PRIu64" fail: %d", market->name, order->id, ret);
+                mysql_free_result(result);
+                return -__LINE__;
+            }
         }
         mysql_free_result(result);
 
@@ -229,74 +235,42 @@ static int load_limit_order(json_t *params)
     if (side != MARKET_ORDER_SIDE_ASK && side != MARKET_ORDER_SIDE_BID)
         return -__LINE__;
 
-    mpd_t *amount = NULL;
-    mpd_t *price  = NULL;
-    mpd_t *taker_fee = NULL;
-    mpd_t *maker_fee = NULL;
+    int64_t amount, price, taker_fee, maker_fee;
 
     // amount
     if (!json_is_string(json_array_get(params, 3)))
-        goto error;
-    amount = decimal(json_string_value(json_array_get(params, 3)), market->stock_prec);
-    if (amount == NULL)
-        goto error;
-    if (mpd_cmp(amount, mpd_zero, &mpd_ctx) <= 0)
-        goto error;
-
-    // price 
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 3)), market->stock_prec, &amount) < 0 || amount <= 0)
+        return -__LINE__;
+
+    // price
     if (!json_is_string(json_array_get(params, 4)))
-        goto error;
-    price = decimal(json_string_value(json_array_get(params, 4)), market->money_prec);
-    if (price == NULL) 
-        goto error;
-    if (mpd_cmp(price, mpd_zero, &mpd_ctx) <= 0)
-        goto error;
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 4)), market->money_prec, &price) < 0 || price <= 0)
+        return -__LINE__;
 
     // taker fee
     if (!json_is_string(json_array_get(params, 5)))
-        goto error;
-    taker_fee = decimal(json_string_value(json_array_get(params, 5)), market->fee_prec);
-    if (taker_fee == NULL)
-        goto error;
-    if (mpd_cmp(taker_fee, mpd_zero, &mpd_ctx) < 0 || mpd_cmp(taker_fee, mpd_one, &mpd_ctx) >= 0)
-        goto error;
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 5)), market->fee_prec, &taker_fee) < 0 ||
+            taker_fee < 0 || taker_fee >= fixed_pow10[market->fee_prec])
+        return -__LINE__;
 
     // maker fee
     if (!json_is_string(json_array_get(params, 6)))
-        goto error;
-    maker_fee = decimal(json_string_value(json_array_get(params, 6)), market->fee_prec);
-    if (maker_fee == NULL)
-        goto error;
-    if (mpd_cmp(maker_fee, mpd_zero, &mpd_ctx) < 0 || mpd_cmp(maker_fee, mpd_one, &mpd_ctx) >= 0)
-        goto error;
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 6)), market->fee_prec, &maker_fee) < 0 ||
+            maker_fee < 0 || maker_fee >= fixed_pow10[market->fee_prec])
+        return -__LINE__;
 
     // source
     if (!json_is_string(json_array_get(params, 7)))
-        goto error;
+        return -__LINE__;
     const char *source = json_string_value(json_array_get(params, 7));
     if (strlen(source) > SOURCE_MAX_LEN)
-        goto error;
-
-    int ret = market_put_limit_order(false, NULL, market, user_id, side, amount, price, taker_fee, maker_fee, source);
-
-    mpd_del(amount);
-    mpd_del(price);
-    mpd_del(taker_fee);
-    mpd_del(maker_fee);
-
-    return ret;
+        return -__LINE__;
 
-error:
-    if (amount)
-        mpd_del(amount);
-    if (price)
-        mpd_del(price);
-    if (taker_fee)
-        mpd_del(taker_fee);
-    if (maker_fee)
-        mpd_del(maker_fee);
-
-    return -__LINE__;
+    return market_put_limit_order(false, NULL, market, user_id, side, amount, price, taker_fee, maker_fee, source);
 }
 
 static int load_market_order(json_t *params)
@@ -324,48 +298,29 @@ static int load_market_order(json_t *params)
     if (side != MARKET_ORDER_SIDE_ASK && side != MARKET_ORDER_SIDE_BID)
         return -__LINE__;
 
-    mpd_t *amount = NULL;
-    mpd_t *taker_fee = NULL;
+    int64_t amount, taker_fee;
 
     // amount
     if (!json_is_string(json_array_get(params, 3)))
-        goto error;
-    amount = decimal(json_string_value(json_array_get(params, 3)), market->stock_prec);
-    if (amount == NULL)
-        goto error;
-    if (mpd_cmp(amount, mpd_zero, &mpd_ctx) <= 0)
-        goto error;
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 3)), market->stock_prec, &amount) < 0 || amount <= 0)
+        return -__LINE__;
 
     // taker fee
     if (!json_is_string(json_array_get(params, 4)))
-        goto error;
-    taker_fee = decimal(json_string_value(json_array_get(params, 4)), market->fee_prec);
-    if (taker_fee == NULL)
-        goto error;
-    if (mpd_cmp(taker_fee, mpd_zero, &mpd_ctx) < 0 || mpd_cmp(taker_fee, mpd_one, &mpd_ctx) >= 0)
-        goto error;
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 4)), market->fee_prec, &taker_fee) < 0 ||
+            taker_fee < 0 || taker_fee >= fixed_pow10[market->fee_prec])
+        return -__LINE__;
 
     // source
     if (!json_is_string(json_array_get(params, 5)))
-        goto error;
+        return -__LINE__;
     const char *source = json_string_value(json_array_get(params, 5));
     if (strlen(source) > SOURCE_MAX_LEN)
-        goto error;
-
-    int ret = market_put_market_order(false, NULL, market, user_id, side, amount, taker_fee, source);
-
-    mpd_del(amount);
-    mpd_del(taker_fee);
-
-    return ret;
-
-error:
-    if (amount)
-        mpd_del(amount);
-    if (taker_fee)
-        mpd_del(taker_fee);
+        return -__LINE__;
 
-    return -__LINE__;
+    return market_put_market_order(false, NULL, market, user_id, side, amount, taker_fee, source);
 }
 
 static int load_fok_order(json_t *params)
@@ -393,61 +348,35 @@ static int load_fok_order(json_t *params)
     if (side != MARKET_ORDER_SIDE_ASK && side != MARKET_ORDER_SIDE_BID)
         return -__LINE__;
 
-    mpd_t *amount = NULL;
-    mpd_t *price = NULL;
-    mpd_t *taker_fee = NULL;
+    int64_t amount, price, taker_fee;
 
     // amount
     if (!json_is_string(json_array_get(params, 3)))
-        goto error;
-    amount = decimal(json_string_value(json_array_get(params, 3)), market->stock_prec);
-    if (amount == NULL)
-        goto error;
-    if (mpd_cmp(amount, mpd_zero, &mpd_ctx) <= 0)
-        goto error;
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 3)), market->stock_prec, &amount) < 0 || amount <= 0)
+        return -__LINE__;
 
     // price
     if (!json_is_string(json_array_get(params, 4)))
-        goto error;
-    price = decimal(json_string_value(json_array_get(params, 4)), market->money_prec);
-    if (price == NULL)
-        goto error;
-    if (mpd_cmp(price, mpd_zero, &mpd_ctx) <= 0)
-        goto error;
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 4)), market->money_prec, &price) < 0 || price <= 0)
+        return -__LINE__;
 
     // taker fee
     if (!json_is_string(json_array_get(params, 5)))
-        goto error;
-    taker_fee = decimal(json_string_value(json_array_get(params, 5)), market->fee_prec);
-    if (taker_fee == NULL)
-        goto error;
-    if (mpd_cmp(taker_fee, mpd_zero, &mpd_ctx) < 0 || mpd_cmp(taker_fee, mpd_one, &mpd_ctx) >= 0)
-        goto error;
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 5)), market->fee_prec, &taker_fee) < 0 ||
+            taker_fee < 0 || taker_fee >= fixed_pow10[market->fee_prec])
+        return -__LINE__;
 
     // source
     if (!json_is_string(json_array_get(params, 6)))
-        goto error;
+        return -__LINE__;
     const char *source = json_string_value(json_array_get(params, 6));
     if (strlen(source) > SOURCE_MAX_LEN)
-        goto error;
-
-    int ret = market_put_fok_order(false, NULL, market, user_id, side, amount, price, taker_fee, source);
-
-    mpd_del(amount);
-    mpd_del(price);
-    mpd_del(taker_fee);
-
-    return ret;
-
-error:
-    if (amount)
-        mpd_del(amount);
-    if (price)
-        mpd_del(price);
-    if (taker_fee)
-        mpd_del(taker_fee);
+        return -__LINE__;
 
-    return -__LINE__;
+    return market_put_fok_order(false, NULL, market, user_id, side, amount, price, taker_fee, source);
 }
 
 static int load_aon_order(json_t *params)
@@ -475,74 +404,72 @@ static int load_aon_order(json_t *params)
     if (side != MARKET_ORDER_SIDE_ASK && side != MARKET_ORDER_SIDE_BID)
         return -__LINE__;
 
-    mpd_t *amount = NULL;
-    mpd_t *price = NULL;
-    mpd_t *taker_fee = NULL;
-    mpd_t *maker_fee = NULL;
+    int64_t amount, price, taker_fee, maker_fee;
 
     // amount
     if (!json_is_string(json_array_get(params, 3)))
-        goto error;
-    amount = decimal(json_string_value(json_array_get(params, 3)), market->stock_prec);
-    if (amount == NULL)
-        goto error;
-    if (mpd_cmp(amount, mpd_zero, &mpd_ctx) <= 0)
-        goto error;
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 3)), market->stock_prec, &amount) < 0 || amount <= 0)
+        return -__LINE__;
 
     // price
     if (!json_is_string(json_array_get(params, 4)))
-        goto error;
-    price = decimal(json_string_value(json_array_get(params, 4)), market->money_prec);
-    if (price == NULL)
-        goto error;
-    if (mpd_cmp(price, mpd_zero, &mpd_ctx) <= 0)
-        goto error;
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 4)), market->money_prec, &price) < 0 || price <= 0)
+        return -__LINE__;
 
     // taker fee
     if (!json_is_string(json_array_get(params, 5)))
-        goto error;
-    taker_fee = decimal(json_string_value(json_array_get(params, 5)), market->fee_prec);
-    if (taker_fee == NULL)
-        goto error;
-    if (mpd_cmp(taker_fee, mpd_zero, &mpd_ctx) < 0 || mpd_cmp(taker_fee, mpd_one, &mpd_ctx) >= 0)
-        goto error;
-    
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 5)), market->fee_prec, &taker_fee) < 0 ||
+            taker_fee < 0 || taker_fee >= fixed_pow10[market->fee_prec])
+        return -__LINE__;
+
     // maker fee
     if (!json_is_string(json_array_get(params, 6)))
-        goto error;
-    maker_fee = decimal(json_string_value(json_array_get(params, 6)), market->fee_prec);
-    if (maker_fee == NULL)
-        goto error;
-    if (mpd_cmp(maker_fee, mpd_zero, &mpd_ctx) < 0 || mpd_cmp(maker_fee, mpd_one, &mpd_ctx) >= 0)
-        goto error;
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 6)), market->fee_prec, &maker_fee) < 0 ||
+            maker_fee < 0 || maker_fee >= fixed_pow10[market->fee_prec])
+        return -__LINE__;
 
     // source
-    if (!json_is_string(json_array_get(params, 6)))
-        goto error;
-    const char *source = json_string_value(json_array_get(params, 6));
+    if (!json_is_string(json_array_get(params, 7)))
+        return -__LINE__;
+    const char *source = json_string_value(json_array_get(params, 7));
     if (strlen(source) > SOURCE_MAX_LEN)
-        goto error;
+        return -__LINE__;
+
+    return market_put_aon_order(false, NULL, market, user_id, side, amount, price, taker_fee, maker_fee, source);
+}
 
-    int ret = market_put_aon_order(false, NULL, market, user_id, side, amount, price, taker_fee, maker_fee, source);
+static int load_batch_order(json_t *params)
+{
+    if (json_array_size(params) != 2)
+        return -__LINE__;
 
-    mpd_del(amount);
-    mpd_del(price);
-    mpd_del(taker_fee);
-    mpd_del(maker_fee);
+    // user_id
+    if (!json_is_integer(json_array_get(params, 0)))
+        return -__LINE__;
+    uint32_t user_id = json_integer_value(json_array_get(params, 0));
 
-    return ret;
+    // orders
+    json_t *orders = json_array_get(params, 1);
+    if (!json_is_array(orders))
+        return -__LINE__;
+
+    for (size_t i = 0; i < json_array_size(orders); ++i) {
+        order_req req;
+        int ret = market_parse_order_req(json_array_get(orders, i), &req);
+        if (ret < 0)
+            return ret;
+        if (req.market == NULL)
+            continue;
+        ret = market_put_order_req(false, NULL, user_id, &req);
+        if (ret < 0)
+            return ret;
+    }
 
-error:
-    if (amount)
-        mpd_del(amount);
-    if (price)
-        mpd_del(price);
-    if (taker_fee)
-        mpd_del(taker_fee);
-    if (maker_fee)
-        mpd_del(maker_fee);
-
-    return -__LINE__;
+    return 0;
 }
 
 static int load_cancel_order(json_t *params)
@@ -582,7 +509,97 @@ static int load_cancel_order(json_t *params)
     return 0;
 }
 
-static int load_oper(json_t *detail)
+static int load_amend_order(json_t *params)
+{
+    if (json_array_size(params) != 5)
+        return -__LINE__;
+
+    // user_id
+    if (!json_is_integer(json_array_get(params, 0)))
+        return -__LINE__;
+    uint32_t user_id = json_integer_value(json_array_get(params, 0));
+
+    // market
+    if (!json_is_string(json_array_get(params, 1)))
+        return -__LINE__;
+    const char *market_name = json_string_value(json_array_get(params, 1));
+    market_t *market = get_market(market_name);
+    if (market == NULL)
+        return 0;
+
+    // order_id
+    if (!json_is_integer(json_array_get(params, 2)))
+        return -__LINE__;
+    uint64_t order_id = json_integer_value(json_array_get(params, 2));
+
+    int64_t amount, price;
+
+    // amount
+    if (!json_is_string(json_array_get(params, 3)))
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 3)), market->stock_prec, &amount) < 0 || amount <= 0)
+        return -__LINE__;
+
+    // price
+    if (!json_is_string(json_array_get(params, 4)))
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, 4)), market->money_prec, &price) < 0 || price <= 0)
+        return -__LINE__;
+
+    order_t *order = market_get_order(market, order_id);
+    if (order == NULL) {
+        return -__LINE__;
+    }
+
+    int ret = market_amend_order(false, NULL, market, order, amount, price);
+    if (ret < 0) {
+        log_error("market_amend_order id: %"PRIu64", user id: %u, market: %s fail: %d", order_id, user_id, market_name, ret);
+        return -__LINE__;
+    }
+
+    return 0;
+}
+
+static int load_cancel_all(json_t *params)
+{
+    if (json_array_size(params) != 3)
+        return -__LINE__;
+
+    // user_id
+    if (!json_is_integer(json_array_get(params, 0)))
+        return -__LINE__;
+    uint32_t user_id = json_integer_value(json_array_get(params, 0));
+
+    // market
+    if (!json_is_string(json_array_get(params, 1)))
+        return -__LINE__;
+    const char *market_name = json_string_value(json_array_get(params, 1));
+    market_t *market = NULL;
+    if (strlen(market_name) > 0) {
+        market = get_market(market_name);
+        if (market == NULL)
+            return 0;
+    }
+
+    // side
+    if (!json_is_integer(json_array_get(params, 2)))
+        return -__LINE__;
+    uint32_t side = json_integer_value(json_array_get(params, 2));
+
+    int market_num = market ? 1 : settings.market_num;
+    for (int i = 0; i < market_num; ++i) {
+        market_t *m = market ? market : get_market(settings.markets[i].name);
+        int ret = market_cancel_user_orders(false, NULL, m, user_id, side);
+        if (ret < 0) {
+            log_error("market_cancel_user_orders user id: %u, market: %s fail: %d", user_id, m->name, ret);
+            return -__LINE__;
+        }
+    }
+
+    return 0;
+}
+
+int load_oper(json_t *detail)
 {
     const char *method = json_string_value(json_object_get(detail, "method"));
     if (method == NULL)
@@ -602,8 +619,14 @@ static int load_oper(json_t *detail)
         ret = load_aon_order(params);
     } else if (strcmp(method, "fok_order") == 0) {
         ret = load_fok_order(params);
+    } else if (strcmp(method, "batch_order") == 0) {
+        ret = load_batch_order(params);
     } else if (strcmp(method, "cancel_order") == 0) {
         ret = load_cancel_order(params);
+    } else if (strcmp(method, "amend_order") == 0) {
+        ret = load_amend_order(params);
+    } else if (strcmp(method, "cancel_all") == 0) {
+        ret = load_cancel_all(params);
     } else {
         return -__LINE__;
     }
@@ -7,11 +7,13 @@
 # define _ME_LOAD_H_
 
 # include <stdint.h>
+# include <jansson.h>
 # include "ut_mysql.h"
 
 int load_orders(MYSQL *conn, const char *table);
 int load_markets(MYSQL *conn, const char *table);
 int load_balance(MYSQL *conn, const char *table);
 int load_operlog(MYSQL *conn, const char *table, uint64_t *start_id);
+int load_oper(json_t *detail);
 
 # endif
@@ -70,6 +70,7 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    double start_time = current_timestamp();
     int ret;
     ret = init_mpd();
     if (ret < 0) {
@@ -139,8 +140,8 @@ int main(int argc, char *argv[])
     nw_timer_set(&cron_timer, 0.5, true, on_cron_check, NULL);
     nw_timer_start(&cron_timer);
 
-    log_vip("server start");
-    log_stderr("server start");
+    log_vip("server start, startup takes %.3f seconds", current_timestamp() - start_time);
+    log_stderr("server start, startup takes %.3f seconds", current_timestamp() - start_time);
     nw_loop_run();
     log_vip("server stop");
 
@@ -12,13 +12,24 @@
 
 uint64_t order_id_start;
 uint64_t deals_id_start;
+dict_t *dict_order_dirty;
 
 struct dict_user_key {
     uint32_t    user_id;
 };
 
-struct dict_order_key {
-    uint64_t    order_id;
+# define ORDER_SLAB_COUNT    1024
+# define LEVEL_SLAB_COUNT    256
+# define NODE_SLAB_COUNT     1024
+# define ENTRY_SLAB_COUNT    1024
+
+static slab_t *node_slabs[SKIPLIST_MAX_LEVEL + 1];
+static slab_t *entry_slab;
+static dict_t *dict_source;
+
+struct source_entry {
+    uint32_t    ref;
+    char        str[];
 };
 
 static uint32_t dict_user_hash_function(const void *key)
@@ -56,14 +67,14 @@ static void dict_user_val_free(void *key)
 
 static uint32_t dict_order_hash_function(const void *key)
 {
-    return dict_generic_hash_function(key, sizeof(struct dict_order_key));
+    return dict_generic_hash_function(key, sizeof(uint64_t));
 }
 
 static int dict_order_key_compare(const void *key1, const void *key2)
 {
-    const struct dict_order_key *obj1 = key1;
-    const struct dict_order_key *obj2 = key2;
-    if (obj1->order_id == obj2->order_id) {
+    const uint64_t *id1 = key1;
+    const uint64_t *id2 = key2;
+    if (*id1 == *id2) {
         return 0;
     }
     return 1;
@@ -71,8 +82,10 @@ static int dict_order_key_compare(const void *key1, const void *key2)
 
 static void *dict_order_key_dup(const void *key)
 {
-    struct dict_order_key *obj = malloc(sizeof(struct dict_order_key));
-    memcpy(obj, key, sizeof(struct dict_order_key));
+    uint64_t *obj = malloc(sizeof(uint64_t));
+    if (obj == NULL)
+        return NULL;
+    *obj = *(const uint64_t *)key;
     return obj;
 }
 
@@ -81,29 +94,148 @@ static void dict_order_key_free(void *key)
     free(key);
 }
 
-static int order_match_compare(const void *value1, const void *value2)
+struct depth_key {
+    uint32_t    side;
+    uint32_t    pad;
+    int64_t     price;
+};
+
+static uint32_t dict_depth_hash_function(const void *key)
 {
-    const order_t *order1 = value1;
-    const order_t *order2 = value2;
+    return dict_generic_hash_function(key, sizeof(struct depth_key));
+}
 
-    if (order1->id == order2->id) {
+static int dict_depth_key_compare(const void *key1, const void *key2)
+{
+    return memcmp(key1, key2, sizeof(struct depth_key));
+}
+
+static void *dict_depth_key_dup(const void *key)
+{
+    struct depth_key *obj = malloc(sizeof(struct depth_key));
+    memcpy(obj, key, sizeof(struct depth_key));
+    return obj;
+}
+
+static void dict_depth_key_free(void *key)
+{
+    free(key);
+}
+
+static uint32_t dict_source_hash_function(const void *key)
+{
+    return dict_generic_hash_function(key, strlen(key));
+}
+
+static int dict_source_key_compare(const void *key1, const void *key2)
+{
+    return strcmp(key1, key2);
+}
+
+static void dict_source_val_free(void *val)
+{
+    free(val);
+}
+
+static void *pool_node_alloc(int level)
+{
+    return slab_alloc(node_slabs[level]);
+}
+
+static void pool_node_free(void *node, int level)
+{
+    slab_free(node_slabs[level], node);
+}
+
+static void *pool_entry_alloc(void)
+{
+    return slab_alloc(entry_slab);
+}
+
+static void pool_entry_free(void *entry)
+{
+    slab_free(entry_slab, entry);
+}
+
+static int init_pool(void)
+{
+    if (entry_slab)
         return 0;
+
+    for (int i = 1; i <= SKIPLIST_MAX_LEVEL; ++i) {
+        node_slabs[i] = slab_create(sizeof(skiplist_node) + i * sizeof(skiplist_node *), NODE_SLAB_COUNT);
+        if (node_slabs[i] == NULL)
+            return -__LINE__;
     }
-    if (order1->type != order2->type) {
-        return 1;
-    }
+    entry_slab = slab_create(sizeof(dict_entry), ENTRY_SLAB_COUNT);
+    if (entry_slab == NULL)
+        return -__LINE__;
 
-    int cmp;
-    if (order1->side == MARKET_ORDER_SIDE_ASK) {
-        cmp = mpd_cmp(order1->price, order2->price, &mpd_ctx);
-    } else {
-        cmp = mpd_cmp(order2->price, order1->price, &mpd_ctx);
+    dict_types dt;
+    memset(&dt, 0, sizeof(dt));
+    dt.hash_function    = dict_source_hash_function;
+    dt.key_compare      = dict_source_key_compare;
+    dt.val_destructor   = dict_source_val_free;
+
+    dict_source = dict_create(&dt, 64);
+    if (dict_source == NULL)
+        return -__LINE__;
+
+    memset(&dt, 0, sizeof(dt));
+    dt.hash_function    = dict_order_hash_function;
+    dt.key_compare      = dict_order_key_compare;
+    dt.key_dup          = dict_order_key_dup;
+    dt.key_destructor   = dict_order_key_free;
+    dt.entry_alloc      = pool_entry_alloc;
+    dt.entry_free       = pool_entry_free;
+
+    dict_order_dirty = dict_create(&dt, 1024);
+    if (dict_order_dirty == NULL)
+        return -__LINE__;
+
+    return 0;
+}
+
+/* orders share one copy of each distinct source string */
+static char *source_intern(const char *source)
+{
+    if (source == NULL)
+        return NULL;
+
+    dict_entry *entry = dict_find(dict_source, source);
+    if (entry) {
+        struct source_entry *obj = entry->val;
+        obj->ref += 1;
+        return obj->str;
     }
-    if (cmp != 0) {
-        return cmp;
+
+    size_t len = strlen(source);
+    struct source_entry *obj = malloc(sizeof(struct source_entry) + len + 1);
+    if (obj == NULL)
+        return NULL;
+    obj->ref = 1;
+    memcpy(obj->str, source, len + 1);
+    if (dict_add(dict_source, obj->str, obj) == NULL) {
+        free(obj);
+        return NULL;
     }
 
-    return order1->id > order2->id ? 1 : -1;
+    return obj->str;
+}
+
+static void source_release(const char *source)
+{
+    if (source == NULL)
+        return;
+
+    dict_entry *entry = dict_find(dict_source, source);
+    if (entry) {
+        struct source_entry *obj = entry->val;
+        obj->ref -= 1;
+        if (obj->ref == 0) {
+            dict_delete(dict_source, source);
+        }
+    }
 }
 
 static int order_id_compare(const void *value1, const void *value2)
@@ -117,24 +249,86 @@ static int order_id_compare(const void *value1, const void *value2)
     return order1->id > order2->id ? -1 : 1;
 }
 
-static void order_free(order_t *order)
+static skiplist_t *order_list_create(void)
+{
+    skiplist_type type;
+    memset(&type, 0, sizeof(type));
+    type.compare    = order_id_compare;
+    type.node_alloc = pool_node_alloc;
+    type.node_free  = pool_node_free;
+
+    return skiplist_create(&type);
+}
+
+// matching stopped at a fill that could not be made, the order must not rest
+# define EXECUTE_STOPPED 1
+
+static int order_level_ask_compare(const void *value1, const void *value2)
+{
+    const order_level_t *level1 = value1;
+    const order_level_t *level2 = value2;
+
+    if (level1->price == level2->price) {
+        return 0;
+    }
+    return level1->price > level2->price ? 1 : -1;
+}
+
+static int order_level_bid_compare(const void *value1, const void *value2)
+{
+    const order_level_t *level1 = value1;
+    const order_level_t *level2 = value2;
+
+    if (level1->price == level2->price) {
+        return 0;
+    }
+    return level1->price < level2->price ? 1 : -1;
+}
+
+/* resting order put, changed or removed since the last slice */
+static void order_dirty(market_t *m, order_t *order)
+{
+    if (dict_find(dict_order_dirty, &order->id) == NULL) {
+        dict_add(dict_order_dirty, &order->id, m);
+    }
+}
+
+void market_clear_dirty(void)
+{
+    dict_clear(dict_order_dirty);
+}
+
+/* a price level was added, changed or removed */
+static void level_changed(market_t *m, uint32_t side, int64_t price)
+{
+    m->book_seq += 1;
+    if (!settings.depth_delta)
+        return;
+
+    struct depth_key key = { .side = side, .price = price };
+    if (dict_find(m->depth_dirty, &key) == NULL) {
+        dict_add(m->depth_dirty, &key, NULL);
+    }
+}
+
+static void order_free(market_t *m, order_t *order)
+{
+    source_release(order->source);
+    slab_free(m->order_slab, order);
+}
+
+int order_amount_prec(market_t *m, order_t *order)
 {
-    mpd_del(order->price);
-    mpd_del(order->amount);
-    mpd_del(order->taker_fee);
-    mpd_del(order->maker_fee);
-    mpd_del(order->left);
-    mpd_del(order->freeze);
-    mpd_del(order->deal_stock);
-    mpd_del(order->deal_money);
-    mpd_del(order->deal_fee);
-    free(order->market);
-    free(order->source);
-    free(order);
+    // market bid order amount is the money to spend
+    if (order->type == MARKET_ORDER_TYPE_MARKET && order->side == MARKET_ORDER_SIDE_BID)
+        return m->value_prec;
+    return m->stock_prec;
 }
 
-json_t *get_order_info(order_t *order)
+json_t *get_order_info(market_t *m, order_t *order)
 {
+    int amount_prec = order_amount_prec(m, order);
+
     json_t *info = json_object();
     json_object_set_new(info, "id", json_integer(order->id));
     json_object_set_new(info, "market", json_string(order->market));
@@ -145,25 +339,240 @@ json_t *get_order_info(order_t *order)
     json_object_set_new(info, "ctime", json_real(order->create_time));
     json_object_set_new(info, "mtime", json_real(order->update_time));
 
-    json_object_set_new_mpd(info, "price", order->price);
-    json_object_set_new_mpd(info, "amount", order->amount);
-    json_object_set_new_mpd(info, "taker_fee", order->taker_fee);
-    json_object_set_new_mpd(info, "maker_fee", order->maker_fee);
-    json_object_set_new_mpd(info, "left", order->left);
-    json_object_set_new_mpd(info, "deal_stock", order->deal_stock);
-    json_object_set_new_mpd(info, "deal_money", order->deal_money);
-    json_object_set_new_mpd(info, "deal_fee", order->deal_fee);
+    json_object_set_new_fixed(info, "price", order->price, m->money_prec);
+    json_object_set_new_fixed(info, "amount", order->amount, amount_prec);
+    json_object_set_new_fixed(info, "taker_fee", order->taker_fee, m->fee_prec);
+    json_object_set_new_fixed(info, "maker_fee", order->maker_fee, m->fee_prec);
+    json_object_set_new_fixed(info, "left", order->left, amount_prec);
+    json_object_set_new_fixed(info, "deal_stock", order->deal_stock, m->stock_prec);
+    json_object_set_new_fixed(info, "deal_money", order->deal_money, m->value_prec);
+    json_object_set_new_fixed(info, "deal_fee", order->deal_fee, m->value_prec);
 
     return info;
 }
 
-static int order_put(market_t *m, order_t *order)
+void write_order_info(json_writer *w, market_t *m, order_t *order)
+{
+    int amount_prec = order_amount_prec(m, order);
+
+    json_writer_object_begin(w);
+    json_writer_key(w, "id");
+    json_writer_int(w, order->id);
+    json_writer_key(w, "market");
+    json_writer_string(w, order->market);
+    json_writer_key(w, "source");
+    json_writer_string(w, order->source);
+    json_writer_key(w, "type");
+    json_writer_int(w, order->type);
+    json_writer_key(w, "side");
+    json_writer_int(w, order->side);
+    json_writer_key(w, "user");
+    json_writer_int(w, order->user_id);
+    json_writer_key(w, "ctime");
+    json_writer_real(w, order->create_time);
+    json_writer_key(w, "mtime");
+    json_writer_real(w, order->update_time);
+
+    json_writer_key(w, "price");
+    json_writer_fixed(w, order->price, m->money_prec);
+    json_writer_key(w, "amount");
+    json_writer_fixed(w, order->amount, amount_prec);
+    json_writer_key(w, "taker_fee");
+    json_writer_fixed(w, order->taker_fee, m->fee_prec);
+    json_writer_key(w, "maker_fee");
+    json_writer_fixed(w, order->maker_fee, m->fee_prec);
+    json_writer_key(w, "left");
+    json_writer_fixed(w, order->left, amount_prec);
+    json_writer_key(w, "deal_stock");
+    json_writer_fixed(w, order->deal_stock, m->stock_prec);
+    json_writer_key(w, "deal_money");
+    json_writer_fixed(w, order->deal_money, m->value_prec);
+    json_writer_key(w, "deal_fee");
+    json_writer_fixed(w, order->deal_fee, m->value_prec);
+    json_writer_object_end(w);
+}
+
+static int trade_deal(market_t *m, int64_t *deal, int64_t price, int64_t amount)
+{
+    return fixed_mul(deal, price, m->money_prec, amount, m->stock_prec, m->value_prec, FIXED_ROUND_DOWN);
+}
+
+static int stock_value(market_t *m, int64_t *value, int64_t amount)
+{
+    return fixed_rescale(value, amount, m->stock_prec, m->value_prec, FIXED_ROUND_DOWN);
+}
+
+// fee is rounded up to the asset precision, the same as the balance would charge
+static int money_fee(market_t *m, int64_t *fee, int64_t deal, int64_t rate)
+{
+    int64_t val;
+    if (fixed_mul(&val, deal, m->value_prec, rate, m->fee_prec, m->money_save, FIXED_ROUND_UP) < 0)
+        return -1;
+    return fixed_rescale(fee, val, m->money_save, m->value_prec, FIXED_ROUND_DOWN);
+}
+
+static int stock_fee(market_t *m, int64_t *fee, int64_t amount, int64_t rate)
+{
+    int64_t val;
+    if (fixed_mul(&val, amount, m->stock_prec, rate, m->fee_prec, m->stock_save, FIXED_ROUND_UP) < 0)
+        return -1;
+    return fixed_rescale(fee, val, m->stock_save, m->value_prec, FIXED_ROUND_DOWN);
+}
+
+// every value derived from the order must fit in the fixed point range, fee rate is less than 1
+static int check_order_value(market_t *m, int64_t amount, int64_t price)
+{
+    int64_t value;
+    if (stock_value(m, &value, amount) < 0)
+        return -1;
+    if (price == 0)
+        return 0;
+    if (trade_deal(m, &value, price, amount) < 0)
+        return -1;
+    return fixed_add(&value, value, value);
+}
+
+static bool balance_enough(uint32_t user_id, const char *asset, int64_t val, int prec)
+{
+    mpd_t *balance = balance_get(user_id, BALANCE_TYPE_AVAILABLE, asset);
+    if (balance == NULL)
+        return false;
+
+    FIXED_MPD(required);
+    bool ret = mpd_cmp(balance, fixed_to_mpd(&required, val, prec), &mpd_ctx) >= 0;
+    mpd_del(&required);
+    return ret;
+}
+
+static mpd_t *trade_balance_add(uint32_t user_id, uint32_t type, const char *asset, int64_t val, int prec)
+{
+    FIXED_MPD(amount);
+    mpd_t *ret = balance_add(user_id, type, asset, fixed_to_mpd(&amount, val, prec));
+    mpd_del(&amount);
+    return ret;
+}
+
+static mpd_t *trade_balance_sub(uint32_t user_id, uint32_t type, const char *asset, int64_t val, int prec)
+{
+    FIXED_MPD(amount);
+    mpd_t *ret = balance_sub(user_id, type, asset, fixed_to_mpd(&amount, val, prec));
+    mpd_del(&amount);
+    return ret;
+}
+
+static mpd_t *trade_balance_freeze(uint32_t user_id, const char *asset, int64_t val, int prec)
+{
+    FIXED_MPD(amount);
+    mpd_t *ret = balance_freeze(user_id, asset, fixed_to_mpd(&amount, val, prec));
+    mpd_del(&amount);
+    return ret;
+}
+
+static mpd_t *trade_balance_unfreeze(uint32_t user_id, const char *asset, int64_t val, int prec)
+{
+    FIXED_MPD(amount);
+    mpd_t *ret = balance_unfreeze(user_id, asset, fixed_to_mpd(&amount, val, prec));
+    mpd_del(&amount);
+    return ret;
+}
+
+static int order_level_add(market_t *m, order_t *order)
+{
+    skiplist_t *book = order->side == MARKET_ORDER_SIDE_ASK ? m->asks : m->bids;
+    order_level_t key = { .price = order->price };
+    order_level_t *level;
+    skiplist_node *node = skiplist_find(book, &key);
+    if (node) {
+        level = node->value;
+    } else {
+        level = slab_alloc(m->level_slab);
+        if (level == NULL)
+            return -__LINE__;
+        memset(level, 0, sizeof(order_level_t));
+        level->price = order->price;
+        if (skiplist_insert(book, level) == NULL) {
+            slab_free(m->level_slab, level);
+            return -__LINE__;
+        }
+    }
+
+    // a live order has the largest seq and goes to the tail, only orders restored from slice move up
+    order_t *prev = level->tail;
+    while (prev && prev->seq > order->seq) {
+        prev = prev->level_prev;
+    }
+    order->level_prev = prev;
+    order->level_next = prev ? prev->level_next : level->head;
+    if (order->level_next) {
+        order->level_next->level_prev = order;
+    } else {
+        level->tail = order;
+    }
+    if (prev) {
+        prev->level_next = order;
+    } else {
+        level->head = order;
+    }
+
+    order->level = level;
+    level->left += order->left;
+    level->count += 1;
+    level_changed(m, order->side, order->price);
+    if (order->side == MARKET_ORDER_SIDE_ASK) {
+        m->ask_count += 1;
+    } else {
+        m->bid_count += 1;
+    }
+
+    return 0;
+}
+
+static void order_level_remove(market_t *m, order_t *order)
+{
+    order_level_t *level = order->level;
+    if (order->level_prev) {
+        order->level_prev->level_next = order->level_next;
+    } else {
+        level->head = order->level_next;
+    }
+    if (order->level_next) {
+        order->level_next->level_prev = order->level_prev;
+    } else {
+        level->tail = order->level_prev;
+    }
+
+    level->left -= order->left;
+    level->count -= 1;
+    level_changed(m, order->side, order->price);
+    order->level = NULL;
+    order->level_prev = NULL;
+    order->level_next = NULL;
+
+    skiplist_t *book;
+    if (order->side == MARKET_ORDER_SIDE_ASK) {
+        book = m->asks;
+        m->ask_count -= 1;
+    } else {
+        book = m->bids;
+        m->bid_count -= 1;
+    }
+
+    if (level->count == 0) {
+        skiplist_node *node = skiplist_find(book, level);
+        if (node) {
+            skiplist_delete(book, node);
+        }
+        slab_free(m->level_slab, level);
+    }
+}
+
+// index a resting order in the market, its balance is not touched
+static int order_insert(market_t *m, order_t *order)
 {
     if (order->type != MARKET_ORDER_TYPE_LIMIT && order->type != MARKET_ORDER_TYPE_AON)
         return -__LINE__;
 
-    struct dict_order_key order_key = { .order_id = order->id };
-    if (dict_add(m->orders, &order_key, order) == NULL)
+    if (dict_add(m->orders, &order->id, order) == NULL)
         return -__LINE__;
 
     struct dict_user_key user_key = { .user_id = order->user_id };
@@ -173,10 +582,7 @@ static int order_put(market_t *m, order_t *order)
         if (skiplist_insert(order_list, order) == NULL)
             return -__LINE__;
     } else {
-        skiplist_type type;
-        memset(&type, 0, sizeof(type));
-        type.compare = order_id_compare;
-        skiplist_t *order_list = skiplist_create(&type);
+        skiplist_t *order_list = order_list_create();
         if (order_list == NULL)
             return -__LINE__;
         if (skiplist_insert(order_list, order) == NULL)
@@ -185,61 +591,51 @@ static int order_put(market_t *m, order_t *order)
             return -__LINE__;
     }
 
+    if (order_level_add(m, order) < 0)
+        return -__LINE__;
+    order_dirty(m, order);
+
+    return 0;
+}
+
+static int order_put(market_t *m, order_t *order)
+{
+    order->seq = ++m->order_seq;
+    int ret = order_insert(m, order);
+    if (ret < 0)
+        return ret;
+
     if (order->side == MARKET_ORDER_SIDE_ASK) {
-        if (skiplist_insert(m->asks, order) == NULL)
+        if (stock_value(m, &order->freeze, order->left) < 0)
             return -__LINE__;
-        mpd_copy(order->freeze, order->left, &mpd_ctx);
-        if (balance_freeze(order->user_id, m->stock, order->left) == NULL)
+        if (trade_balance_freeze(order->user_id, m->stock, order->freeze, m->value_prec) == NULL)
             return -__LINE__;
     } else {
-        if (skiplist_insert(m->bids, order) == NULL)
+        int64_t result, max_fee;
+        if (trade_deal(m, &result, order->price, order->left) < 0)
             return -__LINE__;
-        mpd_t *result = mpd_new(&mpd_ctx);
-        mpd_t *max_fee = mpd_new(&mpd_ctx);
-
-        mpd_mul(result, order->price, order->left, &mpd_ctx);
-        mpd_mul(max_fee, result, order->taker_fee, &mpd_ctx);
-        mpd_add(result, result, max_fee, &mpd_ctx);
-
-        mpd_copy(order->freeze, result, &mpd_ctx);
-        if (balance_freeze(order->user_id, m->money, result) == NULL) {
-            mpd_del(result);
+        if (money_fee(m, &max_fee, result, order->taker_fee) < 0)
+            return -__LINE__;
+        if (fixed_add(&result, result, max_fee) < 0)
             return -__LINE__;
-        }
 
-        mpd_del(result);
-        mpd_del(max_fee);
+        order->freeze = result;
+        if (trade_balance_freeze(order->user_id, m->money, result, m->value_prec) == NULL)
+            return -__LINE__;
     }
 
     return 0;
 }
 
-static int order_finish(bool real, market_t *m, order_t *order)
+// drop the order from the market, its freeze is left to the caller
+static int order_remove(bool real, market_t *m, order_t *order)
 {
-    if (order->side == MARKET_ORDER_SIDE_ASK) {
-        skiplist_node *node = skiplist_find(m->asks, order);
-        if (node) {
-            skiplist_delete(m->asks, node);
-        }
-        if (mpd_cmp(order->freeze, mpd_zero, &mpd_ctx) > 0) {
-            if (balance_unfreeze(order->user_id, m->stock, order->freeze) == NULL) {
-                return -__LINE__;
-            }
-        }
-    } else {
-        skiplist_node *node = skiplist_find(m->bids, order);
-        if (node) {
-            skiplist_delete(m->bids, node);
-        }
-        if (mpd_cmp(order->freeze, mpd_zero, &mpd_ctx) > 0) {
-            if (balance_unfreeze(order->user_id, m->money, order->freeze) == NULL) {
-                return -__LINE__;
-            }
-        }
+    if (order->level) {
+        order_level_remove(m, order);
+        order_dirty(m, order);
     }
 
-    struct dict_order_key order_key = { .order_id = order->id };
-    dict_delete(m->orders, &order_key);
+    dict_delete(m->orders, &order->id);
 
     struct dict_user_key user_key = { .user_id = order->user_id };
     dict_entry *entry = dict_find(m->users, &user_key);
@@ -249,27 +645,37 @@ static int order_finish(bool real, market_t *m, order_t *order)
         if (node) {
             skiplist_delete(order_list, node);
         }
-
-        mpd_t *balance = balance_total(order->user_id, m->name);
-        if (mpd_cmp(balance, mpd_zero, &mpd_ctx) == 0) {
-            // Remove from dict users if balance is zero
+        // the list goes with the last order of the user in the market
+        if (skiplist_len(order_list) == 0) {
             dict_delete(m->users, &user_key);
         }
     }
 
     if (real) {
-        if (mpd_cmp(order->deal_stock, mpd_zero, &mpd_ctx) > 0) {
-            int ret = append_order_history(order);
+        if (order->deal_stock > 0) {
+            int ret = append_order_history(m, order);
             if (ret < 0) {
                 log_fatal("append_order_history fail: %d, order: %"PRIu64"", ret, order->id);
             }
         }
     }
 
-    order_free(order);
+    order_free(m, order);
     return 0;
 }
 
+static int order_finish(bool real, market_t *m, order_t *order)
+{
+    if (order->freeze > 0) {
+        const char *asset = order->side == MARKET_ORDER_SIDE_ASK ? m->stock : m->money;
+        if (trade_balance_unfreeze(order->user_id, asset, order->freeze, m->value_prec) == NULL) {
+            return -__LINE__;
+        }
+    }
+
+    return order_remove(real, m, order);
+}
+
 market_t *market_create(struct market *conf)
 {
     if (!asset_exist(conf->stock) || !asset_exist(conf->money))
@@ -280,6 +686,10 @@ market_t *market_create(struct market *conf)
         return NULL;
     if (conf->money_prec + conf->fee_prec > asset_prec(conf->money))
         return NULL;
+    if (asset_prec(conf->stock) > FIXED_PREC_MAX || asset_prec(conf->money) > FIXED_PREC_MAX)
+        return NULL;
+    if (init_pool() < 0)
+        return NULL;
 
     market_t *m = malloc(sizeof(market_t));
     memset(m, 0, sizeof(market_t));
@@ -289,10 +699,23 @@ market_t *market_create(struct market *conf)
     m->stock_prec       = conf->stock_prec;
     m->money_prec       = conf->money_prec;
     m->fee_prec         = conf->fee_prec;
-    m->min_amount       = mpd_qncopy(conf->min_amount);
+    m->stock_save       = asset_prec(conf->stock);
+    m->money_save       = asset_prec(conf->money);
+    m->value_prec       = m->stock_save > m->money_save ? m->stock_save : m->money_save;
     m->last_price       = mpd_qncopy(conf->closing_price);
     m->closing_price    = mpd_qncopy(conf->closing_price);
     m->include_fee      = true;
+    // start from the time so the sequence keeps growing across restarts
+    m->book_seq         = (uint64_t)(current_timestamp() * 1000000);
+    m->depth_seq        = m->book_seq;
+
+    if (fixed_from_mpd(&m->min_amount, conf->min_amount, m->stock_prec) < 0)
+        return NULL;
+
+    m->order_slab = slab_create(sizeof(order_t), ORDER_SLAB_COUNT);
+    m->level_slab = slab_create(sizeof(order_level_t), LEVEL_SLAB_COUNT);
+    if (m->order_slab == NULL || m->level_slab == NULL)
+        return NULL;
 
     dict_types dt;
     memset(&dt, 0, sizeof(dt));
@@ -309,18 +732,31 @@ market_t *market_create(struct market *conf)
     memset(&dt, 0, sizeof(dt));
     dt.hash_function    = dict_order_hash_function;
     dt.key_compare      = dict_order_key_compare;
-    dt.key_dup          = dict_order_key_dup;
-    dt.key_destructor   = dict_order_key_free;
+    dt.entry_alloc      = pool_entry_alloc;
+    dt.entry_free       = pool_entry_free;
 
     m->orders = dict_create(&dt, 1024);
     if (m->orders == NULL)
         return NULL;
 
+    memset(&dt, 0, sizeof(dt));
+    dt.hash_function    = dict_depth_hash_function;
+    dt.key_compare      = dict_depth_key_compare;
+    dt.key_dup          = dict_depth_key_dup;
+    dt.key_destructor   = dict_depth_key_free;
+
+    m->depth_dirty = dict_create(&dt, 64);
+    if (m->depth_dirty == NULL)
+        return NULL;
+
     skiplist_type lt;
     memset(&lt, 0, sizeof(lt));
-    lt.compare          = order_match_compare;
+    lt.node_alloc       = pool_node_alloc;
+    lt.node_free        = pool_node_free;
 
+    lt.compare          = order_level_ask_compare;
     m->asks = skiplist_create(&lt);
+    lt.compare          = order_level_bid_compare;
     m->bids = skiplist_create(&lt);
     if (m->asks == NULL || m->bids == NULL)
         return NULL;
@@ -328,670 +764,510 @@ market_t *market_create(struct market *conf)
     return m;
 }
 
-static int append_balance_trade_add(order_t *order, const char *asset, mpd_t *change, mpd_t *price, mpd_t *amount)
+static int append_balance_trade_add(market_t *m, order_t *order, const char *asset, int64_t change, int prec, int64_t price, int64_t amount)
 {
-    json_t *detail = json_object();
-    json_object_set_new(detail, "m", json_string(order->market));
-    json_object_set_new(detail, "i", json_integer(order->id));
-    json_object_set_new_mpd(detail, "p", price);
-    json_object_set_new_mpd(detail, "a", amount);
-    char *detail_str = json_dumps(detail, JSON_SORT_KEYS);
-    int ret = append_user_balance_history(order->update_time, order->user_id, asset, "trade", change, detail_str);
-    free(detail_str);
-    json_decref(detail);
-    return ret;
+    return append_user_balance_trade_history(m, order, asset, change, prec, price, amount, false, 0);
 }
 
-static int append_balance_trade_sub(order_t *order, const char *asset, mpd_t *change, mpd_t *price, mpd_t *amount)
-{
-    json_t *detail = json_object();
-    json_object_set_new(detail, "m", json_string(order->market));
-    json_object_set_new(detail, "i", json_integer(order->id));
-    json_object_set_new_mpd(detail, "p", price);
-    json_object_set_new_mpd(detail, "a", amount);
-    char *detail_str = json_dumps(detail, JSON_SORT_KEYS);
-    mpd_t *real_change = mpd_new(&mpd_ctx);
-    mpd_copy_negate(real_change, change, &mpd_ctx);
-    int ret = append_user_balance_history(order->update_time, order->user_id, asset, "trade", real_change, detail_str);
-    mpd_del(real_change);
-    free(detail_str);
-    json_decref(detail);
-    return ret;
+static int append_balance_trade_sub(market_t *m, order_t *order, const char *asset, int64_t change, int prec, int64_t price, int64_t amount)
+{
+    return append_user_balance_trade_history(m, order, asset, -change, prec, price, amount, false, 0);
 }
 
-
-static int append_balance_trade_fee(order_t *order, const char *asset, mpd_t *change, mpd_t *price, mpd_t *amount, mpd_t *fee_rate)
+static int append_balance_trade_fee(market_t *m, order_t *order, const char *asset, int64_t change, int prec, int64_t price, int64_t amount, int64_t fee_rate)
 {
-    json_t *detail = json_object();
-    json_object_set_new(detail, "m", json_string(order->market));
-    json_object_set_new(detail, "i", json_integer(order->id));
-    json_object_set_new_mpd(detail, "p", price);
-    json_object_set_new_mpd(detail, "a", amount);
-    json_object_set_new_mpd(detail, "f", fee_rate);
-    char *detail_str = json_dumps(detail, JSON_SORT_KEYS);
-    mpd_t *real_change = mpd_new(&mpd_ctx);
-    mpd_copy_negate(real_change, change, &mpd_ctx);
-    int ret = append_user_balance_history(order->update_time, order->user_id, asset, "trade", real_change, detail_str);
-    mpd_del(real_change);
-    free(detail_str);
-    json_decref(detail);
-    return ret;
+    return append_user_balance_trade_history(m, order, asset, -change, prec, price, amount, true, fee_rate);
 }
 
-bool check_price_limit(mpd_t *cmp_price, mpd_t *price, const char *pct)
+# define PRICE_LIMIT_PREC 6
+
+bool check_price_limit(market_t *m, mpd_t *cmp_price, int64_t price, const char *pct)
 {
     if (cmp_price == NULL)
         return false;
 
-    if (mpd_cmp(price, mpd_zero, &mpd_ctx) == 0
-        || mpd_cmp(cmp_price, mpd_zero, &mpd_ctx) == 0
-        || mpd_cmp(price, cmp_price, &mpd_ctx) == 0)
+    int64_t cmp;
+    if (fixed_from_mpd(&cmp, cmp_price, m->money_prec) < 0)
+        return false;
+    if (price == 0 || cmp == 0 || price == cmp)
         return true;
 
-    mpd_t *limit = decimal(pct, 0);
-    if (mpd_cmp(limit, mpd_zero, &mpd_ctx) == 0) {
-        mpd_del(limit);
+    int64_t limit;
+    if (fixed_parse(pct, PRICE_LIMIT_PREC, &limit) < 0)
+        return false;
+    if (limit == 0)
         return true;
-    }
 
-    mpd_t *range = mpd_new(&mpd_ctx);
-    mpd_t *diff = mpd_new(&mpd_ctx);
-    mpd_mul(range, cmp_price, limit, &mpd_ctx);
-    mpd_del(limit);
-
-    mpd_sub(diff, price, cmp_price, &mpd_ctx);
-    mpd_abs(diff, diff, &mpd_ctx);
+    int64_t range, diff;
+    if (fixed_mul(&range, cmp, m->money_prec, limit, PRICE_LIMIT_PREC, m->money_prec + PRICE_LIMIT_PREC, FIXED_ROUND_DOWN) < 0)
+        return true;
+    if (fixed_rescale(&diff, price > cmp ? price - cmp : cmp - price, m->money_prec, m->money_prec + PRICE_LIMIT_PREC, FIXED_ROUND_DOWN) < 0)
+        return false;
 
     // Within N% of last price
-    if (mpd_cmp(diff, range, &mpd_ctx) > 0) {
-        mpd_del(range);
-        mpd_del(diff);
+    if (diff > range)
         return false;
-    }
-
-    mpd_del(range);
-    mpd_del(diff);
 
     return true;
 }
 
-static int execute_limit_ask_order(bool real, market_t *m, order_t *taker)
+/* every value a fill changes, computed before any order or balance is touched */
+typedef struct fill_t {
+    order_t *taker;
+    order_t *maker;
+    order_t *ask;
+    order_t *bid;
+    int64_t price;
+    int64_t amount;
+    int64_t deal;
+    int64_t ask_fee;
+    int64_t bid_fee;
+    bool    fee_money;
+    int64_t taker_left;
+    int64_t taker_stock;
+    int64_t taker_money;
+    int64_t taker_fee;
+    int64_t maker_stock;
+    int64_t maker_money;
+    int64_t maker_fee;
+    int64_t maker_freeze;
+    int64_t deal_freeze;
+    int64_t fee_freeze;
+} fill_t;
+
+static int fill_prepare(market_t *m, fill_t *f, order_t *taker, order_t *maker, int64_t price, int64_t amount)
 {
-    mpd_t *price    = mpd_new(&mpd_ctx);
-    mpd_t *amount   = mpd_new(&mpd_ctx);
-    mpd_t *deal     = mpd_new(&mpd_ctx);
-    mpd_t *ask_fee  = mpd_new(&mpd_ctx);
-    mpd_t *bid_fee  = mpd_new(&mpd_ctx);
-    mpd_t *result   = mpd_new(&mpd_ctx);
+    memset(f, 0, sizeof(fill_t));
+    f->taker  = taker;
+    f->maker  = maker;
+    f->ask    = taker->side == MARKET_ORDER_SIDE_ASK ? taker : maker;
+    f->bid    = taker->side == MARKET_ORDER_SIDE_ASK ? maker : taker;
+    f->price  = price;
+    f->amount = amount;
+    // only limit takers charge the bid fee in money on include_fee markets
+    f->fee_money = m->include_fee && taker->type == MARKET_ORDER_TYPE_LIMIT;
+
+    int64_t ask_rate = f->ask == taker ? taker->taker_fee : maker->maker_fee;
+    int64_t bid_rate = f->bid == taker ? taker->taker_fee : maker->maker_fee;
+    if (trade_deal(m, &f->deal, price, amount) < 0)
+        return -__LINE__;
+    if (money_fee(m, &f->ask_fee, f->deal, ask_rate) < 0)
+        return -__LINE__;
+    if (f->fee_money) {
+        if (money_fee(m, &f->bid_fee, f->deal, bid_rate) < 0)
+            return -__LINE__;
+    } else {
+        if (stock_fee(m, &f->bid_fee, amount, bid_rate) < 0)
+            return -__LINE__;
+    }
 
-    skiplist_node *node;
-    skiplist_iter *iter = skiplist_get_iterator(m->bids);
-    while ((node = skiplist_next(iter)) != NULL) {
-        if (mpd_cmp(taker->left, mpd_zero, &mpd_ctx) == 0) {
-            break;
-        }
+    // market bid order left is the money to spend
+    int64_t used = taker->type == MARKET_ORDER_TYPE_MARKET && taker->side == MARKET_ORDER_SIDE_BID ? f->deal : amount;
+    if (used > taker->left)
+        return -__LINE__;
+    f->taker_left = taker->left - used;
 
-        order_t *maker = node->value;
+    int64_t taker_fee = f->ask == taker ? f->ask_fee : f->bid_fee;
+    int64_t maker_fee = f->ask == maker ? f->ask_fee : f->bid_fee;
+    if (fixed_add(&f->taker_stock, taker->deal_stock, amount) < 0)
+        return -__LINE__;
+    if (fixed_add(&f->taker_money, taker->deal_money, f->deal) < 0)
+        return -__LINE__;
+    if (fixed_add(&f->taker_fee, taker->deal_fee, taker_fee) < 0)
+        return -__LINE__;
+    if (fixed_add(&f->maker_stock, maker->deal_stock, amount) < 0)
+        return -__LINE__;
+    if (fixed_add(&f->maker_money, maker->deal_money, f->deal) < 0)
+        return -__LINE__;
+    if (fixed_add(&f->maker_fee, maker->deal_fee, maker_fee) < 0)
+        return -__LINE__;
 
-        // Price
-        if (mpd_cmp(taker->price, maker->price, &mpd_ctx) > 0)
-            break;
-        // Amount : Limit to AON
-        if (maker->type == MARKET_ORDER_TYPE_AON &&
-            mpd_cmp(taker->left, maker->left, &mpd_ctx) < 0)
-            continue;
-        // Amount
-        if (mpd_cmp(taker->left, maker->left, &mpd_ctx) < 0)
-            mpd_copy(amount, taker->left, &mpd_ctx);
-        else
-            mpd_copy(amount, maker->left, &mpd_ctx);
-
-        mpd_copy(price, maker->price, &mpd_ctx);
-        mpd_mul(deal, price, amount, &mpd_ctx);
-        mpd_mul(ask_fee, deal, taker->taker_fee, &mpd_ctx);
-
-        if (!m->include_fee)
-            mpd_mul(bid_fee, amount, maker->maker_fee, &mpd_ctx);
-        else
-            mpd_mul(bid_fee, deal, maker->maker_fee, &mpd_ctx);
-
-        taker->update_time = maker->update_time = current_timestamp();
-        uint64_t deal_id = ++deals_id_start;
-        if (real) {
-            append_order_deal_history(taker->update_time, deal_id, taker, MARKET_ROLE_TAKER, maker, MARKET_ROLE_MAKER, price, amount, deal, ask_fee, bid_fee);
-            push_deal_message(taker->update_time, m->name, taker, maker, price, amount, ask_fee, bid_fee, MARKET_ORDER_SIDE_ASK, deal_id, m->stock, m->money);
-        }
+    // the taker pays from available, what it receives covers its fee
+    if (taker == f->ask) {
+        if (!balance_enough(taker->user_id, m->stock, amount, m->stock_prec))
+            return -__LINE__;
+    } else {
+        int64_t cost = f->deal;
+        if (f->fee_money && fixed_add(&cost, cost, f->bid_fee) < 0)
+            return -__LINE__;
+        if (!balance_enough(taker->user_id, m->money, cost, m->value_prec))
+            return -__LINE__;
+    }
+
+    // the maker pays from its freeze, fees are rounded per fill so a bid freeze may fall short
+    if (maker == f->ask) {
+        int64_t value;
+        if (stock_value(m, &value, amount) < 0 || value > maker->freeze)
+            return -__LINE__;
+        f->deal_freeze = value;
+    } else {
+        int64_t fee = f->fee_money ? f->bid_fee : 0;
+        f->deal_freeze = f->deal < maker->freeze ? f->deal : maker->freeze;
+        f->fee_freeze = fee < maker->freeze - f->deal_freeze ? fee : maker->freeze - f->deal_freeze;
+        int64_t extra = f->deal - f->deal_freeze + fee - f->fee_freeze;
+        if (extra > 0 && !balance_enough(maker->user_id, m->money, extra, m->value_prec))
+            return -__LINE__;
+    }
+    f->maker_freeze = maker->freeze - f->deal_freeze - f->fee_freeze;
 
-        mpd_sub(taker->left, taker->left, amount, &mpd_ctx);
-        mpd_add(taker->deal_stock, taker->deal_stock, amount, &mpd_ctx);
-        mpd_add(taker->deal_money, taker->deal_money, deal, &mpd_ctx);
-        mpd_add(taker->deal_fee, taker->deal_fee, ask_fee, &mpd_ctx);
+    return 0;
+}
+
+static void fill_balance(market_t *m, order_t *order, bool add, uint32_t type, const char *asset, int64_t val, int prec)
+{
+    if (val == 0)
+        return;
+    mpd_t *ret;
+    if (add) {
+        ret = trade_balance_add(order->user_id, type, asset, val, prec);
+    } else {
+        ret = trade_balance_sub(order->user_id, type, asset, val, prec);
+    }
+    if (ret == NULL) {
+        log_fatal("fill balance fail, market: %s, order: %"PRIu64", user: %u, asset: %s, type: %u, add: %d, val: %"PRIi64,
+                m->name, order->id, order->user_id, asset, type, add, val);
+    }
+}
 
-        balance_sub(taker->user_id, BALANCE_TYPE_AVAILABLE, m->stock, amount);
+// a maker pays from its freeze and the part beyond it from available
+static void fill_balance_freeze(market_t *m, order_t *order, const char *asset, int64_t val, int64_t from_freeze, int prec)
+{
+    fill_balance(m, order, false, BALANCE_TYPE_FREEZE, asset, from_freeze, prec);
+    fill_balance(m, order, false, BALANCE_TYPE_AVAILABLE, asset, val - from_freeze, prec);
+}
+
+static void fill_ask_balance(bool real, market_t *m, fill_t *f)
+{
+    order_t *order = f->ask;
+    int64_t rate = order == f->taker ? order->taker_fee : order->maker_fee;
+    if (order == f->taker) {
+        fill_balance(m, order, false, BALANCE_TYPE_AVAILABLE, m->stock, f->amount, m->stock_prec);
+    } else {
+        fill_balance(m, order, false, BALANCE_TYPE_FREEZE, m->stock, f->deal_freeze, m->value_prec);
+    }
+    if (real) {
+        append_balance_trade_sub(m, order, m->stock, f->amount, m->stock_prec, f->price, f->amount);
+    }
+    fill_balance(m, order, true, BALANCE_TYPE_AVAILABLE, m->money, f->deal, m->value_prec);
+    if (real) {
+        append_balance_trade_add(m, order, m->money, f->deal, m->value_prec, f->price, f->amount);
+    }
+    if (f->ask_fee > 0) {
+        fill_balance(m, order, false, BALANCE_TYPE_AVAILABLE, m->money, f->ask_fee, m->value_prec);
         if (real) {
-            append_balance_trade_sub(taker, m->stock, amount, price, amount);
+            append_balance_trade_fee(m, order, m->money, f->ask_fee, m->value_prec, f->price, f->amount, rate);
         }
-        balance_add(taker->user_id, BALANCE_TYPE_AVAILABLE, m->money, deal);
-        if (real) {
-            append_balance_trade_add(taker, m->money, deal, price, amount);
+    }
+}
+
+static void fill_bid_balance(bool real, market_t *m, fill_t *f)
+{
+    order_t *order = f->bid;
+    int64_t rate = order == f->taker ? order->taker_fee : order->maker_fee;
+    if (order == f->taker) {
+        fill_balance(m, order, false, BALANCE_TYPE_AVAILABLE, m->money, f->deal, m->value_prec);
+    } else {
+        fill_balance_freeze(m, order, m->money, f->deal, f->deal_freeze, m->value_prec);
+    }
+    if (real) {
+        append_balance_trade_sub(m, order, m->money, f->deal, m->value_prec, f->price, f->amount);
+    }
+    fill_balance(m, order, true, BALANCE_TYPE_AVAILABLE, m->stock, f->amount, m->stock_prec);
+    if (real) {
+        append_balance_trade_add(m, order, m->stock, f->amount, m->stock_prec, f->price, f->amount);
+    }
+    if (f->bid_fee > 0) {
+        const char *fee_asset = f->fee_money ? m->money : m->stock;
+        if (order == f->maker && f->fee_money) {
+            fill_balance_freeze(m, order, fee_asset, f->bid_fee, f->fee_freeze, m->value_prec);
+        } else {
+            fill_balance(m, order, false, BALANCE_TYPE_AVAILABLE, fee_asset, f->bid_fee, m->value_prec);
         }
-        if (mpd_cmp(ask_fee, mpd_zero, &mpd_ctx) > 0) {
-            balance_sub(taker->user_id, BALANCE_TYPE_AVAILABLE, m->money, ask_fee);
-            if (real) {
-                append_balance_trade_fee(taker, m->money, ask_fee, price, amount, taker->taker_fee);
-            }
+        if (real) {
+            append_balance_trade_fee(m, order, fee_asset, f->bid_fee, m->value_prec, f->price, f->amount, rate);
         }
+    }
+}
 
-        mpd_sub(maker->left, maker->left, amount, &mpd_ctx);
-        mpd_sub(maker->freeze, maker->freeze, deal, &mpd_ctx);
-        mpd_add(maker->deal_stock, maker->deal_stock, amount, &mpd_ctx);
-        mpd_add(maker->deal_money, maker->deal_money, deal, &mpd_ctx);
-        mpd_add(maker->deal_fee, maker->deal_fee, bid_fee, &mpd_ctx);
+static void fill_apply(bool real, market_t *m, fill_t *f)
+{
+    order_t *taker = f->taker;
+    order_t *maker = f->maker;
 
-        balance_sub(maker->user_id, BALANCE_TYPE_FREEZE, m->money, deal);
+    taker->update_time = maker->update_time = current_timestamp();
+    uint64_t deal_id = ++deals_id_start;
+    if (real) {
+        uint32_t ask_role = f->ask == taker ? MARKET_ROLE_TAKER : MARKET_ROLE_MAKER;
+        uint32_t bid_role = f->bid == taker ? MARKET_ROLE_TAKER : MARKET_ROLE_MAKER;
+        append_order_deal_history(m, taker->update_time, deal_id, f->ask, ask_role, f->bid, bid_role,
+                f->price, f->amount, f->deal, f->ask_fee, f->bid_fee);
+        push_deal_message(taker->update_time, m, f->ask, f->bid, f->price, f->amount, f->ask_fee, f->bid_fee, taker->side, deal_id);
+    }
 
+    taker->left = f->taker_left;
+    taker->deal_stock = f->taker_stock;
+    taker->deal_money = f->taker_money;
+    taker->deal_fee = f->taker_fee;
+    if (taker == f->ask) {
+        fill_ask_balance(real, m, f);
+    } else {
+        fill_bid_balance(real, m, f);
+    }
+
+    maker->left -= f->amount;
+    maker->level->left -= f->amount;
+    level_changed(m, maker->side, maker->price);
+    order_dirty(m, maker);
+    maker->freeze = f->maker_freeze;
+    maker->deal_stock = f->maker_stock;
+    maker->deal_money = f->maker_money;
+    maker->deal_fee = f->maker_fee;
+    if (maker == f->ask) {
+        fill_ask_balance(real, m, f);
+    } else {
+        fill_bid_balance(real, m, f);
+    }
+
+    // what is left of the freeze is released when the maker finishes
+    if (maker->left == 0) {
         if (real) {
-            append_balance_trade_sub(maker, m->money, deal, price, amount);
-        }
-        balance_add(maker->user_id, BALANCE_TYPE_AVAILABLE, m->stock, amount);
-        if (real) {
-            append_balance_trade_add(maker, m->stock, amount, price, amount);
+            push_order_message(ORDER_EVENT_FINISH, maker, m, f->amount);
         }
-        if (mpd_cmp(bid_fee, mpd_zero, &mpd_ctx) > 0) {
-            char *fee_currency = m->include_fee? m->money : m->stock;
-            if (m->include_fee) {
-                mpd_sub(maker->freeze, maker->freeze, bid_fee, &mpd_ctx);
-                balance_sub(maker->user_id, BALANCE_TYPE_FREEZE, fee_currency, bid_fee);
-            }
-            else {
-                balance_sub(maker->user_id, BALANCE_TYPE_AVAILABLE, fee_currency, bid_fee);
-            }
-
-            if (real) {
-                append_balance_trade_fee(maker, fee_currency, bid_fee, price, amount, maker->maker_fee);
-            }
+        int ret = order_finish(real, m, maker);
+        if (ret < 0) {
+            log_fatal("order_finish fail: %d, order: %"PRIu64, ret, maker->id);
         }
-
-        if (mpd_cmp(maker->left, mpd_zero, &mpd_ctx) == 0) {
-            if (real) {
-                push_order_message(ORDER_EVENT_FINISH, maker, m, amount);
-            }
-            order_finish(real, m, maker);
-        } else {
-            if (real) {
-                push_order_message(ORDER_EVENT_UPDATE, maker, m, amount);
-            }
+    } else {
+        if (real) {
+            push_order_message(ORDER_EVENT_UPDATE, maker, m, f->amount);
         }
-
-        mpd_copy(m->last_price, price, &mpd_ctx);
     }
-    skiplist_release_iterator(iter);
 
-    mpd_del(amount);
-    mpd_del(price);
-    mpd_del(deal);
-    mpd_del(ask_fee);
-    mpd_del(bid_fee);
-    mpd_del(result);
+    if (taker->type == MARKET_ORDER_TYPE_LIMIT) {
+        fixed_to_mpd(m->last_price, f->price, m->money_prec);
+    }
+}
 
+// a fill that can not be made stops the matching, nothing of it is applied
+static int execute_fill(bool real, market_t *m, order_t *taker, order_t *maker, int64_t price, int64_t amount)
+{
+    fill_t f;
+    int ret = fill_prepare(m, &f, taker, maker, price, amount);
+    if (ret < 0) {
+        log_fatal("fill fail: %d, market: %s, taker: %"PRIu64", maker: %"PRIu64, ret, m->name, taker->id, maker->id);
+        return ret;
+    }
+    fill_apply(real, m, &f);
     return 0;
 }
 
-static int execute_limit_bid_order(bool real, market_t *m, order_t *taker)
+static int execute_limit_ask_order(bool real, market_t *m, order_t *taker)
 {
-    mpd_t *price    = mpd_new(&mpd_ctx);
-    mpd_t *amount   = mpd_new(&mpd_ctx);
-    mpd_t *deal     = mpd_new(&mpd_ctx);
-    mpd_t *ask_fee  = mpd_new(&mpd_ctx);
-    mpd_t *bid_fee  = mpd_new(&mpd_ctx);
-    mpd_t *result   = mpd_new(&mpd_ctx);
-
-    skiplist_node *node;
-    skiplist_iter *iter = skiplist_get_iterator(m->asks);
-    while ((node = skiplist_next(iter)) != NULL) {
-        if (mpd_cmp(taker->left, mpd_zero, &mpd_ctx) == 0) {
+    order_t *maker;
+    order_book_iter *iter = order_book_get_iterator(m->bids);
+    while ((maker = order_book_next(iter)) != NULL) {
+        if (taker->left == 0) {
             break;
         }
 
-        order_t *maker = node->value;
 
         // Price
-        if (mpd_cmp(taker->price, maker->price, &mpd_ctx) < 0)
+        if (taker->price > maker->price)
             break;
         // Amount : Limit to AON
-        if (maker->type == MARKET_ORDER_TYPE_AON &&
-            mpd_cmp(taker->left, maker->left, &mpd_ctx) < 0)
+        if (maker->type == MARKET_ORDER_TYPE_AON && taker->left < maker->left)
             continue;
         // Amount
-        if (mpd_cmp(taker->left, maker->left, &mpd_ctx) < 0)
-            mpd_copy(amount, taker->left, &mpd_ctx);
-        else
-            mpd_copy(amount, maker->left, &mpd_ctx);
-
-        mpd_copy(price, maker->price, &mpd_ctx);
-        mpd_mul(deal, price, amount, &mpd_ctx);
-        mpd_mul(ask_fee, deal, maker->maker_fee, &mpd_ctx);
-
-        if (!m->include_fee)
-            mpd_mul(bid_fee, amount, taker->taker_fee, &mpd_ctx);
-        else
-            mpd_mul(bid_fee, deal, taker->taker_fee, &mpd_ctx);
-
-        taker->update_time = maker->update_time = current_timestamp();
-        uint64_t deal_id = ++deals_id_start;
-        if (real) {
-            append_order_deal_history(taker->update_time, deal_id, maker, MARKET_ROLE_MAKER, taker, MARKET_ROLE_TAKER, price, amount, deal, ask_fee, bid_fee);
-            push_deal_message(taker->update_time, m->name, maker, taker, price, amount, ask_fee, bid_fee, MARKET_ORDER_SIDE_BID, deal_id, m->stock, m->money);
+        int64_t amount = taker->left < maker->left ? taker->left : maker->left;
+
+        if (execute_fill(real, m, taker, maker, maker->price, amount) < 0) {
+            order_book_release_iterator(iter);
+            return EXECUTE_STOPPED;
         }
+    }
+    order_book_release_iterator(iter);
 
-        mpd_sub(taker->left, taker->left, amount, &mpd_ctx);
-        mpd_add(taker->deal_stock, taker->deal_stock, amount, &mpd_ctx);
-        mpd_add(taker->deal_money, taker->deal_money, deal, &mpd_ctx);
-        mpd_add(taker->deal_fee, taker->deal_fee, bid_fee, &mpd_ctx);
+    return 0;
+}
 
-        balance_sub(taker->user_id, BALANCE_TYPE_AVAILABLE, m->money, deal);
-        if (real) {
-            append_balance_trade_sub(taker, m->money, deal, price, amount);
-        }
-        balance_add(taker->user_id, BALANCE_TYPE_AVAILABLE, m->stock, amount);
-        if (real) {
-            append_balance_trade_add(taker, m->stock, amount, price, amount);
-        }
-        if (mpd_cmp(bid_fee, mpd_zero, &mpd_ctx) > 0) {
-            char *fee_currency = m->include_fee? m->money : m->stock;
-            balance_sub(taker->user_id, BALANCE_TYPE_AVAILABLE, fee_currency, bid_fee);
-            if (real) {
-                append_balance_trade_fee(taker, fee_currency, bid_fee, price, amount, taker->taker_fee);
-            }
+static int execute_limit_bid_order(bool real, market_t *m, order_t *taker)
+{
+    order_t *maker;
+    order_book_iter *iter = order_book_get_iterator(m->asks);
+    while ((maker = order_book_next(iter)) != NULL) {
+        if (taker->left == 0) {
+            break;
         }
 
-        mpd_sub(maker->left, maker->left, amount, &mpd_ctx);
-        mpd_sub(maker->freeze, maker->freeze, amount, &mpd_ctx);
-        mpd_add(maker->deal_stock, maker->deal_stock, amount, &mpd_ctx);
-        mpd_add(maker->deal_money, maker->deal_money, deal, &mpd_ctx);
-        mpd_add(maker->deal_fee, maker->deal_fee, ask_fee, &mpd_ctx);
 
-        balance_sub(maker->user_id, BALANCE_TYPE_FREEZE, m->stock, amount);
-        if (real) {
-            append_balance_trade_sub(maker, m->stock, amount, price, amount);
-        }
-        balance_add(maker->user_id, BALANCE_TYPE_AVAILABLE, m->money, deal);
-        if (real) {
-            append_balance_trade_add(maker, m->money, deal, price, amount);
-        }
-        if (mpd_cmp(ask_fee, mpd_zero, &mpd_ctx) > 0) {
-            balance_sub(maker->user_id, BALANCE_TYPE_AVAILABLE, m->money, ask_fee);
-            if (real) {
-                append_balance_trade_fee(maker, m->money, ask_fee, price, amount, maker->maker_fee);
-            }
-        }
+        // Price
+        if (taker->price < maker->price)
+            break;
+        // Amount : Limit to AON
+        if (maker->type == MARKET_ORDER_TYPE_AON && taker->left < maker->left)
+            continue;
+        // Amount
+        int64_t amount = taker->left < maker->left ? taker->left : maker->left;
 
-        // Finished order (sell)
-        if (mpd_cmp(maker->left, mpd_zero, &mpd_ctx) == 0) {
-            if (real) {
-                push_order_message(ORDER_EVENT_FINISH, maker, m, amount);
-            }
-            order_finish(real, m, maker);
-        } else {
-            if (real) {
-                push_order_message(ORDER_EVENT_UPDATE, maker, m, amount);
-            }
+        if (execute_fill(real, m, taker, maker, maker->price, amount) < 0) {
+            order_book_release_iterator(iter);
+            return EXECUTE_STOPPED;
         }
-
-        mpd_copy(m->last_price, price, &mpd_ctx);
     }
-    skiplist_release_iterator(iter);
-
-    mpd_del(amount);
-    mpd_del(price);
-    mpd_del(deal);
-    mpd_del(ask_fee);
-    mpd_del(bid_fee);
-    mpd_del(result);
+    order_book_release_iterator(iter);
 
     return 0;
 }
 
 static int execute_aon_ask_order(bool real, market_t *m, order_t *taker)
 {
-    mpd_t *price    = mpd_new(&mpd_ctx);
-    mpd_t *amount   = mpd_new(&mpd_ctx);
-    mpd_t *deal     = mpd_new(&mpd_ctx);
-    mpd_t *ask_fee  = mpd_new(&mpd_ctx);
-    mpd_t *bid_fee  = mpd_new(&mpd_ctx);
-    mpd_t *result   = mpd_new(&mpd_ctx);
-
-    skiplist_node *node;
-    skiplist_iter *iter = skiplist_get_iterator(m->bids);
-    while ((node = skiplist_next(iter)) != NULL) {
-        if (mpd_cmp(taker->left, mpd_zero, &mpd_ctx) == 0)
+    order_t *maker;
+    order_book_iter *iter = order_book_get_iterator(m->bids);
+    while ((maker = order_book_next(iter)) != NULL) {
+        if (taker->left == 0)
             break;
 
-        order_t *maker = node->value;
 
         // Price
-        if (mpd_cmp(taker->price, maker->price, &mpd_ctx) > 0)
+        if (taker->price > maker->price)
             break;
         // Amount
-        if (mpd_cmp(taker->left, maker->left, &mpd_ctx) > 0)
+        if (taker->left > maker->left)
             continue;
         // Amount : AON to AON
-        if (maker->type == MARKET_ORDER_TYPE_AON &&
-            mpd_cmp(taker->left, maker->left, &mpd_ctx) != 0)
+        if (maker->type == MARKET_ORDER_TYPE_AON && taker->left != maker->left)
             continue;
 
-        mpd_copy(price, maker->price, &mpd_ctx);
-        mpd_copy(amount, taker->left, &mpd_ctx); // All or Nothing
-
-        mpd_mul(deal, price, amount, &mpd_ctx);
-        mpd_mul(ask_fee, deal, taker->taker_fee, &mpd_ctx);
-        mpd_mul(bid_fee, amount, maker->maker_fee, &mpd_ctx);
-
-        taker->update_time = maker->update_time = current_timestamp();
-        uint64_t deal_id = ++deals_id_start;
-        if (real) {
-            append_order_deal_history(taker->update_time, deal_id, taker,
-                    MARKET_ROLE_TAKER, maker, MARKET_ROLE_MAKER, price, amount,
-                    deal, ask_fee, bid_fee);
-            push_deal_message(taker->update_time, m->name, taker, maker, price,
-                    amount, ask_fee, bid_fee, MARKET_ORDER_SIDE_ASK, deal_id,
-                    m->stock, m->money);
-        }
-
-        // Taker
-        mpd_copy(taker->left, mpd_zero, &mpd_ctx);
-        mpd_copy(taker->deal_stock, amount, &mpd_ctx);
-        mpd_copy(taker->deal_money, deal, &mpd_ctx);
-        mpd_copy(taker->deal_fee, ask_fee, &mpd_ctx);
-
-        balance_sub(taker->user_id, BALANCE_TYPE_AVAILABLE, m->stock, amount);
-        if (real) {
-            append_balance_trade_sub(taker, m->stock, amount, price, amount);
-        }
-        balance_add(taker->user_id, BALANCE_TYPE_AVAILABLE, m->money, deal);
-        if (real) {
-            append_balance_trade_add(taker, m->money, deal, price, amount);
-        }
-        if (mpd_cmp(ask_fee, mpd_zero, &mpd_ctx) > 0) {
-            balance_sub(taker->user_id, BALANCE_TYPE_AVAILABLE, m->money,
-                        ask_fee);
-            if (real) {
-                append_balance_trade_fee(taker, m->money, ask_fee, price,
-                                         amount, taker->taker_fee);
-            }
-        }
-
-        // Maker
-        mpd_sub(maker->left, maker->left, amount, &mpd_ctx);
-        mpd_sub(maker->freeze, maker->freeze, deal, &mpd_ctx);
-        mpd_add(maker->deal_stock, maker->deal_stock, amount, &mpd_ctx);
-        mpd_add(maker->deal_money, maker->deal_money, deal, &mpd_ctx);
-        mpd_add(maker->deal_fee, maker->deal_fee, bid_fee, &mpd_ctx);
-
-        balance_sub(maker->user_id, BALANCE_TYPE_FREEZE, m->money, deal);
-        if (real) {
-            append_balance_trade_sub(maker, m->money, deal, price, amount);
-        }
-        balance_add(maker->user_id, BALANCE_TYPE_AVAILABLE, m->stock, amount);
-        if (real) {
-            append_balance_trade_add(maker, m->stock, amount, price, amount);
-        }
-        if (mpd_cmp(bid_fee, mpd_zero, &mpd_ctx) > 0) {
-            balance_sub(maker->user_id, BALANCE_TYPE_AVAILABLE, m->stock,
-                        bid_fee);
-            if (real) {
-                append_balance_trade_fee(maker, m->stock, bid_fee, price,
-                                         amount, maker->maker_fee);
-            }
-        }
-
-        if (mpd_cmp(maker->left, mpd_zero, &mpd_ctx) == 0) {
-            if (real) {
-                push_order_message(ORDER_EVENT_FINISH, maker, m, amount);
-            }
-            order_finish(real, m, maker);
-        } else {
-            if (real) {
-                push_order_message(ORDER_EVENT_UPDATE, maker, m, amount);
-            }
+        // All or Nothing
+        if (execute_fill(real, m, taker, maker, maker->price, taker->left) < 0) {
+            order_book_release_iterator(iter);
+            return EXECUTE_STOPPED;
         }
     }
-    skiplist_release_iterator(iter);
-
-    mpd_del(amount);
-    mpd_del(price);
-    mpd_del(deal);
-    mpd_del(ask_fee);
-    mpd_del(bid_fee);
-    mpd_del(result);
+    order_book_release_iterator(iter);
 
     return 0;
 }
 
 static int execute_aon_bid_order(bool real, market_t *m, order_t *taker)
 {
-    mpd_t *price    = mpd_new(&mpd_ctx);
-    mpd_t *amount   = mpd_new(&mpd_ctx);
-    mpd_t *deal     = mpd_new(&mpd_ctx);
-    mpd_t *ask_fee  = mpd_new(&mpd_ctx);
-    mpd_t *bid_fee  = mpd_new(&mpd_ctx);
-    mpd_t *result   = mpd_new(&mpd_ctx);
-
-    skiplist_node *node;
-    skiplist_iter *iter = skiplist_get_iterator(m->asks);  // ASC
-    while ((node = skiplist_next(iter)) != NULL) {
-        if (mpd_cmp(taker->left, mpd_zero, &mpd_ctx) == 0) {
+    order_t *maker;
+    order_book_iter *iter = order_book_get_iterator(m->asks);
+    while ((maker = order_book_next(iter)) != NULL) {
+        if (taker->left == 0) {
             break;
         }
 
-        order_t *maker = node->value;
 
         // Price
-        if (mpd_cmp(taker->price, maker->price, &mpd_ctx) < 0)
+        if (taker->price < maker->price)
             break;
         // Amount
-        if (mpd_cmp(taker->left, maker->left, &mpd_ctx) > 0)
+        if (taker->left > maker->left)
             continue;
         // Amount : AON to AON
-        if (maker->type == MARKET_ORDER_TYPE_AON &&
-            mpd_cmp(taker->left, maker->left, &mpd_ctx) != 0)
+        if (maker->type == MARKET_ORDER_TYPE_AON && taker->left != maker->left)
             continue;
 
-        mpd_copy(price, maker->price, &mpd_ctx);
-        mpd_copy(amount, taker->left, &mpd_ctx); // All or Nothing
-
-        mpd_mul(deal, price, amount, &mpd_ctx);
-        mpd_mul(ask_fee, deal, maker->maker_fee, &mpd_ctx);
-        mpd_mul(bid_fee, amount, taker->taker_fee, &mpd_ctx);
-
-        taker->update_time = maker->update_time = current_timestamp();
-        uint64_t deal_id = ++deals_id_start;
-        if (real) {
-            append_order_deal_history(taker->update_time, deal_id, maker,
-                    MARKET_ROLE_MAKER, taker, MARKET_ROLE_TAKER, price, amount,
-                    deal, ask_fee, bid_fee);
-            push_deal_message(taker->update_time, m->name, maker, taker, price,
-                    amount, ask_fee, bid_fee, MARKET_ORDER_SIDE_BID, deal_id,
-                    m->stock, m->money);
-        }
-
-        mpd_copy(taker->left, mpd_zero, &mpd_ctx);
-        mpd_copy(taker->deal_stock, amount, &mpd_ctx);
-        mpd_copy(taker->deal_money, deal, &mpd_ctx);
-        mpd_copy(taker->deal_fee, bid_fee, &mpd_ctx);
-
-        balance_sub(taker->user_id, BALANCE_TYPE_AVAILABLE, m->money, deal);
-        if (real) {
-            append_balance_trade_sub(taker, m->money, deal, price, amount);
-        }
-        balance_add(taker->user_id, BALANCE_TYPE_AVAILABLE, m->stock, amount);
-        if (real) {
-            append_balance_trade_add(taker, m->stock, amount, price, amount);
+        // All or Nothing
+        if (execute_fill(real, m, taker, maker, maker->price, taker->left) < 0) {
+            order_book_release_iterator(iter);
+            return EXECUTE_STOPPED;
         }
-        if (mpd_cmp(bid_fee, mpd_zero, &mpd_ctx) > 0) {
-            balance_sub(taker->user_id, BALANCE_TYPE_AVAILABLE, m->stock,
-                        bid_fee);
-            if (real) {
-                append_balance_trade_fee(taker, m->stock, bid_fee, price,
-                                         amount, taker->taker_fee);
-            }
-        }
-
-        mpd_sub(maker->left, maker->left, amount, &mpd_ctx);
-        mpd_sub(maker->freeze, maker->freeze, amount, &mpd_ctx);
-        mpd_add(maker->deal_stock, maker->deal_stock, amount, &mpd_ctx);
-        mpd_add(maker->deal_money, maker->deal_money, deal, &mpd_ctx);
-        mpd_add(maker->deal_fee, maker->deal_fee, ask_fee, &mpd_ctx);
+    }
+    order_book_release_iterator(iter);
 
-        balance_sub(maker->user_id, BALANCE_TYPE_FREEZE, m->stock, amount);
-        if (real) {
-            append_balance_trade_sub(maker, m->stock, amount, price, amount);
-        }
-        balance_add(maker->user_id, BALANCE_TYPE_AVAILABLE, m->money, deal);
-        if (real) {
-            append_balance_trade_add(maker, m->money, deal, price, amount);
-        }
-        if (mpd_cmp(ask_fee, mpd_zero, &mpd_ctx) > 0) {
-            balance_sub(maker->user_id, BALANCE_TYPE_AVAILABLE, m->money, ask_fee);
-            if (real) {
-                append_balance_trade_fee(maker, m->money, ask_fee, price,
-                                         amount, maker->maker_fee);
-            }
-        }
+    return 0;
+}
 
-        if (mpd_cmp(maker->left, mpd_zero, &mpd_ctx) == 0) {
-            if (real) {
-                push_order_message(ORDER_EVENT_FINISH, maker, m, amount);
-            }
-            order_finish(real, m, maker);
-        } else {
-            if (real) {
-                push_order_message(ORDER_EVENT_UPDATE, maker, m, amount);
-            }
-        }
+static order_t *order_create(market_t *m, uint32_t type, uint32_t user_id, uint32_t side,
+        int64_t amount, int64_t price, int64_t taker_fee, int64_t maker_fee, const char *source)
+{
+    order_t *order = market_new_order(m);
+    if (order == NULL) {
+        return NULL;
     }
-    skiplist_release_iterator(iter);
 
-    mpd_del(amount);
-    mpd_del(price);
-    mpd_del(deal);
-    mpd_del(ask_fee);
-    mpd_del(bid_fee);
-    mpd_del(result);
+    order->id           = ++order_id_start;
+    order->type         = type;
+    order->side         = side;
+    order->create_time  = current_timestamp();
+    order->update_time  = order->create_time;
+    order->source       = source_intern(source);
+    order->user_id      = user_id;
+    order->price        = price;
+    order->amount       = amount;
+    order->taker_fee    = taker_fee;
+    order->maker_fee    = maker_fee;
+    order->left         = amount;
 
-    return 0;
+    return order;
 }
 
-int market_put_limit_order(bool real, json_t **result, market_t *m, uint32_t user_id, uint32_t side, mpd_t *amount, mpd_t *price, mpd_t *taker_fee, mpd_t *maker_fee, const char *source)
+int market_put_limit_order(bool real, json_t **result, market_t *m, uint32_t user_id, uint32_t side, int64_t amount, int64_t price, int64_t taker_fee, int64_t maker_fee, const char *source)
 {
+    if (check_order_value(m, amount, price) < 0) {
+        return -2;
+    }
+
     // SELL
     if (side == MARKET_ORDER_SIDE_ASK) {
-        mpd_t *balance = balance_get(user_id, BALANCE_TYPE_AVAILABLE, m->stock);
-        if (!balance || mpd_cmp(balance, amount, &mpd_ctx) < 0) {
+        if (!balance_enough(user_id, m->stock, amount, m->stock_prec)) {
             return -1;
         }
     }
     // BUY
     else {
-        mpd_t *balance = balance_get(user_id, BALANCE_TYPE_AVAILABLE, m->money);
-        mpd_t *required = mpd_new(&mpd_ctx);
-        mpd_mul(required, amount, price, &mpd_ctx);
-
-        if (!balance || mpd_cmp(balance, required, &mpd_ctx) < 0) {
-            mpd_del(required);
+        int64_t required;
+        trade_deal(m, &required, price, amount);
+        if (!balance_enough(user_id, m->money, required, m->value_prec)) {
             return -1;
         }
 
         if (m->include_fee) {
-            mpd_t *max_fee = mpd_new(&mpd_ctx);
-            mpd_mul(max_fee, required, taker_fee, &mpd_ctx);
-            mpd_add(required, required, max_fee, &mpd_ctx);
-            mpd_del(max_fee);
+            int64_t max_fee;
+            money_fee(m, &max_fee, required, taker_fee);
+            required += max_fee;
 
-            if (!balance || mpd_cmp(balance, required, &mpd_ctx) < 0) {
-                mpd_del(required);
+            if (!balance_enough(user_id, m->money, required, m->value_prec)) {
                 return -5;
             }
         }
-
-        mpd_del(required);
     }
 
-    if (mpd_cmp(amount, m->min_amount, &mpd_ctx) < 0) {
+    if (amount < m->min_amount) {
         return -2;
     }
 
-    order_t *order = malloc(sizeof(order_t));
+    order_t *order = order_create(m, MARKET_ORDER_TYPE_LIMIT, user_id, side, amount, price, taker_fee, maker_fee, source);
     if (order == NULL) {
         return -__LINE__;
     }
 
-    order->id           = ++order_id_start;
-    order->type         = MARKET_ORDER_TYPE_LIMIT;
-    order->side         = side;
-    order->create_time  = current_timestamp();
-    order->update_time  = order->create_time;
-    order->market       = strdup(m->name);
-    order->source       = strdup(source);
-    order->user_id      = user_id;
-    order->price        = mpd_new(&mpd_ctx);
-    order->amount       = mpd_new(&mpd_ctx);
-    order->taker_fee    = mpd_new(&mpd_ctx);
-    order->maker_fee    = mpd_new(&mpd_ctx);
-    order->left         = mpd_new(&mpd_ctx);
-    order->freeze       = mpd_new(&mpd_ctx);
-    order->deal_stock   = mpd_new(&mpd_ctx);
-    order->deal_money   = mpd_new(&mpd_ctx);
-    order->deal_fee     = mpd_new(&mpd_ctx);
-
-    mpd_copy(order->price, price, &mpd_ctx);
-    mpd_copy(order->amount, amount, &mpd_ctx);
-    mpd_copy(order->taker_fee, taker_fee, &mpd_ctx);
-    mpd_copy(order->maker_fee, maker_fee, &mpd_ctx);
-    mpd_copy(order->left, amount, &mpd_ctx);
-    mpd_copy(order->freeze, mpd_zero, &mpd_ctx);
-    mpd_copy(order->deal_stock, mpd_zero, &mpd_ctx);
-    mpd_copy(order->deal_money, mpd_zero, &mpd_ctx);
-    mpd_copy(order->deal_fee, mpd_zero, &mpd_ctx);
-
     int ret;
     if (side == MARKET_ORDER_SIDE_ASK) {
         ret = execute_limit_ask_order(real, m, order);
     } else {
         ret = execute_limit_bid_order(real, m, order);
     }
-    if (ret < 0) {
-        if (ret == -4) {
-            order_free(order);
-            return ret;
-        }
-
-        log_error("execute order: %"PRIu64" fail: %d", order->id, ret);
-        order_free(order);
-        return -__LINE__;
-    }
-
-    if (mpd_cmp(order->left, mpd_zero, &mpd_ctx) == 0) {
+    // an order whose matching stopped early is finished, it could cross the book if it rested
+    if (order->left == 0 || ret == EXECUTE_STOPPED) {
         if (side == MARKET_ORDER_SIDE_BID)
             add_user_to_market(m->name, user_id);
 
         if (real) {
-            ret = append_order_history(order);
+            ret = append_order_history(m, order);
             if (ret < 0) {
                 log_fatal("append_order_history fail: %d, order: %"PRIu64"", ret, order->id);
             }
-            push_order_message(ORDER_EVENT_FINISH, order, m, order->amount);
-            *result = get_order_info(order);
+            push_order_message(ORDER_EVENT_FINISH, order, m, order->amount - order->left);
+            *result = get_order_info(m, order);
         }
-        order_free(order);
+        order_free(m, order);
     } else {
         if (real) {
-            mpd_t *filled = mpd_new(&mpd_ctx);
-            mpd_sub(filled, order->left, order->amount, &mpd_ctx);
-
-            push_order_message(ORDER_EVENT_PUT, order, m, filled);
-            *result = get_order_info(order);
-            mpd_del(filled);
+            push_order_message(ORDER_EVENT_PUT, order, m, order->left - order->amount);
+            *result = get_order_info(m, order);
         }
         ret = order_put(m, order);
         if (ret < 0) {
@@ -1004,498 +1280,231 @@ int market_put_limit_order(bool real, json_t **result, market_t *m, uint32_t use
 
 static int execute_market_ask_order(bool real, market_t *m, order_t *taker)
 {
-    mpd_t *price    = mpd_new(&mpd_ctx);
-    mpd_t *amount   = mpd_new(&mpd_ctx);
-    mpd_t *deal     = mpd_new(&mpd_ctx);
-    mpd_t *ask_fee  = mpd_new(&mpd_ctx);
-    mpd_t *bid_fee  = mpd_new(&mpd_ctx);
-    mpd_t *result   = mpd_new(&mpd_ctx);
-
-    skiplist_node *node;
-    skiplist_iter *iter = skiplist_get_iterator(m->bids);
-    while ((node = skiplist_next(iter)) != NULL) {
-        if (mpd_cmp(taker->left, mpd_zero, &mpd_ctx) == 0) {
+    order_t *maker;
+    order_book_iter *iter = order_book_get_iterator(m->bids);
+    while ((maker = order_book_next(iter)) != NULL) {
+        if (taker->left == 0) {
             break;
         }
 
-        order_t *maker = node->value;
-
-        if (maker->type == MARKET_ORDER_TYPE_AON &&
-            mpd_cmp(taker->left, maker->left, &mpd_ctx) < 0)
+        if (maker->type == MARKET_ORDER_TYPE_AON && taker->left < maker->left)
             continue;
 
-        if (mpd_cmp(taker->left, maker->left, &mpd_ctx) < 0)
-            mpd_copy(amount, taker->left, &mpd_ctx);
-        else
-            mpd_copy(amount, maker->left, &mpd_ctx);
-
-        mpd_copy(price, maker->price, &mpd_ctx);
-        mpd_mul(deal, price, amount, &mpd_ctx);
-        mpd_mul(ask_fee, deal, taker->taker_fee, &mpd_ctx);
-        mpd_mul(bid_fee, amount, maker->maker_fee, &mpd_ctx);
-
-        taker->update_time = maker->update_time = current_timestamp();
-        uint64_t deal_id = ++deals_id_start;
-        if (real) {
-            append_order_deal_history(taker->update_time, deal_id, taker, MARKET_ROLE_TAKER, maker, MARKET_ROLE_MAKER, price, amount, deal, ask_fee, bid_fee);
-            push_deal_message(taker->update_time, m->name, taker, maker, price, amount, ask_fee, bid_fee, MARKET_ORDER_SIDE_ASK, deal_id, m->stock, m->money);
-        }
-
-        mpd_sub(taker->left, taker->left, amount, &mpd_ctx);
-        mpd_add(taker->deal_stock, taker->deal_stock, amount, &mpd_ctx);
-        mpd_add(taker->deal_money, taker->deal_money, deal, &mpd_ctx);
-        mpd_add(taker->deal_fee, taker->deal_fee, ask_fee, &mpd_ctx);
-
-        balance_sub(taker->user_id, BALANCE_TYPE_AVAILABLE, m->stock, amount);
-        if (real) {
-            append_balance_trade_sub(taker, m->stock, amount, price, amount);
-        }
-        balance_add(taker->user_id, BALANCE_TYPE_AVAILABLE, m->money, deal);
-        if (real) {
-            append_balance_trade_add(taker, m->money, deal, price, amount);
-        }
-        if (mpd_cmp(ask_fee, mpd_zero, &mpd_ctx) > 0) {
-            balance_sub(taker->user_id, BALANCE_TYPE_AVAILABLE, m->money, ask_fee);
-            if (real) {
-                append_balance_trade_fee(taker, m->money, ask_fee, price, amount, taker->taker_fee);
-            }
-        }
-
-        mpd_sub(maker->left, maker->left, amount, &mpd_ctx);
-        mpd_sub(maker->freeze, maker->freeze, deal, &mpd_ctx);
-        mpd_add(maker->deal_stock, maker->deal_stock, amount, &mpd_ctx);
-        mpd_add(maker->deal_money, maker->deal_money, deal, &mpd_ctx);
-        mpd_add(maker->deal_fee, maker->deal_fee, bid_fee, &mpd_ctx);
-
-        balance_sub(maker->user_id, BALANCE_TYPE_FREEZE, m->money, deal);
-        if (real) {
-            append_balance_trade_sub(maker, m->money, deal, price, amount);
-        }
-        balance_add(maker->user_id, BALANCE_TYPE_AVAILABLE, m->stock, amount);
-        if (real) {
-            append_balance_trade_add(maker, m->stock, amount, price, amount);
-        }
-        if (mpd_cmp(bid_fee, mpd_zero, &mpd_ctx) > 0) {
-            balance_sub(maker->user_id, BALANCE_TYPE_AVAILABLE, m->stock, bid_fee);
-            if (real) {
-                append_balance_trade_fee(maker, m->stock, bid_fee, price, amount, maker->maker_fee);
-            }
-        }
+        int64_t amount = taker->left < maker->left ? taker->left : maker->left;
 
-        if (mpd_cmp(maker->left, mpd_zero, &mpd_ctx) == 0) {
-            if (real) {
-                push_order_message(ORDER_EVENT_FINISH, maker, m, amount);
-            }
-            order_finish(real, m, maker);
-        } else {
-            if (real) {
-                push_order_message(ORDER_EVENT_UPDATE, maker, m, amount);
-            }
+        if (execute_fill(real, m, taker, maker, maker->price, amount) < 0) {
+            order_book_release_iterator(iter);
+            return EXECUTE_STOPPED;
         }
     }
-    skiplist_release_iterator(iter);
-
-    mpd_del(amount);
-    mpd_del(price);
-    mpd_del(deal);
-    mpd_del(ask_fee);
-    mpd_del(bid_fee);
-    mpd_del(result);
+    order_book_release_iterator(iter);
 
     return 0;
 }
 
 static int execute_market_bid_order(bool real, market_t *m, order_t *taker)
 {
-    mpd_t *price    = mpd_new(&mpd_ctx);
-    mpd_t *amount   = mpd_new(&mpd_ctx);
-    mpd_t *deal     = mpd_new(&mpd_ctx);
-    mpd_t *ask_fee  = mpd_new(&mpd_ctx);
-    mpd_t *bid_fee  = mpd_new(&mpd_ctx);
-    mpd_t *result   = mpd_new(&mpd_ctx);
-
-    skiplist_node *node;
-    skiplist_iter *iter = skiplist_get_iterator(m->asks);
-    while ((node = skiplist_next(iter)) != NULL) {
-        if (mpd_cmp(taker->left, mpd_zero, &mpd_ctx) == 0) {
+    order_t *maker;
+    order_book_iter *iter = order_book_get_iterator(m->asks);
+    while ((maker = order_book_next(iter)) != NULL) {
+        if (taker->left == 0) {
             break;
         }
 
-        order_t *maker = node->value;
-
-        if (maker->type == MARKET_ORDER_TYPE_AON &&
-            mpd_cmp(taker->left, maker->left, &mpd_ctx) < 0)
-            continue;
-
-        mpd_copy(price, maker->price, &mpd_ctx);
-
-        // Precision handling
-        mpd_div(amount, taker->left, price, &mpd_ctx);
-        mpd_rescale(amount, amount, -m->stock_prec, &mpd_ctx);
-        while (true) {
-            mpd_mul(result, amount, price, &mpd_ctx);
-            if (mpd_cmp(result, taker->left, &mpd_ctx) > 0) {
-                mpd_set_i32(result, -m->stock_prec, &mpd_ctx);
-                mpd_pow(result, mpd_ten, result, &mpd_ctx);
-                mpd_sub(amount, amount, result, &mpd_ctx);
-            } else {
-                break;
-            }
-        }
+        int64_t price = maker->price;
 
-        if (mpd_cmp(amount, maker->left, &mpd_ctx) > 0) {
-            mpd_copy(amount, maker->left, &mpd_ctx);
-        }
-        if (mpd_cmp(amount, mpd_zero, &mpd_ctx) == 0) {
-            break;
+        // Precision handling, the most stock the money left can buy
+        int64_t amount;
+        if (fixed_div(&amount, taker->left, m->value_prec, price, m->money_prec, m->stock_prec, FIXED_ROUND_DOWN) < 0) {
+            log_fatal("fixed point overflow, market: %s, order: %"PRIu64, m->name, taker->id);
+            order_book_release_iterator(iter);
+            return EXECUTE_STOPPED;
         }
 
-        mpd_mul(deal, price, amount, &mpd_ctx);
-        mpd_mul(ask_fee, deal, maker->maker_fee, &mpd_ctx);
-        mpd_mul(bid_fee, amount, taker->taker_fee, &mpd_ctx);
-
-        taker->update_time = maker->update_time = current_timestamp();
-        uint64_t deal_id = ++deals_id_start;
-        if (real) {
-            append_order_deal_history(taker->update_time, deal_id, maker, MARKET_ROLE_MAKER, taker, MARKET_ROLE_TAKER, price, amount, deal, ask_fee, bid_fee);
-            push_deal_message(taker->update_time, m->name, maker, taker, price, amount, ask_fee, bid_fee, MARKET_ORDER_SIDE_BID, deal_id, m->stock, m->money);
-        }
-
-        mpd_sub(taker->left, taker->left, deal, &mpd_ctx);
-        mpd_add(taker->deal_stock, taker->deal_stock, amount, &mpd_ctx);
-        mpd_add(taker->deal_money, taker->deal_money, deal, &mpd_ctx);
-        mpd_add(taker->deal_fee, taker->deal_fee, bid_fee, &mpd_ctx);
-
-        balance_sub(taker->user_id, BALANCE_TYPE_AVAILABLE, m->money, deal);
-        if (real) {
-            append_balance_trade_sub(taker, m->money, deal, price, amount);
-        }
-        balance_add(taker->user_id, BALANCE_TYPE_AVAILABLE, m->stock, amount);
-        if (real) {
-            append_balance_trade_add(taker, m->stock, amount, price, amount);
-        }
-        if (mpd_cmp(bid_fee, mpd_zero, &mpd_ctx) > 0) {
-            balance_sub(taker->user_id, BALANCE_TYPE_AVAILABLE, m->stock, bid_fee);
-            if (real) {
-                append_balance_trade_fee(taker, m->stock, bid_fee, price, amount, taker->taker_fee);
-            }
-        }
-
-        mpd_sub(maker->left, maker->left, amount, &mpd_ctx);
-        mpd_sub(maker->freeze, maker->freeze, amount, &mpd_ctx);
-        mpd_add(maker->deal_stock, maker->deal_stock, amount, &mpd_ctx);
-        mpd_add(maker->deal_money, maker->deal_money, deal, &mpd_ctx);
-        mpd_add(maker->deal_fee, maker->deal_fee, ask_fee, &mpd_ctx);
+        if (maker->type == MARKET_ORDER_TYPE_AON && amount < maker->left)
+            continue;
 
-        balance_sub(maker->user_id, BALANCE_TYPE_FREEZE, m->stock, amount);
-        if (real) {
-            append_balance_trade_sub(maker, m->stock, amount, price, amount);
-        }
-        balance_add(maker->user_id, BALANCE_TYPE_AVAILABLE, m->money, deal);
-        if (real) {
-            append_balance_trade_add(maker, m->money, deal, price, amount);
+        if (amount > maker->left) {
+            amount = maker->left;
         }
-        if (mpd_cmp(ask_fee, mpd_zero, &mpd_ctx) > 0) {
-            balance_sub(maker->user_id, BALANCE_TYPE_AVAILABLE, m->money, ask_fee);
-            if (real) {
-                append_balance_trade_fee(maker, m->money, ask_fee, price, amount, maker->maker_fee);
-            }
+        if (amount == 0) {
+            break;
         }
 
-        if (mpd_cmp(maker->left, mpd_zero, &mpd_ctx) == 0) {
-            if (real) {
-                push_order_message(ORDER_EVENT_FINISH, maker, m, amount);
-            }
-            order_finish(real, m, maker);
-        } else {
-            if (real) {
-                push_order_message(ORDER_EVENT_UPDATE, maker, m, amount);
-            }
+        if (execute_fill(real, m, taker, maker, price, amount) < 0) {
+            order_book_release_iterator(iter);
+            return EXECUTE_STOPPED;
         }
     }
-    skiplist_release_iterator(iter);
-
-    mpd_del(amount);
-    mpd_del(price);
-    mpd_del(deal);
-    mpd_del(ask_fee);
-    mpd_del(bid_fee);
-    mpd_del(result);
+    order_book_release_iterator(iter);
 
     return 0;
 }
 
-int market_put_market_order(bool real, json_t **result, market_t *m, uint32_t user_id, uint32_t side, mpd_t *amount, mpd_t *taker_fee, const char *source)
+int market_put_market_order(bool real, json_t **result, market_t *m, uint32_t user_id, uint32_t side, int64_t amount, int64_t taker_fee, const char *source)
 {
     if (side == MARKET_ORDER_SIDE_ASK) {
-        mpd_t *balance = balance_get(user_id, BALANCE_TYPE_AVAILABLE, m->stock);
-        if (!balance || mpd_cmp(balance, amount, &mpd_ctx) < 0) {
+        if (check_order_value(m, amount, 0) < 0) {
+            return -2;
+        }
+        if (!balance_enough(user_id, m->stock, amount, m->stock_prec)) {
             return -1;
         }
 
-        skiplist_iter *iter = skiplist_get_iterator(m->bids);
-        skiplist_node *node = skiplist_next(iter);
-        if (node == NULL) {
-            skiplist_release_iterator(iter);
+        if (m->bid_count == 0) {
             return -3;
         }
-        skiplist_release_iterator(iter);
 
-        if (mpd_cmp(amount, m->min_amount, &mpd_ctx) < 0) {
+        if (amount < m->min_amount) {
             return -2;
         }
     } else {
-        mpd_t *balance = balance_get(user_id, BALANCE_TYPE_AVAILABLE, m->money);
-        if (!balance || mpd_cmp(balance, amount, &mpd_ctx) < 0) {
+        // amount of market bid order is money
+        if (stock_value(m, &amount, amount) < 0) {
+            return -2;
+        }
+        if (!balance_enough(user_id, m->money, amount, m->value_prec)) {
             return -1;
         }
 
-        skiplist_iter *iter = skiplist_get_iterator(m->asks);
-        skiplist_node *node = skiplist_next(iter);
+        skiplist_node *node = m->asks->header->forward[0];
         if (node == NULL) {
-            skiplist_release_iterator(iter);
             return -3;
         }
-        skiplist_release_iterator(iter);
 
-        order_t *order = node->value;
-        mpd_t *require = mpd_new(&mpd_ctx);
-        mpd_mul(require, order->price, m->min_amount, &mpd_ctx);
-        if (mpd_cmp(amount, require, &mpd_ctx) < 0) {
-            mpd_del(require);
+        order_level_t *level = node->value;
+        int64_t require;
+        if (trade_deal(m, &require, level->price, m->min_amount) < 0 || amount < require) {
             return -2;
         }
-        mpd_del(require);
     }
 
-    order_t *order = malloc(sizeof(order_t));
+    order_t *order = order_create(m, MARKET_ORDER_TYPE_MARKET, user_id, side, amount, 0, taker_fee, 0, source);
     if (order == NULL) {
         return -__LINE__;
     }
 
-    order->id           = ++order_id_start;
-    order->type         = MARKET_ORDER_TYPE_MARKET;
-    order->side         = side;
-    order->create_time  = current_timestamp();
-    order->update_time  = order->create_time;
-    order->market       = strdup(m->name);
-    order->source       = strdup(source);
-    order->user_id      = user_id;
-    order->price        = mpd_new(&mpd_ctx);
-    order->amount       = mpd_new(&mpd_ctx);
-    order->taker_fee    = mpd_new(&mpd_ctx);
-    order->maker_fee    = mpd_new(&mpd_ctx);
-    order->left         = mpd_new(&mpd_ctx);
-    order->freeze       = mpd_new(&mpd_ctx);
-    order->deal_stock   = mpd_new(&mpd_ctx);
-    order->deal_money   = mpd_new(&mpd_ctx);
-    order->deal_fee     = mpd_new(&mpd_ctx);
-
-    mpd_copy(order->price, mpd_zero, &mpd_ctx);
-    mpd_copy(order->amount, amount, &mpd_ctx);
-    mpd_copy(order->taker_fee, taker_fee, &mpd_ctx);
-    mpd_copy(order->maker_fee, mpd_zero, &mpd_ctx);
-    mpd_copy(order->left, amount, &mpd_ctx);
-    mpd_copy(order->freeze, mpd_zero, &mpd_ctx);
-    mpd_copy(order->deal_stock, mpd_zero, &mpd_ctx);
-    mpd_copy(order->deal_money, mpd_zero, &mpd_ctx);
-    mpd_copy(order->deal_fee, mpd_zero, &mpd_ctx);
-
     int ret;
     if (side == MARKET_ORDER_SIDE_ASK) {
         ret = execute_market_ask_order(real, m, order);
     } else {
         ret = execute_market_bid_order(real, m, order);
     }
-    if (ret < 0) {
-        log_error("execute order: %"PRIu64" fail: %d", order->id, ret);
-        order_free(order);
-        return -__LINE__;
+    // a market order never rests, one whose matching stopped early finishes with what it filled
+    if (ret == EXECUTE_STOPPED) {
+        log_error("market order stopped early, market: %s, order: %"PRIu64", left: %"PRIi64, m->name, order->id, order->left);
     }
-
     if (real) {
-        int ret = append_order_history(order);
+        ret = append_order_history(m, order);
         if (ret < 0) {
             log_fatal("append_order_history fail: %d, order: %"PRIu64"", ret, order->id);
         }
-        mpd_t *filled = mpd_new(&mpd_ctx);
-        mpd_sub(filled, order->left, order->amount, &mpd_ctx);
-
-        push_order_message(ORDER_EVENT_FINISH, order, m, filled);
-        *result = get_order_info(order);
-        mpd_del(filled);
+        push_order_message(ORDER_EVENT_FINISH, order, m, order->left - order->amount);
+        *result = get_order_info(m, order);
     }
 
-    order_free(order);
+    order_free(m, order);
     return 0;
 }
 
 int market_put_fok_order(bool real, json_t **result, market_t *m,
-    uint32_t user_id, uint32_t side, mpd_t *amount, mpd_t *price,
-    mpd_t *taker_fee, const char *source)
+    uint32_t user_id, uint32_t side, int64_t amount, int64_t price,
+    int64_t taker_fee, const char *source)
 {
+    if (check_order_value(m, amount, price) < 0) {
+        return -2;
+    }
+
     if (side == MARKET_ORDER_SIDE_ASK) {
-        mpd_t *balance = balance_get(user_id, BALANCE_TYPE_AVAILABLE, m->stock);
-        if (!balance || mpd_cmp(balance, amount, &mpd_ctx) < 0) {
+        if (!balance_enough(user_id, m->stock, amount, m->stock_prec)) {
             return -1;
         }
     } else {
-        mpd_t *balance = balance_get(user_id, BALANCE_TYPE_AVAILABLE, m->money);
-        mpd_t *require = mpd_new(&mpd_ctx);
-        mpd_mul(require, amount, price, &mpd_ctx);
-        if (!balance || mpd_cmp(balance, require, &mpd_ctx) < 0) {
-            mpd_del(require);
+        int64_t require;
+        trade_deal(m, &require, price, amount);
+        if (!balance_enough(user_id, m->money, require, m->value_prec)) {
             return -1;
         }
-        mpd_del(require);
     }
 
-    if (mpd_cmp(amount, m->min_amount, &mpd_ctx) < 0) {
+    if (amount < m->min_amount) {
         return -2;
     }
 
-    order_t *order = malloc(sizeof(order_t));
+    order_t *order = order_create(m, MARKET_ORDER_TYPE_FOK, user_id, side, amount, price, taker_fee, 0, source);
     if (order == NULL) {
         return -__LINE__;
     }
 
-    order->id           = ++order_id_start;
-    order->type         = MARKET_ORDER_TYPE_FOK;
-    order->side         = side;
-    order->create_time  = current_timestamp();
-    order->update_time  = order->create_time;
-    order->market       = strdup(m->name);
-    order->source       = strdup(source);
-    order->user_id      = user_id;
-    order->price        = mpd_new(&mpd_ctx);
-    order->amount       = mpd_new(&mpd_ctx);
-    order->taker_fee    = mpd_new(&mpd_ctx);
-    order->maker_fee    = mpd_new(&mpd_ctx);
-    order->left         = mpd_new(&mpd_ctx);
-    order->freeze       = mpd_new(&mpd_ctx);
-    order->deal_stock   = mpd_new(&mpd_ctx);
-    order->deal_money   = mpd_new(&mpd_ctx);
-    order->deal_fee     = mpd_new(&mpd_ctx);
-
-    mpd_copy(order->price, price, &mpd_ctx);
-    mpd_copy(order->amount, amount, &mpd_ctx);
-    mpd_copy(order->taker_fee, taker_fee, &mpd_ctx);
-    mpd_copy(order->maker_fee, mpd_zero, &mpd_ctx);
-    mpd_copy(order->left, amount, &mpd_ctx);
-    mpd_copy(order->freeze, mpd_zero, &mpd_ctx);
-    mpd_copy(order->deal_stock, mpd_zero, &mpd_ctx);
-    mpd_copy(order->deal_money, mpd_zero, &mpd_ctx);
-    mpd_copy(order->deal_fee, mpd_zero, &mpd_ctx);
-
     int ret;
     if (side == MARKET_ORDER_SIDE_ASK) {
         ret = execute_aon_ask_order(real, m, order);
     } else {
         ret = execute_aon_bid_order(real, m, order);
     }
-    if (ret < 0) {
-        log_error("execute aon order: %"PRIu64" fail: %d", order->id, ret);
-        order_free(order);
-        return -__LINE__;
-    }
-
     if (real) {
-        ret = append_order_history(order);
+        ret = append_order_history(m, order);
         if (ret < 0) {
             log_fatal("append_order_history fail: %d, order: %"PRIu64"", ret,
                       order->id);
         }
         push_order_message(ORDER_EVENT_FINISH, order, m, order->amount);
-        *result = get_order_info(order);
+        *result = get_order_info(m, order);
     }
 
-    order_free(order);
+    order_free(m, order);
     return 0;
 }
 
 int market_put_aon_order(bool real, json_t **result, market_t *m,
-    uint32_t user_id, uint32_t side, mpd_t *amount, mpd_t *price,
-    mpd_t *taker_fee, mpd_t *maker_fee, const char *source)
+    uint32_t user_id, uint32_t side, int64_t amount, int64_t price,
+    int64_t taker_fee, int64_t maker_fee, const char *source)
 {
+    if (check_order_value(m, amount, price) < 0) {
+        return -2;
+    }
+
     if (side == MARKET_ORDER_SIDE_ASK) {
-        mpd_t *balance = balance_get(user_id, BALANCE_TYPE_AVAILABLE, m->stock);
-        if (!balance || mpd_cmp(balance, amount, &mpd_ctx) < 0) {
+        if (!balance_enough(user_id, m->stock, amount, m->stock_prec)) {
             return -1;
         }
     } else {
-        mpd_t *balance = balance_get(user_id, BALANCE_TYPE_AVAILABLE, m->money);
-        mpd_t *require = mpd_new(&mpd_ctx);
-        mpd_mul(require, amount, price, &mpd_ctx);
-        if (!balance || mpd_cmp(balance, require, &mpd_ctx) < 0) {
-            mpd_del(require);
+        int64_t require;
+        trade_deal(m, &require, price, amount);
+        if (!balance_enough(user_id, m->money, require, m->value_prec)) {
             return -1;
         }
-        mpd_del(require);
     }
 
-    if (mpd_cmp(amount, m->min_amount, &mpd_ctx) < 0) {
+    if (amount < m->min_amount) {
         return -2;
     }
 
-    order_t *order = malloc(sizeof(order_t));
+    order_t *order = order_create(m, MARKET_ORDER_TYPE_AON, user_id, side, amount, price, taker_fee, 0, source);
     if (order == NULL) {
         return -__LINE__;
     }
 
-    order->id           = ++order_id_start;
-    order->type         = MARKET_ORDER_TYPE_AON;
-    order->side         = side;
-    order->create_time  = current_timestamp();
-    order->update_time  = order->create_time;
-    order->market       = strdup(m->name);
-    order->source       = strdup(source);
-    order->user_id      = user_id;
-    order->price        = mpd_new(&mpd_ctx);
-    order->amount       = mpd_new(&mpd_ctx);
-    order->taker_fee    = mpd_new(&mpd_ctx);
-    order->maker_fee    = mpd_new(&mpd_ctx);
-    order->left         = mpd_new(&mpd_ctx);
-    order->freeze       = mpd_new(&mpd_ctx);
-    order->deal_stock   = mpd_new(&mpd_ctx);
-    order->deal_money   = mpd_new(&mpd_ctx);
-    order->deal_fee     = mpd_new(&mpd_ctx);
-
-    mpd_copy(order->price, price, &mpd_ctx);
-    mpd_copy(order->amount, amount, &mpd_ctx);
-    mpd_copy(order->taker_fee, taker_fee, &mpd_ctx);
-    mpd_copy(order->maker_fee, mpd_zero, &mpd_ctx);
-    mpd_copy(order->left, amount, &mpd_ctx);
-    mpd_copy(order->freeze, mpd_zero, &mpd_ctx);
-    mpd_copy(order->deal_stock, mpd_zero, &mpd_ctx);
-    mpd_copy(order->deal_money, mpd_zero, &mpd_ctx);
-    mpd_copy(order->deal_fee, mpd_zero, &mpd_ctx);
-
     int ret;
     if (side == MARKET_ORDER_SIDE_ASK) {
         ret = execute_aon_ask_order(real, m, order);
     } else {
         ret = execute_aon_bid_order(real, m, order);
     }
-    if (ret < 0) {
-        log_error("execute aon order: %"PRIu64" fail: %d", order->id, ret);
-        order_free(order);
-        return -__LINE__;
-    }
-
-    if (mpd_cmp(order->left, mpd_zero, &mpd_ctx) == 0) {
+    if (order->left == 0 || ret == EXECUTE_STOPPED) {
         if (real) {
-            ret = append_order_history(order);
+            ret = append_order_history(m, order);
             if (ret < 0) {
                 log_fatal("append_order_history fail: %d, order: %"PRIu64"", ret, order->id);
             }
-            push_order_message(ORDER_EVENT_FINISH, order, m, order->amount);
-            *result = get_order_info(order);
+            push_order_message(ORDER_EVENT_FINISH, order, m, order->amount - order->left);
+            *result = get_order_info(m, order);
         }
-        order_free(order);
+        order_free(m, order);
     } else {
         if (real) {
-            push_order_message(ORDER_EVENT_PUT, order, m, mpd_zero);
-            *result = get_order_info(order);
+            push_order_message(ORDER_EVENT_PUT, order, m, 0);
+            *result = get_order_info(m, order);
         }
         ret = order_put(m, order);
         if (ret < 0) {
@@ -1508,22 +1517,428 @@ int market_put_aon_order(bool real, json_t **result, market_t *m,
 int market_cancel_order(bool real, json_t **result, market_t *m, order_t *order)
 {
     if (real) {
-        push_order_message(ORDER_EVENT_FINISH, order, m, mpd_zero);
-        *result = get_order_info(order);
+        push_order_message(ORDER_EVENT_FINISH, order, m, 0);
+        *result = get_order_info(m, order);
     }
     order_finish(real, m, order);
     return 0;
 }
 
-int market_put_order(market_t *m, order_t *order)
+int market_parse_order_req(json_t *params, order_req *req)
+{
+    if (!json_is_array(params))
+        return -__LINE__;
+    memset(req, 0, sizeof(order_req));
+    size_t idx = 0;
+
+    // type
+    if (!json_is_integer(json_array_get(params, idx)))
+        return -__LINE__;
+    req->type = json_integer_value(json_array_get(params, idx++));
+    if (req->type != MARKET_ORDER_TYPE_LIMIT && req->type != MARKET_ORDER_TYPE_MARKET &&
+            req->type != MARKET_ORDER_TYPE_AON && req->type != MARKET_ORDER_TYPE_FOK)
+        return -__LINE__;
+    bool is_price_setter = (req->type != MARKET_ORDER_TYPE_MARKET);
+    bool is_maker_candiate = (req->type == MARKET_ORDER_TYPE_LIMIT || req->type == MARKET_ORDER_TYPE_AON);
+    if (json_array_size(params) != 6 + is_price_setter + is_maker_candiate)
+        return -__LINE__;
+
+    // market
+    if (!json_is_string(json_array_get(params, idx)))
+        return -__LINE__;
+    market_t *m = get_market(json_string_value(json_array_get(params, idx++)));
+    if (m == NULL)
+        return 0;
+
+    // side
+    if (!json_is_integer(json_array_get(params, idx)))
+        return -__LINE__;
+    req->side = json_integer_value(json_array_get(params, idx++));
+    if (req->side != MARKET_ORDER_SIDE_ASK && req->side != MARKET_ORDER_SIDE_BID)
+        return -__LINE__;
+
+    // amount
+    if (!json_is_string(json_array_get(params, idx)))
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, idx++)), m->stock_prec, &req->amount) < 0 || req->amount <= 0)
+        return -__LINE__;
+
+    // price
+    if (is_price_setter) {
+        if (!json_is_string(json_array_get(params, idx)))
+            return -__LINE__;
+        if (fixed_parse(json_string_value(json_array_get(params, idx++)), m->money_prec, &req->price) < 0 || req->price <= 0)
+            return -__LINE__;
+    }
+
+    // taker fee
+    if (!json_is_string(json_array_get(params, idx)))
+        return -__LINE__;
+    if (fixed_parse(json_string_value(json_array_get(params, idx++)), m->fee_prec, &req->taker_fee) < 0 ||
+            req->taker_fee < 0 || req->taker_fee >= fixed_pow10[m->fee_prec])
+        return -__LINE__;
+
+    // maker fee
+    if (is_maker_candiate) {
+        if (!json_is_string(json_array_get(params, idx)))
+            return -__LINE__;
+        if (fixed_parse(json_string_value(json_array_get(params, idx++)), m->fee_prec, &req->maker_fee) < 0 ||
+                req->maker_fee < 0 || req->maker_fee >= fixed_pow10[m->fee_prec])
+            return -__LINE__;
+    }
+
+    // source
+    if (!json_is_string(json_array_get(params, idx)))
+        return -__LINE__;
+    req->source = json_string_value(json_array_get(params, idx++));
+    if (strlen(req->source) >= SOURCE_MAX_LEN)
+        return -__LINE__;
+
+    req->market = m;
+    return 0;
+}
+
+struct batch_require {
+    const char  *asset;
+    mpd_t       *value;
+};
+
+static void batch_require_add(struct batch_require *list, size_t *count, const char *asset, int64_t val, int prec)
+{
+    size_t i;
+    for (i = 0; i < *count; ++i) {
+        if (strcmp(list[i].asset, asset) == 0)
+            break;
+    }
+    if (i == *count) {
+        list[i].asset = asset;
+        list[i].value = mpd_qncopy(mpd_zero);
+        *count += 1;
+    }
+
+    FIXED_MPD(require);
+    mpd_add(list[i].value, list[i].value, fixed_to_mpd(&require, val, prec), &mpd_ctx);
+    mpd_del(&require);
+}
+
+// the same amount each market_put_*_order checks, summed by asset
+int market_check_batch_balance(uint32_t user_id, order_req *reqs, size_t count)
+{
+    struct batch_require list[ORDER_BATCH_MAX];
+    size_t list_count = 0;
+    int ret = 0;
+
+    if (count > ORDER_BATCH_MAX)
+        return -__LINE__;
+
+    for (size_t i = 0; i < count; ++i) {
+        order_req *req = &reqs[i];
+        market_t *m = req->market;
+        if (check_order_value(m, req->amount, req->price) < 0) {
+            ret = -2;
+            goto cleanup;
+        }
+
+        if (req->side == MARKET_ORDER_SIDE_ASK) {
+            batch_require_add(list, &list_count, m->stock, req->amount, m->stock_prec);
+            continue;
+        }
+
+        int64_t require;
+        if (req->type == MARKET_ORDER_TYPE_MARKET) {
+            stock_value(m, &require, req->amount);
+        } else {
+            trade_deal(m, &require, req->price, req->amount);
+            if (req->type == MARKET_ORDER_TYPE_LIMIT && m->include_fee) {
+                int64_t max_fee;
+                money_fee(m, &max_fee, require, req->taker_fee);
+                require += max_fee;
+            }
+        }
+        batch_require_add(list, &list_count, m->money, require, m->value_prec);
+    }
+
+    for (size_t i = 0; i < list_count; ++i) {
+        mpd_t *balance = balance_get(user_id, BALANCE_TYPE_AVAILABLE, list[i].asset);
+        if (balance == NULL || mpd_cmp(balance, list[i].value, &mpd_ctx) < 0) {
+            ret = -1;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    for (size_t i = 0; i < list_count; ++i) {
+        mpd_del(list[i].value);
+    }
+    return ret;
+}
+
+int market_put_order_req(bool real, json_t **result, uint32_t user_id, order_req *req)
+{
+    switch (req->type) {
+    case MARKET_ORDER_TYPE_LIMIT:
+        return market_put_limit_order(real, result, req->market, user_id, req->side,
+                req->amount, req->price, req->taker_fee, req->maker_fee, req->source);
+    case MARKET_ORDER_TYPE_MARKET:
+        return market_put_market_order(real, result, req->market, user_id, req->side,
+                req->amount, req->taker_fee, req->source);
+    case MARKET_ORDER_TYPE_AON:
+        return market_put_aon_order(real, result, req->market, user_id, req->side,
+                req->amount, req->price, req->taker_fee, req->maker_fee, req->source);
+    case MARKET_ORDER_TYPE_FOK:
+        return market_put_fok_order(real, result, req->market, user_id, req->side,
+                req->amount, req->price, req->taker_fee, req->source);
+    }
+    return -__LINE__;
+}
+
+// the freeze balance must cover the freeze of every order taken out
+static bool freeze_enough(uint32_t user_id, const char *asset, mpd_t *total)
+{
+    if (mpd_cmp(total, mpd_zero, &mpd_ctx) == 0)
+        return true;
+    mpd_t *balance = balance_get(user_id, BALANCE_TYPE_FREEZE, asset);
+    if (balance == NULL)
+        return false;
+    return mpd_cmp(balance, total, &mpd_ctx) >= 0;
+}
+
+int market_cancel_user_orders(bool real, json_t *result, market_t *m, uint32_t user_id, uint32_t side)
+{
+    skiplist_t *order_list = market_get_order_list(m, user_id);
+    if (order_list == NULL || skiplist_len(order_list) == 0)
+        return 0;
+
+    // order_remove can release the list, take the orders out first
+    order_t **orders = malloc(sizeof(order_t *) * skiplist_len(order_list));
+    if (orders == NULL)
+        return -__LINE__;
+    size_t count = 0;
+    skiplist_node *node;
+    skiplist_iter *iter = skiplist_get_iterator(order_list);
+    while ((node = skiplist_next(iter)) != NULL) {
+        order_t *order = node->value;
+        if (side != 0 && order->side != side)
+            continue;
+        orders[count++] = order;
+    }
+    skiplist_release_iterator(iter);
+
+    // sum in decimal, nothing is changed until both sums are known to be frozen
+    int ret = 0;
+    mpd_t *stock_freeze = mpd_qncopy(mpd_zero);
+    mpd_t *money_freeze = mpd_qncopy(mpd_zero);
+    for (size_t i = 0; i < count; ++i) {
+        order_t *order = orders[i];
+        mpd_t *total = order->side == MARKET_ORDER_SIDE_ASK ? stock_freeze : money_freeze;
+        FIXED_MPD(freeze);
+        mpd_add(total, total, fixed_to_mpd(&freeze, order->freeze, m->value_prec), &mpd_ctx);
+        mpd_del(&freeze);
+    }
+
+    if (!freeze_enough(user_id, m->stock, stock_freeze) || !freeze_enough(user_id, m->money, money_freeze)) {
+        log_error("freeze of user: %u not enough to cancel orders in market: %s", user_id, m->name);
+        ret = -__LINE__;
+        goto cleanup;
+    }
+    if (mpd_cmp(stock_freeze, mpd_zero, &mpd_ctx) > 0 && balance_unfreeze(user_id, m->stock, stock_freeze) == NULL) {
+        ret = -__LINE__;
+        goto cleanup;
+    }
+    if (mpd_cmp(money_freeze, mpd_zero, &mpd_ctx) > 0 && balance_unfreeze(user_id, m->money, money_freeze) == NULL) {
+        if (mpd_cmp(stock_freeze, mpd_zero, &mpd_ctx) > 0 && balance_freeze(user_id, m->stock, stock_freeze) == NULL) {
+            log_fatal("refreeze user: %u, asset: %s fail", user_id, m->stock);
+        }
+        ret = -__LINE__;
+        goto cleanup;
+    }
+
+    // the freeze is released, the orders go whatever a removal returns
+    for (size_t i = 0; i < count; ++i) {
+        order_t *order = orders[i];
+        uint64_t order_id = order->id;
+        if (real) {
+            push_order_message(ORDER_EVENT_FINISH, order, m, 0);
+            json_array_append_new(result, json_integer(order_id));
+        }
+        int remove_ret = order_remove(real, m, order);
+        if (remove_ret < 0) {
+            log_fatal("order_remove fail: %d, order: %"PRIu64"", remove_ret, order_id);
+        }
+    }
+    ret = count;
+
+cleanup:
+    mpd_del(stock_freeze);
+    mpd_del(money_freeze);
+    free(orders);
+    return ret;
+}
+
+// freeze of a resting order with left at price, the same as order_put
+static int order_require(market_t *m, order_t *order, int64_t price, int64_t left, int64_t *require)
+{
+    if (order->side == MARKET_ORDER_SIDE_ASK)
+        return stock_value(m, require, left);
+
+    int64_t max_fee;
+    if (trade_deal(m, require, price, left) < 0)
+        return -1;
+    if (money_fee(m, &max_fee, *require, order->taker_fee) < 0)
+        return -1;
+    return fixed_add(require, *require, max_fee);
+}
+
+// a smaller amount at the same price keeps the order in place with its time priority
+static int order_reduce(bool real, json_t **result, market_t *m, order_t *order, int64_t amount)
+{
+    int64_t old_require, new_require;
+    if (order_require(m, order, order->price, order->left, &old_require) < 0)
+        return -__LINE__;
+    if (order_require(m, order, order->price, amount, &new_require) < 0)
+        return -__LINE__;
+
+    int64_t unfreeze = old_require - new_require;
+    if (unfreeze > order->freeze)
+        unfreeze = order->freeze;
+    if (unfreeze > 0) {
+        const char *asset = order->side == MARKET_ORDER_SIDE_ASK ? m->stock : m->money;
+        if (trade_balance_unfreeze(order->user_id, asset, unfreeze, m->value_prec) == NULL)
+            return -__LINE__;
+        order->freeze -= unfreeze;
+    }
+
+    int64_t reduce = order->left - amount;
+    order->left = amount;
+    order->amount -= reduce;
+    order->level->left -= reduce;
+    level_changed(m, order->side, order->price);
+    order->update_time = current_timestamp();
+    order_dirty(m, order);
+
+    if (real) {
+        push_order_message(ORDER_EVENT_UPDATE, order, m, 0);
+        *result = get_order_info(m, order);
+    }
+    return 0;
+}
+
+// an amended order only rests in the book, it must not trade
+static bool order_would_cross(market_t *m, uint32_t side, int64_t price)
+{
+    skiplist_t *book = side == MARKET_ORDER_SIDE_ASK ? m->bids : m->asks;
+    skiplist_node *node = book->header->forward[0];
+    if (node == NULL)
+        return false;
+
+    order_level_t *level = node->value;
+    if (side == MARKET_ORDER_SIDE_ASK)
+        return price <= level->price;
+    return price >= level->price;
+}
+
+// a new price or a larger amount moves the order to the level of the new price, it keeps its id
+static int order_reposition(bool real, json_t **result, market_t *m, order_t *order, int64_t amount, int64_t price)
+{
+    if (check_order_value(m, amount, price) < 0 || amount < m->min_amount)
+        return -2;
+    if (order_would_cross(m, order->side, price))
+        return -3;
+
+    int64_t require;
+    if (order_require(m, order, price, amount, &require) < 0)
+        return -2;
+    const char *asset = order->side == MARKET_ORDER_SIDE_ASK ? m->stock : m->money;
+    int64_t delta = require - order->freeze;
+    if (delta > 0 && !balance_enough(order->user_id, asset, delta, m->value_prec))
+        return -1;
+
+    // only the difference to the freeze already held is frozen or released
+    if (delta > 0) {
+        if (trade_balance_freeze(order->user_id, asset, delta, m->value_prec) == NULL)
+            return -__LINE__;
+    } else if (delta < 0) {
+        if (trade_balance_unfreeze(order->user_id, asset, -delta, m->value_prec) == NULL)
+            return -__LINE__;
+    }
+    order->freeze = require;
+
+    // a new price or a larger amount loses the place in the queue
+    order_level_remove(m, order);
+    order->price = price;
+    order->amount += amount - order->left;
+    order->left = amount;
+    order->update_time = current_timestamp();
+    order->seq = ++m->order_seq;
+    int ret = order_level_add(m, order);
+    if (ret < 0) {
+        log_fatal("order_level_add fail: %d, order: %"PRIu64, ret, order->id);
+        return ret;
+    }
+    order_dirty(m, order);
+
+    if (real) {
+        push_order_message(ORDER_EVENT_UPDATE, order, m, 0);
+        *result = get_order_info(m, order);
+    }
+    return 0;
+}
+
+int market_amend_order(bool real, json_t **result, market_t *m, order_t *order, int64_t amount, int64_t price)
+{
+    if (amount <= 0 || price <= 0)
+        return -2;
+    if (order->level == NULL)
+        return -__LINE__;
+
+    if (price == order->price && amount <= order->left)
+        return order_reduce(real, result, m, order, amount);
+    return order_reposition(real, result, m, order, amount, price);
+}
+
+order_t *market_new_order(market_t *m)
+{
+    order_t *order = slab_alloc(m->order_slab);
+    if (order == NULL) {
+        return NULL;
+    }
+    memset(order, 0, sizeof(order_t));
+    order->market = m->name;
+
+    return order;
+}
+
+int market_restore_order(market_t *m, order_t *order)
 {
-    return order_put(m, order);
+    if (order->seq > m->order_seq)
+        m->order_seq = order->seq;
+    return order_insert(m, order);
+}
+
+int market_remove_order(market_t *m, order_t *order)
+{
+    if (order->level) {
+        order_level_remove(m, order);
+    }
+    dict_delete(m->orders, &order->id);
+
+    struct dict_user_key user_key = { .user_id = order->user_id };
+    dict_entry *entry = dict_find(m->users, &user_key);
+    if (entry) {
+        skiplist_t *order_list = entry->val;
+        skiplist_node *node = skiplist_find(order_list, order);
+        if (node) {
+            skiplist_delete(order_list, node);
+        }
+    }
+
+    order_free(m, order);
+    return 0;
 }
 
 order_t *market_get_order(market_t *m, uint64_t order_id)
 {
-    struct dict_order_key key = { .order_id = order_id };
-    dict_entry *entry = dict_find(m->orders, &key);
+    dict_entry *entry = dict_find(m->orders, &order_id);
     if (entry) {
         return entry->val;
     }
@@ -1542,28 +1957,138 @@ skiplist_t *market_get_order_list(market_t *m, uint32_t user_id)
 
 int market_get_status(market_t *m, size_t *ask_count, mpd_t *ask_amount, size_t *bid_count, mpd_t *bid_amount)
 {
-    *ask_count = m->asks->len;
-    *bid_count = m->bids->len;
-    mpd_copy(ask_amount, mpd_zero, &mpd_ctx);
-    mpd_copy(bid_amount, mpd_zero, &mpd_ctx);
+    *ask_count = m->ask_count;
+    *bid_count = m->bid_count;
+    int64_t ask_total = 0;
+    int64_t bid_total = 0;
 
     skiplist_node *node;
     skiplist_iter *iter = skiplist_get_iterator(m->asks);
     while ((node = skiplist_next(iter)) != NULL) {
-        order_t *order = node->value;
-        mpd_add(ask_amount, ask_amount, order->left, &mpd_ctx);
+        order_level_t *level = node->value;
+        ask_total += level->left;
     }
     skiplist_release_iterator(iter);
 
     iter = skiplist_get_iterator(m->bids);
     while ((node = skiplist_next(iter)) != NULL) {
-        order_t *order = node->value;
-        mpd_add(bid_amount, bid_amount, order->left, &mpd_ctx);
+        order_level_t *level = node->value;
+        bid_total += level->left;
     }
+    skiplist_release_iterator(iter);
+
+    fixed_to_mpd(ask_amount, ask_total, m->stock_prec);
+    fixed_to_mpd(bid_amount, bid_total, m->stock_prec);
 
     return 0;
 }
 
+json_t *market_depth_delta(market_t *m)
+{
+    if (dict_size(m->depth_dirty) == 0)
+        return NULL;
+
+    json_t *asks = json_array();
+    json_t *bids = json_array();
+    dict_entry *entry;
+    dict_iterator *iter = dict_get_iterator(m->depth_dirty);
+    while ((entry = dict_next(iter)) != NULL) {
+        struct depth_key *key = entry->key;
+        skiplist_t *book = key->side == MARKET_ORDER_SIDE_ASK ? m->asks : m->bids;
+        order_level_t level_key = { .price = key->price };
+        skiplist_node *node = skiplist_find(book, &level_key);
+        int64_t left = node ? ((order_level_t *)node->value)->left : 0;
+
+        json_t *info = json_array();
+        json_array_append_new_fixed(info, key->price, m->money_prec);
+        json_array_append_new_fixed(info, left, m->stock_prec);
+        json_array_append_new(key->side == MARKET_ORDER_SIDE_ASK ? asks : bids, info);
+    }
+    dict_release_iterator(iter);
+
+    json_t *delta = json_object();
+    json_object_set_new(delta, "market", json_string(m->name));
+    json_object_set_new(delta, "prev_seq", json_integer(m->depth_seq));
+    json_object_set_new(delta, "seq", json_integer(m->book_seq));
+    json_object_set_new(delta, "asks", asks);
+    json_object_set_new(delta, "bids", bids);
+
+    market_depth_clear(m);
+    return delta;
+}
+
+void market_depth_clear(market_t *m)
+{
+    dict_clear(m->depth_dirty);
+    m->depth_seq = m->book_seq;
+}
+
+order_book_iter *order_book_get_iterator(skiplist_t *book)
+{
+    order_book_iter *iter = malloc(sizeof(order_book_iter));
+    if (iter == NULL) {
+        return NULL;
+    }
+    iter->level_iter = skiplist_get_iterator(book);
+    if (iter->level_iter == NULL) {
+        free(iter);
+        return NULL;
+    }
+    iter->next = NULL;
+    return iter;
+}
+
+order_t *order_book_next(order_book_iter *iter)
+{
+    order_t *order = iter->next;
+    if (order == NULL) {
+        skiplist_node *node = skiplist_next(iter->level_iter);
+        if (node == NULL) {
+            return NULL;
+        }
+        order_level_t *level = node->value;
+        order = level->head;
+    }
+    // take the next one before the caller finishes this order
+    iter->next = order->level_next;
+    return order;
+}
+
+void order_book_release_iterator(order_book_iter *iter)
+{
+    skiplist_release_iterator(iter->level_iter);
+    free(iter);
+}
+
+sds market_pool_status(sds reply)
+{
+    reply = sdscatprintf(reply, "%-16s %-12s %-10s %-12s\n", "pool", "used", "slabs", "bytes");
+    for (size_t i = 0; i < settings.market_num; ++i) {
+        market_t *m = get_market(settings.markets[i].name);
+        if (m == NULL)
+            continue;
+        reply = sdscatprintf(reply, "%-16s %-12"PRIu64" %-10u %-12zu\n", m->name,
+                slab_used(m->order_slab), slab_num(m->order_slab), slab_bytes(m->order_slab));
+        reply = sdscatprintf(reply, "%-16s %-12"PRIu64" %-10u %-12zu\n", "  level",
+                slab_used(m->level_slab), slab_num(m->level_slab), slab_bytes(m->level_slab));
+    }
+
+    uint64_t node_used = 0;
+    uint32_t node_num = 0;
+    size_t node_bytes = 0;
+    for (int i = 1; i <= SKIPLIST_MAX_LEVEL; ++i) {
+        node_used  += slab_used(node_slabs[i]);
+        node_num   += slab_num(node_slabs[i]);
+        node_bytes += slab_bytes(node_slabs[i]);
+    }
+    reply = sdscatprintf(reply, "%-16s %-12"PRIu64" %-10u %-12zu\n", "skiplist node", node_used, node_num, node_bytes);
+    reply = sdscatprintf(reply, "%-16s %-12"PRIu64" %-10u %-12zu\n", "dict entry",
+            slab_used(entry_slab), slab_num(entry_slab), slab_bytes(entry_slab));
+    reply = sdscatprintf(reply, "%-16s %-12u\n", "source", dict_size(dict_source));
+
+    return reply;
+}
+
 sds market_status(sds reply)
 {
     reply = sdscatprintf(reply, "order last ID: %"PRIu64"\n", order_id_start);
@@ -1659,10 +2184,7 @@ int add_user_to_market(const char *market, uint32_t user_id)
 
     dict_entry *entry = dict_find(m->users, &user_key);
     if (!entry) {
-        skiplist_type type;
-        memset(&type, 0, sizeof(type));
-        type.compare = order_id_compare;
-        skiplist_t *order_list = skiplist_create(&type);
+        skiplist_t *order_list = order_list_create();
 
         if (dict_add(m->users, &user_key, order_list) == NULL)
             return -__LINE__;
@@ -10,7 +10,18 @@
 
 extern uint64_t order_id_start;
 extern uint64_t deals_id_start;
+/* id of resting orders put, changed or removed since the last slice, val is the market */
+extern dict_t *dict_order_dirty;
 
+/*
+ * order numbers are fixed point values (see ut_fixed.h), the precision of
+ * each field is taken from the market:
+ *   price                          money_prec
+ *   amount, left                   stock_prec, value_prec for market bid order
+ *   deal_stock                     stock_prec
+ *   taker_fee, maker_fee           fee_prec
+ *   freeze, deal_money, deal_fee   value_prec
+ */
 typedef struct order_t {
     uint64_t        id;
     uint32_t        type;
@@ -20,17 +31,32 @@ typedef struct order_t {
     uint32_t        user_id;
     char            *market;
     char            *source;
-    mpd_t           *price;
-    mpd_t           *amount;
-    mpd_t           *taker_fee;
-    mpd_t           *maker_fee;
-    mpd_t           *left;
-    mpd_t           *freeze;
-    mpd_t           *deal_stock;
-    mpd_t           *deal_money;
-    mpd_t           *deal_fee;
+    int64_t         price;
+    int64_t         amount;
+    int64_t         taker_fee;
+    int64_t         maker_fee;
+    int64_t         left;
+    int64_t         freeze;
+    int64_t         deal_stock;
+    int64_t         deal_money;
+    int64_t         deal_fee;
+    /* time priority in its price level, drawn again when the order is repositioned */
+    uint64_t        seq;
+
+    struct order_level_t *level;
+    struct order_t  *level_prev;
+    struct order_t  *level_next;
 } order_t;
 
+/* resting orders at one price, linked by seq */
+typedef struct order_level_t {
+    int64_t         price;
+    int64_t         left;
+    size_t          count;
+    order_t         *head;
+    order_t         *tail;
+} order_level_t;
+
 typedef struct market_t {
     char            *name;
     char            *stock;
@@ -39,40 +65,114 @@ typedef struct market_t {
     int             stock_prec;
     int             money_prec;
     int             fee_prec;
-    mpd_t           *min_amount;
+    int             stock_save;
+    int             money_save;
+    int             value_prec;
+    int64_t         min_amount;
 
     dict_t          *orders;
     dict_t          *users;
 
+    /* order_level_t, best price first */
     skiplist_t      *asks;
     skiplist_t      *bids;
+    size_t          ask_count;
+    size_t          bid_count;
+
+    slab_t          *order_slab;
+    slab_t          *level_slab;
 
     mpd_t           *last_price;
     mpd_t           *closing_price;
 
     bool            include_fee;
+
+    /* the last seq given to a resting order */
+    uint64_t        order_seq;
+
+    /* bumped on every price level change, depth_seq is where the last delta ended */
+    uint64_t        book_seq;
+    uint64_t        depth_seq;
+    /* price levels changed since depth_seq */
+    dict_t          *depth_dirty;
 } market_t;
 
+/*
+ * one order of a batch put, parsed from
+ *   [type, market, side, amount, price, taker_fee, maker_fee, source]
+ * price is absent for market order, maker_fee is only for limit and aon order
+ */
+typedef struct order_req {
+    uint32_t        type;
+    market_t        *market;
+    uint32_t        side;
+    int64_t         amount;
+    int64_t         price;
+    int64_t         taker_fee;
+    int64_t         maker_fee;
+    const char      *source;
+} order_req;
+
+# define ORDER_BATCH_MAX    100
+
+typedef struct order_book_iter {
+    skiplist_iter   *level_iter;
+    order_t         *next;
+} order_book_iter;
+
 market_t *market_create(struct market *conf);
+/*
+ * the price levels changed since the last delta, NULL if none:
+ *   {"market": name, "prev_seq": n, "seq": m, "asks": [[price, left]], "bids": [...]}
+ * left is 0 for a removed level
+ */
+json_t *market_depth_delta(market_t *m);
+void market_depth_clear(market_t *m);
 int market_get_status(market_t *m, size_t *ask_count, mpd_t *ask_amount, size_t *bid_count, mpd_t *bid_amount);
 
-int market_put_limit_order(bool real, json_t **result, market_t *m, uint32_t user_id, uint32_t side, mpd_t *amount, mpd_t *price, mpd_t *taker_fee, mpd_t *maker_fee, const char *source);
-int market_put_market_order(bool real, json_t **result, market_t *m, uint32_t user_id, uint32_t side, mpd_t *amount, mpd_t *taker_fee, const char *source);
-int market_put_aon_order(bool real, json_t **result, market_t *m, uint32_t user_id, uint32_t side, mpd_t *amount, mpd_t *price, mpd_t *taker_fee, mpd_t *maker_fee, const char *source);
-int market_put_fok_order(bool real, json_t **result, market_t *m, uint32_t user_id, uint32_t side, mpd_t *amount, mpd_t *price, mpd_t *taker_fee, const char *source);
+int market_put_limit_order(bool real, json_t **result, market_t *m, uint32_t user_id, uint32_t side, int64_t amount, int64_t price, int64_t taker_fee, int64_t maker_fee, const char *source);
+int market_put_market_order(bool real, json_t **result, market_t *m, uint32_t user_id, uint32_t side, int64_t amount, int64_t taker_fee, const char *source);
+int market_put_aon_order(bool real, json_t **result, market_t *m, uint32_t user_id, uint32_t side, int64_t amount, int64_t price, int64_t taker_fee, int64_t maker_fee, const char *source);
+int market_put_fok_order(bool real, json_t **result, market_t *m, uint32_t user_id, uint32_t side, int64_t amount, int64_t price, int64_t taker_fee, const char *source);
 int market_cancel_order(bool real, json_t **result, market_t *m, order_t *order);
-
-int market_put_order(market_t *m, order_t *order);
-
-json_t *get_order_info(order_t *order);
+/* cancel the orders of user on side, 0 for both sides, ids are appended to result, return the number canceled */
+int market_cancel_user_orders(bool real, json_t *result, market_t *m, uint32_t user_id, uint32_t side);
+/* set the left amount and price of a resting order, it keeps its id and only the freeze difference
+ * is frozen or released. a new price or amount moves it to the level of the price, -3 if it would trade */
+int market_amend_order(bool real, json_t **result, market_t *m, order_t *order, int64_t amount, int64_t price);
+
+/* market is NULL if it does not exist */
+int market_parse_order_req(json_t *params, order_req *req);
+/* the available balance of the user covers all orders of the batch, -1 if not */
+int market_check_batch_balance(uint32_t user_id, order_req *reqs, size_t count);
+int market_put_order_req(bool real, json_t **result, uint32_t user_id, order_req *req);
+
+/* allocate a zeroed order from the market pool, for orders restored from slice */
+order_t *market_new_order(market_t *m);
+/* index an order restored from slice as it was, its freeze is part of the restored balance, seq places it in its level */
+int market_restore_order(market_t *m, order_t *order);
+/* drop an order restored from slice without touching balance */
+int market_remove_order(market_t *m, order_t *order);
+void market_clear_dirty(void);
+
+int order_amount_prec(market_t *m, order_t *order);
+json_t *get_order_info(market_t *m, order_t *order);
+/* the same as get_order_info, written straight into a reply */
+void write_order_info(json_writer *w, market_t *m, order_t *order);
 order_t *market_get_order(market_t *m, uint64_t id);
 skiplist_t *market_get_order_list(market_t *m, uint32_t user_id);
 
+/* iterate orders of asks or bids in match priority, the returned order can be finished */
+order_book_iter *order_book_get_iterator(skiplist_t *book);
+order_t *order_book_next(order_book_iter *iter);
+void order_book_release_iterator(order_book_iter *iter);
+
 sds market_status(sds reply);
+sds market_pool_status(sds reply);
 
 int market_register(const char *asset, char *init_price);
 json_t *market_detail(market_t *market);
 int add_user_to_market(const char *market, uint32_t user_id);
-bool check_price_limit(mpd_t *cmp_price, mpd_t *price, const char *pct);
+bool check_price_limit(market_t *m, mpd_t *cmp_price, int64_t price, const char *pct);
 
 # endif
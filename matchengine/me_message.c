@@ -5,6 +5,7 @@
 
 # include "me_config.h"
 # include "me_message.h"
+# include "me_trade.h"
 
 # include <librdkafka/rdkafka.h>
 
@@ -13,16 +14,31 @@ static rd_kafka_t *rk;
 static rd_kafka_topic_t *rkt_deals;
 static rd_kafka_topic_t *rkt_orders;
 static rd_kafka_topic_t *rkt_balances;
+static rd_kafka_topic_t *rkt_depth;
 
 static list_t *list_deals;
 static list_t *list_orders;
 static list_t *list_balances;
+static list_t *list_depth;
 
 static nw_timer timer;
+static nw_timer depth_timer;
+
+// a message waiting for room in the producer queue, data is handed to kafka with RD_KAFKA_MSG_F_FREE
+struct message_item {
+    char        *data;
+    size_t      len;
+    sds         key;
+};
+
+static uint64_t produced_count;
+static uint64_t queue_full_count;
+static uint64_t delivery_fail_count;
 
 static void on_delivery(rd_kafka_t *rk, const rd_kafka_message_t *rkmessage, void *opaque)
 {
     if (rkmessage->err) {
+        delivery_fail_count++;
         log_fatal("Message delivery failed: %s", rd_kafka_err2str(rkmessage->err));
     } else {
         log_trace("Message delivered (topic: %s, %zd bytes, partition %"PRId32")",
@@ -35,18 +51,41 @@ static void on_logger(const rd_kafka_t *rk, int level, const char *fac, const ch
     log_error("RDKAFKA-%i-%s: %s: %s\n", level, fac, rk ? rd_kafka_name(rk) : NULL, buf);
 }
 
+// on success kafka owns item->data
+static int produce_item(rd_kafka_topic_t *topic, struct message_item *item)
+{
+    int32_t partition = 0;
+    const void *key = NULL;
+    size_t key_len = 0;
+    if (item->key) {
+        partition = RD_KAFKA_PARTITION_UA;
+        key = item->key;
+        key_len = sdslen(item->key);
+    }
+
+    int ret = rd_kafka_produce(topic, partition, RD_KAFKA_MSG_F_FREE, item->data, item->len, key, key_len, NULL);
+    if (ret == -1) {
+        if (rd_kafka_last_error() == RD_KAFKA_RESP_ERR__QUEUE_FULL) {
+            queue_full_count++;
+        } else {
+            log_fatal("Failed to produce: %s to topic %s: %s\n", item->data,
+                    rd_kafka_topic_name(topic), rd_kafka_err2str(rd_kafka_last_error()));
+        }
+        return -__LINE__;
+    }
+    item->data = NULL;
+    produced_count++;
+
+    return 0;
+}
+
 static void produce_list(list_t *list, rd_kafka_topic_t *topic)
 {
     list_node *node;
     list_iter *iter = list_get_iterator(list, LIST_START_HEAD);
     while ((node = list_next(iter)) != NULL) {
-        int ret = rd_kafka_produce(topic, 0, RD_KAFKA_MSG_F_COPY, node->value, strlen(node->value), NULL, 0, NULL);
-        if (ret == -1) {
-            log_fatal("Failed to produce: %s to topic %s: %s\n", (char *)node->value,
-                    rd_kafka_topic_name(rkt_deals), rd_kafka_err2str(rd_kafka_last_error()));
-            if (rd_kafka_last_error() == RD_KAFKA_RESP_ERR__QUEUE_FULL) {
-                break;
-            }
+        if (produce_item(topic, node->value) < 0 && rd_kafka_last_error() == RD_KAFKA_RESP_ERR__QUEUE_FULL) {
+            break;
         }
         list_del(list, node);
     }
@@ -55,6 +94,9 @@ static void produce_list(list_t *list, rd_kafka_topic_t *topic)
 
 static void on_timer(nw_timer *t, void *privdata)
 {
+    // serve delivery reports first so the queue has room for the pending lists
+    rd_kafka_poll(rk, 0);
+
     if (list_balances->len) {
         produce_list(list_balances, rkt_balances);
     }
@@ -64,27 +106,86 @@ static void on_timer(nw_timer *t, void *privdata)
     if (list_deals->len) {
         produce_list(list_deals, rkt_deals);
     }
+    if (list_depth->len) {
+        produce_list(list_depth, rkt_depth);
+    }
 
     rd_kafka_poll(rk, 0);
 }
 
 static void on_list_free(void *value)
 {
-    free(value);
+    struct message_item *item = value;
+    free(item->data);
+    sdsfree(item->key);
+    free(item);
 }
 
-int init_message(void)
+static int push_message(char *message, sds key, rd_kafka_topic_t *topic, list_t *list);
+
+// a lost delta only costs subscribers a resync, so depth never blocks the engine
+static void on_depth_timer(nw_timer *t, void *privdata)
+{
+    for (size_t i = 0; i < settings.market_num; ++i) {
+        market_t *m = get_market(settings.markets[i].name);
+        if (m == NULL)
+            continue;
+        json_t *delta = market_depth_delta(m);
+        if (delta == NULL)
+            continue;
+        if (list_depth->len < MAX_PENDING_MESSAGE) {
+            push_message(json_dumps(delta, 0), NULL, rkt_depth, list_depth);
+        } else {
+            log_error("depth message pending too much, drop delta of market: %s", m->name);
+        }
+        json_decref(delta);
+    }
+}
+
+static int set_kafka_conf(rd_kafka_conf_t *conf, const char *name, const char *value)
 {
     char errstr[1024];
-    rd_kafka_conf_t *conf = rd_kafka_conf_new();
-    if (rd_kafka_conf_set(conf, "bootstrap.servers", (&settings.producer)->brokers, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
-        log_stderr("Set kafka brokers: %s fail: %s", (&settings.producer)->brokers, errstr);
+    if (rd_kafka_conf_set(conf, name, value, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
+        log_stderr("Set kafka %s: %s fail: %s", name, value, errstr);
         return -__LINE__;
     }
-    if (rd_kafka_conf_set(conf, "queue.buffering.max.ms", "1", errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
-        log_stderr("Set kafka buffering: %s fail: %s", (&settings.producer)->brokers, errstr);
-        return -__LINE__;
+    return 0;
+}
+
+static rd_kafka_topic_t *new_topic(const char *name, bool keyed)
+{
+    rd_kafka_topic_conf_t *conf = rd_kafka_topic_conf_new();
+    if (keyed) {
+        // the same key always lands on the same partition, so the deals of a market keep their order
+        char errstr[1024];
+        if (rd_kafka_topic_conf_set(conf, "partitioner", "consistent", errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
+            log_stderr("Set kafka partitioner fail: %s", errstr);
+            rd_kafka_topic_conf_destroy(conf);
+            return NULL;
+        }
+    }
+
+    rd_kafka_topic_t *topic = rd_kafka_topic_new(rk, name, conf);
+    if (topic == NULL) {
+        log_stderr("Failed to create topic object: %s", rd_kafka_err2str(rd_kafka_last_error()));
+        return NULL;
     }
+    return topic;
+}
+
+int init_message(void)
+{
+    char errstr[1024];
+    char value[32];
+    rd_kafka_conf_t *conf = rd_kafka_conf_new();
+    ERR_RET_LN(set_kafka_conf(conf, "bootstrap.servers", settings.producer.brokers));
+    snprintf(value, sizeof(value), "%d", settings.producer.linger_ms);
+    ERR_RET_LN(set_kafka_conf(conf, "queue.buffering.max.ms", value));
+    snprintf(value, sizeof(value), "%d", settings.producer.batch_num);
+    ERR_RET_LN(set_kafka_conf(conf, "batch.num.messages", value));
+    snprintf(value, sizeof(value), "%d", settings.producer.queue_max);
+    ERR_RET_LN(set_kafka_conf(conf, "queue.buffering.max.messages", value));
+    ERR_RET_LN(set_kafka_conf(conf, "compression.codec", settings.producer.compression));
     rd_kafka_conf_set_log_cb(conf, on_logger);
     rd_kafka_conf_set_dr_msg_cb(conf, on_delivery);
 
@@ -94,21 +195,15 @@ int init_message(void)
         return -__LINE__;
     }
 
-    rkt_balances = rd_kafka_topic_new(rk, (&settings.producer)->topic_balances, NULL);
-    if (rkt_balances == NULL) {
-        log_stderr("Failed to create topic object: %s", rd_kafka_err2str(rd_kafka_last_error()));
+    rkt_balances = new_topic(settings.producer.topic_balances, false);
+    if (rkt_balances == NULL)
         return -__LINE__;
-    }
-    rkt_orders = rd_kafka_topic_new(rk, (&settings.producer)->topic_orders, NULL);
-    if (rkt_orders == NULL) {
-        log_stderr("Failed to create topic object: %s", rd_kafka_err2str(rd_kafka_last_error()));
+    rkt_orders = new_topic(settings.producer.topic_orders, false);
+    if (rkt_orders == NULL)
         return -__LINE__;
-    }
-    rkt_deals = rd_kafka_topic_new(rk, (&settings.producer)->topic_deals, NULL);
-    if (rkt_deals == NULL) {
-        log_stderr("Failed to create topic object: %s", rd_kafka_err2str(rd_kafka_last_error()));
+    rkt_deals = new_topic(settings.producer.topic_deals, settings.producer.partition_deals_by_market);
+    if (rkt_deals == NULL)
         return -__LINE__;
-    }
 
     list_type lt;
     memset(&lt, 0, sizeof(lt));
@@ -123,10 +218,30 @@ int init_message(void)
     list_balances = list_create(&lt);
     if (list_balances == NULL)
         return -__LINE__;
+    list_depth = list_create(&lt);
+    if (list_depth == NULL)
+        return -__LINE__;
 
     nw_timer_set(&timer, 0.1, true, on_timer, NULL);
     nw_timer_start(&timer);
 
+    if (settings.depth_delta) {
+        rkt_depth = new_topic(settings.producer.topic_depth, false);
+        if (rkt_depth == NULL)
+            return -__LINE__;
+
+        // changes replayed at startup are already in the book subscribers load
+        for (size_t i = 0; i < settings.market_num; ++i) {
+            market_t *m = get_market(settings.markets[i].name);
+            if (m) {
+                market_depth_clear(m);
+            }
+        }
+
+        nw_timer_set(&depth_timer, settings.depth_delta_interval, true, on_depth_timer, NULL);
+        nw_timer_start(&depth_timer);
+    }
+
     return 0;
 }
 
@@ -138,6 +253,9 @@ int fini_message(void)
     rd_kafka_topic_destroy(rkt_balances);
     rd_kafka_topic_destroy(rkt_orders);
     rd_kafka_topic_destroy(rkt_deals);
+    if (rkt_depth) {
+        rd_kafka_topic_destroy(rkt_depth);
+    }
     rd_kafka_destroy(rk);
 
     return 0;
@@ -151,26 +269,35 @@ static json_t *json_array_append_mpd(json_t *message, mpd_t *val)
     return message;
 }
 
-static int push_message(char *message, rd_kafka_topic_t *topic, list_t *list)
+/*
+ * a message with a key is partitioned by it, otherwise it goes to partition 0.
+ * only deals are keyed, by market: marketprice consumes one partition per deal
+ * shard, while the orders, balances and depth consumers of accessws read
+ * partition 0 alone.
+ */
+static int push_message(char *message, sds key, rd_kafka_topic_t *topic, list_t *list)
 {
     log_trace("push %s message: %s", rd_kafka_topic_name(topic), message);
 
+    struct message_item *item = malloc(sizeof(struct message_item));
+    item->data = message;
+    item->len = strlen(message);
+    item->key = key;
+
     if (list->len) {
-        list_add_node_tail(list, message);
+        list_add_node_tail(list, item);
         return 0;
     }
 
-    int ret = rd_kafka_produce(topic, 0, RD_KAFKA_MSG_F_COPY, message, strlen(message), NULL, 0, NULL);
-    if (ret == -1) {
-        log_fatal("Failed to produce: %s to topic %s: %s\n", message, rd_kafka_topic_name(rkt_deals), rd_kafka_err2str(rd_kafka_last_error()));
+    if (produce_item(topic, item) < 0) {
         if (rd_kafka_last_error() == RD_KAFKA_RESP_ERR__QUEUE_FULL) {
-            list_add_node_tail(list, message);
+            list_add_node_tail(list, item);
             return 0;
         }
-        free(message);
+        on_list_free(item);
         return -__LINE__;
     }
-    free(message);
+    on_list_free(item);
 
     return 0;
 }
@@ -184,49 +311,49 @@ int push_balance_message(double t, uint32_t user_id, const char *asset, const ch
     json_array_append_new(message, json_string(business));
     json_array_append_mpd(message, change);
 
-    push_message(json_dumps(message, 0), rkt_balances, list_balances);
+    push_message(json_dumps(message, 0), NULL, rkt_balances, list_balances);
     json_decref(message);
 
     return 0;
 }
 
-int push_order_message(uint32_t event, order_t *order, market_t *market, mpd_t *filled)
+int push_order_message(uint32_t event, order_t *order, market_t *market, int64_t filled)
 {
     json_t *message = json_object();
     json_object_set_new(message, "event", json_integer(event));
-    json_object_set_new(message, "order", get_order_info(order));
+    json_object_set_new(message, "order", get_order_info(market, order));
     json_object_set_new(message, "stock", json_string(market->stock));
     json_object_set_new(message, "money", json_string(market->money));
 
     json_t *morder = json_object_get(message, "order");
-    json_object_set_new_mpd(morder, "filled", filled);
+    json_object_set_new_fixed(morder, "filled", filled, order_amount_prec(market, order));
 
-    push_message(json_dumps(message, 0), rkt_orders, list_orders);
+    push_message(json_dumps(message, 0), NULL, rkt_orders, list_orders);
     json_decref(message);
 
     return 0;
 }
 
-int push_deal_message(double t, const char *market, order_t *ask, order_t *bid, mpd_t *price, mpd_t *amount,
-        mpd_t *ask_fee, mpd_t *bid_fee, int side, uint64_t id, const char *stock, const char *money)
+int push_deal_message(double t, market_t *market, order_t *ask, order_t *bid, int64_t price, int64_t amount,
+        int64_t ask_fee, int64_t bid_fee, int side, uint64_t id)
 {
     json_t *message = json_array();
     json_array_append_new(message, json_real(t));
-    json_array_append_new(message, json_string(market));
+    json_array_append_new(message, json_string(market->name));
     json_array_append_new(message, json_integer(ask->id));
     json_array_append_new(message, json_integer(bid->id));
     json_array_append_new(message, json_integer(ask->user_id));
     json_array_append_new(message, json_integer(bid->user_id));
-    json_array_append_mpd(message, price);
-    json_array_append_mpd(message, amount);
-    json_array_append_mpd(message, ask_fee);
-    json_array_append_mpd(message, bid_fee);
+    json_array_append_new_fixed(message, price, market->money_prec);
+    json_array_append_new_fixed(message, amount, market->stock_prec);
+    json_array_append_new_fixed(message, ask_fee, market->value_prec);
+    json_array_append_new_fixed(message, bid_fee, market->value_prec);
     json_array_append_new(message, json_integer(side));
     json_array_append_new(message, json_integer(id));
-    json_array_append_new(message, json_string(stock));
-    json_array_append_new(message, json_string(money));
+    json_array_append_new(message, json_string(market->stock));
+    json_array_append_new(message, json_string(market->money));
 
-    push_message(json_dumps(message, 0), rkt_deals, list_deals);
+    push_message(json_dumps(message, 0), settings.producer.partition_deals_by_market ? sdsnew(market->name) : NULL, rkt_deals, list_deals);
     json_decref(message);
 
     return 0;
@@ -249,6 +376,11 @@ sds message_status(sds reply)
     reply = sdscatprintf(reply, "message deals pending: %lu\n", list_deals->len);
     reply = sdscatprintf(reply, "message orders pending: %lu\n", list_orders->len);
     reply = sdscatprintf(reply, "message balances pending: %lu\n", list_balances->len);
+    reply = sdscatprintf(reply, "message depth pending: %lu\n", list_depth->len);
+    reply = sdscatprintf(reply, "message kafka queue: %d\n", rd_kafka_outq_len(rk));
+    reply = sdscatprintf(reply, "message produced: %"PRIu64"\n", produced_count);
+    reply = sdscatprintf(reply, "message queue full: %"PRIu64"\n", queue_full_count);
+    reply = sdscatprintf(reply, "message delivery fail: %"PRIu64"\n", delivery_fail_count);
     return reply;
 }
 
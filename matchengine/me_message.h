@@ -19,9 +19,9 @@ enum {
 };
 
 int push_balance_message(double t, uint32_t user_id, const char *asset, const char *business, mpd_t *change);
-int push_order_message(uint32_t event, order_t *order, market_t *market, mpd_t *filled);
-int push_deal_message(double t, const char *market, order_t *ask, order_t *bid, mpd_t *price, mpd_t *amount,
-        mpd_t *ask_fee, mpd_t *bid_fee, int side, uint64_t id, const char *stock, const char *money);
+int push_order_message(uint32_t event, order_t *order, market_t *market, int64_t filled);
+int push_deal_message(double t, market_t *market, order_t *ask, order_t *bid, int64_t price, int64_t amount,
+        int64_t ask_fee, int64_t bid_fee, int side, uint64_t id);
 
 bool is_message_block(void);
 sds message_status(sds reply);
@@ -1,174 +1,934 @@
 /*
- * Description: 
+ * Description:
  *     History: yang@haipo.me, 2017/04/01, create
  */
 
+# include <dirent.h>
+# include <fcntl.h>
+# include <pthread.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+
 # include "me_config.h"
 # include "me_operlog.h"
+# include "me_load.h"
+# include "ut_crc32.h"
+# include "ut_pack.h"
+
+/*
+ * operlog is written to an append only journal before it is shipped to
+ * mysql. the journal is a list of segment files named by the id of their
+ * first record, each record is:
+ *
+ *   uint32 len | uint32 crc32c(body) | body: uint64 id | double time | detail
+ *
+ * all integers are little endian, detail is the json of the command.
+ */
+
+# define OPERLOG_HEAD_SIZE      8
+# define OPERLOG_BODY_MIN       16
+# define OPERLOG_BODY_MAX       (16 * 1024 * 1024)
+# define OPERLOG_SHIP_ROWS      1000
+# define REPLAY_WINDOW          16384
+# define REPLAY_THREAD_MAX      32
 
 uint64_t operlog_id_start;
 
-static MYSQL *mysql_conn;
-static nw_job *job;
-static list_t *list;
-static nw_timer timer;
+static nw_job *writer_job;
+static nw_job *ship_job;
+static nw_timer flush_timer;
+static nw_timer ship_timer;
 
-struct operlog {
-    uint64_t id;
-    double create_time;
-    char *detail;
+static sds journal_buf;
+static uint64_t journal_buf_first;
+static uint64_t durable_id;
+static uint64_t shipped_id;
+static bool ship_running;
+static volatile bool ship_stopping;
+
+struct operlog_batch {
+    sds data;
+    uint64_t first_id;
+    uint64_t last_id;
 };
 
-static void *on_job_init(void)
+struct ship_request {
+    uint64_t target_id;
+    uint64_t shipped_id;
+};
+
+struct journal_writer {
+    int fd;
+    size_t size;
+};
+
+struct journal_shipper {
+    MYSQL *conn;
+    FILE *fp;
+    uint64_t segment;
+    uint64_t last_id;
+    sds table_last;
+};
+
+static sds segment_path(uint64_t first_id)
 {
-    return mysql_connect(&settings.db_log);
+    return sdscatprintf(sdsempty(), "%s/operlog.%020"PRIu64, settings.operlog_path, first_id);
 }
 
-static void on_job(nw_job_entry *entry, void *privdata)
+static int uint64_compare(const void *a, const void *b)
 {
-    MYSQL *conn = privdata;
-    sds sql = entry->request;
-    log_trace("exec sql: %s", sql);
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    if (x == y)
+        return 0;
+    return x > y ? 1 : -1;
+}
+
+/* sorted first ids of all segments */
+static int list_segments(uint64_t **ids, size_t *count)
+{
+    DIR *dir = opendir(settings.operlog_path);
+    if (dir == NULL)
+        return -__LINE__;
+
+    size_t total = 16;
+    uint64_t *arr = malloc(total * sizeof(uint64_t));
+    *count = 0;
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        uint64_t id;
+        char tail;
+        if (sscanf(ent->d_name, "operlog.%"SCNu64"%c", &id, &tail) != 1)
+            continue;
+        if (*count == total) {
+            total *= 2;
+            arr = realloc(arr, total * sizeof(uint64_t));
+        }
+        arr[(*count)++] = id;
+    }
+    closedir(dir);
+
+    qsort(arr, *count, sizeof(uint64_t), uint64_compare);
+    *ids = arr;
+
+    return 0;
+}
+
+/* return 1 on a record, 0 on end of file, < 0 on torn or corrupt record */
+static int read_record(FILE *fp, sds *body)
+{
+    char head[OPERLOG_HEAD_SIZE];
+    size_t n = fread(head, 1, sizeof(head), fp);
+    if (n == 0)
+        return 0;
+    if (n != sizeof(head))
+        return -__LINE__;
+
+    void *p = head;
+    size_t left = sizeof(head);
+    uint32_t len, crc;
+    unpack_uint32_le(&p, &left, &len);
+    unpack_uint32_le(&p, &left, &crc);
+    if (len < OPERLOG_BODY_MIN || len > OPERLOG_BODY_MAX)
+        return -__LINE__;
+
+    sds data = sdsnewlen(NULL, len);
+    if (fread(data, 1, len, fp) != len) {
+        sdsfree(data);
+        return -__LINE__;
+    }
+    if (generate_crc32c(data, len) != crc) {
+        sdsfree(data);
+        return -__LINE__;
+    }
+
+    *body = data;
+    return 1;
+}
+
+static void decode_body(sds body, uint64_t *id, double *create_time, const char **detail, size_t *detail_len)
+{
+    void *p = body;
+    size_t left = sdslen(body);
+    uint64_t time_bits;
+    unpack_uint64_le(&p, &left, id);
+    unpack_uint64_le(&p, &left, &time_bits);
+    memcpy(create_time, &time_bits, sizeof(double));
+    *detail = p;
+    *detail_len = left;
+}
+
+static int write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t ret = write(fd, data, len);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -__LINE__;
+        }
+        data += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+static void *on_writer_init(void)
+{
+    struct journal_writer *w = malloc(sizeof(struct journal_writer));
+    if (w == NULL)
+        return NULL;
+    w->fd = -1;
+    w->size = 0;
+
+    uint64_t *ids;
+    size_t count;
+    if (list_segments(&ids, &count) < 0) {
+        free(w);
+        return NULL;
+    }
+    if (count > 0) {
+        sds path = segment_path(ids[count - 1]);
+        w->fd = open(path, O_WRONLY | O_APPEND);
+        if (w->fd < 0) {
+            log_error("open operlog segment: %s fail: %s", path, strerror(errno));
+            sdsfree(path);
+            free(ids);
+            free(w);
+            return NULL;
+        }
+        w->size = lseek(w->fd, 0, SEEK_END);
+        sdsfree(path);
+    }
+    free(ids);
+
+    return w;
+}
+
+static void on_writer_job(nw_job_entry *entry, void *privdata)
+{
+    struct journal_writer *w = privdata;
+    struct operlog_batch *batch = entry->request;
+
+    if (w->fd < 0 || w->size >= (size_t)settings.operlog_segment_size) {
+        sds path = segment_path(batch->first_id);
+        while (true) {
+            int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+            if (fd < 0) {
+                log_fatal("create operlog segment: %s fail: %s", path, strerror(errno));
+                usleep(1000 * 1000);
+                continue;
+            }
+            if (w->fd >= 0) {
+                close(w->fd);
+            }
+            w->fd = fd;
+            w->size = 0;
+            break;
+        }
+        sdsfree(path);
+    }
+
+    // one write and one sync for every record of the batch
     while (true) {
-        int ret = mysql_real_query(conn, sql, sdslen(sql));
-        if (ret != 0 && mysql_errno(conn) != 1062) {
-            log_fatal("exec sql: %s fail: %d %s", sql, mysql_errno(conn), mysql_error(conn));
+        off_t pos = lseek(w->fd, 0, SEEK_END);
+        if (pos < 0) {
+            log_fatal("seek operlog fail: %s", strerror(errno));
+            usleep(1000 * 1000);
+            continue;
+        }
+        if (write_all(w->fd, batch->data, sdslen(batch->data)) < 0 || fdatasync(w->fd) != 0) {
+            log_fatal("write operlog fail: %s", strerror(errno));
+            // nothing is appended after a torn record, replay would stop at it
+            while (ftruncate(w->fd, pos) != 0) {
+                log_fatal("truncate operlog to: %jd fail: %s", (intmax_t)pos, strerror(errno));
+                usleep(1000 * 1000);
+            }
             usleep(1000 * 1000);
             continue;
         }
         break;
     }
+    w->size += sdslen(batch->data);
 }
 
-static void on_job_cleanup(nw_job_entry *entry)
+static void on_writer_finish(nw_job_entry *entry)
 {
-    sdsfree(entry->request);
+    struct operlog_batch *batch = entry->request;
+    durable_id = batch->last_id;
 }
 
-static void on_job_release(void *privdata)
+static void on_writer_cleanup(nw_job_entry *entry)
 {
-    mysql_close(privdata);
+    struct operlog_batch *batch = entry->request;
+    sdsfree(batch->data);
+    free(batch);
 }
 
-static void on_list_free(void *value)
+static void on_writer_release(void *privdata)
 {
-    struct operlog *log = value;
-    free(log->detail);
-    free(log);
+    struct journal_writer *w = privdata;
+    if (w->fd >= 0) {
+        close(w->fd);
+    }
+    free(w);
 }
 
-static void flush_log(void)
+static void *on_shipper_init(void)
+{
+    MYSQL *conn = mysql_connect(&settings.db_log);
+    if (conn == NULL)
+        return NULL;
+
+    struct journal_shipper *s = malloc(sizeof(struct journal_shipper));
+    memset(s, 0, sizeof(struct journal_shipper));
+    s->conn = conn;
+    s->last_id = shipped_id;
+    s->table_last = sdsempty();
+
+    return s;
+}
+
+static int ship_exec(MYSQL *conn, sds sql)
 {
-    static sds table_last;
-    if (table_last == NULL) {
-        table_last = sdsempty();
+    log_trace("exec sql: %s", sql);
+    while (true) {
+        int ret = mysql_real_query(conn, sql, sdslen(sql));
+        if (ret != 0 && mysql_errno(conn) != 1062) {
+            log_fatal("exec sql: %s fail: %d %s", sql, mysql_errno(conn), mysql_error(conn));
+            // on shutdown the rest stays in the journal for the next start
+            if (ship_stopping)
+                return -__LINE__;
+            usleep(1000 * 1000);
+            continue;
+        }
+        return 0;
     }
+}
+
+static void ship_purge(struct journal_shipper *s)
+{
+    uint64_t *ids;
+    size_t count;
+    if (list_segments(&ids, &count) < 0)
+        return;
 
     time_t now = time(NULL);
-    struct tm *tm = localtime(&now);
-    sds table = sdsempty();
-    table = sdscatprintf(table, "operlog_%04d%02d%02d", 1900 + tm->tm_year, 1 + tm->tm_mon, tm->tm_mday);
+    for (size_t i = 0; i + 1 < count && ids[i] < s->segment; ++i) {
+        sds path = segment_path(ids[i]);
+        struct stat st;
+        if (stat(path, &st) == 0 && st.st_mtime < now - settings.slice_keeptime) {
+            log_info("remove operlog segment: %s", path);
+            unlink(path);
+        }
+        sdsfree(path);
+    }
+    free(ids);
+}
 
-    if (sdscmp(table_last, table) != 0) {
-        sds create_table_sql = sdsempty();
-        create_table_sql = sdscatprintf(create_table_sql, "CREATE TABLE IF NOT EXISTS `%s` like `operlog_example`", table);
-        nw_job_add(job, 0, create_table_sql);
-        table_last = sdscpy(table_last, table);
+/* open the segment that holds last_id + 1 and seek to that record */
+static int ship_open(struct journal_shipper *s)
+{
+    uint64_t *ids;
+    size_t count;
+    if (list_segments(&ids, &count) < 0)
+        return -__LINE__;
+
+    uint64_t segment = 0;
+    bool found = false;
+    for (size_t i = 0; i < count && ids[i] <= s->last_id + 1; ++i) {
+        segment = ids[i];
+        found = true;
     }
+    free(ids);
+    if (!found)
+        return -__LINE__;
+
+    sds path = segment_path(segment);
+    FILE *fp = fopen(path, "rb");
+    sdsfree(path);
+    if (fp == NULL)
+        return -__LINE__;
+
+    while (true) {
+        off_t pos = ftello(fp);
+        sds body = NULL;
+        int ret = read_record(fp, &body);
+        if (ret <= 0) {
+            fseeko(fp, pos, SEEK_SET);
+            break;
+        }
+        uint64_t id;
+        double create_time;
+        const char *detail;
+        size_t detail_len;
+        decode_body(body, &id, &create_time, &detail, &detail_len);
+        sdsfree(body);
+        if (id > s->last_id) {
+            fseeko(fp, pos, SEEK_SET);
+            break;
+        }
+    }
+
+    if (s->fp) {
+        fclose(s->fp);
+    }
+    s->fp = fp;
+    s->segment = segment;
+
+    return 0;
+}
+
+static void on_shipper_job(nw_job_entry *entry, void *privdata)
+{
+    struct journal_shipper *s = privdata;
+    struct ship_request *req = entry->request;
 
     sds sql = sdsempty();
-    sql = sdscatprintf(sql, "INSERT INTO `%s` (`id`, `time`, `detail`) VALUES ", table);
-    sdsfree(table);
-
-    size_t count = 0;
-    char buf[10240];
-    list_node *node;
-    list_iter *iter = list_get_iterator(list, LIST_START_HEAD);
-    while ((node = list_next(iter)) != NULL) {
-        struct operlog *log = node->value;
-        size_t detail_len = strlen(log->detail);
-        mysql_real_escape_string(mysql_conn, buf, log->detail, detail_len);
-        sql = sdscatprintf(sql, "(%"PRIu64", %f, '%s')", log->id, log->create_time, buf);
-        if (list_len(list) > 1) {
+    size_t rows = 0;
+    uint64_t committed_id = s->last_id;
+    bool failed = false;
+    while (s->last_id < req->target_id && !ship_stopping) {
+        if (s->fp == NULL && ship_open(s) < 0) {
+            log_fatal("can not find operlog segment for id: %"PRIu64, s->last_id + 1);
+            break;
+        }
+
+        clearerr(s->fp);
+        off_t pos = ftello(s->fp);
+        sds body = NULL;
+        int ret = read_record(s->fp, &body);
+        if (ret == 0) {
+            // end of segment, the record must be in the next one
+            uint64_t segment = s->segment;
+            fclose(s->fp);
+            s->fp = NULL;
+            if (ship_open(s) < 0 || s->segment == segment) {
+                log_fatal("can not find operlog segment for id: %"PRIu64, s->last_id + 1);
+                break;
+            }
+            ship_purge(s);
+            continue;
+        } else if (ret < 0) {
+            log_fatal("read operlog segment: %"PRIu64" fail: %d", s->segment, ret);
+            fseeko(s->fp, pos, SEEK_SET);
+            break;
+        }
+
+        uint64_t id;
+        double create_time;
+        const char *detail;
+        size_t detail_len;
+        decode_body(body, &id, &create_time, &detail, &detail_len);
+
+        time_t t = (time_t)create_time;
+        struct tm tm;
+        localtime_r(&t, &tm);
+        sds table = sdscatprintf(sdsempty(), "operlog_%04d%02d%02d", 1900 + tm.tm_year, 1 + tm.tm_mon, tm.tm_mday);
+        if (rows > 0 && (sdscmp(table, s->table_last) != 0 || rows >= OPERLOG_SHIP_ROWS)) {
+            if (ship_exec(s->conn, sql) < 0) {
+                failed = true;
+            } else {
+                committed_id = s->last_id;
+            }
+            sdsclear(sql);
+            rows = 0;
+        }
+        if (!failed && sdscmp(table, s->table_last) != 0) {
+            sds create_table_sql = sdscatprintf(sdsempty(), "CREATE TABLE IF NOT EXISTS `%s` like `operlog_example`", table);
+            if (ship_exec(s->conn, create_table_sql) < 0) {
+                failed = true;
+            } else {
+                s->table_last = sdscpy(s->table_last, table);
+            }
+            sdsfree(create_table_sql);
+        }
+        if (failed) {
+            sdsfree(table);
+            sdsfree(body);
+            break;
+        }
+
+        if (rows == 0) {
+            sql = sdscatprintf(sql, "INSERT IGNORE INTO `%s` (`id`, `time`, `detail`) VALUES ", table);
+        } else {
             sql = sdscatprintf(sql, ", ");
         }
-        list_del(list, node);
-        count++;
+        sds escape = sdsnewlen(NULL, detail_len * 2 + 1);
+        size_t escape_len = mysql_real_escape_string(s->conn, escape, detail, detail_len);
+        sql = sdscatprintf(sql, "(%"PRIu64", %f, '", id, create_time);
+        sql = sdscatlen(sql, escape, escape_len);
+        sql = sdscatprintf(sql, "')");
+        sdsfree(escape);
+        sdsfree(table);
+        sdsfree(body);
+
+        rows += 1;
+        s->last_id = id;
+    }
+
+    if (rows > 0) {
+        if (ship_exec(s->conn, sql) < 0) {
+            failed = true;
+        } else {
+            committed_id = s->last_id;
+        }
+    }
+    sdsfree(sql);
+
+    if (failed) {
+        // read again from the last committed record
+        s->last_id = committed_id;
+        if (s->fp) {
+            fclose(s->fp);
+            s->fp = NULL;
+        }
+    }
+    req->shipped_id = s->last_id;
+}
+
+static void on_shipper_finish(nw_job_entry *entry)
+{
+    struct ship_request *req = entry->request;
+    shipped_id = req->shipped_id;
+    ship_running = false;
+}
+
+static void on_shipper_cleanup(nw_job_entry *entry)
+{
+    free(entry->request);
+}
+
+static void on_shipper_release(void *privdata)
+{
+    struct journal_shipper *s = privdata;
+    if (s->fp) {
+        fclose(s->fp);
     }
-    list_release_iterator(iter);
-    nw_job_add(job, 0, sql);
-    log_debug("flush oper log count: %zu", count);
+    mysql_close(s->conn);
+    sdsfree(s->table_last);
+    free(s);
 }
 
-static void on_timer(nw_timer *t, void *privdata)
+static void flush_log(void)
+{
+    struct operlog_batch *batch = malloc(sizeof(struct operlog_batch));
+    batch->data = journal_buf;
+    batch->first_id = journal_buf_first;
+    batch->last_id = operlog_id_start;
+    nw_job_add(writer_job, 0, batch);
+    log_debug("flush oper log: %"PRIu64" - %"PRIu64", size: %zu", batch->first_id, batch->last_id, sdslen(batch->data));
+
+    journal_buf = sdsempty();
+    journal_buf_first = 0;
+}
+
+static void on_flush_timer(nw_timer *t, void *privdata)
 {
-    if (list->len > 0) {
+    if (sdslen(journal_buf) > 0) {
         flush_log();
     }
 }
 
-int init_operlog(void)
+static void on_ship_timer(nw_timer *t, void *privdata)
+{
+    if (ship_running || shipped_id >= durable_id)
+        return;
+
+    struct ship_request *req = malloc(sizeof(struct ship_request));
+    req->target_id = durable_id;
+    req->shipped_id = shipped_id;
+    nw_job_add(ship_job, 0, req);
+    ship_running = true;
+}
+
+struct replay_record {
+    const char *data;
+    uint32_t len;
+    uint32_t crc;
+    off_t offset;
+    uint64_t id;
+    json_t *detail;
+    int error;
+};
+
+struct replay_task {
+    struct replay_record *records;
+    size_t begin;
+    size_t end;
+    uint64_t skip_id;
+};
+
+struct replay_decoder {
+    int thread_num;
+    pthread_t threads[REPLAY_THREAD_MAX];
+    struct replay_task tasks[REPLAY_THREAD_MAX];
+};
+
+static void *replay_decode(void *data)
+{
+    struct replay_task *task = data;
+    for (size_t i = task->begin; i < task->end; ++i) {
+        struct replay_record *r = &task->records[i];
+        if (generate_crc32c(r->data, r->len) != r->crc) {
+            r->error = -__LINE__;
+            continue;
+        }
+
+        void *p = (void *)r->data;
+        size_t left = r->len;
+        unpack_uint64_le(&p, &left, &r->id);
+        if (r->id <= task->skip_id)
+            continue;
+
+        const char *detail = r->data + OPERLOG_BODY_MIN;
+        r->detail = json_loadb(detail, r->len - OPERLOG_BODY_MIN, 0, NULL);
+        if (r->detail == NULL) {
+            r->error = -__LINE__;
+        }
+    }
+
+    return NULL;
+}
+
+static void replay_decoder_start(struct replay_decoder *d, struct replay_record *records, size_t begin, size_t end, uint64_t skip_id)
+{
+    int thread_num = settings.operlog_replay_thread;
+    if (thread_num > REPLAY_THREAD_MAX)
+        thread_num = REPLAY_THREAD_MAX;
+    if (thread_num < 1)
+        thread_num = 1;
+
+    size_t step = (end - begin + thread_num - 1) / thread_num;
+    d->thread_num = 0;
+    for (int i = 0; i < thread_num && begin < end; ++i) {
+        struct replay_task *task = &d->tasks[i];
+        task->records = records;
+        task->begin = begin;
+        task->end = begin + step < end ? begin + step : end;
+        task->skip_id = skip_id;
+        begin = task->end;
+        if (pthread_create(&d->threads[d->thread_num], NULL, replay_decode, task) == 0) {
+            d->thread_num++;
+        } else {
+            replay_decode(task);
+        }
+    }
+}
+
+static void replay_decoder_join(struct replay_decoder *d)
+{
+    for (int i = 0; i < d->thread_num; ++i) {
+        pthread_join(d->threads[i], NULL);
+    }
+    d->thread_num = 0;
+}
+
+/* split a mapped segment into records, return the offset of a torn tail or -1 */
+static off_t replay_split(const char *map, size_t size, struct replay_record **records, size_t *count)
 {
-    mysql_conn = mysql_init(NULL);
-    if (mysql_conn == NULL)
+    size_t total = 1024;
+    struct replay_record *arr = malloc(total * sizeof(struct replay_record));
+    *count = 0;
+
+    size_t offset = 0;
+    off_t torn = -1;
+    while (offset < size) {
+        if (size - offset < OPERLOG_HEAD_SIZE) {
+            torn = offset;
+            break;
+        }
+        void *p = (void *)(map + offset);
+        size_t left = OPERLOG_HEAD_SIZE;
+        uint32_t len, crc;
+        unpack_uint32_le(&p, &left, &len);
+        unpack_uint32_le(&p, &left, &crc);
+        if (len < OPERLOG_BODY_MIN || len > OPERLOG_BODY_MAX || size - offset - OPERLOG_HEAD_SIZE < len) {
+            torn = offset;
+            break;
+        }
+
+        if (*count == total) {
+            total *= 2;
+            arr = realloc(arr, total * sizeof(struct replay_record));
+        }
+        struct replay_record *r = &arr[(*count)++];
+        memset(r, 0, sizeof(struct replay_record));
+        r->data = map + offset + OPERLOG_HEAD_SIZE;
+        r->len = len;
+        r->crc = crc;
+        r->offset = offset;
+        offset += OPERLOG_HEAD_SIZE + len;
+    }
+
+    *records = arr;
+    return torn;
+}
+
+/* decode windows of records in worker threads, apply them in order on this thread */
+static int replay_segment(uint64_t segment, bool last_segment, uint64_t *last_id, size_t *replayed)
+{
+    sds path = segment_path(segment);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        log_error("open operlog segment: %s fail: %s", path, strerror(errno));
+        sdsfree(path);
+        return -__LINE__;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        sdsfree(path);
         return -__LINE__;
-    if (mysql_options(mysql_conn, MYSQL_SET_CHARSET_NAME, settings.db_log.charset) != 0)
+    }
+    size_t size = st.st_size;
+    if (size == 0) {
+        close(fd);
+        sdsfree(path);
+        return 0;
+    }
+
+    char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_error("mmap operlog segment: %s fail: %s", path, strerror(errno));
+        sdsfree(path);
         return -__LINE__;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    log_stderr("load oper log from: %s", path);
+
+    struct replay_record *records;
+    size_t count;
+    off_t truncate_at = replay_split(map, size, &records, &count);
+    if (truncate_at >= 0 && !last_segment) {
+        log_error("operlog segment: %s corrupt at: %jd", path, (intmax_t)truncate_at);
+        munmap(map, size);
+        free(records);
+        sdsfree(path);
+        return -__LINE__;
+    }
+
+    int ret = 0;
+    struct replay_decoder decoders[2];
+    memset(decoders, 0, sizeof(decoders));
+    size_t window_end = count < REPLAY_WINDOW ? count : REPLAY_WINDOW;
+    replay_decoder_start(&decoders[0], records, 0, window_end, *last_id);
+
+    size_t i = 0;
+    for (int w = 0; i < count; w ^= 1) {
+        replay_decoder_join(&decoders[w]);
+        size_t end = window_end;
+        if (end < count) {
+            window_end = end + REPLAY_WINDOW < count ? end + REPLAY_WINDOW : count;
+            replay_decoder_start(&decoders[w ^ 1], records, end, window_end, *last_id);
+        }
+
+        for (; i < end; ++i) {
+            struct replay_record *r = &records[i];
+            if (r->error < 0) {
+                if (last_segment && i + 1 == count) {
+                    // torn write of the last batch, it was never acknowledged
+                    truncate_at = r->offset;
+                    i = count;
+                    break;
+                }
+                log_error("operlog segment: %s corrupt at: %jd", path, (intmax_t)r->offset);
+                ret = -__LINE__;
+                break;
+            }
+            if (r->id <= *last_id)
+                continue;
+            if (r->id != *last_id + 1) {
+                log_error("invalid id: %"PRIu64", last id: %"PRIu64"", r->id, *last_id);
+                ret = -__LINE__;
+                break;
+            }
+            int load_ret = load_oper(r->detail);
+            json_decref(r->detail);
+            r->detail = NULL;
+            if (load_ret < 0) {
+                log_error("load_oper: %"PRIu64" fail: %d", r->id, load_ret);
+                ret = -__LINE__;
+                break;
+            }
+            *last_id = r->id;
+            *replayed += 1;
+        }
+        if (ret < 0)
+            break;
+    }
+
+    replay_decoder_join(&decoders[0]);
+    replay_decoder_join(&decoders[1]);
+    for (size_t j = 0; j < count; ++j) {
+        if (records[j].detail) {
+            json_decref(records[j].detail);
+        }
+    }
+    free(records);
+    munmap(map, size);
+
+    if (ret == 0 && truncate_at >= 0) {
+        log_error("truncate operlog segment: %s at: %jd", path, (intmax_t)truncate_at);
+        if (truncate(path, truncate_at) != 0) {
+            ret = -__LINE__;
+        }
+    }
+    sdsfree(path);
+
+    return ret;
+}
+
+bool operlog_journal_has(uint64_t id)
+{
+    uint64_t *ids;
+    size_t count;
+    if (list_segments(&ids, &count) < 0)
+        return false;
+    bool has = count > 0 && ids[0] <= id;
+    free(ids);
+    return has;
+}
+
+int load_operlog_from_journal(uint64_t *start_id, uint64_t shipped)
+{
+    if (mkdir(settings.operlog_path, 0755) != 0 && errno != EEXIST) {
+        log_error("create operlog path: %s fail: %s", settings.operlog_path, strerror(errno));
+        return -__LINE__;
+    }
+
+    // every id not bigger than shipped is already in mysql
+    shipped_id = shipped;
+
+    uint64_t *ids;
+    size_t count;
+    if (list_segments(&ids, &count) < 0)
+        return -__LINE__;
+
+    double begin = current_timestamp();
+    size_t replayed = 0;
+    uint64_t last_id = *start_id;
+    for (size_t i = 0; i < count; ++i) {
+        if (i + 1 < count && ids[i + 1] <= last_id + 1)
+            continue;
+        int ret = replay_segment(ids[i], i + 1 == count, &last_id, &replayed);
+        if (ret < 0) {
+            free(ids);
+            return ret;
+        }
+    }
+    free(ids);
+
+    double cost = current_timestamp() - begin;
+    log_info("replay %zu oper log from journal in %.3f seconds, %.0f records/s", replayed, cost, cost > 0 ? replayed / cost : 0);
+    log_stderr("replay %zu oper log from journal in %.3f seconds, %.0f records/s", replayed, cost, cost > 0 ? replayed / cost : 0);
+
+    *start_id = last_id;
+    return 0;
+}
+
+int init_operlog(void)
+{
+    if (mkdir(settings.operlog_path, 0755) != 0 && errno != EEXIST)
+        return -__LINE__;
+
+    durable_id = operlog_id_start;
+    if (shipped_id > durable_id)
+        shipped_id = durable_id;
+    journal_buf = sdsempty();
 
     nw_job_type type;
     memset(&type, 0, sizeof(type));
-    type.on_init    = on_job_init;
-    type.on_job     = on_job;
-    type.on_cleanup = on_job_cleanup;
-    type.on_release = on_job_release;
+    type.on_init    = on_writer_init;
+    type.on_job     = on_writer_job;
+    type.on_finish  = on_writer_finish;
+    type.on_cleanup = on_writer_cleanup;
+    type.on_release = on_writer_release;
 
-    job = nw_job_create(&type, 1);
-    if (job == NULL)
+    writer_job = nw_job_create(&type, 1);
+    if (writer_job == NULL)
         return -__LINE__;
 
-    list_type lt;
-    memset(&lt, 0, sizeof(lt));
-    lt.free = on_list_free;
-    list = list_create(&lt);
-    if (list == NULL)
+    memset(&type, 0, sizeof(type));
+    type.on_init    = on_shipper_init;
+    type.on_job     = on_shipper_job;
+    type.on_finish  = on_shipper_finish;
+    type.on_cleanup = on_shipper_cleanup;
+    type.on_release = on_shipper_release;
+
+    ship_job = nw_job_create(&type, 1);
+    if (ship_job == NULL)
         return -__LINE__;
 
-    nw_timer_set(&timer, 0.1, true, on_timer, NULL);
-    nw_timer_start(&timer);
+    nw_timer_set(&flush_timer, settings.operlog_flush_interval, true, on_flush_timer, NULL);
+    nw_timer_start(&flush_timer);
+
+    nw_timer_set(&ship_timer, 0.1, true, on_ship_timer, NULL);
+    nw_timer_start(&ship_timer);
 
     return 0;
 }
 
 int fini_operlog(void)
 {
-    on_timer(NULL, NULL);
+    on_flush_timer(NULL, NULL);
 
-    usleep(100 * 1000);
-    nw_job_release(job);
-    mysql_close(mysql_conn);
+    // the journal must be complete, the shipper catches up on next start
+    while (writer_job->request_count > 0) {
+        usleep(10 * 1000);
+    }
+    ship_stopping = true;
+    nw_job_release(writer_job);
+    nw_job_release(ship_job);
 
     return 0;
 }
 
 int append_operlog(const char *method, json_t *params)
 {
-    json_t *detail = json_object();
-    json_object_set_new(detail, "method", json_string(method));
-    json_object_set(detail, "params", params);
-    struct operlog *log = malloc(sizeof(struct operlog));
-    log->id = ++operlog_id_start;
-    log->create_time = current_timestamp();
-    log->detail = json_dumps(detail, JSON_SORT_KEYS);
-    json_decref(detail);
-    list_add_node_tail(list, log);
-    log_debug("add log: %s", log->detail);
+    json_t *json = json_object();
+    json_object_set_new(json, "method", json_string(method));
+    json_object_set(json, "params", params);
+    char *detail = json_dumps(json, JSON_SORT_KEYS);
+    json_decref(json);
+
+    uint64_t id = ++operlog_id_start;
+    double create_time = current_timestamp();
+    uint64_t time_bits;
+    memcpy(&time_bits, &create_time, sizeof(double));
+
+    size_t detail_len = strlen(detail);
+    size_t body_len = OPERLOG_BODY_MIN + detail_len;
+    size_t offset = sdslen(journal_buf);
+    journal_buf = sdsMakeRoomFor(journal_buf, OPERLOG_HEAD_SIZE + body_len);
+
+    char *body = journal_buf + offset + OPERLOG_HEAD_SIZE;
+    void *p = body;
+    size_t left = body_len;
+    pack_uint64_le(&p, &left, id);
+    pack_uint64_le(&p, &left, time_bits);
+    pack_buf(&p, &left, detail, detail_len);
+
+    p = journal_buf + offset;
+    left = OPERLOG_HEAD_SIZE;
+    pack_uint32_le(&p, &left, body_len);
+    pack_uint32_le(&p, &left, generate_crc32c(body, body_len));
+    sdsIncrLen(journal_buf, OPERLOG_HEAD_SIZE + body_len);
+
+    if (journal_buf_first == 0) {
+        journal_buf_first = id;
+    }
+    log_debug("add log: %s", detail);
+    free(detail);
 
     return 0;
 }
 
 bool is_operlog_block(void)
 {
-    if (job->request_count >= MAX_PENDING_OPERLOG)
+    if (writer_job->request_count >= MAX_PENDING_OPERLOG)
         return true;
     return false;
 }
@@ -176,7 +936,9 @@ bool is_operlog_block(void)
 sds operlog_status(sds reply)
 {
     reply = sdscatprintf(reply, "operlog last ID: %"PRIu64"\n", operlog_id_start);
-    reply = sdscatprintf(reply, "operlog pending: %d\n", job->request_count);
+    reply = sdscatprintf(reply, "operlog durable ID: %"PRIu64"\n", durable_id);
+    reply = sdscatprintf(reply, "operlog shipped ID: %"PRIu64"\n", shipped_id);
+    reply = sdscatprintf(reply, "operlog pending: %d\n", writer_job->request_count);
     return reply;
 }
 
@@ -14,6 +14,11 @@ int init_operlog(void);
 int fini_operlog(void);
 
 int append_operlog(const char *method, json_t *params);
+/* true if the journal still has the record with this id or an earlier one */
+bool operlog_journal_has(uint64_t id);
+/* replay journal records after start_id, shipped is the last id already in mysql,
+ * called before init_operlog */
+int load_operlog_from_journal(uint64_t *start_id, uint64_t shipped);
 
 bool is_operlog_block(void);
 sds operlog_status(sds reply);
@@ -3,14 +3,18 @@
  *     History: yang@haipo.me, 2017/04/04, create
  */
 
+# include <sys/wait.h>
+
 # include "me_config.h"
 # include "me_persist.h"
 # include "me_operlog.h"
 # include "me_market.h"
 # include "me_load.h"
-# include "me_dump.h"
+# include "me_balance.h"
+# include "me_snapshot.h"
 
 static time_t last_slice_time;
+static pid_t slice_pid;
 static nw_timer timer;
 
 static time_t get_today_start(void)
@@ -59,6 +63,17 @@ static int get_last_slice(MYSQL *conn, time_t *timestamp, uint64_t *last_oper_id
 
 static int load_slice_from_db(MYSQL *conn, time_t timestamp)
 {
+    if (snapshot_exist(timestamp)) {
+        int ret = load_snapshot(timestamp);
+        if (ret < 0) {
+            log_error("load_snapshot of %ld fail: %d", timestamp, ret);
+            log_stderr("load_snapshot of %ld fail: %d", timestamp, ret);
+            return -__LINE__;
+        }
+        return 0;
+    }
+
+    // slices made before the snapshot file are still in mysql tables
     sds table = sdsempty();
 
     table = sdscatprintf(table, "slice_order_%ld", timestamp);
@@ -122,6 +137,42 @@ static int load_operlog_from_db(MYSQL *conn, time_t date, uint64_t *start_id)
     return 0;
 }
 
+static int get_operlog_shipped_id(MYSQL *conn, time_t begin, time_t end, uint64_t *shipped_id)
+{
+    for (; begin < end; begin += 86400) {
+        struct tm *t = localtime(&begin);
+        sds table = sdsempty();
+        table = sdscatprintf(table, "operlog_%04d%02d%02d", 1900 + t->tm_year, 1 + t->tm_mon, t->tm_mday);
+        if (!is_table_exists(conn, table)) {
+            sdsfree(table);
+            continue;
+        }
+
+        sds sql = sdsempty();
+        sql = sdscatprintf(sql, "SELECT MAX(`id`) FROM `%s`", table);
+        sdsfree(table);
+        int ret = mysql_real_query(conn, sql, sdslen(sql));
+        if (ret != 0) {
+            log_error("exec sql: %s fail: %d %s", sql, mysql_errno(conn), mysql_error(conn));
+            sdsfree(sql);
+            return -__LINE__;
+        }
+        sdsfree(sql);
+
+        MYSQL_RES *result = mysql_store_result(conn);
+        MYSQL_ROW row = mysql_fetch_row(result);
+        if (row && row[0]) {
+            uint64_t id = strtoull(row[0], NULL, 0);
+            if (id > *shipped_id) {
+                *shipped_id = id;
+            }
+        }
+        mysql_free_result(result);
+    }
+
+    return 0;
+}
+
 int init_from_db(void)
 {
     MYSQL *conn = mysql_connect(&settings.db_log);
@@ -148,18 +199,27 @@ int init_from_db(void)
     order_id_start = last_order_id;
     deals_id_start = last_deals_id;
 
-    if (last_slice_time == 0) {
-        ret = load_operlog_from_db(conn, now, &last_oper_id);
-        if (ret < 0)
-            goto cleanup;
-    } else {
+    time_t begin = now;
+    if (last_slice_time != 0) {
         ret = load_slice_from_db(conn, last_slice_time);
         if (ret < 0) {
             goto cleanup;
         }
+        begin = last_slice_time;
+    }
+    // the next delta slice only holds changes made after the slice
+    balance_clear_dirty();
+    market_clear_dirty();
+    time_t end = get_today_start() + 86400;
 
-        time_t begin = last_slice_time;
-        time_t end = get_today_start() + 86400;
+    uint64_t shipped_id = last_oper_id;
+    if (operlog_journal_has(last_oper_id + 1)) {
+        // the local journal is a superset of the operlog tables, skip them
+        ret = get_operlog_shipped_id(conn, begin, end, &shipped_id);
+        if (ret < 0) {
+            goto cleanup;
+        }
+    } else {
         while (begin < end) {
             ret = load_operlog_from_db(conn, begin, &last_oper_id);
             if (ret < 0) {
@@ -167,8 +227,13 @@ int init_from_db(void)
             }
             begin += 86400;
         }
+        shipped_id = last_oper_id;
     }
 
+    ret = load_operlog_from_journal(&last_oper_id, shipped_id);
+    if (ret < 0)
+        goto cleanup;
+
     operlog_id_start = last_oper_id;
 
     mysql_close(conn);
@@ -181,54 +246,6 @@ cleanup:
     return ret;
 }
 
-static int dump_order_to_db(MYSQL *conn, time_t end)
-{
-    sds table = sdsempty();
-    table = sdscatprintf(table, "slice_order_%ld", end);
-    log_info("dump order to: %s", table);
-    int ret = dump_orders(conn, table);
-    if (ret < 0) {
-        log_error("dump_orders to %s fail: %d", table, ret);
-        sdsfree(table);
-        return -__LINE__;
-    }
-    sdsfree(table);
-
-    return 0;
-}
-
-static int dump_balance_to_db(MYSQL *conn, time_t end)
-{
-    sds table = sdsempty();
-    table = sdscatprintf(table, "slice_balance_%ld", end);
-    log_info("dump balance to: %s", table);
-    int ret = dump_balance(conn, table);
-    if (ret < 0) {
-        log_error("dump_balance to %s fail: %d", table, ret);
-        sdsfree(table);
-        return -__LINE__;
-    }
-    sdsfree(table);
-
-    return 0;
-}
-
-static int dump_markets_to_db(MYSQL *conn, time_t end)
-{
-    sds table = sdsempty();
-    table = sdscatprintf(table, "slice_market_%ld", end);
-    log_info("dump market to: %s", table);
-    int ret = dump_markets(conn, table);
-    if (ret < 0) {
-        log_error("dump_markets to %s fail: %d", table, ret);
-        sdsfree(table);
-        return -__LINE__;
-    }
-    sdsfree(table);
-
-    return 0;
-}
-
 int update_slice_history(MYSQL *conn, time_t end)
 {
     sds sql = sdsempty();
@@ -258,19 +275,9 @@ int dump_to_db(time_t timestamp)
     log_info("start dump slice, timestamp: %ld", timestamp);
 
     int ret;
-    ret = dump_order_to_db(conn, timestamp);
-    if (ret < 0) {
-        goto cleanup;
-    }
-
-    ret = dump_balance_to_db(conn, timestamp);
-    if (ret < 0) {
-        goto cleanup;
-    }
-
-    // Dump market closing/last prices
-    ret = dump_markets_to_db(conn, timestamp);
+    ret = dump_snapshot(timestamp, operlog_id_start, order_id_start, deals_id_start);
     if (ret < 0) {
+        log_error("dump_snapshot fail: %d", ret);
         goto cleanup;
     }
 
@@ -320,9 +327,13 @@ static int delete_slice(MYSQL *conn, uint64_t id, time_t timestamp)
 {
     log_info("delete slice id: %"PRIu64", time: %ld start", id, timestamp);
 
-    int ret;
+    int ret = delete_snapshot(timestamp);
+    if (ret < 0) {
+        return -__LINE__;
+    }
+
     sds sql = sdsempty();
-    sql = sdscatprintf(sql, "DROP TABLE `slice_order_%ld`", timestamp);
+    sql = sdscatprintf(sql, "DROP TABLE IF EXISTS `slice_order_%ld`", timestamp);
     log_trace("exec sql: %s", sql);
     ret = mysql_real_query(conn, sql, sdslen(sql));
     if (ret != 0) {
@@ -331,7 +342,7 @@ static int delete_slice(MYSQL *conn, uint64_t id, time_t timestamp)
     }
     sdsclear(sql);
 
-    sql = sdscatprintf(sql, "DROP TABLE `slice_balance_%ld`", timestamp);
+    sql = sdscatprintf(sql, "DROP TABLE IF EXISTS `slice_balance_%ld`", timestamp);
     log_trace("exec sql: %s", sql);
     ret = mysql_real_query(conn, sql, sdslen(sql));
     if (ret != 0) {
@@ -340,7 +351,7 @@ static int delete_slice(MYSQL *conn, uint64_t id, time_t timestamp)
     }
     sdsclear(sql);
 
-    sql = sdscatprintf(sql, "DROP TABLE `slice_market_%ld`", timestamp);
+    sql = sdscatprintf(sql, "DROP TABLE IF EXISTS `slice_market_%ld`", timestamp);
     log_trace("exec sql: %s", sql);
     ret = mysql_real_query(conn, sql, sdslen(sql));
     if (ret != 0) {
@@ -363,6 +374,38 @@ static int delete_slice(MYSQL *conn, uint64_t id, time_t timestamp)
     return 0;
 }
 
+/* keep the full base of the oldest slice kept, the deltas after it need it */
+static int get_keep_time(MYSQL *conn, time_t *keep_time)
+{
+    sds sql = sdsempty();
+    sql = sdscatprintf(sql, "SELECT `time` FROM `slice_history` WHERE `time` >= %ld ORDER BY `id` ASC LIMIT 1", *keep_time);
+    int ret = mysql_real_query(conn, sql, sdslen(sql));
+    if (ret != 0) {
+        log_error("exec sql: %s fail: %d %s", sql, mysql_errno(conn), mysql_error(conn));
+        sdsfree(sql);
+        return -__LINE__;
+    }
+    sdsfree(sql);
+
+    MYSQL_RES *result = mysql_store_result(conn);
+    MYSQL_ROW row = mysql_fetch_row(result);
+    if (row == NULL) {
+        mysql_free_result(result);
+        return 0;
+    }
+    time_t oldest = strtol(row[0], NULL, 0);
+    mysql_free_result(result);
+
+    time_t base = oldest;
+    if (snapshot_exist(oldest) && snapshot_get_base(oldest, &base) < 0)
+        return -__LINE__;
+    if (base < *keep_time) {
+        *keep_time = base;
+    }
+
+    return 0;
+}
+
 int clear_slice(time_t timestamp)
 {
     MYSQL *conn = mysql_connect(&settings.db_log);
@@ -380,9 +423,14 @@ int clear_slice(time_t timestamp)
         goto cleanup;
     }
 
+    time_t keep_time = timestamp - settings.slice_keeptime;
+    ret = get_keep_time(conn, &keep_time);
+    if (ret < 0) {
+        goto cleanup;
+    }
+
     sds sql = sdsempty();
-    sql = sdscatprintf(sql, "SELECT `id`, `time` FROM `slice_history` WHERE `time` < %ld",
-                       timestamp - settings.slice_keeptime);
+    sql = sdscatprintf(sql, "SELECT `id`, `time` FROM `slice_history` WHERE `time` < %ld", keep_time);
     ret = mysql_real_query(conn, sql, sdslen(sql));
     if (ret != 0) {
         log_error("exec sql: %s fail: %d %s", sql, mysql_errno(conn), mysql_error(conn));
@@ -422,13 +470,24 @@ int make_slice(time_t timestamp)
         log_fatal("fork fail: %d", pid);
         return -__LINE__;
     } else if (pid > 0) {
+        slice_pid = pid;
+        snapshot_forked(timestamp);
         return 0;
     }
 
     int ret;
+    if (settings.balance_check) {
+        // the slice process has a frozen copy of the state, check the running totals on it
+        ret = balance_check_status();
+        if (ret != 0) {
+            log_fatal("balance_check_status fail: %d", ret);
+        }
+    }
+
     ret = dump_to_db(timestamp);
     if (ret < 0) {
         log_fatal("dump_to_db fail: %d", ret);
+        exit(EXIT_FAILURE);
     }
 
     // Drop tables
@@ -441,8 +500,30 @@ int make_slice(time_t timestamp)
     return 0;
 }
 
+/* a delta slice chains to the last one, so it must be known to be written */
+static bool slice_running(void)
+{
+    if (slice_pid == 0)
+        return false;
+
+    int status;
+    pid_t pid = waitpid(slice_pid, &status, WNOHANG);
+    if (pid == 0)
+        return true;
+    if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        log_fatal("slice process: %d fail, next slice will be full", slice_pid);
+        snapshot_reset();
+    }
+    slice_pid = 0;
+
+    return false;
+}
+
 static void on_timer(nw_timer *timer, void *privdata)
 {
+    if (slice_running())
+        return;
+
     time_t now = time(NULL);
     if ((now - last_slice_time) >= settings.slice_interval && (now % settings.slice_interval) <= 5) {
         make_slice(now);
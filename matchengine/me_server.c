@@ -16,14 +16,37 @@
 static rpc_svr *svr;
 static dict_t *dict_cache;
 static nw_timer cache_timer;
+static sds reply_buf;
 
 struct cache_val {
     double      time;
-    json_t      *result;
+    sds         result;
 };
 
+static int reply_binary(nw_ses *ses, rpc_pkg *pkg, const json_t *json)
+{
+    sds body = sdsempty();
+    if (rpc_bin_encode(&body, json) < 0) {
+        sdsfree(body);
+        return -__LINE__;
+    }
+
+    rpc_pkg reply;
+    memcpy(&reply, pkg, sizeof(reply));
+    reply.pkg_type = RPC_PKG_TYPE_REPLY;
+    reply.body = body;
+    reply.body_size = sdslen(body);
+    rpc_send(ses, &reply);
+    sdsfree(body);
+
+    return 0;
+}
+
 static int reply_json(nw_ses *ses, rpc_pkg *pkg, const json_t *json)
 {
+    if (rpc_pkg_is_binary(pkg))
+        return reply_binary(ses, pkg, json);
+
     char *message_data;
     if (settings.debug) {
         message_data = json_dumps(json, JSON_INDENT(4));
@@ -100,10 +123,40 @@ static int reply_success(nw_ses *ses, rpc_pkg *pkg)
     return ret;
 }
 
+// the reply envelope around a result the caller streams into w, buffer is reused between replies
+static void reply_writer_begin(json_writer *w, rpc_pkg *pkg)
+{
+    json_writer_init(w, reply_buf, rpc_pkg_is_binary(pkg));
+    json_writer_object_begin(w);
+    json_writer_key(w, "error");
+    json_writer_null(w);
+    json_writer_key(w, "result");
+}
+
+static int reply_writer_end(nw_ses *ses, rpc_pkg *pkg, json_writer *w)
+{
+    json_writer_key(w, "id");
+    json_writer_int(w, pkg->req_id);
+    json_writer_object_end(w);
+    reply_buf = w->buf;
+    if (!w->binary) {
+        log_trace("connection: %s send: %s", nw_sock_human_addr(&ses->peer_addr), reply_buf);
+    }
+
+    rpc_pkg reply;
+    memcpy(&reply, pkg, sizeof(reply));
+    reply.pkg_type = RPC_PKG_TYPE_REPLY;
+    reply.body = reply_buf;
+    reply.body_size = sdslen(reply_buf);
+    rpc_send(ses, &reply);
+
+    return 0;
+}
+
 static bool process_cache(nw_ses *ses, rpc_pkg *pkg, sds *cache_key)
 {
     sds key = sdsempty();
-    key = sdscatprintf(key, "%u", pkg->command);
+    key = sdscatprintf(key, "%u:%d:", pkg->command, rpc_pkg_is_binary(pkg));
     key = sdscatlen(key, pkg->body, pkg->body_size);
     dict_entry *entry = dict_find(dict_cache, key);
     if (entry == NULL) {
@@ -119,22 +172,83 @@ static bool process_cache(nw_ses *ses, rpc_pkg *pkg, sds *cache_key)
         return false;
     }
 
-    reply_result(ses, pkg, cache->result);
+    json_writer w;
+    reply_writer_begin(&w, pkg);
+    json_writer_raw(&w, cache->result, sdslen(cache->result));
+    reply_writer_end(ses, pkg, &w);
     sdsfree(key);
     return true;
 }
 
-static int add_cache(sds cache_key, json_t *result)
+// result is the written value, in the encoding of the request the key was made from
+static int add_cache(sds cache_key, const char *result, size_t len)
 {
     struct cache_val cache;
     cache.time = current_timestamp();
-    cache.result = result;
-    json_incref(result);
+    cache.result = sdsnewlen(result, len);
     dict_replace(dict_cache, cache_key, &cache);
 
     return 0;
 }
 
+static void write_balance(json_writer *w, const char *key, mpd_t *value, int prec_save, int prec_show)
+{
+    json_writer_key(w, key);
+    if (value == NULL) {
+        json_writer_string(w, "0");
+    } else if (prec_save != prec_show) {
+        mpd_t *show = mpd_qncopy(value);
+        mpd_rescale(show, show, -prec_show, &mpd_ctx);
+        json_writer_mpd(w, show);
+        mpd_del(show);
+    } else {
+        json_writer_mpd(w, value);
+    }
+}
+
+static void write_balance_unit(json_writer *w, const char *asset, mpd_t *available, mpd_t *freeze)
+{
+    int prec_save = asset_prec(asset);
+    int prec_show = asset_prec_show(asset);
+
+    json_writer_key(w, asset);
+    json_writer_object_begin(w);
+    write_balance(w, "available", available, prec_save, prec_show);
+    write_balance(w, "freeze", freeze, prec_save, prec_show);
+
+    // Additional Fields
+    mpd_t *total = mpd_qncopy(mpd_zero);
+    if (available)
+        mpd_add(total, total, available, &mpd_ctx);
+    if (freeze)
+        mpd_add(total, total, freeze, &mpd_ctx);
+    json_writer_key(w, "total");
+    json_writer_mpd(w, total);  // Total = available + freeze
+
+    market_t *m = get_market(asset);
+    if (m != NULL) {
+        mpd_mul(total, total, m->last_price, &mpd_ctx);
+        mpd_rescale(total, total, -prec_show, &mpd_ctx);
+        json_writer_key(w, "value");
+        json_writer_mpd(w, total); // Value in default currency
+        json_writer_key(w, "last_price");
+        json_writer_mpd(w, m->last_price);
+        json_writer_key(w, "closing_price");
+        json_writer_mpd(w, m->closing_price);
+    }
+    mpd_del(total);
+    json_writer_object_end(w);
+}
+
+static bool asset_requested_before(json_t *params, size_t index, const char *asset)
+{
+    for (size_t i = 1; i < index; ++i) {
+        if (strcmp(json_string_value(json_array_get(params, i)), asset) == 0)
+            return true;
+    }
+    return false;
+}
+
 static int on_cmd_balance_query(nw_ses *ses, rpc_pkg *pkg, json_t *params)
 {
     size_t request_size = json_array_size(params);
@@ -148,131 +262,40 @@ static int on_cmd_balance_query(nw_ses *ses, rpc_pkg *pkg, json_t *params)
     if (user_id == 0)
         return reply_error_invalid_argument(ses, pkg);
 
-    json_t *result = json_object();
+    for (size_t i = 1; i < request_size; ++i) {
+        const char *asset = json_string_value(json_array_get(params, i));
+        if (!asset || !asset_exist(asset))
+            return reply_error_invalid_argument(ses, pkg);
+    }
+
+    json_writer w;
+    reply_writer_begin(&w, pkg);
+    json_writer_object_begin(&w);
 
-    // Assets - Show All
     if (request_size == 1) {
+        // Assets - Show All
         for (size_t i = 0; i < settings.asset_num; ++i) {
             const char *asset = settings.assets[i].name;
-            json_t *unit = json_object();
-            int prec_save = asset_prec(asset);
-            int prec_show = asset_prec_show(asset);
-
             mpd_t *available = balance_get(user_id, BALANCE_TYPE_AVAILABLE, asset);
             mpd_t *freeze = balance_get(user_id, BALANCE_TYPE_FREEZE, asset);
-
             if (!available && !freeze)
                 continue;
-
-            if (available) {
-                if (prec_save != prec_show) {
-                    mpd_t *show = mpd_qncopy(available);
-                    mpd_rescale(show, show, -prec_show, &mpd_ctx);
-                    json_object_set_new_mpd(unit, "available", show);
-                    mpd_del(show);
-                } else {
-                    json_object_set_new_mpd(unit, "available", available);
-                }
-            } else {
-                available = mpd_qncopy(mpd_zero);
-                json_object_set_new(unit, "available", json_string("0"));
-            }
-
-            if (freeze) {
-                if (prec_save != prec_show) {
-                    mpd_t *show = mpd_qncopy(freeze);
-                    mpd_rescale(show, show, -prec_show, &mpd_ctx);
-                    json_object_set_new_mpd(unit, "freeze", show);
-                    mpd_del(show);
-                } else {
-                    json_object_set_new_mpd(unit, "freeze", freeze);
-                }
-            } else {
-                freeze = mpd_qncopy(mpd_zero);
-                json_object_set_new(unit, "freeze", json_string("0"));
-            }
-
-            // Additional Fields
-            mpd_t *total = mpd_new(&mpd_ctx);
-            mpd_add(total, available, freeze, &mpd_ctx);
-            json_object_set_new_mpd(unit, "total", total);  // Total = available + freeze
-
-            market_t *m = get_market(asset);
-            if (m != NULL) {
-                mpd_mul(total, total, m->last_price, &mpd_ctx);
-                mpd_rescale(total, total, -prec_show, &mpd_ctx);
-                json_object_set_new_mpd(unit, "value", total); // Value in default currency
-                json_object_set_new_mpd(unit, "last_price", m->last_price);
-                json_object_set_new_mpd(unit, "closing_price", m->closing_price);
-            }
-            mpd_del(total);
-
-            json_object_set_new(result, asset, unit);
+            write_balance_unit(&w, asset, available, freeze);
         }
     } else {
-    // Assets - Show requested assets only
+        // Assets - Show requested assets only
         for (size_t i = 1; i < request_size; ++i) {
             const char *asset = json_string_value(json_array_get(params, i));
-            if (!asset || !asset_exist(asset)) {
-                json_decref(result);
-                return reply_error_invalid_argument(ses, pkg);
-            }
-            json_t *unit = json_object();
-            int prec_save = asset_prec(asset);
-            int prec_show = asset_prec_show(asset);
-
+            if (asset_requested_before(params, i, asset))
+                continue;
             mpd_t *available = balance_get(user_id, BALANCE_TYPE_AVAILABLE, asset);
-            if (available) {
-                if (prec_save != prec_show) {
-                    mpd_t *show = mpd_qncopy(available);
-                    mpd_rescale(show, show, -prec_show, &mpd_ctx);
-                    json_object_set_new_mpd(unit, "available", show);
-                    mpd_del(show);
-                } else {
-                    json_object_set_new_mpd(unit, "available", available);
-                }
-            } else {
-                json_object_set_new(unit, "available", json_string("0"));
-            }
-
             mpd_t *freeze = balance_get(user_id, BALANCE_TYPE_FREEZE, asset);
-            if (freeze) {
-                if (prec_save != prec_show) {
-                    mpd_t *show = mpd_qncopy(freeze);
-                    mpd_rescale(show, show, -prec_show, &mpd_ctx);
-                    json_object_set_new_mpd(unit, "freeze", show);
-                    mpd_del(show);
-                } else {
-                    json_object_set_new_mpd(unit, "freeze", freeze);
-                }
-            } else {
-                json_object_set_new(unit, "freeze", json_string("0"));
-            }
-
-            mpd_t *total = mpd_qncopy(mpd_zero);
-            if (available)
-                mpd_add(total, total, available, &mpd_ctx);
-            if (freeze)
-                mpd_add(total, total, freeze, &mpd_ctx);
-            json_object_set_new_mpd(unit, "total", total);  // Total = available + freeze
-
-            market_t *m = get_market(asset);
-            if (m != NULL) {
-                mpd_mul(total, total, m->last_price, &mpd_ctx);
-                mpd_rescale(total, total, -prec_show, &mpd_ctx);
-                json_object_set_new_mpd(unit, "value", total); // Value in default currency
-                json_object_set_new_mpd(unit, "last_price", m->last_price);
-                json_object_set_new_mpd(unit, "closing_price", m->closing_price);
-            }
-            mpd_del(total);
-
-            json_object_set_new(result, asset, unit);
+            write_balance_unit(&w, asset, available, freeze);
         }
     }
 
-    int ret = reply_result(ses, pkg, result);
-    json_decref(result);
-    return ret;
+    json_writer_object_end(&w);
+    return reply_writer_end(ses, pkg, &w);
 }
 
 static int on_cmd_balance_update(nw_ses *ses, rpc_pkg *pkg, json_t *params)
@@ -399,183 +422,189 @@ invalid_argument:
     return reply_error_invalid_argument(ses, pkg);
 }
 
-static int on_cmd_order_put(nw_ses *ses, rpc_pkg *pkg, json_t *params)
+// price times amount reaches the min amount of money, and the price is within the limit
+static int check_order_price(market_t *market, int64_t amount, int64_t price)
 {
-    // 1) Validation
-    if (json_array_size(params) > 8 || json_array_size(params) < 6)
-        return reply_error_invalid_argument(ses, pkg);
+    int64_t total, min_total;
+    if (fixed_mul(&total, price, market->money_prec, amount, market->stock_prec, market->money_save, FIXED_ROUND_DOWN) < 0)
+        return -2;
+    if (fixed_from_mpd(&min_total, asset_min_amount(market->money), market->money_save) < 0
+        || total < min_total
+        || !check_price_limit(market, market->last_price, price, "0.0")
+        || !check_price_limit(market, market->closing_price, price, "0.0"))
+        return -4;
+    return 0;
+}
 
-    bool is_price_setter = (pkg->command != CMD_ORDER_PUT_MARKET);
-    bool is_maker_candiate = (pkg->command != CMD_ORDER_PUT_MARKET) &&
-                             (pkg->command != CMD_ORDER_PUT_FOK);
+static int order_put_error(int ret, const char **message)
+{
+    switch (ret) {
+    case -1:
+        *message = "insufficient balance";
+        return 10;
+    case -2:
+        *message = "invalid amount";
+        return 11;
+    case -4:
+        *message = "price out of range";
+        return 12;
+    case -5:
+        *message = "insufficient balance";
+        return 13;
+    default:
+        *message = "internal error";
+        return 2;
+    }
+}
 
-    // LIMIT, AON (8)
-    if (is_maker_candiate && json_array_size(params) != 8)
-        return reply_error_invalid_argument(ses, pkg);
-    else if (pkg->command == CMD_ORDER_PUT_MARKET
-        && json_array_size(params) != 6)
-        return reply_error_invalid_argument(ses, pkg);
-    else if (pkg->command == CMD_ORDER_PUT_FOK
-        && json_array_size(params) != 7)
+static int on_cmd_order_put(nw_ses *ses, rpc_pkg *pkg, json_t *params)
+{
+    uint32_t type;
+    const char *oper;
+    switch (pkg->command) {
+    case CMD_ORDER_PUT_LIMIT:
+        type = MARKET_ORDER_TYPE_LIMIT;
+        oper = "limit_order";
+        break;
+    case CMD_ORDER_PUT_AON:
+        type = MARKET_ORDER_TYPE_AON;
+        oper = "aon_order";
+        break;
+    case CMD_ORDER_PUT_MARKET:
+        type = MARKET_ORDER_TYPE_MARKET;
+        oper = "market_order";
+        break;
+    case CMD_ORDER_PUT_FOK:
+        type = MARKET_ORDER_TYPE_FOK;
+        oper = "fok_order";
+        break;
+    default:
         return reply_error_invalid_argument(ses, pkg);
+    }
 
-    // 2) Parse
-    int idx = 0;
-
-    // user_id
-    if (!json_is_integer(json_array_get(params, idx)))
+    if (json_array_size(params) < 1)
         return reply_error_invalid_argument(ses, pkg);
-    uint32_t user_id = json_integer_value(json_array_get(params, idx++));
 
-    // market
-    if (!json_is_string(json_array_get(params, idx)))
-        return reply_error_invalid_argument(ses, pkg);
-    const char *market_name = json_string_value(json_array_get(params, idx++));
-    market_t *market = get_market(market_name);
-    if (market == NULL)
+    // user_id
+    if (!json_is_integer(json_array_get(params, 0)))
         return reply_error_invalid_argument(ses, pkg);
+    uint32_t user_id = json_integer_value(json_array_get(params, 0));
 
-    // side
-    if (!json_is_integer(json_array_get(params, idx)))
-        return reply_error_invalid_argument(ses, pkg);
-    uint32_t side = json_integer_value(json_array_get(params, idx++));
-    if (side != MARKET_ORDER_SIDE_ASK && side != MARKET_ORDER_SIDE_BID)
+    // the rest is an order of a batch, with the type in place of the user_id
+    json_t *order = json_array();
+    json_array_append_new(order, json_integer(type));
+    for (size_t i = 1; i < json_array_size(params); ++i) {
+        json_array_append(order, json_array_get(params, i));
+    }
+    order_req req;
+    int ret = market_parse_order_req(order, &req);
+    json_decref(order);
+    if (ret < 0 || req.market == NULL)
         return reply_error_invalid_argument(ses, pkg);
 
-    mpd_t *amount = NULL;
-    mpd_t *price = mpd_qncopy(mpd_zero);
-    mpd_t *taker_fee = NULL;
-    mpd_t *maker_fee = mpd_qncopy(mpd_zero);
+    ret = 0;
+    if (req.type != MARKET_ORDER_TYPE_MARKET) {
+        ret = check_order_price(req.market, req.amount, req.price);
+    }
     json_t *result = NULL;
-
-    // amount
-    if (!json_is_string(json_array_get(params, idx)))
-        goto invalid_argument;
-    amount = decimal(json_string_value(json_array_get(params, idx++)), market->stock_prec);
-    if (amount == NULL || mpd_cmp(amount, mpd_zero, &mpd_ctx) <= 0)
-        goto invalid_argument;
-
-    // price - Non-Market
-    if (is_price_setter) {
-        if (!json_is_string(json_array_get(params, idx)))
-            goto invalid_argument;
-        mpd_del(price);
-        price = decimal(json_string_value(json_array_get(params, idx++)), market->money_prec);
-        if (price == NULL || mpd_cmp(price, mpd_zero, &mpd_ctx) <= 0)
-            goto invalid_argument;
+    if (ret == 0) {
+        ret = market_put_order_req(true, &result, user_id, &req);
     }
-
-    // taker fee
-    if (!json_is_string(json_array_get(params, idx)))
-        goto invalid_argument;
-    taker_fee = decimal(json_string_value(json_array_get(params, idx++)), market->fee_prec);
-    if (taker_fee == NULL || mpd_cmp(taker_fee, mpd_zero, &mpd_ctx) < 0 ||
-        mpd_cmp(taker_fee, mpd_one, &mpd_ctx) >= 0)
-        goto invalid_argument;
-
-    // maker fee - LIMIT, AON
-    if (is_maker_candiate) {
-        if (!json_is_string(json_array_get(params, idx)))
-            goto invalid_argument;
-        mpd_del(maker_fee);
-        maker_fee = decimal(json_string_value(json_array_get(params, idx++)), market->fee_prec);
-        if (maker_fee == NULL || mpd_cmp(maker_fee, mpd_zero, &mpd_ctx) < 0 ||
-            mpd_cmp(maker_fee, mpd_one, &mpd_ctx) >= 0)
-            goto invalid_argument;
+    if (ret < 0) {
+        const char *message;
+        int code = order_put_error(ret, &message);
+        if (code == 2) {
+            log_fatal("market_put_order_req fail: %d", ret);
+        }
+        return reply_error(ses, pkg, code, message);
     }
 
-    if (json_array_size(params) != idx + 1)
-        goto invalid_argument;
+    append_operlog(oper, params);
+    ret = reply_result(ses, pkg, result);
+    json_decref(result);
+
+    return ret;
+}
+
+static int on_cmd_order_put_batch(nw_ses *ses, rpc_pkg *pkg, json_t *params)
+{
+    if (json_array_size(params) != 2)
+        return reply_error_invalid_argument(ses, pkg);
+
+    // user_id
+    if (!json_is_integer(json_array_get(params, 0)))
+        return reply_error_invalid_argument(ses, pkg);
+    uint32_t user_id = json_integer_value(json_array_get(params, 0));
 
-    // source
-    if (!json_is_string(json_array_get(params, idx)))
-        goto invalid_argument;
-    const char *source = json_string_value(json_array_get(params, idx++));
-    if (strlen(source) >= SOURCE_MAX_LEN)
-        goto invalid_argument;
+    // orders
+    json_t *orders = json_array_get(params, 1);
+    if (!json_is_array(orders))
+        return reply_error_invalid_argument(ses, pkg);
+    size_t count = json_array_size(orders);
+    if (count == 0 || count > ORDER_BATCH_MAX)
+        return reply_error_invalid_argument(ses, pkg);
 
+    // the whole batch is rejected if any order is invalid
     int ret;
-    char *oper;
-
-    // 3) Price Limits
-    if (is_price_setter) {
-        mpd_t *total = mpd_new(&mpd_ctx);
-        mpd_mul(total, price, amount, &mpd_ctx);
-        mpd_rescale(total, total, -asset_prec(market->money), &mpd_ctx);
-
-        if (mpd_cmp(total, asset_min_amount(market->money), &mpd_ctx) < 0
-            || !check_price_limit(market->last_price, price, "0.0")
-            || !check_price_limit(market->closing_price, price, "0.0")) {
-            ret = -4;
-            mpd_del(total);
-            goto invalid_order;
+    order_req reqs[ORDER_BATCH_MAX];
+    for (size_t i = 0; i < count; ++i) {
+        if (market_parse_order_req(json_array_get(orders, i), &reqs[i]) < 0 || reqs[i].market == NULL)
+            return reply_error_invalid_argument(ses, pkg);
+        if (reqs[i].type != MARKET_ORDER_TYPE_MARKET) {
+            ret = check_order_price(reqs[i].market, reqs[i].amount, reqs[i].price);
+            if (ret < 0) {
+                const char *message;
+                int code = order_put_error(ret, &message);
+                return reply_error(ses, pkg, code, message);
+            }
         }
-        mpd_del(total);
     }
 
-    switch(pkg->command) {
-        case CMD_ORDER_PUT_LIMIT:
-            ret = market_put_limit_order(true, &result, market, user_id, side,
-                                   amount, price, taker_fee, maker_fee, source);
-            oper = "limit_order";
-            break;
-        case CMD_ORDER_PUT_AON:
-            ret = market_put_aon_order(true, &result, market, user_id, side,
-                                   amount, price, taker_fee, maker_fee, source);
-            oper = "aon_order";
-            break;
-        case CMD_ORDER_PUT_MARKET:
-            ret = market_put_market_order(true, &result, market, user_id, side,
-                                                     amount, taker_fee, source);
-            oper = "market_order";
-            break;
-        case CMD_ORDER_PUT_FOK:
-            ret = market_put_fok_order(true, &result, market, user_id, side,
-                                              amount, price, taker_fee, source);
-            oper = "fok_order";
-            break;
-        default:
-            goto invalid_argument;
+    ret = market_check_batch_balance(user_id, reqs, count);
+    if (ret < 0) {
+        const char *message;
+        int code = order_put_error(ret, &message);
+        if (code == 2) {
+            log_fatal("market_check_batch_balance fail: %d", ret);
+        }
+        return reply_error(ses, pkg, code, message);
     }
 
-invalid_order:
-    mpd_del(amount);
-    mpd_del(price);
-    mpd_del(taker_fee);
-    mpd_del(maker_fee);
-
-    if (ret == -1)
-        return reply_error(ses, pkg, 10, "insufficient balance");
-    else if (ret == -2)
-        return reply_error(ses, pkg, 11, "invalid amount");
-    else if (ret == -4)
-        return reply_error(ses, pkg, 12, "price out of range");
-    else if (ret == -5)
-        return reply_error(ses, pkg, 13, "insufficient balance");
-    else if (ret < 0) {
-        log_fatal("market_put_limit_order fail: %d", ret);
-        return reply_error_internal_error(ses, pkg);
+    // execute in order, only the orders put are written to operlog
+    json_t *result = json_array();
+    json_t *done = json_array();
+    for (size_t i = 0; i < count; ++i) {
+        json_t *order = NULL;
+        ret = market_put_order_req(true, &order, user_id, &reqs[i]);
+        if (ret < 0) {
+            const char *message;
+            int code = order_put_error(ret, &message);
+            if (code == 2) {
+                log_fatal("market_put_order_req fail: %d", ret);
+            }
+            json_t *error = json_object();
+            json_object_set_new(error, "code", json_integer(code + 5000));
+            json_object_set_new(error, "message", json_string(message));
+            json_array_append_new(result, error);
+        } else {
+            json_array_append_new(result, order);
+            json_array_append(done, json_array_get(orders, i));
+        }
     }
 
-    append_operlog(oper, params);
+    if (json_array_size(done) > 0) {
+        json_t *oper_params = json_array();
+        json_array_append_new(oper_params, json_integer(user_id));
+        json_array_append(oper_params, done);
+        append_operlog("batch_order", oper_params);
+        json_decref(oper_params);
+    }
+    json_decref(done);
+
     ret = reply_result(ses, pkg, result);
     json_decref(result);
 
     return ret;
-
-invalid_argument:
-    if (amount)
-        mpd_del(amount);
-    if (price)
-        mpd_del(price);
-    if (taker_fee)
-        mpd_del(taker_fee);
-    if (maker_fee)
-        mpd_del(maker_fee);
-    if (result)
-        json_decref(result);
-
-    return reply_error_invalid_argument(ses, pkg);
 }
 
 static int on_cmd_order_query(nw_ses *ses, rpc_pkg *pkg, json_t *params)
@@ -629,7 +658,7 @@ static int on_cmd_order_query(nw_ses *ses, rpc_pkg *pkg, json_t *params)
             while ((node = skiplist_next(iter)) != NULL && index < limit) {
                 index++;
                 order_t *order = node->value;
-                json_array_append_new(orders, get_order_info(order));
+                json_array_append_new(orders, get_order_info(market, order));
             }
             skiplist_release_iterator(iter);
         }
@@ -685,6 +714,132 @@ static int on_cmd_order_cancel(nw_ses *ses, rpc_pkg *pkg, json_t *params)
     return ret;
 }
 
+static int on_cmd_order_amend(nw_ses *ses, rpc_pkg *pkg, json_t *params)
+{
+    if (json_array_size(params) != 5)
+        return reply_error_invalid_argument(ses, pkg);
+
+    // user_id
+    if (!json_is_integer(json_array_get(params, 0)))
+        return reply_error_invalid_argument(ses, pkg);
+    uint32_t user_id = json_integer_value(json_array_get(params, 0));
+
+    // market
+    if (!json_is_string(json_array_get(params, 1)))
+        return reply_error_invalid_argument(ses, pkg);
+    const char *market_name = json_string_value(json_array_get(params, 1));
+    market_t *market = get_market(market_name);
+    if (market == NULL)
+        return reply_error_invalid_argument(ses, pkg);
+
+    // order_id
+    if (!json_is_integer(json_array_get(params, 2)))
+        return reply_error_invalid_argument(ses, pkg);
+    uint64_t order_id = json_integer_value(json_array_get(params, 2));
+
+    // amount, the new left amount
+    int64_t amount, price;
+    if (!json_is_string(json_array_get(params, 3)))
+        return reply_error_invalid_argument(ses, pkg);
+    if (fixed_parse(json_string_value(json_array_get(params, 3)), market->stock_prec, &amount) < 0 || amount <= 0)
+        return reply_error_invalid_argument(ses, pkg);
+
+    // price
+    if (!json_is_string(json_array_get(params, 4)))
+        return reply_error_invalid_argument(ses, pkg);
+    if (fixed_parse(json_string_value(json_array_get(params, 4)), market->money_prec, &price) < 0 || price <= 0)
+        return reply_error_invalid_argument(ses, pkg);
+
+    order_t *order = market_get_order(market, order_id);
+    if (order == NULL) {
+        return reply_error(ses, pkg, 10, "order not found");
+    }
+    if (order->user_id != user_id) {
+        return reply_error(ses, pkg, 11, "user mismatch");
+    }
+
+    int ret = 0;
+    if (price != order->price) {
+        ret = check_order_price(market, amount, price);
+    }
+    json_t *result = NULL;
+    if (ret == 0) {
+        ret = market_amend_order(true, &result, market, order, amount, price);
+    }
+    if (ret == -1) {
+        return reply_error(ses, pkg, 12, "insufficient balance");
+    } else if (ret == -2) {
+        return reply_error(ses, pkg, 13, "invalid amount");
+    } else if (ret == -3) {
+        return reply_error(ses, pkg, 15, "order would trade");
+    } else if (ret == -4) {
+        return reply_error(ses, pkg, 14, "price out of range");
+    } else if (ret < 0) {
+        log_fatal("amend order: %"PRIu64" fail: %d", order_id, ret);
+        return reply_error_internal_error(ses, pkg);
+    }
+
+    append_operlog("amend_order", params);
+    ret = reply_result(ses, pkg, result);
+    json_decref(result);
+    return ret;
+}
+
+static int on_cmd_order_cancel_all(nw_ses *ses, rpc_pkg *pkg, json_t *params)
+{
+    if (json_array_size(params) != 3)
+        return reply_error_invalid_argument(ses, pkg);
+
+    // user_id
+    if (!json_is_integer(json_array_get(params, 0)))
+        return reply_error_invalid_argument(ses, pkg);
+    uint32_t user_id = json_integer_value(json_array_get(params, 0));
+
+    // market, empty for all markets
+    if (!json_is_string(json_array_get(params, 1)))
+        return reply_error_invalid_argument(ses, pkg);
+    const char *market_name = json_string_value(json_array_get(params, 1));
+    market_t *market = NULL;
+    if (strlen(market_name) > 0) {
+        market = get_market(market_name);
+        if (market == NULL)
+            return reply_error_invalid_argument(ses, pkg);
+    }
+
+    // side, 0 for both sides
+    if (!json_is_integer(json_array_get(params, 2)))
+        return reply_error_invalid_argument(ses, pkg);
+    uint32_t side = json_integer_value(json_array_get(params, 2));
+    if (side != 0 && side != MARKET_ORDER_SIDE_ASK && side != MARKET_ORDER_SIDE_BID)
+        return reply_error_invalid_argument(ses, pkg);
+
+    int ret;
+    json_t *result = json_array();
+    int market_num = market ? 1 : settings.market_num;
+    for (int i = 0; i < market_num; ++i) {
+        market_t *m = market ? market : get_market(settings.markets[i].name);
+        ret = market_cancel_user_orders(true, result, m, user_id, side);
+        if (ret < 0) {
+            log_fatal("cancel orders of user: %u, market: %s fail: %d", user_id, m->name, ret);
+            json_decref(result);
+            return reply_error_internal_error(ses, pkg);
+        }
+        if (ret > 0) {
+            // one operlog per market, so a replay only repeats the markets that were cancelled
+            json_t *oper = json_array();
+            json_array_append_new(oper, json_integer(user_id));
+            json_array_append_new(oper, json_string(m->name));
+            json_array_append_new(oper, json_integer(side));
+            append_operlog("cancel_all", oper);
+            json_decref(oper);
+        }
+    }
+
+    ret = reply_result(ses, pkg, result);
+    json_decref(result);
+    return ret;
+}
+
 static int on_cmd_order_book(nw_ses *ses, rpc_pkg *pkg, json_t *params)
 {
     if (json_array_size(params) != 4)
@@ -717,178 +872,154 @@ static int on_cmd_order_book(nw_ses *ses, rpc_pkg *pkg, json_t *params)
     if (limit > ORDER_BOOK_MAX_LEN)
         return reply_error_invalid_argument(ses, pkg);
 
-    json_t *result = json_object();
-    json_object_set_new(result, "offset", json_integer(offset));
-    json_object_set_new(result, "limit", json_integer(limit));
-
     uint64_t total;
-    skiplist_iter *iter;
+    skiplist_t *book;
     if (side == MARKET_ORDER_SIDE_ASK) {
-        iter = skiplist_get_iterator(market->asks);
-        total = market->asks->len;
-        json_object_set_new(result, "total", json_integer(total));
+        book = market->asks;
+        total = market->ask_count;
     } else {
-        iter = skiplist_get_iterator(market->bids);
-        total = market->bids->len;
-        json_object_set_new(result, "total", json_integer(total));
+        book = market->bids;
+        total = market->bid_count;
     }
 
-    json_t *orders = json_array();
+    json_writer w;
+    reply_writer_begin(&w, pkg);
+    json_writer_object_begin(&w);
+    json_writer_key(&w, "offset");
+    json_writer_int(&w, offset);
+    json_writer_key(&w, "limit");
+    json_writer_int(&w, limit);
+    json_writer_key(&w, "total");
+    json_writer_int(&w, total);
+
+    json_writer_key(&w, "orders");
+    json_writer_array_begin(&w);
     if (offset < total) {
-        for (size_t i = 0; i < offset; i++) {
-            if (skiplist_next(iter) == NULL)
+        // skip whole levels first, then orders inside the level
+        skiplist_node *node;
+        skiplist_iter *iter = skiplist_get_iterator(book);
+        order_t *order = NULL;
+        while ((node = skiplist_next(iter)) != NULL) {
+            order_level_t *level = node->value;
+            if (offset < level->count) {
+                order = level->head;
                 break;
+            }
+            offset -= level->count;
         }
+        for (; order && offset > 0; offset--) {
+            order = order->level_next;
+        }
+
         size_t index = 0;
-        skiplist_node *node;
-        while ((node = skiplist_next(iter)) != NULL && index < limit) {
+        while (order && index < limit) {
             index++;
-            order_t *order = node->value;
-            json_array_append_new(orders, get_order_info(order));
+            write_order_info(&w, market, order);
+            order = order->level_next;
+            if (order == NULL && (node = skiplist_next(iter)) != NULL) {
+                order_level_t *level = node->value;
+                order = level->head;
+            }
         }
+        skiplist_release_iterator(iter);
     }
-    skiplist_release_iterator(iter);
+    json_writer_array_end(&w);
 
-    json_object_set_new(result, "orders", orders);
-    int ret = reply_result(ses, pkg, result);
-    json_decref(result);
-    return ret;
+    json_writer_object_end(&w);
+    return reply_writer_end(ses, pkg, &w);
 }
 
-static json_t *get_depth(market_t *market, size_t limit)
+static void write_depth_item(json_writer *w, market_t *market, int64_t price, int64_t amount)
 {
-    mpd_t *price = mpd_new(&mpd_ctx);
-    mpd_t *amount = mpd_new(&mpd_ctx);
+    json_writer_array_begin(w);
+    json_writer_fixed(w, price, market->money_prec);
+    json_writer_fixed(w, amount, market->stock_prec);
+    json_writer_array_end(w);
+}
 
-    json_t *asks = json_array();
-    skiplist_iter *iter = skiplist_get_iterator(market->asks);
-    skiplist_node *node = skiplist_next(iter);
+static void write_depth_side(json_writer *w, market_t *market, skiplist_t *book, size_t limit)
+{
+    json_writer_array_begin(w);
+    skiplist_iter *iter = skiplist_get_iterator(book);
+    skiplist_node *node;
     size_t index = 0;
-    while (node && index < limit) {
+    while ((node = skiplist_next(iter)) != NULL && index < limit) {
         index++;
-        order_t *order = node->value;
-        mpd_copy(price, order->price, &mpd_ctx);
-        mpd_copy(amount, order->left, &mpd_ctx);
-        while ((node = skiplist_next(iter)) != NULL) {
-            order = node->value;
-            if (mpd_cmp(price, order->price, &mpd_ctx) == 0) {
-                mpd_add(amount, amount, order->left, &mpd_ctx);
-            } else {
-                break;
-            }
-        }
-        json_t *info = json_array();
-        json_array_append_new_mpd(info, price);
-        json_array_append_new_mpd(info, amount);
-        json_array_append_new(asks, info);
+        order_level_t *level = node->value;
+        write_depth_item(w, market, level->price, level->left);
     }
     skiplist_release_iterator(iter);
+    json_writer_array_end(w);
+}
 
-    json_t *bids = json_array();
-    iter = skiplist_get_iterator(market->bids);
-    node = skiplist_next(iter);
-    index = 0;
-    while (node && index < limit) {
-        index++;
-        order_t *order = node->value;
-        mpd_copy(price, order->price, &mpd_ctx);
-        mpd_copy(amount, order->left, &mpd_ctx);
-        while ((node = skiplist_next(iter)) != NULL) {
-            order = node->value;
-            if (mpd_cmp(price, order->price, &mpd_ctx) == 0) {
-                mpd_add(amount, amount, order->left, &mpd_ctx);
-            } else {
-                break;
-            }
-        }
-        json_t *info = json_array();
-        json_array_append_new_mpd(info, price);
-        json_array_append_new_mpd(info, amount);
-        json_array_append_new(bids, info);
-    }
-    skiplist_release_iterator(iter);
-
-    mpd_del(price);
-    mpd_del(amount);
-
-    json_t *result = json_object();
-    json_object_set_new(result, "asks", asks);
-    json_object_set_new(result, "bids", bids);
-
-    return result;
+static void write_depth(json_writer *w, market_t *market, size_t limit)
+{
+    json_writer_object_begin(w);
+    json_writer_key(w, "asks");
+    write_depth_side(w, market, market->asks, limit);
+    json_writer_key(w, "bids");
+    write_depth_side(w, market, market->bids, limit);
+    json_writer_key(w, "seq");
+    json_writer_int(w, market->book_seq);
+    json_writer_object_end(w);
 }
 
-static json_t *get_depth_merge(market_t* market, size_t limit, mpd_t *interval)
+static void write_depth_merge(json_writer *w, market_t* market, size_t limit, int64_t interval)
 {
-    mpd_t *q = mpd_new(&mpd_ctx);
-    mpd_t *r = mpd_new(&mpd_ctx);
-    mpd_t *price = mpd_new(&mpd_ctx);
-    mpd_t *amount = mpd_new(&mpd_ctx);
+    int64_t price, amount;
 
-    json_t *asks = json_array();
+    json_writer_object_begin(w);
+    json_writer_key(w, "asks");
+    json_writer_array_begin(w);
     skiplist_iter *iter = skiplist_get_iterator(market->asks);
     skiplist_node *node = skiplist_next(iter);
     size_t index = 0;
     while (node && index < limit) {
         index++;
-        order_t *order = node->value;
-        mpd_divmod(q, r, order->price, interval, &mpd_ctx);
-        mpd_mul(price, q, interval, &mpd_ctx);
-        if (mpd_cmp(r, mpd_zero, &mpd_ctx) != 0) {
-            mpd_add(price, price, interval, &mpd_ctx);
+        order_level_t *level = node->value;
+        price = level->price / interval * interval;
+        if (price != level->price) {
+            price += interval;
         }
-        mpd_copy(amount, order->left, &mpd_ctx);
+        amount = level->left;
         while ((node = skiplist_next(iter)) != NULL) {
-            order = node->value;
-            if (mpd_cmp(price, order->price, &mpd_ctx) >= 0) {
-                mpd_add(amount, amount, order->left, &mpd_ctx);
+            level = node->value;
+            if (price >= level->price) {
+                amount += level->left;
             } else {
                 break;
             }
         }
-        json_t *info = json_array();
-        json_array_append_new_mpd(info, price);
-        json_array_append_new_mpd(info, amount);
-        json_array_append_new(asks, info);
+        write_depth_item(w, market, price, amount);
     }
     skiplist_release_iterator(iter);
+    json_writer_array_end(w);
 
-    json_t *bids = json_array();
+    json_writer_key(w, "bids");
+    json_writer_array_begin(w);
     iter = skiplist_get_iterator(market->bids);
     node = skiplist_next(iter);
     index = 0;
     while (node && index < limit) {
         index++;
-        order_t *order = node->value;
-        mpd_divmod(q, r, order->price, interval, &mpd_ctx);
-        mpd_mul(price, q, interval, &mpd_ctx);
-        mpd_copy(amount, order->left, &mpd_ctx);
+        order_level_t *level = node->value;
+        price = level->price / interval * interval;
+        amount = level->left;
         while ((node = skiplist_next(iter)) != NULL) {
-            order = node->value;
-            if (mpd_cmp(price, order->price, &mpd_ctx) <= 0) {
-                mpd_add(amount, amount, order->left, &mpd_ctx);
+            level = node->value;
+            if (price <= level->price) {
+                amount += level->left;
             } else {
                 break;
             }
         }
-
-        json_t *info = json_array();
-        json_array_append_new_mpd(info, price);
-        json_array_append_new_mpd(info, amount);
-        json_array_append_new(bids, info);
+        write_depth_item(w, market, price, amount);
     }
     skiplist_release_iterator(iter);
-
-    mpd_del(q);
-    mpd_del(r);
-    mpd_del(price);
-    mpd_del(amount);
-
-    json_t *result = json_object();
-    json_object_set_new(result, "asks", asks);
-    json_object_set_new(result, "bids", bids);
-
-    return result;
+    json_writer_array_end(w);
+    json_writer_key(w, "seq");
+    json_writer_int(w, market->book_seq);
+    json_writer_object_end(w);
 }
 
 static int on_cmd_order_book_depth(nw_ses *ses, rpc_pkg *pkg, json_t *params)
@@ -914,39 +1045,28 @@ static int on_cmd_order_book_depth(nw_ses *ses, rpc_pkg *pkg, json_t *params)
     // interval
     if (!json_is_string(json_array_get(params, 2)))
         return reply_error_invalid_argument(ses, pkg);
-    mpd_t *interval = decimal(json_string_value(json_array_get(params, 2)), market->money_prec);
-    if (!interval)
+    int64_t interval;
+    if (fixed_parse(json_string_value(json_array_get(params, 2)), market->money_prec, &interval) < 0 || interval < 0)
         return reply_error_invalid_argument(ses, pkg);
-    if (mpd_cmp(interval, mpd_zero, &mpd_ctx) < 0) {
-        mpd_del(interval);
-        return reply_error_invalid_argument(ses, pkg);
-    }
 
     sds cache_key = NULL;
     if (process_cache(ses, pkg, &cache_key)) {
-        mpd_del(interval);
         return 0;
     }
 
-    json_t *result = NULL;
-    if (mpd_cmp(interval, mpd_zero, &mpd_ctx) == 0) {
-        result = get_depth(market, limit);
+    json_writer w;
+    reply_writer_begin(&w, pkg);
+    size_t result_pos = sdslen(w.buf);
+    if (interval == 0) {
+        write_depth(&w, market, limit);
     } else {
-        result = get_depth_merge(market, limit, interval);
-    }
-    mpd_del(interval);
-
-    if (result == NULL) {
-        sdsfree(cache_key);
-        return reply_error_internal_error(ses, pkg);
+        write_depth_merge(&w, market, limit, interval);
     }
 
-    add_cache(cache_key, result);
+    add_cache(cache_key, w.buf + result_pos, sdslen(w.buf) - result_pos);
     sdsfree(cache_key);
 
-    int ret = reply_result(ses, pkg, result);
-    json_decref(result);
-    return ret;
+    return reply_writer_end(ses, pkg, &w);
 }
 
 static int on_cmd_order_detail(nw_ses *ses, rpc_pkg *pkg, json_t *params)
@@ -972,7 +1092,7 @@ static int on_cmd_order_detail(nw_ses *ses, rpc_pkg *pkg, json_t *params)
     if (order == NULL) {
         result = json_null();
     } else {
-        result = get_order_info(order);
+        result = get_order_info(market, order);
     }
 
     int ret = reply_result(ses, pkg, result);
@@ -1108,21 +1228,29 @@ static int on_cmd_market_detail(nw_ses *ses, rpc_pkg *pkg, json_t *params)
     return ret;
 }
 
+// only dumped when a trace or error line is written, the same text for both
+static const char *params_text(char **str, json_t *params)
+{
+    if (*str == NULL)
+        *str = json_dumps(params, 0);
+    return *str ? *str : "";
+}
+
 static void svr_on_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
 {
-    json_t *params = json_loadb(pkg->body, pkg->body_size, 0, NULL);
+    json_t *params = rpc_pkg_body_json(pkg);
     if (params == NULL || !json_is_array(params)) {
         goto decode_error;
     }
-    sds params_str = sdsnewlen(pkg->body, pkg->body_size);
+    char *params_str = NULL;
 
     int ret;
     switch (pkg->command) {
     case CMD_BALANCE_QUERY:
-        log_trace("from: %s cmd balance query, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd balance query, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
         ret = on_cmd_balance_query(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_balance_query %s fail: %d", params_str, ret);
+            log_error("on_cmd_balance_query %s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     case CMD_BALANCE_UPDATE:
@@ -1132,24 +1260,24 @@ static void svr_on_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
             reply_error_service_unavailable(ses, pkg);
             goto cleanup;
         }
-        log_trace("from: %s cmd balance update, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd balance update, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
         ret = on_cmd_balance_update(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_balance_update %s fail: %d", params_str, ret);
+            log_error("on_cmd_balance_update %s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     case CMD_ASSET_LIST:
-        log_trace("from: %s cmd asset list, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd asset list, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
         ret = on_cmd_asset_list(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_asset_list %s fail: %d", params_str, ret);
+            log_error("on_cmd_asset_list %s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     case CMD_ASSET_SUMMARY:
-        log_trace("from: %s cmd asset summary, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd asset summary, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
         ret = on_cmd_asset_summary(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_asset_summary %s fail: %d", params_str, ret);
+            log_error("on_cmd_asset_summary %s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     case CMD_ORDER_PUT_LIMIT:
@@ -1162,18 +1290,31 @@ static void svr_on_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
             reply_error_service_unavailable(ses, pkg);
             goto cleanup;
         }
-        log_trace("from: %s cmd order put, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd order put, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
 
         ret = on_cmd_order_put(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_order_put %s fail: %d", params_str, ret);
+            log_error("on_cmd_order_put %s fail: %d", params_text(&params_str, params), ret);
+        }
+        break;
+    case CMD_ORDER_PUT_BATCH:
+        if (is_operlog_block() || is_history_block() || is_message_block() || signal_block) {
+            log_fatal("service unavailable, operlog: %d, history: %d, message: %d",
+                    is_operlog_block(), is_history_block(), is_message_block());
+            reply_error_service_unavailable(ses, pkg);
+            goto cleanup;
+        }
+        log_trace("from: %s cmd order put batch, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
+        ret = on_cmd_order_put_batch(ses, pkg, params);
+        if (ret < 0) {
+            log_error("on_cmd_order_put_batch %s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     case CMD_ORDER_QUERY:
-        log_trace("from: %s cmd order query, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd order query, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
         ret = on_cmd_order_query(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_order_query %s fail: %d", params_str, ret);
+            log_error("on_cmd_order_query %s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     case CMD_ORDER_CANCEL:
@@ -1183,59 +1324,85 @@ static void svr_on_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
             reply_error_service_unavailable(ses, pkg);
             goto cleanup;
         }
-        log_trace("from: %s cmd order cancel, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd order cancel, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
         ret = on_cmd_order_cancel(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_order_cancel %s fail: %d", params_str, ret);
+            log_error("on_cmd_order_cancel %s fail: %d", params_text(&params_str, params), ret);
+        }
+        break;
+    case CMD_ORDER_AMEND:
+        if (is_operlog_block() || is_history_block() || is_message_block() || signal_block) {
+            log_fatal("service unavailable, operlog: %d, history: %d, message: %d",
+                    is_operlog_block(), is_history_block(), is_message_block());
+            reply_error_service_unavailable(ses, pkg);
+            goto cleanup;
+        }
+        log_trace("from: %s cmd order amend, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
+        ret = on_cmd_order_amend(ses, pkg, params);
+        if (ret < 0) {
+            log_error("on_cmd_order_amend %s fail: %d", params_text(&params_str, params), ret);
+        }
+        break;
+    case CMD_ORDER_CANCEL_ALL:
+        if (is_operlog_block() || is_history_block() || is_message_block()) {
+            log_fatal("service unavailable, operlog: %d, history: %d, message: %d",
+                    is_operlog_block(), is_history_block(), is_message_block());
+            reply_error_service_unavailable(ses, pkg);
+            goto cleanup;
+        }
+        log_trace("from: %s cmd order cancel all, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
+        ret = on_cmd_order_cancel_all(ses, pkg, params);
+        if (ret < 0) {
+            log_error("on_cmd_order_cancel_all %s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     case CMD_ORDER_BOOK:
-        log_trace("from: %s cmd order book, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd order book, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
         ret = on_cmd_order_book(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_order_book %s fail: %d", params_str, ret);
+            log_error("on_cmd_order_book %s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     case CMD_ORDER_BOOK_DEPTH:
-        log_trace("from: %s cmd order book depth, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd order book depth, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
         ret = on_cmd_order_book_depth(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_order_book_depth %s fail: %d", params_str, ret);
+            log_error("on_cmd_order_book_depth %s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     case CMD_ORDER_DETAIL:
-        log_trace("from: %s cmd order detail, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd order detail, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
         ret = on_cmd_order_detail(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_order_detail %s fail: %d", params_str, ret);
+            log_error("on_cmd_order_detail %s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     case CMD_MARKET_LIST:
-        log_trace("from: %s cmd market list, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd market list, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
         ret = on_cmd_market_list(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_market_list %s fail: %d", params_str, ret);
+            log_error("on_cmd_market_list %s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     case CMD_MARKET_SUMMARY:
-        log_trace("from: %s cmd market summary, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd market summary, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
         ret = on_cmd_market_summary(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_market_summary%s fail: %d", params_str, ret);
+            log_error("on_cmd_market_summary%s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     case CMD_MARKET_REGISTER:
-        log_trace("from: %s cmd market register, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd market register, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
         ret = on_cmd_market_register(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_market_register%s fail: %d", params_str, ret);
+            log_error("on_cmd_market_register%s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     case CMD_MARKET_DETAIL:
-        log_trace("from: %s cmd market detail, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_str);
+        log_trace("from: %s cmd market detail, sequence: %u params: %s", nw_sock_human_addr(&ses->peer_addr), pkg->sequence, params_text(&params_str, params));
         ret = on_cmd_market_detail(ses, pkg, params);
         if (ret < 0) {
-            log_error("on_cmd_market_detail%s fail: %d", params_str, ret);
+            log_error("on_cmd_market_detail%s fail: %d", params_text(&params_str, params), ret);
         }
         break;
     default:
@@ -1244,7 +1411,7 @@ static void svr_on_recv_pkg(nw_ses *ses, rpc_pkg *pkg)
     }
 
 cleanup:
-    sdsfree(params_str);
+    free(params_str);
     json_decref(params);
     return;
 
@@ -1301,7 +1468,7 @@ static void *cache_dict_val_dup(const void *val)
 static void cache_dict_val_free(void *val)
 {
     struct cache_val *obj = val;
-    json_decref(obj->result);
+    sdsfree(obj->result);
     free(val);
 }
 
@@ -1336,6 +1503,7 @@ int init_server(void)
     dict_cache = dict_create(&dt, 64);
     if (dict_cache == NULL)
         return -__LINE__;
+    reply_buf = sdsempty();
 
     nw_timer_set(&cache_timer, 60, true, on_cache_timer, NULL);
     nw_timer_start(&cache_timer);
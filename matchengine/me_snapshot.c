@@ -0,0 +1,863 @@
+/*
+ * Description: binary slice snapshot
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# include <fcntl.h>
+# include <libgen.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+
+# include "me_config.h"
+# include "me_snapshot.h"
+# include "me_trade.h"
+# include "me_market.h"
+# include "me_balance.h"
+# include "ut_crc32.h"
+
+/*
+ * a slice is one snapshot file instead of the slice_order_, slice_balance_
+ * and slice_market_ tables. the file is a header followed by sections of
+ * fixed width records, in host byte order:
+ *
+ *   head | markets | orders | removed orders | balances
+ *
+ * the head holds the offset, count, record size and crc32c of each section.
+ * order numbers are stored as they are in memory, the precision of each
+ * market is kept in its record and checked on load. the file is written to
+ * a temp file in the forked slice process and renamed when complete, the
+ * loader maps it and rebuilds the order book and balance in one pass.
+ *
+ * a full slice holds every order and balance. a delta slice only holds the
+ * orders and balance keys changed since the previous slice, a removed
+ * balance is stored as zero. each slice points to the previous one and to
+ * its full base, restore applies the base and then the deltas in order.
+ */
+
+# define SNAPSHOT_MAGIC         "MESLICE"
+# define SNAPSHOT_VERSION       2
+# define SNAPSHOT_ENDIAN        0x01020304
+# define SNAPSHOT_NAME_LEN      32
+# define SNAPSHOT_DECIMAL_LEN   48
+# define SNAPSHOT_BUF_SIZE      (4 * 1024 * 1024)
+# define SNAPSHOT_CHAIN_MAX      10000
+
+enum {
+    SNAPSHOT_KIND_FULL = 1,
+    SNAPSHOT_KIND_DELTA,
+};
+
+enum {
+    SNAPSHOT_SECTION_MARKET,
+    SNAPSHOT_SECTION_ORDER,
+    SNAPSHOT_SECTION_ORDER_DEL,
+    SNAPSHOT_SECTION_BALANCE,
+    SNAPSHOT_SECTION_NUM,
+};
+
+struct snapshot_section {
+    uint64_t    offset;
+    uint64_t    count;
+    uint32_t    size;
+    uint32_t    crc;
+};
+
+struct snapshot_head {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    endian;
+    uint32_t    kind;
+    uint32_t    pad;
+    uint64_t    time;
+    uint64_t    base;
+    uint64_t    prev;
+    uint64_t    oper_id;
+    uint64_t    order_id;
+    uint64_t    deals_id;
+    struct snapshot_section sections[SNAPSHOT_SECTION_NUM];
+};
+
+struct snapshot_market {
+    char        name[SNAPSHOT_NAME_LEN];
+    int32_t     stock_prec;
+    int32_t     money_prec;
+    int32_t     fee_prec;
+    int32_t     value_prec;
+    char        closing_price[SNAPSHOT_DECIMAL_LEN];
+    char        last_price[SNAPSHOT_DECIMAL_LEN];
+    uint64_t    order_seq;
+};
+
+struct snapshot_order {
+    uint64_t    id;
+    uint32_t    type;
+    uint32_t    side;
+    double      create_time;
+    double      update_time;
+    uint32_t    user_id;
+    uint32_t    market;
+    int64_t     price;
+    int64_t     amount;
+    int64_t     taker_fee;
+    int64_t     maker_fee;
+    int64_t     left;
+    int64_t     freeze;
+    int64_t     deal_stock;
+    int64_t     deal_money;
+    int64_t     deal_fee;
+    uint64_t    seq;
+};
+
+struct snapshot_order_del {
+    uint64_t    id;
+    uint32_t    market;
+    uint32_t    pad;
+};
+
+struct snapshot_balance {
+    uint32_t    user_id;
+    uint32_t    type;
+    char        asset[ASSET_NAME_MAX_LEN + 1];
+    char        balance[SNAPSHOT_DECIMAL_LEN];
+};
+
+struct snapshot_writer {
+    FILE        *fp;
+    uint64_t    offset;
+    struct snapshot_section *section;
+};
+
+// the last slice made or loaded by this process and its full base
+static time_t snapshot_prev;
+static time_t snapshot_base;
+
+sds snapshot_path(time_t timestamp)
+{
+    return sdscatprintf(sdsempty(), "%s/slice.%ld", settings.slice_path, (long)timestamp);
+}
+
+bool snapshot_exist(time_t timestamp)
+{
+    sds path = snapshot_path(timestamp);
+    bool exist = access(path, F_OK) == 0;
+    sdsfree(path);
+    return exist;
+}
+
+static int write_decimal(char *dest, mpd_t *val)
+{
+    char *str = mpd_to_sci(val, 0);
+    if (str == NULL)
+        return -__LINE__;
+    size_t len = strlen(str);
+    if (len >= SNAPSHOT_DECIMAL_LEN) {
+        free(str);
+        return -__LINE__;
+    }
+    memcpy(dest, str, len + 1);
+    free(str);
+    return 0;
+}
+
+static void section_begin(struct snapshot_writer *w, struct snapshot_section *section, uint32_t size)
+{
+    w->section = section;
+    section->offset = w->offset;
+    section->count = 0;
+    section->size = size;
+    section->crc = 0;
+}
+
+static int section_append(struct snapshot_writer *w, const void *record)
+{
+    struct snapshot_section *section = w->section;
+    if (fwrite(record, section->size, 1, w->fp) != 1)
+        return -__LINE__;
+    section->crc = update_crc32c(section->crc, record, section->size);
+    section->count += 1;
+    w->offset += section->size;
+    return 0;
+}
+
+static int dump_snapshot_markets(struct snapshot_writer *w, struct snapshot_head *head)
+{
+    section_begin(w, &head->sections[SNAPSHOT_SECTION_MARKET], sizeof(struct snapshot_market));
+    for (int i = 0; i < settings.market_num; ++i) {
+        market_t *m = get_market(settings.markets[i].name);
+        if (m == NULL)
+            return -__LINE__;
+
+        struct snapshot_market record;
+        memset(&record, 0, sizeof(record));
+        if (strlen(m->name) >= SNAPSHOT_NAME_LEN)
+            return -__LINE__;
+        strcpy(record.name, m->name);
+        record.stock_prec = m->stock_prec;
+        record.money_prec = m->money_prec;
+        record.fee_prec   = m->fee_prec;
+        record.value_prec = m->value_prec;
+        if (write_decimal(record.closing_price, m->closing_price) < 0)
+            return -__LINE__;
+        if (write_decimal(record.last_price, m->last_price) < 0)
+            return -__LINE__;
+        record.order_seq = m->order_seq;
+        if (section_append(w, &record) < 0)
+            return -__LINE__;
+    }
+
+    return 0;
+}
+
+static int append_order(struct snapshot_writer *w, uint32_t index, order_t *order)
+{
+    struct snapshot_order record;
+    memset(&record, 0, sizeof(record));
+    record.id           = order->id;
+    record.type         = order->type;
+    record.side         = order->side;
+    record.create_time  = order->create_time;
+    record.update_time  = order->update_time;
+    record.user_id      = order->user_id;
+    record.market       = index;
+    record.price        = order->price;
+    record.amount       = order->amount;
+    record.taker_fee    = order->taker_fee;
+    record.maker_fee    = order->maker_fee;
+    record.left         = order->left;
+    record.freeze       = order->freeze;
+    record.deal_stock   = order->deal_stock;
+    record.deal_money   = order->deal_money;
+    record.deal_fee     = order->deal_fee;
+    record.seq          = order->seq;
+    return section_append(w, &record);
+}
+
+static int dump_snapshot_order_list(struct snapshot_writer *w, uint32_t index, skiplist_t *book)
+{
+    int ret = 0;
+    order_t *order;
+    order_book_iter *iter = order_book_get_iterator(book);
+    while ((order = order_book_next(iter)) != NULL) {
+        if (append_order(w, index, order) < 0) {
+            ret = -__LINE__;
+            break;
+        }
+    }
+    order_book_release_iterator(iter);
+
+    return ret;
+}
+
+static int dump_snapshot_orders(struct snapshot_writer *w, struct snapshot_head *head)
+{
+    section_begin(w, &head->sections[SNAPSHOT_SECTION_ORDER], sizeof(struct snapshot_order));
+    for (int i = 0; i < settings.market_num; ++i) {
+        market_t *m = get_market(settings.markets[i].name);
+        if (m == NULL)
+            return -__LINE__;
+        int ret = dump_snapshot_order_list(w, i, m->asks);
+        if (ret < 0) {
+            log_error("dump market: %s asks orders list fail: %d", m->name, ret);
+            return -__LINE__;
+        }
+        ret = dump_snapshot_order_list(w, i, m->bids);
+        if (ret < 0) {
+            log_error("dump market: %s bids orders list fail: %d", m->name, ret);
+            return -__LINE__;
+        }
+    }
+
+    return 0;
+}
+
+static int market_index(market_t *m)
+{
+    for (int i = 0; i < settings.market_num; ++i) {
+        if (strcmp(settings.markets[i].name, m->name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/* changed orders go to the order section, removed ones to the order_del section */
+static int dump_snapshot_dirty_orders(struct snapshot_writer *w, struct snapshot_head *head)
+{
+    int ret = 0;
+    dict_entry *entry;
+    dict_iterator *iter;
+
+    section_begin(w, &head->sections[SNAPSHOT_SECTION_ORDER], sizeof(struct snapshot_order));
+    iter = dict_get_iterator(dict_order_dirty);
+    while ((entry = dict_next(iter)) != NULL) {
+        market_t *m = entry->val;
+        order_t *order = market_get_order(m, *(uint64_t *)entry->key);
+        if (order == NULL)
+            continue;
+        int index = market_index(m);
+        if (index < 0 || append_order(w, index, order) < 0) {
+            ret = -__LINE__;
+            break;
+        }
+    }
+    dict_release_iterator(iter);
+    if (ret < 0)
+        return ret;
+
+    section_begin(w, &head->sections[SNAPSHOT_SECTION_ORDER_DEL], sizeof(struct snapshot_order_del));
+    iter = dict_get_iterator(dict_order_dirty);
+    while ((entry = dict_next(iter)) != NULL) {
+        market_t *m = entry->val;
+        uint64_t id = *(uint64_t *)entry->key;
+        if (market_get_order(m, id) != NULL)
+            continue;
+        int index = market_index(m);
+        if (index < 0) {
+            ret = -__LINE__;
+            break;
+        }
+        struct snapshot_order_del record;
+        memset(&record, 0, sizeof(record));
+        record.id = id;
+        record.market = index;
+        if (section_append(w, &record) < 0) {
+            ret = -__LINE__;
+            break;
+        }
+    }
+    dict_release_iterator(iter);
+
+    return ret;
+}
+
+static int dump_snapshot_dirty_balance(struct snapshot_writer *w, struct snapshot_head *head)
+{
+    section_begin(w, &head->sections[SNAPSHOT_SECTION_BALANCE], sizeof(struct snapshot_balance));
+
+    int ret = 0;
+    dict_entry *entry;
+    dict_iterator *iter = dict_get_iterator(dict_balance_dirty);
+    while ((entry = dict_next(iter)) != NULL) {
+        struct balance_key *key = entry->key;
+        struct snapshot_balance record;
+        memset(&record, 0, sizeof(record));
+        record.user_id = key->user_id;
+        record.type = key->type;
+        memcpy(record.asset, key->asset, sizeof(record.asset));
+        mpd_t *balance = balance_get(key->user_id, key->type, key->asset);
+        if (write_decimal(record.balance, balance ? balance : mpd_zero) < 0) {
+            ret = -__LINE__;
+            break;
+        }
+        if (section_append(w, &record) < 0) {
+            ret = -__LINE__;
+            break;
+        }
+    }
+    dict_release_iterator(iter);
+
+    return ret;
+}
+
+static int dump_snapshot_balance(struct snapshot_writer *w, struct snapshot_head *head)
+{
+    section_begin(w, &head->sections[SNAPSHOT_SECTION_BALANCE], sizeof(struct snapshot_balance));
+
+    int ret = 0;
+    mpd_t *val;
+    struct balance_key key;
+    balance_iterator *iter = balance_get_iterator();
+    while ((val = balance_next(iter, &key)) != NULL) {
+        struct snapshot_balance record;
+        memset(&record, 0, sizeof(record));
+        record.user_id = key.user_id;
+        record.type = key.type;
+        memcpy(record.asset, key.asset, sizeof(record.asset));
+        if (write_decimal(record.balance, val) < 0) {
+            ret = -__LINE__;
+            break;
+        }
+        if (section_append(w, &record) < 0) {
+            ret = -__LINE__;
+            break;
+        }
+    }
+    balance_release_iterator(iter);
+
+    return ret;
+}
+
+static int sync_dir(const char *path)
+{
+    char *copy = strdup(path);
+    int fd = open(dirname(copy), O_RDONLY);
+    free(copy);
+    if (fd < 0)
+        return -__LINE__;
+    int ret = fsync(fd);
+    close(fd);
+    return ret == 0 ? 0 : -__LINE__;
+}
+
+static bool snapshot_is_full(time_t timestamp)
+{
+    if (snapshot_prev == 0 || settings.slice_base_interval <= 0)
+        return true;
+    return timestamp - snapshot_base >= settings.slice_base_interval;
+}
+
+int dump_snapshot(time_t timestamp, uint64_t oper_id, uint64_t order_id, uint64_t deals_id)
+{
+    if (mkdir(settings.slice_path, 0755) != 0 && errno != EEXIST) {
+        log_error("create slice path: %s fail: %s", settings.slice_path, strerror(errno));
+        return -__LINE__;
+    }
+
+    sds path = snapshot_path(timestamp);
+    sds tmp_path = sdscatprintf(sdsempty(), "%s.tmp", path);
+    log_info("dump slice to: %s", path);
+
+    int ret = 0;
+    struct snapshot_writer w;
+    memset(&w, 0, sizeof(w));
+    w.fp = fopen(tmp_path, "wb");
+    if (w.fp == NULL) {
+        log_error("open slice file: %s fail: %s", tmp_path, strerror(errno));
+        sdsfree(tmp_path);
+        sdsfree(path);
+        return -__LINE__;
+    }
+    setvbuf(w.fp, NULL, _IOFBF, SNAPSHOT_BUF_SIZE);
+
+    struct snapshot_head head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    head.version  = SNAPSHOT_VERSION;
+    head.endian   = SNAPSHOT_ENDIAN;
+    head.time     = timestamp;
+    if (snapshot_is_full(timestamp)) {
+        head.kind = SNAPSHOT_KIND_FULL;
+        head.base = timestamp;
+    } else {
+        head.kind = SNAPSHOT_KIND_DELTA;
+        head.base = snapshot_base;
+        head.prev = snapshot_prev;
+    }
+    head.oper_id  = oper_id;
+    head.order_id = order_id;
+    head.deals_id = deals_id;
+
+    // the head is written again when the sections are complete
+    if (fwrite(&head, sizeof(head), 1, w.fp) != 1) {
+        ret = -__LINE__;
+        goto cleanup;
+    }
+    w.offset = sizeof(head);
+
+    ret = dump_snapshot_markets(&w, &head);
+    if (ret < 0) {
+        log_error("dump_snapshot_markets fail: %d", ret);
+        goto cleanup;
+    }
+    if (head.kind == SNAPSHOT_KIND_FULL) {
+        ret = dump_snapshot_orders(&w, &head);
+        if (ret < 0) {
+            log_error("dump_snapshot_orders fail: %d", ret);
+            goto cleanup;
+        }
+        section_begin(&w, &head.sections[SNAPSHOT_SECTION_ORDER_DEL], sizeof(struct snapshot_order_del));
+        ret = dump_snapshot_balance(&w, &head);
+        if (ret < 0) {
+            log_error("dump_snapshot_balance fail: %d", ret);
+            goto cleanup;
+        }
+    } else {
+        ret = dump_snapshot_dirty_orders(&w, &head);
+        if (ret < 0) {
+            log_error("dump_snapshot_dirty_orders fail: %d", ret);
+            goto cleanup;
+        }
+        ret = dump_snapshot_dirty_balance(&w, &head);
+        if (ret < 0) {
+            log_error("dump_snapshot_dirty_balance fail: %d", ret);
+            goto cleanup;
+        }
+    }
+
+    if (fseek(w.fp, 0, SEEK_SET) != 0 || fwrite(&head, sizeof(head), 1, w.fp) != 1) {
+        ret = -__LINE__;
+        goto cleanup;
+    }
+    if (fflush(w.fp) != 0 || fsync(fileno(w.fp)) != 0) {
+        ret = -__LINE__;
+        goto cleanup;
+    }
+    fclose(w.fp);
+    w.fp = NULL;
+
+    if (rename(tmp_path, path) != 0) {
+        log_error("rename slice file: %s fail: %s", tmp_path, strerror(errno));
+        ret = -__LINE__;
+        goto cleanup;
+    }
+    sync_dir(path);
+
+    log_info("dump %s slice success, base: %"PRIu64", orders: %"PRIu64", removed orders: %"PRIu64", balances: %"PRIu64", size: %"PRIu64,
+            head.kind == SNAPSHOT_KIND_FULL ? "full" : "delta", head.base, head.sections[SNAPSHOT_SECTION_ORDER].count,
+            head.sections[SNAPSHOT_SECTION_ORDER_DEL].count, head.sections[SNAPSHOT_SECTION_BALANCE].count, w.offset);
+    sdsfree(tmp_path);
+    sdsfree(path);
+    return 0;
+
+cleanup:
+    if (w.fp) {
+        fclose(w.fp);
+    }
+    unlink(tmp_path);
+    sdsfree(tmp_path);
+    sdsfree(path);
+    return ret;
+}
+
+static const void *section_data(const char *map, size_t size, const struct snapshot_head *head, int type, size_t record_size)
+{
+    const struct snapshot_section *section = &head->sections[type];
+    if (section->size != record_size)
+        return NULL;
+    if (section->offset < sizeof(struct snapshot_head) || section->offset > size)
+        return NULL;
+    if (section->count > (size - section->offset) / record_size)
+        return NULL;
+
+    const char *data = map + section->offset;
+    if (generate_crc32c(data, section->count * record_size) != section->crc)
+        return NULL;
+    return data;
+}
+
+static bool valid_decimal(const char *str)
+{
+    return memchr(str, '\0', SNAPSHOT_DECIMAL_LEN) != NULL;
+}
+
+static int load_snapshot_markets(const struct snapshot_market *records, size_t count, market_t **markets)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const struct snapshot_market *record = &records[i];
+        if (memchr(record->name, '\0', SNAPSHOT_NAME_LEN) == NULL)
+            return -__LINE__;
+        market_t *m = get_market(record->name);
+        markets[i] = m;
+        if (m == NULL)
+            continue;
+
+        if (record->stock_prec != m->stock_prec || record->money_prec != m->money_prec ||
+                record->fee_prec != m->fee_prec || record->value_prec != m->value_prec) {
+            log_error("market: %s precision changed since the slice", m->name);
+            return -__LINE__;
+        }
+
+        if (!valid_decimal(record->last_price))
+            return -__LINE__;
+        mpd_t *last_price = decimal(record->last_price, 0);
+        if (last_price == NULL)
+            return -__LINE__;
+        mpd_copy(m->last_price, last_price, &mpd_ctx);
+        mpd_del(last_price);
+        if (record->order_seq > m->order_seq)
+            m->order_seq = record->order_seq;
+    }
+
+    return 0;
+}
+
+static int load_snapshot_orders(const struct snapshot_order *records, size_t count, market_t **markets, size_t market_count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const struct snapshot_order *record = &records[i];
+        if (record->market >= market_count)
+            return -__LINE__;
+        market_t *m = markets[record->market];
+        if (m == NULL)
+            continue;
+
+        // a delta holds the latest state of an order already in the book
+        order_t *order = market_get_order(m, record->id);
+        if (order) {
+            market_remove_order(m, order);
+        }
+
+        order = market_new_order(m);
+        if (order == NULL)
+            return -__LINE__;
+        order->id           = record->id;
+        order->type         = record->type;
+        order->side         = record->side;
+        order->create_time  = record->create_time;
+        order->update_time  = record->update_time;
+        order->user_id      = record->user_id;
+        order->price        = record->price;
+        order->amount       = record->amount;
+        order->taker_fee    = record->taker_fee;
+        order->maker_fee    = record->maker_fee;
+        order->left         = record->left;
+        order->freeze       = record->freeze;
+        order->deal_stock   = record->deal_stock;
+        order->deal_money   = record->deal_money;
+        order->deal_fee     = record->deal_fee;
+        order->seq          = record->seq;
+
+        int ret = market_restore_order(m, order);
+        if (ret < 0) {
+            log_error("market_restore_order market: %s, order: %"PRIu64" fail: %d", m->name, record->id, ret);
+            return -__LINE__;
+        }
+    }
+
+    return 0;
+}
+
+static int load_snapshot_order_del(const struct snapshot_order_del *records, size_t count, market_t **markets, size_t market_count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const struct snapshot_order_del *record = &records[i];
+        if (record->market >= market_count)
+            return -__LINE__;
+        market_t *m = markets[record->market];
+        if (m == NULL)
+            continue;
+        order_t *order = market_get_order(m, record->id);
+        if (order) {
+            market_remove_order(m, order);
+        }
+    }
+
+    return 0;
+}
+
+static int load_snapshot_balance(const struct snapshot_balance *records, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const struct snapshot_balance *record = &records[i];
+        if (memchr(record->asset, '\0', sizeof(record->asset)) == NULL || !valid_decimal(record->balance))
+            return -__LINE__;
+        if (!asset_exist(record->asset))
+            continue;
+
+        mpd_t *balance = decimal(record->balance, asset_prec(record->asset));
+        if (balance == NULL)
+            return -__LINE__;
+        balance_set(record->user_id, record->type, record->asset, balance);
+        add_user_to_market(record->asset, record->user_id); // Add to market->users
+        mpd_del(balance);
+    }
+
+    return 0;
+}
+
+static bool valid_head(const struct snapshot_head *head, time_t timestamp)
+{
+    if (memcmp(head->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+        return false;
+    if (head->version != SNAPSHOT_VERSION || head->endian != SNAPSHOT_ENDIAN || head->time != (uint64_t)timestamp)
+        return false;
+    if (head->kind == SNAPSHOT_KIND_FULL)
+        return head->base == head->time;
+    if (head->kind == SNAPSHOT_KIND_DELTA)
+        return head->base <= head->prev && head->prev < head->time;
+    return false;
+}
+
+static int read_snapshot_head(time_t timestamp, struct snapshot_head *head)
+{
+    sds path = snapshot_path(timestamp);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        log_error("open slice file: %s fail: %s", path, strerror(errno));
+        sdsfree(path);
+        return -__LINE__;
+    }
+    ssize_t n = pread(fd, head, sizeof(struct snapshot_head), 0);
+    close(fd);
+    if (n != sizeof(struct snapshot_head) || !valid_head(head, timestamp)) {
+        log_error("invalid slice file head: %s", path);
+        sdsfree(path);
+        return -__LINE__;
+    }
+    sdsfree(path);
+
+    return 0;
+}
+
+static int load_snapshot_file(time_t timestamp)
+{
+    sds path = snapshot_path(timestamp);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        log_error("open slice file: %s fail: %s", path, strerror(errno));
+        sdsfree(path);
+        return -__LINE__;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct snapshot_head)) {
+        log_error("invalid slice file: %s", path);
+        close(fd);
+        sdsfree(path);
+        return -__LINE__;
+    }
+    size_t size = st.st_size;
+    char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_error("mmap slice file: %s fail: %s", path, strerror(errno));
+        sdsfree(path);
+        return -__LINE__;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    log_stderr("load slice from: %s", path);
+
+    int ret = 0;
+    market_t **markets = NULL;
+    double begin = current_timestamp();
+    const struct snapshot_head *head = (const struct snapshot_head *)map;
+    if (!valid_head(head, timestamp)) {
+        log_error("invalid slice file head: %s", path);
+        ret = -__LINE__;
+        goto cleanup;
+    }
+
+    const struct snapshot_market *market_records = section_data(map, size, head, SNAPSHOT_SECTION_MARKET, sizeof(struct snapshot_market));
+    const struct snapshot_order *order_records = section_data(map, size, head, SNAPSHOT_SECTION_ORDER, sizeof(struct snapshot_order));
+    const struct snapshot_order_del *order_del_records = section_data(map, size, head, SNAPSHOT_SECTION_ORDER_DEL, sizeof(struct snapshot_order_del));
+    const struct snapshot_balance *balance_records = section_data(map, size, head, SNAPSHOT_SECTION_BALANCE, sizeof(struct snapshot_balance));
+    if (market_records == NULL || order_records == NULL || order_del_records == NULL || balance_records == NULL) {
+        log_error("slice file: %s corrupt", path);
+        ret = -__LINE__;
+        goto cleanup;
+    }
+
+    size_t market_count = head->sections[SNAPSHOT_SECTION_MARKET].count;
+    size_t order_count = head->sections[SNAPSHOT_SECTION_ORDER].count;
+    size_t order_del_count = head->sections[SNAPSHOT_SECTION_ORDER_DEL].count;
+    size_t balance_count = head->sections[SNAPSHOT_SECTION_BALANCE].count;
+    markets = calloc(market_count + 1, sizeof(market_t *));
+    if (markets == NULL) {
+        ret = -__LINE__;
+        goto cleanup;
+    }
+
+    ret = load_snapshot_markets(market_records, market_count, markets);
+    if (ret < 0) {
+        log_error("load_snapshot_markets fail: %d", ret);
+        goto cleanup;
+    }
+    ret = load_snapshot_order_del(order_del_records, order_del_count, markets, market_count);
+    if (ret < 0) {
+        log_error("load_snapshot_order_del fail: %d", ret);
+        goto cleanup;
+    }
+    ret = load_snapshot_orders(order_records, order_count, markets, market_count);
+    if (ret < 0) {
+        log_error("load_snapshot_orders fail: %d", ret);
+        goto cleanup;
+    }
+    // balance comes last, it overrides the freeze applied when orders are put
+    ret = load_snapshot_balance(balance_records, balance_count);
+    if (ret < 0) {
+        log_error("load_snapshot_balance fail: %d", ret);
+        goto cleanup;
+    }
+
+    double cost = current_timestamp() - begin;
+    log_info("load slice: %s, orders: %zu, removed orders: %zu, balances: %zu in %.3f seconds", path, order_count, order_del_count, balance_count, cost);
+    log_stderr("load slice: %s, orders: %zu, removed orders: %zu, balances: %zu in %.3f seconds", path, order_count, order_del_count, balance_count, cost);
+
+cleanup:
+    free(markets);
+    munmap(map, size);
+    sdsfree(path);
+    return ret;
+}
+
+int load_snapshot(time_t timestamp)
+{
+    // walk back to the full base, then apply the chain forward
+    size_t count = 0;
+    time_t *chain = malloc(sizeof(time_t) * SNAPSHOT_CHAIN_MAX);
+    if (chain == NULL)
+        return -__LINE__;
+
+    struct snapshot_head head;
+    time_t base = 0;
+    time_t t = timestamp;
+    while (true) {
+        if (count == SNAPSHOT_CHAIN_MAX) {
+            free(chain);
+            return -__LINE__;
+        }
+        if (read_snapshot_head(t, &head) < 0) {
+            free(chain);
+            return -__LINE__;
+        }
+        if (count == 0) {
+            base = head.base;
+        }
+        chain[count++] = t;
+        if (head.kind == SNAPSHOT_KIND_FULL)
+            break;
+        t = head.prev;
+    }
+
+    for (size_t i = count; i > 0; --i) {
+        int ret = load_snapshot_file(chain[i - 1]);
+        if (ret < 0) {
+            free(chain);
+            return ret;
+        }
+    }
+    free(chain);
+
+    snapshot_prev = timestamp;
+    snapshot_base = base;
+    return 0;
+}
+
+int snapshot_get_base(time_t timestamp, time_t *base)
+{
+    struct snapshot_head head;
+    int ret = read_snapshot_head(timestamp, &head);
+    if (ret < 0)
+        return ret;
+    *base = head.base;
+    return 0;
+}
+
+void snapshot_forked(time_t timestamp)
+{
+    if (snapshot_is_full(timestamp)) {
+        snapshot_base = timestamp;
+    }
+    snapshot_prev = timestamp;
+
+    // the slice process keeps its own copy of the dirty sets
+    balance_clear_dirty();
+    market_clear_dirty();
+}
+
+void snapshot_reset(void)
+{
+    snapshot_prev = 0;
+    snapshot_base = 0;
+}
+
+int delete_snapshot(time_t timestamp)
+{
+    sds path = snapshot_path(timestamp);
+    int ret = 0;
+    if (unlink(path) != 0 && errno != ENOENT) {
+        log_error("delete slice file: %s fail: %s", path, strerror(errno));
+        ret = -__LINE__;
+    }
+    sdsfree(path);
+    return ret;
+}
+
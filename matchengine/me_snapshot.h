@@ -0,0 +1,29 @@
+/*
+ * Description: binary slice snapshot
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# ifndef _ME_SNAPSHOT_H_
+# define _ME_SNAPSHOT_H_
+
+# include "me_config.h"
+
+/* path of the snapshot file of the slice at timestamp, free with sdsfree */
+sds snapshot_path(time_t timestamp);
+bool snapshot_exist(time_t timestamp);
+
+/* dump a full or delta slice to the snapshot file of timestamp, called in the slice process */
+int dump_snapshot(time_t timestamp, uint64_t oper_id, uint64_t order_id, uint64_t deals_id);
+/* load the slice at timestamp, with its full base and the deltas in between */
+int load_snapshot(time_t timestamp);
+/* the full slice the slice at timestamp is based on */
+int snapshot_get_base(time_t timestamp, time_t *base);
+
+/* called in the main process once the slice process is forked */
+void snapshot_forked(time_t timestamp);
+/* the last slice failed, make the next one full */
+void snapshot_reset(void);
+int delete_snapshot(time_t timestamp);
+
+# endif
+
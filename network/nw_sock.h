@@ -87,5 +87,8 @@ int nw_sock_set_no_delay(int sockfd);
 /* set sockfd reuse addr */
 int nw_sock_set_reuse_addr(int sockfd);
 
+/* set sockfd reuse port, processes bind the same port and the kernel balances accept */
+int nw_sock_set_reuse_port(int sockfd);
+
 # endif
 
@@ -266,6 +266,19 @@ nw_svr *nw_svr_create(nw_svr_cfg *cfg, nw_svr_type *type, void *privdata)
     return svr;
 }
 
+int nw_svr_set_reuse_port(nw_svr *svr)
+{
+    for (uint32_t i = 0; i < svr->svr_count; ++i) {
+        nw_ses *ses = &svr->svr_list[i];
+        if (ses->sock_type != SOCK_STREAM)
+            continue;
+        if (nw_sock_set_reuse_port(ses->sockfd) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
 int nw_svr_start(nw_svr *svr)
 {
     for (uint32_t i = 0; i < svr->svr_count; ++i) {
@@ -105,6 +105,8 @@ typedef struct nw_svr {
 /* create a server instance, the privdata will assign to nw_svr privdata */
 nw_svr *nw_svr_create(nw_svr_cfg *cfg, nw_svr_type *type, void *privdata);
 int nw_svr_add_clt_fd(nw_svr *svr, int fd);
+/* set SO_REUSEPORT on the stream binds, should be called before nw_svr_start */
+int nw_svr_set_reuse_port(nw_svr *svr);
 int nw_svr_start(nw_svr *svr);
 int nw_svr_stop(nw_svr *svr);
 void nw_svr_release(nw_svr *svr);
@@ -0,0 +1,111 @@
+/*
+ * Description:
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# include <stdio.h>
+# include <assert.h>
+
+# include "mp_config.h"
+# include "mp_kline.h"
+
+# define PERIOD     600
+# define BASE       (1000 * 60)
+
+static bool equal(mpd_t *val, const char *str)
+{
+    mpd_t *expect = decimal(str, 0);
+    assert(expect != NULL);
+    bool ret = mpd_cmp(val, expect, &mpd_ctx) == 0;
+    mpd_del(expect);
+    return ret;
+}
+
+static void check(struct kline_info *info, const char *open, const char *close, const char *high, const char *low,
+        const char *volume, const char *deal)
+{
+    assert(info != NULL);
+    assert(equal(info->open, open));
+    assert(equal(info->close, close));
+    assert(equal(info->high, high));
+    assert(equal(info->low, low));
+    assert(equal(info->volume, volume));
+    assert(equal(info->deal, deal));
+    kline_info_free(info);
+}
+
+// the same steps as a deal message: the minute kline first, then the window
+static void put_deal(kline_ring *ring, kline_window *window, time_t timestamp, const char *price_str, const char *amount_str, time_t now)
+{
+    mpd_t *price = decimal(price_str, 0);
+    mpd_t *amount = decimal(amount_str, 0);
+    time_t minute = timestamp / 60 * 60;
+    struct kline_info *kinfo = kline_ring_open(ring, minute, price);
+    assert(kinfo != NULL);
+    kline_info_update(kinfo, price, amount);
+    kline_window_update(window, timestamp, price, amount, now);
+    mpd_del(price);
+    mpd_del(amount);
+}
+
+static void test_expire(void)
+{
+    kline_ring *ring = kline_ring_create(60, PERIOD / 60 + 1);
+    kline_window *window = kline_window_create(ring, PERIOD);
+    assert(ring != NULL && window != NULL);
+    assert(kline_window_get(window, BASE) == NULL);
+
+    put_deal(ring, window, BASE + 1, "10", "1", BASE + 1);
+    put_deal(ring, window, BASE + 61, "12", "2", BASE + 61);
+    put_deal(ring, window, BASE + 121, "8", "1", BASE + 121);
+    check(kline_window_get(window, BASE + 150), "10", "8", "12", "8", "4", "42");
+
+    // the first two minutes fall out, high and low follow
+    check(kline_window_get(window, BASE + PERIOD + 60), "8", "8", "8", "8", "1", "8");
+
+    // a deal older than the window is ignored
+    put_deal(ring, window, BASE + 70, "100", "1", BASE + PERIOD + 60);
+    check(kline_window_get(window, BASE + PERIOD + 60), "8", "8", "8", "8", "1", "8");
+
+    assert(kline_window_get(window, BASE + 120 + PERIOD + 60) == NULL);
+
+    kline_window_release(window);
+    kline_ring_release(ring);
+}
+
+static void test_rebuild(void)
+{
+    kline_ring *ring = kline_ring_create(60, PERIOD / 60 + 1);
+    assert(ring != NULL);
+
+    // a window created over minutes already in the ring builds from them
+    kline_window *window = kline_window_create(ring, PERIOD);
+    assert(window != NULL);
+    put_deal(ring, window, BASE + 300, "5", "1", BASE + 300);
+    kline_window_release(window);
+    window = kline_window_create(ring, PERIOD);
+    assert(window != NULL);
+    check(kline_window_get(window, BASE + 310), "5", "5", "5", "5", "1", "5");
+
+    // a deal of an earlier minute starts over from the ring
+    put_deal(ring, window, BASE + 240, "20", "2", BASE + 310);
+    check(kline_window_get(window, BASE + 310), "20", "5", "20", "5", "3", "45");
+
+    // a later deal of the same minute moves close, the earlier minute keeps open
+    put_deal(ring, window, BASE + 320, "4", "1", BASE + 320);
+    check(kline_window_get(window, BASE + 330), "20", "4", "20", "4", "4", "49");
+
+    kline_window_release(window);
+    kline_ring_release(ring);
+}
+
+int main(int argc, char *argv[])
+{
+    assert(init_mpd() == 0);
+
+    test_expire();
+    test_rebuild();
+
+    printf("test kline success\n");
+    return 0;
+}
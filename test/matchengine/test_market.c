@@ -0,0 +1,260 @@
+/*
+ * Description:
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# include <stdio.h>
+# include <assert.h>
+
+# include "me_config.h"
+# include "me_market.h"
+# include "me_balance.h"
+# include "me_history.h"
+# include "me_message.h"
+
+struct settings settings;
+
+int append_order_history(market_t *m, order_t *order)
+{
+    return 0;
+}
+
+int append_order_deal_history(market_t *m, double t, uint64_t deal_id, order_t *ask, int ask_role, order_t *bid, int bid_role,
+        int64_t price, int64_t amount, int64_t deal, int64_t ask_fee, int64_t bid_fee)
+{
+    return 0;
+}
+
+int append_user_balance_trade_history(market_t *m, order_t *order, const char *asset, int64_t change, int prec,
+        int64_t price, int64_t amount, bool has_fee, int64_t fee_rate)
+{
+    return 0;
+}
+
+int push_order_message(uint32_t event, order_t *order, market_t *market, int64_t filled)
+{
+    return 0;
+}
+
+int push_deal_message(double t, market_t *market, order_t *ask, order_t *bid, int64_t price, int64_t amount,
+        int64_t ask_fee, int64_t bid_fee, int side, uint64_t id)
+{
+    return 0;
+}
+
+market_t *get_market(const char *name)
+{
+    return NULL;
+}
+
+# define VALUE_PREC 8
+
+static int64_t fixed(const char *str, int prec)
+{
+    int64_t val;
+    assert(fixed_parse(str, prec, &val) == 0);
+    return val;
+}
+
+static int64_t balance_of(uint32_t user_id, uint32_t type, const char *asset)
+{
+    mpd_t *balance = balance_get(user_id, type, asset);
+    if (balance == NULL)
+        return 0;
+    int64_t val;
+    assert(fixed_from_mpd(&val, balance, VALUE_PREC) == 0);
+    return val;
+}
+
+static void set_balance(uint32_t user_id, const char *asset, const char *amount)
+{
+    mpd_t *val = decimal(amount, 0);
+    assert(balance_set(user_id, BALANCE_TYPE_AVAILABLE, asset, val) != NULL);
+    mpd_del(val);
+}
+
+// the order list of a user is sorted newest first
+static order_t *last_order(market_t *m, uint32_t user_id)
+{
+    skiplist_t *list = market_get_order_list(m, user_id);
+    if (list == NULL || list->len == 0)
+        return NULL;
+    return list->header->forward[0]->value;
+}
+
+static market_t *create_market(void)
+{
+    static struct asset assets[2];
+    assets[0].name = "BTC";
+    assets[0].prec_save = 8;
+    assets[0].prec_show = 8;
+    assets[0].min_amount = decimal("0", 0);
+    assets[1].name = "USDT";
+    assets[1].prec_save = 8;
+    assets[1].prec_show = 8;
+    assets[1].min_amount = decimal("0", 0);
+    settings.assets = assets;
+    settings.asset_num = 2;
+    assert(init_balance() == 0);
+
+    struct market conf;
+    memset(&conf, 0, sizeof(conf));
+    // not an asset name, so a lookup of the market name as an asset finds nothing
+    conf.name = "BTCUSDT";
+    conf.stock = "BTC";
+    conf.money = "USDT";
+    conf.fee_prec = 4;
+    conf.stock_prec = 4;
+    conf.money_prec = 2;
+    conf.min_amount = decimal("0.0001", 0);
+    conf.init_price = decimal("3.33", 0);
+    conf.closing_price = decimal("3.33", 0);
+
+    market_t *m = market_create(&conf);
+    assert(m != NULL);
+    return m;
+}
+
+// the maker fee is charged per fill and is higher than the fee frozen for it
+static void test_bid_maker_freeze(market_t *m)
+{
+    set_balance(1, "USDT", "100");
+    set_balance(2, "BTC", "10");
+
+    int64_t taker_fee = fixed("0.001", m->fee_prec);
+    int64_t maker_fee = fixed("0.002", m->fee_prec);
+    assert(market_put_limit_order(false, NULL, m, 1, MARKET_ORDER_SIDE_BID, fixed("1", m->stock_prec),
+                fixed("3.33", m->money_prec), taker_fee, maker_fee, "test") == 0);
+    order_t *maker = last_order(m, 1);
+    assert(maker != NULL);
+    assert(maker->freeze == balance_of(1, BALANCE_TYPE_FREEZE, "USDT"));
+
+    for (int i = 0; i < 3; ++i) {
+        assert(market_put_limit_order(false, NULL, m, 2, MARKET_ORDER_SIDE_ASK, fixed("0.3333", m->stock_prec),
+                    fixed("3.33", m->money_prec), taker_fee, maker_fee, "test") == 0);
+        assert(maker->freeze >= 0);
+        assert(maker->freeze == balance_of(1, BALANCE_TYPE_FREEZE, "USDT"));
+    }
+
+    assert(market_put_limit_order(false, NULL, m, 2, MARKET_ORDER_SIDE_ASK, fixed("0.0001", m->stock_prec),
+                fixed("3.33", m->money_prec), taker_fee, maker_fee, "test") == 0);
+    assert(last_order(m, 1) == NULL);
+    assert(balance_of(1, BALANCE_TYPE_FREEZE, "USDT") == 0);
+    assert(balance_of(1, BALANCE_TYPE_AVAILABLE, "BTC") == fixed("1", VALUE_PREC));
+
+    // every fill charged its deal and its own fee, nothing more is left frozen
+    int64_t paid = fixed("100", VALUE_PREC) - balance_of(1, BALANCE_TYPE_AVAILABLE, "USDT");
+    assert(paid > fixed("3.33333", VALUE_PREC));
+    assert(balance_of(2, BALANCE_TYPE_FREEZE, "BTC") == 0);
+}
+
+static void test_amend(market_t *m)
+{
+    set_balance(3, "USDT", "100");
+    set_balance(3, "BTC", "10");
+
+    int64_t fee = fixed("0.001", m->fee_prec);
+    assert(market_put_limit_order(false, NULL, m, 3, MARKET_ORDER_SIDE_ASK, fixed("1", m->stock_prec),
+                fixed("5", m->money_prec), fee, fee, "test") == 0);
+    assert(market_put_limit_order(false, NULL, m, 3, MARKET_ORDER_SIDE_BID, fixed("1", m->stock_prec),
+                fixed("3", m->money_prec), fee, fee, "test") == 0);
+    order_t *order = last_order(m, 3);
+    assert(order != NULL && order->side == MARKET_ORDER_SIDE_BID);
+    uint64_t id = order->id;
+
+    // a new price moves the order under its id, only the difference is frozen
+    assert(market_amend_order(false, NULL, m, order, fixed("2", m->stock_prec), fixed("3.1", m->money_prec)) == 0);
+    assert(market_get_order(m, id) == order);
+    assert(order->price == fixed("3.1", m->money_prec));
+    assert(order->left == fixed("2", m->stock_prec));
+    assert(order->freeze == fixed("6.2062", VALUE_PREC));
+    assert(balance_of(3, BALANCE_TYPE_FREEZE, "USDT") == order->freeze);
+    assert(balance_of(3, BALANCE_TYPE_AVAILABLE, "USDT") == fixed("100", VALUE_PREC) - order->freeze);
+
+    // a reduce at the same price releases the difference
+    assert(market_amend_order(false, NULL, m, order, fixed("1", m->stock_prec), fixed("3.1", m->money_prec)) == 0);
+    assert(order->freeze == fixed("3.1031", VALUE_PREC));
+    assert(balance_of(3, BALANCE_TYPE_FREEZE, "USDT") == order->freeze);
+
+    // an amend that would trade or can not be frozen changes nothing
+    assert(market_amend_order(false, NULL, m, order, fixed("1", m->stock_prec), fixed("5", m->money_prec)) == -3);
+    assert(market_amend_order(false, NULL, m, order, fixed("100", m->stock_prec), fixed("3.1", m->money_prec)) == -1);
+    assert(order->price == fixed("3.1", m->money_prec));
+    assert(order->left == fixed("1", m->stock_prec));
+    assert(order->freeze == fixed("3.1031", VALUE_PREC));
+    assert(balance_of(3, BALANCE_TYPE_FREEZE, "USDT") == order->freeze);
+    assert(balance_of(3, BALANCE_TYPE_AVAILABLE, "USDT") == fixed("100", VALUE_PREC) - order->freeze);
+}
+
+// a new price or a larger amount queues behind the orders already resting at the price
+static void test_amend_priority(market_t *m)
+{
+    set_balance(5, "USDT", "100");
+    set_balance(6, "USDT", "100");
+
+    int64_t fee = fixed("0.001", m->fee_prec);
+    assert(market_put_limit_order(false, NULL, m, 6, MARKET_ORDER_SIDE_BID, fixed("1", m->stock_prec),
+                fixed("2.7", m->money_prec), fee, fee, "test") == 0);
+    order_t *older = last_order(m, 6);
+    assert(market_put_limit_order(false, NULL, m, 5, MARKET_ORDER_SIDE_BID, fixed("1", m->stock_prec),
+                fixed("2.8", m->money_prec), fee, fee, "test") == 0);
+    order_t *resting = last_order(m, 5);
+    assert(older != NULL && resting != NULL && older->id < resting->id);
+
+    assert(market_amend_order(false, NULL, m, older, fixed("1", m->stock_prec), fixed("2.8", m->money_prec)) == 0);
+    assert(older->level == resting->level);
+    assert(resting->level->head == resting);
+    assert(resting->level->tail == older);
+
+    // a reduce keeps the place, a larger amount gives it up
+    assert(market_amend_order(false, NULL, m, resting, fixed("0.5", m->stock_prec), fixed("2.8", m->money_prec)) == 0);
+    assert(resting->level->head == resting);
+    assert(market_amend_order(false, NULL, m, resting, fixed("2", m->stock_prec), fixed("2.8", m->money_prec)) == 0);
+    assert(older->level->head == older);
+    assert(older->level->tail == resting);
+
+    assert(market_cancel_user_orders(false, NULL, m, 5, 0) == 1);
+    assert(market_cancel_user_orders(false, NULL, m, 6, 0) == 1);
+}
+
+static void test_cancel_all(market_t *m)
+{
+    set_balance(4, "USDT", "100");
+    set_balance(4, "BTC", "10");
+
+    int64_t fee = fixed("0.001", m->fee_prec);
+    assert(market_put_limit_order(false, NULL, m, 4, MARKET_ORDER_SIDE_ASK, fixed("1", m->stock_prec),
+                fixed("6", m->money_prec), fee, fee, "test") == 0);
+    assert(market_put_limit_order(false, NULL, m, 4, MARKET_ORDER_SIDE_BID, fixed("2", m->stock_prec),
+                fixed("2", m->money_prec), fee, fee, "test") == 0);
+    assert(market_put_limit_order(false, NULL, m, 4, MARKET_ORDER_SIDE_BID, fixed("1", m->stock_prec),
+                fixed("2.5", m->money_prec), fee, fee, "test") == 0);
+    assert(balance_of(4, BALANCE_TYPE_FREEZE, "BTC") == fixed("1", VALUE_PREC));
+    assert(balance_of(4, BALANCE_TYPE_FREEZE, "USDT") > 0);
+
+    // one side only leaves the other frozen
+    assert(market_cancel_user_orders(false, NULL, m, 4, MARKET_ORDER_SIDE_BID) == 2);
+    assert(balance_of(4, BALANCE_TYPE_FREEZE, "USDT") == 0);
+    assert(balance_of(4, BALANCE_TYPE_AVAILABLE, "USDT") == fixed("100", VALUE_PREC));
+    assert(balance_of(4, BALANCE_TYPE_FREEZE, "BTC") == fixed("1", VALUE_PREC));
+
+    assert(market_cancel_user_orders(false, NULL, m, 4, 0) == 1);
+    assert(last_order(m, 4) == NULL);
+    assert(balance_of(4, BALANCE_TYPE_FREEZE, "BTC") == 0);
+    assert(balance_of(4, BALANCE_TYPE_AVAILABLE, "BTC") == fixed("10", VALUE_PREC));
+    assert(market_cancel_user_orders(false, NULL, m, 4, 0) == 0);
+}
+
+int main(int argc, char *argv[])
+{
+    assert(init_mpd() == 0);
+    market_t *m = create_market();
+
+    test_bid_maker_freeze(m);
+    test_amend(m);
+    test_amend_priority(m);
+    test_cancel_all(m);
+
+    printf("test market success\n");
+    return 0;
+}
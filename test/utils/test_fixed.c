@@ -0,0 +1,71 @@
+/*
+ * Description:
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# include <stdio.h>
+# include <assert.h>
+# include "ut_fixed.h"
+# include "ut_decimal.h"
+
+static void check_parse(const char *str, int prec, int64_t expect)
+{
+    int64_t val = 0;
+    assert(fixed_parse(str, prec, &val) == 0);
+    if (val != expect) {
+        printf("parse %s prec %d: %"PRId64" != %"PRId64"\n", str, prec, val, expect);
+        assert(0);
+    }
+}
+
+static void check_format(int64_t val, int prec, const char *expect)
+{
+    char buf[FIXED_STR_MAX_LEN];
+    fixed_format(buf, val, prec);
+    if (strcmp(buf, expect) != 0) {
+        printf("format %"PRId64" prec %d: %s != %s\n", val, prec, buf, expect);
+        assert(0);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    init_mpd();
+
+    check_parse("100.12345678", 8, 10012345678LL);
+    check_parse("100.123456789", 8, 10012345678LL);
+    check_parse("-1.5", 2, -150);
+    check_parse("1e-8", 8, 1);
+    check_parse("1.5E2", 0, 150);
+    check_parse("0.000", 4, 0);
+    check_parse("12", 4, 120000);
+
+    int64_t val;
+    assert(fixed_parse("", 8, &val) < 0);
+    assert(fixed_parse("1.2.3", 8, &val) < 0);
+    assert(fixed_parse("abc", 8, &val) < 0);
+    assert(fixed_parse("100000000000", 8, &val) < 0);
+
+    check_format(10012345678LL, 8, "100.12345678");
+    check_format(150, 2, "1.5");
+    check_format(1, 8, "0.00000001");
+    check_format(-150, 2, "-1.5");
+    check_format(0, 8, "0");
+    check_format(42, 0, "42");
+
+    // 1.5 * 2.25 = 3.375
+    assert(fixed_mul(&val, 150, 2, 225, 2, 3, FIXED_ROUND_DOWN) == 0 && val == 3375);
+    assert(fixed_mul(&val, 150, 2, 225, 2, 2, FIXED_ROUND_DOWN) == 0 && val == 337);
+    assert(fixed_mul(&val, 150, 2, 225, 2, 2, FIXED_ROUND_UP) == 0 && val == 338);
+    assert(fixed_mul(&val, INT64_MAX, 0, 2, 0, 0, FIXED_ROUND_DOWN) < 0);
+    // 10 / 3 = 3.33
+    assert(fixed_div(&val, 10, 0, 3, 0, 2, FIXED_ROUND_DOWN) == 0 && val == 333);
+    assert(fixed_div(&val, 10, 0, 3, 0, 2, FIXED_ROUND_UP) == 0 && val == 334);
+    assert(fixed_rescale(&val, 12345, 4, 2, FIXED_ROUND_DOWN) == 0 && val == 123);
+    assert(fixed_rescale(&val, 12345, 4, 6, FIXED_ROUND_DOWN) == 0 && val == 1234500);
+    assert(fixed_add(&val, INT64_MAX, 1) < 0);
+
+    printf("test fixed success\n");
+    return 0;
+}
+
@@ -0,0 +1,70 @@
+/*
+ * Description:
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# include <stdio.h>
+# include <string.h>
+# include <assert.h>
+# include "ut_json_writer.h"
+# include "ut_rpc_bin.h"
+
+static void write_sample(json_writer *w)
+{
+    json_writer_object_begin(w);
+    json_writer_key(w, "error");
+    json_writer_null(w);
+    json_writer_key(w, "result");
+    json_writer_object_begin(w);
+    json_writer_key(w, "asks");
+    json_writer_array_begin(w);
+    for (int i = 0; i < 300; ++i) {
+        json_writer_array_begin(w);
+        json_writer_fixed(w, 800000 + i, 2);
+        json_writer_fixed(w, -5, 8);
+        json_writer_array_end(w);
+    }
+    json_writer_array_end(w);
+    json_writer_key(w, "bids");
+    json_writer_array_begin(w);
+    json_writer_array_end(w);
+    json_writer_key(w, "source");
+    json_writer_string(w, "a \"quoted\"\n\\ text");
+    json_writer_key(w, "ctime");
+    json_writer_real(w, 1500000000.5);
+    json_writer_key(w, "ok");
+    json_writer_bool(w, true);
+    json_writer_object_end(w);
+    json_writer_key(w, "id");
+    json_writer_int(w, -7);
+    json_writer_object_end(w);
+}
+
+int main(int argc, char *argv[])
+{
+    json_writer w;
+    json_writer_init(&w, sdsempty(), false);
+    write_sample(&w);
+    json_t *text = json_loadb(w.buf, sdslen(w.buf), 0, NULL);
+    assert(text != NULL);
+    json_t *result = json_object_get(text, "result");
+    assert(json_array_size(json_object_get(result, "asks")) == 300);
+    json_t *item = json_array_get(json_object_get(result, "asks"), 1);
+    assert(strcmp(json_string_value(json_array_get(item, 0)), "8000.01") == 0);
+    assert(strcmp(json_string_value(json_array_get(item, 1)), "-0.00000005") == 0);
+    assert(strcmp(json_string_value(json_object_get(result, "source")), "a \"quoted\"\n\\ text") == 0);
+
+    // the binary writer gives the same value as the text writer
+    json_writer_init(&w, w.buf, true);
+    write_sample(&w);
+    json_t *binary = rpc_bin_decode(w.buf, sdslen(w.buf));
+    assert(binary != NULL);
+    assert(json_equal(text, binary));
+
+    json_decref(text);
+    json_decref(binary);
+    sdsfree(w.buf);
+
+    printf("test json writer success\n");
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * Description:
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# include <stdio.h>
+# include <assert.h>
+# include "ut_rpc_bin.h"
+
+static void check_roundtrip(const char *text)
+{
+    json_t *value = json_loads(text, JSON_DECODE_ANY, NULL);
+    assert(value != NULL);
+
+    sds body = sdsempty();
+    assert(rpc_bin_encode(&body, value) == 0);
+    json_t *decoded = rpc_bin_decode(body, sdslen(body));
+    assert(decoded != NULL);
+    if (!json_equal(value, decoded)) {
+        char *str = json_dumps(decoded, JSON_ENCODE_ANY);
+        printf("roundtrip %s: %s\n", text, str);
+        assert(0);
+    }
+
+    json_decref(decoded);
+    json_decref(value);
+    sdsfree(body);
+}
+
+int main(int argc, char *argv[])
+{
+    check_roundtrip("[1, \"BTCCNY\", 2, \"10.5\", \"8000.00\", \"0.002\", \"0.001\", \"api\"]");
+    check_roundtrip("[\"0\", \"0.0\", \"-1.25\", \"-0\", \"01\", \"1.\", \".5\", \"1e8\", \"123456789012345678901\"]");
+    check_roundtrip("{\"error\": null, \"result\": {\"id\": 12, \"ctime\": 1500000000.123, \"ok\": true}, \"id\": -7}");
+    check_roundtrip("[[], {}, \"\", false]");
+
+    // decimals take a scaled integer instead of the string
+    json_t *value = json_string("8000.12345678");
+    sds body = sdsempty();
+    assert(rpc_bin_encode(&body, value) == 0);
+    assert((uint8_t)body[0] == RPC_BIN_DECIMAL);
+    assert(sdslen(body) < strlen("8000.12345678"));
+    json_decref(value);
+
+    // truncated body
+    assert(rpc_bin_decode(body, sdslen(body) - 1) == NULL);
+    sdsfree(body);
+
+    printf("test rpc bin success\n");
+    return 0;
+}
+
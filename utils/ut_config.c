@@ -369,6 +369,7 @@ int load_cfg_kafka_consumer(json_t *root, const char *key, kafka_consumer_cfg *c
     ERR_RET(read_cfg_str(node, "topic", &cfg->topic, NULL));
     ERR_RET(read_cfg_int(node, "partition", &cfg->partition, false, 0));
     ERR_RET(read_cfg_int(node, "limit", &cfg->limit, false, 1000));
+    ERR_RET(read_cfg_int(node, "batch_num", &cfg->batch_num, false, 100));
     ERR_RET(read_cfg_int64(node, "offset", &cfg->offset, false, 0));
 
     return 0;
@@ -384,6 +385,12 @@ int load_cfg_kafka_producer(json_t *root, const char *key, kafka_producer_cfg *c
     ERR_RET(read_cfg_str(node, "topic_balances", &cfg->topic_balances, NULL));
     ERR_RET(read_cfg_str(node, "topic_deals", &cfg->topic_deals, NULL));
     ERR_RET(read_cfg_str(node, "topic_orders", &cfg->topic_orders, NULL));
+    ERR_RET(read_cfg_str(node, "topic_depth", &cfg->topic_depth, "depth"));
+    ERR_RET(read_cfg_bool(node, "partition_deals_by_market", &cfg->partition_deals_by_market, false, false));
+    ERR_RET(read_cfg_int(node, "linger_ms", &cfg->linger_ms, false, 1));
+    ERR_RET(read_cfg_int(node, "batch_num", &cfg->batch_num, false, 10000));
+    ERR_RET(read_cfg_int(node, "queue_max", &cfg->queue_max, false, 100000));
+    ERR_RET(read_cfg_str(node, "compression", &cfg->compression, "none"));
 
     return 0;
 }
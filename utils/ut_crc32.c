@@ -74,9 +74,9 @@ static const unsigned int crc_c[256] = {
 	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
 };
 
-uint32_t generate_crc32c(const char *buffer, size_t length) {
+uint32_t update_crc32c(uint32_t crc, const char *buffer, size_t length) {
   size_t i;
-  uint32_t crc32 = ~0L;
+  uint32_t crc32 = ~crc;
 
   for (i = 0; i < length; i++){
       CRC32C(crc32, (unsigned char)buffer[i]);
@@ -84,3 +84,7 @@ uint32_t generate_crc32c(const char *buffer, size_t length) {
   return ~crc32;
 }
 
+uint32_t generate_crc32c(const char *buffer, size_t length) {
+  return update_crc32c(0, buffer, length);
+}
+
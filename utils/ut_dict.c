@@ -50,6 +50,17 @@ uint32_t dict_generic_hash_function(const void *data, size_t len)
     } \
 } while (0)
 
+# define DICT_ALLOC_ENTRY(dt) \
+    ((dt)->type.entry_alloc ? (dt)->type.entry_alloc() : malloc(sizeof(dict_entry)))
+
+# define DICT_FREE_ENTRY(dt, entry) do { \
+    if ((dt)->type.entry_free) { \
+        (dt)->type.entry_free(entry); \
+    } else { \
+        free(entry); \
+    } \
+} while (0)
+
 # define DICT_HASH_KEY(dt, key) (dt)->type.hash_function(key)
 # define DICT_COMPARE_KEY(dt, key1, key2) (dt)->type.key_compare((key1), (key2))
 
@@ -138,7 +149,7 @@ static void check_clear(dict_t *dt, uint32_t index)
             }
             DICT_FREE_HASH_KEY(dt, entry);
             DICT_FREE_HASH_VAL(dt, entry);
-            free(entry);
+            DICT_FREE_ENTRY(dt, entry);
             entry = NULL;
             dt->used--;
         }
@@ -169,7 +180,7 @@ dict_entry *dict_add(dict_t *dt, void *key, void *val)
         return NULL;
     if (dict_expand_if_needed(dt) != 0)
         return NULL;
-    dict_entry *entry = malloc(sizeof(dict_entry));
+    dict_entry *entry = DICT_ALLOC_ENTRY(dt);
     if (entry == NULL)
         return NULL;
 
@@ -215,7 +226,7 @@ int dict_delete(dict_t *dt, const void *key)
             }
             DICT_FREE_HASH_KEY(dt, entry);
             DICT_FREE_HASH_VAL(dt, entry);
-            free(entry);
+            DICT_FREE_ENTRY(dt, entry);
             dt->used--;
             return 1;
         }
@@ -252,7 +263,7 @@ void dict_release(dict_t *dt)
             next_entry = entry->next;
             DICT_FREE_HASH_KEY(dt, entry);
             DICT_FREE_HASH_VAL(dt, entry);
-            free(entry);
+            DICT_FREE_ENTRY(dt, entry);
             entry = next_entry;
         }
     }
@@ -23,6 +23,9 @@ typedef struct dict_types {
     int (*key_compare)(const void *key1, const void *key2);
     void (*key_destructor)(void *key);
     void (*val_destructor)(void *val);
+    /* optional entry allocator */
+    void *(*entry_alloc)(void);
+    void (*entry_free)(void *entry);
 } dict_types;
 
 typedef struct dict_t {
@@ -0,0 +1,282 @@
+/*
+ * Description: scaled integer (fixed point) decimal arithmetic
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# include <string.h>
+# include <ctype.h>
+
+# include "ut_fixed.h"
+# include "ut_decimal.h"
+
+typedef __int128 int128_t;
+
+# define INT128_DIGITS_MAX 36
+
+const int64_t fixed_pow10[FIXED_PREC_MAX + 1] = {
+    1LL,
+    10LL,
+    100LL,
+    1000LL,
+    10000LL,
+    100000LL,
+    1000000LL,
+    10000000LL,
+    100000000LL,
+    1000000000LL,
+    10000000000LL,
+    100000000000LL,
+    1000000000000LL,
+    10000000000000LL,
+    100000000000000LL,
+    1000000000000000LL,
+    10000000000000000LL,
+    100000000000000000LL,
+    1000000000000000000LL,
+};
+
+static int128_t pow10_128(int n)
+{
+    int128_t val = 1;
+    for (int i = 0; i < n; ++i)
+        val *= 10;
+    return val;
+}
+
+static int narrow(int64_t *result, int128_t val)
+{
+    if (val > INT64_MAX || val < INT64_MIN)
+        return -1;
+    *result = (int64_t)val;
+    return 0;
+}
+
+/* val / 10^shift when shift > 0, val * 10^-shift when shift < 0 */
+static int shift_128(int64_t *result, int128_t val, int shift, int round)
+{
+    if (shift == 0)
+        return narrow(result, val);
+
+    if (shift < 0) {
+        if (val == 0)
+            return narrow(result, 0);
+        if (-shift > FIXED_PREC_MAX)
+            return -1;
+        int64_t mul = fixed_pow10[-shift];
+        if (val > INT64_MAX / mul || val < INT64_MIN / mul)
+            return -1;
+        return narrow(result, val * mul);
+    }
+
+    if (shift > INT128_DIGITS_MAX) {
+        if (val == 0 || round == FIXED_ROUND_DOWN)
+            return narrow(result, 0);
+        return narrow(result, val > 0 ? 1 : -1);
+    }
+
+    int128_t div = pow10_128(shift);
+    int128_t q = val / div;
+    if (round == FIXED_ROUND_UP && q * div != val) {
+        q += val > 0 ? 1 : -1;
+    }
+    return narrow(result, q);
+}
+
+int fixed_parse(const char *str, int prec, int64_t *result)
+{
+    if (str == NULL || prec < 0 || prec > FIXED_PREC_MAX)
+        return -1;
+
+    const char *p = str;
+    bool negative = false;
+    if (*p == '+' || *p == '-') {
+        negative = (*p == '-');
+        p++;
+    }
+
+    int128_t mantissa = 0;
+    int digits = 0;
+    int scale = 0;
+    bool has_digit = false;
+    bool in_fraction = false;
+    for (; *p; ++p) {
+        if (*p == '.') {
+            if (in_fraction)
+                return -1;
+            in_fraction = true;
+            continue;
+        }
+        if (!isdigit((unsigned char)*p))
+            break;
+        has_digit = true;
+        if (digits >= INT128_DIGITS_MAX) {
+            // extra fraction digits only truncate, extra integer digits overflow
+            if (!in_fraction)
+                return -1;
+            continue;
+        }
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa != 0)
+            digits++;
+        if (in_fraction)
+            scale++;
+    }
+    if (!has_digit)
+        return -1;
+
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        bool exp_negative = false;
+        if (*p == '+' || *p == '-') {
+            exp_negative = (*p == '-');
+            p++;
+        }
+        if (!isdigit((unsigned char)*p))
+            return -1;
+        int exp = 0;
+        for (; isdigit((unsigned char)*p); ++p) {
+            exp = exp * 10 + (*p - '0');
+            if (exp > 1000)
+                return -1;
+        }
+        scale += exp_negative ? exp : -exp;
+    }
+    if (*p != '\0')
+        return -1;
+
+    if (negative)
+        mantissa = -mantissa;
+
+    return shift_128(result, mantissa, scale - prec, FIXED_ROUND_DOWN);
+}
+
+char *fixed_format(char *buf, int64_t val, int prec)
+{
+    char digits[32];
+    uint64_t abs = val < 0 ? (uint64_t)(-(val + 1)) + 1 : (uint64_t)val;
+    int len = snprintf(digits, sizeof(digits), "%"PRIu64, abs);
+
+    char *p = buf;
+    if (val < 0)
+        *p++ = '-';
+
+    if (prec <= 0) {
+        memcpy(p, digits, len + 1);
+        return buf;
+    }
+
+    if (len <= prec) {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = len; i < prec; ++i)
+            *p++ = '0';
+        memcpy(p, digits, len);
+        p += len;
+    } else {
+        memcpy(p, digits, len - prec);
+        p += len - prec;
+        *p++ = '.';
+        memcpy(p, digits + len - prec, prec);
+        p += prec;
+    }
+    *p = '\0';
+
+    return rstripzero(buf);
+}
+
+int fixed_add(int64_t *result, int64_t a, int64_t b)
+{
+    int64_t val;
+    if (__builtin_add_overflow(a, b, &val))
+        return -1;
+    *result = val;
+    return 0;
+}
+
+int fixed_sub(int64_t *result, int64_t a, int64_t b)
+{
+    int64_t val;
+    if (__builtin_sub_overflow(a, b, &val))
+        return -1;
+    *result = val;
+    return 0;
+}
+
+int fixed_rescale(int64_t *result, int64_t val, int prec, int result_prec, int round)
+{
+    return shift_128(result, val, prec - result_prec, round);
+}
+
+int fixed_mul(int64_t *result, int64_t a, int a_prec, int64_t b, int b_prec, int result_prec, int round)
+{
+    int128_t val = (int128_t)a * b;
+    return shift_128(result, val, a_prec + b_prec - result_prec, round);
+}
+
+int fixed_div(int64_t *result, int64_t a, int a_prec, int64_t b, int b_prec, int result_prec, int round)
+{
+    if (b == 0)
+        return -1;
+
+    // a / b = (a * 10^n) / b with scale a_prec + n - b_prec
+    int n = result_prec + b_prec - a_prec;
+    int128_t dividend = a;
+    if (n > 0) {
+        if (n > FIXED_PREC_MAX + 1)
+            return -1;
+        dividend *= pow10_128(n);
+    } else if (n < 0) {
+        int64_t shifted;
+        if (shift_128(&shifted, dividend, -n, FIXED_ROUND_DOWN) < 0)
+            return -1;
+        dividend = shifted;
+    }
+
+    int128_t q = dividend / b;
+    if (round == FIXED_ROUND_UP && q * b != dividend) {
+        q += ((dividend > 0) == (b > 0)) ? 1 : -1;
+    }
+    return narrow(result, q);
+}
+
+int fixed_from_mpd(int64_t *result, const mpd_t *val, int prec)
+{
+    FIXED_MPD(tmp);
+    uint32_t status = 0;
+    mpd_qrescale(&tmp, val, -prec, &mpd_ctx, &status);
+    if (status & MPD_Invalid_operation) {
+        mpd_del(&tmp);
+        return -1;
+    }
+
+    tmp.exp = 0;
+    status = 0;
+    int64_t v = mpd_qget_i64(&tmp, &status);
+    mpd_del(&tmp);
+    if (status & MPD_Invalid_operation)
+        return -1;
+
+    *result = v;
+    return 0;
+}
+
+mpd_t *fixed_to_mpd(mpd_t *result, int64_t val, int prec)
+{
+    uint32_t status = 0;
+    mpd_qset_i64(result, val, &mpd_ctx, &status);
+    result->exp = -prec;
+    return result;
+}
+
+int json_object_set_new_fixed(json_t *obj, const char *key, int64_t val, int prec)
+{
+    char buf[FIXED_STR_MAX_LEN];
+    return json_object_set_new(obj, key, json_string(fixed_format(buf, val, prec)));
+}
+
+int json_array_append_new_fixed(json_t *obj, int64_t val, int prec)
+{
+    char buf[FIXED_STR_MAX_LEN];
+    return json_array_append_new(obj, json_string(fixed_format(buf, val, prec)));
+}
+
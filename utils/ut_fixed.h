@@ -0,0 +1,54 @@
+/*
+ * Description: scaled integer (fixed point) decimal arithmetic
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# ifndef _UT_FIXED_H_
+# define _UT_FIXED_H_
+
+# include <stdint.h>
+# include <stdbool.h>
+# include <mpdecimal.h>
+# include <jansson.h>
+
+/*
+ * A fixed value is an int64_t holding the decimal value multiplied by
+ * 10^prec, prec is not stored with the value and must be known by the
+ * caller (usually it comes from the market or asset precision).
+ */
+
+# define FIXED_PREC_MAX     18
+# define FIXED_STR_MAX_LEN  48
+
+enum {
+    FIXED_ROUND_DOWN,
+    FIXED_ROUND_UP,
+};
+
+extern const int64_t fixed_pow10[FIXED_PREC_MAX + 1];
+
+/* stack allocated mpd_t, no malloc is needed to use it as a temporary */
+# define FIXED_MPD(name) \
+    mpd_uint_t name##_data[MPD_MINALLOC_MAX]; \
+    mpd_t name = { MPD_STATIC | MPD_STATIC_DATA, 0, 0, 0, MPD_MINALLOC_MAX, name##_data }
+
+/* parse a decimal string, extra digits are truncated, return < 0 on syntax error or overflow */
+int fixed_parse(const char *str, int prec, int64_t *result);
+/* format without trailing zeros, buf size should be at least FIXED_STR_MAX_LEN */
+char *fixed_format(char *buf, int64_t val, int prec);
+
+/* all arithmetic returns < 0 on overflow and leaves result untouched */
+int fixed_add(int64_t *result, int64_t a, int64_t b);
+int fixed_sub(int64_t *result, int64_t a, int64_t b);
+int fixed_rescale(int64_t *result, int64_t val, int prec, int result_prec, int round);
+int fixed_mul(int64_t *result, int64_t a, int a_prec, int64_t b, int b_prec, int result_prec, int round);
+int fixed_div(int64_t *result, int64_t a, int a_prec, int64_t b, int b_prec, int result_prec, int round);
+
+int fixed_from_mpd(int64_t *result, const mpd_t *val, int prec);
+mpd_t *fixed_to_mpd(mpd_t *result, int64_t val, int prec);
+
+int json_object_set_new_fixed(json_t *obj, const char *key, int64_t val, int prec);
+int json_array_append_new_fixed(json_t *obj, int64_t val, int prec);
+
+# endif
+
@@ -0,0 +1,258 @@
+/*
+ * Description: streaming json writer
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <inttypes.h>
+# include <string.h>
+
+# include "ut_json_writer.h"
+# include "ut_rpc_bin.h"
+# include "ut_pack.h"
+# include "ut_fixed.h"
+# include "ut_decimal.h"
+# include "ut_misc.h"
+
+// a varint of 0xff and 8 bytes can hold any count, patched when the container ends
+# define COUNT_PLACEHOLDER_SIZE 9
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static void put_char(json_writer *w, char c)
+{
+    w->buf = sdscatlen(w->buf, &c, 1);
+}
+
+static void put_varint(json_writer *w, uint64_t num)
+{
+    char buf[9];
+    void *p = buf;
+    size_t left = sizeof(buf);
+    pack_varint_le(&p, &left, num);
+    w->buf = sdscatlen(w->buf, buf, sizeof(buf) - left);
+}
+
+static uint64_t zigzag_encode(int64_t num)
+{
+    return ((uint64_t)num << 1) ^ (uint64_t)(num >> 63);
+}
+
+static void put_text_string(json_writer *w, const char *str)
+{
+    put_char(w, '"');
+    const char *start = str;
+    const char *p = str;
+    for (; *p; ++p) {
+        unsigned char c = *p;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        if (p > start)
+            w->buf = sdscatlen(w->buf, start, p - start);
+        switch (c) {
+        case '"':  w->buf = sdscatlen(w->buf, "\\\"", 2); break;
+        case '\\': w->buf = sdscatlen(w->buf, "\\\\", 2); break;
+        case '\b': w->buf = sdscatlen(w->buf, "\\b", 2); break;
+        case '\f': w->buf = sdscatlen(w->buf, "\\f", 2); break;
+        case '\n': w->buf = sdscatlen(w->buf, "\\n", 2); break;
+        case '\r': w->buf = sdscatlen(w->buf, "\\r", 2); break;
+        case '\t': w->buf = sdscatlen(w->buf, "\\t", 2); break;
+        default: {
+            char esc[6] = { '\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xf] };
+            w->buf = sdscatlen(w->buf, esc, sizeof(esc));
+            break;
+        }
+        }
+        start = p + 1;
+    }
+    if (p > start)
+        w->buf = sdscatlen(w->buf, start, p - start);
+    put_char(w, '"');
+}
+
+static void value_prefix(json_writer *w)
+{
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    if (w->depth == 0)
+        return;
+    if (!w->binary && !w->first[w->depth])
+        put_char(w, ',');
+    w->first[w->depth] = false;
+    w->count[w->depth] += 1;
+}
+
+static void container_begin(json_writer *w, char open, uint8_t tag)
+{
+    value_prefix(w);
+    if (w->binary) {
+        put_char(w, tag);
+        w->count_pos[w->depth + 1] = sdslen(w->buf);
+        char placeholder[COUNT_PLACEHOLDER_SIZE] = { (char)0xff };
+        w->buf = sdscatlen(w->buf, placeholder, sizeof(placeholder));
+    } else {
+        put_char(w, open);
+    }
+    w->depth += 1;
+    w->first[w->depth] = true;
+    w->count[w->depth] = 0;
+}
+
+static void container_end(json_writer *w, char close)
+{
+    if (w->binary) {
+        uint64_t count = htole64(w->count[w->depth]);
+        memcpy(w->buf + w->count_pos[w->depth] + 1, &count, sizeof(count));
+    } else {
+        put_char(w, close);
+    }
+    w->depth -= 1;
+}
+
+void json_writer_init(json_writer *w, sds buf, bool binary)
+{
+    memset(w, 0, sizeof(json_writer));
+    sdsclear(buf);
+    w->buf = buf;
+    w->binary = binary;
+}
+
+void json_writer_object_begin(json_writer *w)
+{
+    container_begin(w, '{', RPC_BIN_OBJECT);
+}
+
+void json_writer_object_end(json_writer *w)
+{
+    container_end(w, '}');
+}
+
+void json_writer_array_begin(json_writer *w)
+{
+    container_begin(w, '[', RPC_BIN_ARRAY);
+}
+
+void json_writer_array_end(json_writer *w)
+{
+    container_end(w, ']');
+}
+
+void json_writer_key(json_writer *w, const char *key)
+{
+    value_prefix(w);
+    if (w->binary) {
+        size_t len = strlen(key);
+        put_varint(w, len);
+        w->buf = sdscatlen(w->buf, key, len);
+    } else {
+        put_text_string(w, key);
+        put_char(w, ':');
+    }
+    w->after_key = true;
+}
+
+void json_writer_null(json_writer *w)
+{
+    value_prefix(w);
+    if (w->binary) {
+        put_char(w, RPC_BIN_NULL);
+    } else {
+        w->buf = sdscatlen(w->buf, "null", 4);
+    }
+}
+
+void json_writer_bool(json_writer *w, bool val)
+{
+    value_prefix(w);
+    if (w->binary) {
+        put_char(w, val ? RPC_BIN_TRUE : RPC_BIN_FALSE);
+    } else if (val) {
+        w->buf = sdscatlen(w->buf, "true", 4);
+    } else {
+        w->buf = sdscatlen(w->buf, "false", 5);
+    }
+}
+
+void json_writer_int(json_writer *w, int64_t val)
+{
+    value_prefix(w);
+    if (w->binary) {
+        put_char(w, RPC_BIN_INT);
+        put_varint(w, zigzag_encode(val));
+    } else {
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf), "%"PRId64, val);
+        w->buf = sdscatlen(w->buf, buf, len);
+    }
+}
+
+void json_writer_real(json_writer *w, double val)
+{
+    value_prefix(w);
+    if (w->binary) {
+        uint64_t bits;
+        memcpy(&bits, &val, sizeof(bits));
+        bits = htole64(bits);
+        put_char(w, RPC_BIN_REAL);
+        w->buf = sdscatlen(w->buf, &bits, sizeof(bits));
+    } else {
+        // the same as jansson, a real always has a dot or an exponent
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf), "%.17g", val);
+        if (strpbrk(buf, ".eE") == NULL && len + 2 < sizeof(buf)) {
+            buf[len++] = '.';
+            buf[len++] = '0';
+        }
+        w->buf = sdscatlen(w->buf, buf, len);
+    }
+}
+
+void json_writer_string(json_writer *w, const char *str)
+{
+    value_prefix(w);
+    if (w->binary) {
+        rpc_bin_put_string(&w->buf, str, strlen(str));
+    } else {
+        put_text_string(w, str);
+    }
+}
+
+void json_writer_fixed(json_writer *w, int64_t val, int prec)
+{
+    value_prefix(w);
+    if (w->binary && prec >= 0 && prec <= FIXED_PREC_MAX) {
+        // strip trailing zeros as fixed_format does, so both decode to the same string
+        while (prec > 0 && val % 10 == 0) {
+            val /= 10;
+            prec--;
+        }
+        put_char(w, RPC_BIN_DECIMAL);
+        put_varint(w, zigzag_encode(val));
+        put_char(w, prec);
+    } else {
+        char buf[FIXED_STR_MAX_LEN];
+        fixed_format(buf, val, prec);
+        if (w->binary) {
+            rpc_bin_put_string(&w->buf, buf, strlen(buf));
+        } else {
+            put_text_string(w, buf);
+        }
+    }
+}
+
+void json_writer_mpd(json_writer *w, const mpd_t *val)
+{
+    char *str = mpd_to_sci(val, 0);
+    json_writer_string(w, rstripzero(str));
+    free(str);
+}
+
+void json_writer_raw(json_writer *w, const char *data, size_t len)
+{
+    value_prefix(w);
+    w->buf = sdscatlen(w->buf, data, len);
+}
+
@@ -0,0 +1,58 @@
+/*
+ * Description: streaming json writer
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# ifndef _UT_JSON_WRITER_H_
+# define _UT_JSON_WRITER_H_
+
+# include <stdint.h>
+# include <stdbool.h>
+# include <mpdecimal.h>
+
+# include "ut_sds.h"
+
+/*
+ * Write a json value token by token into a buffer, without building a
+ * jansson tree. In binary mode the output is the ut_rpc_bin encoding of
+ * the same value, the element count of arrays and objects is patched
+ * when they end.
+ *
+ * Decimals are written the same as json_object_set_new_fixed and
+ * json_object_set_new_mpd, so a reply reads the same as one built with
+ * jansson.
+ */
+
+# define JSON_WRITER_DEPTH_MAX  16
+
+typedef struct json_writer {
+    sds         buf;
+    bool        binary;
+    bool        after_key;
+    int         depth;
+    bool        first[JSON_WRITER_DEPTH_MAX];
+    size_t      count_pos[JSON_WRITER_DEPTH_MAX];
+    uint64_t    count[JSON_WRITER_DEPTH_MAX];
+} json_writer;
+
+/* buf is cleared and reused, it is owned by the caller */
+void json_writer_init(json_writer *w, sds buf, bool binary);
+
+void json_writer_object_begin(json_writer *w);
+void json_writer_object_end(json_writer *w);
+void json_writer_array_begin(json_writer *w);
+void json_writer_array_end(json_writer *w);
+void json_writer_key(json_writer *w, const char *key);
+
+void json_writer_null(json_writer *w);
+void json_writer_bool(json_writer *w, bool val);
+void json_writer_int(json_writer *w, int64_t val);
+void json_writer_real(json_writer *w, double val);
+void json_writer_string(json_writer *w, const char *str);
+void json_writer_fixed(json_writer *w, int64_t val, int prec);
+void json_writer_mpd(json_writer *w, const mpd_t *val);
+/* a value already written by a writer of the same mode */
+void json_writer_raw(json_writer *w, const char *data, size_t len);
+
+# endif
+
@@ -10,16 +10,20 @@
 # include "ut_log.h"
 # include "ut_kafka.h"
 
-typedef struct message_t {
-    sds message;
-    int64_t offset;
-} message_t;
+typedef struct message_batch {
+    size_t count;
+    kafka_message messages[];
+} message_batch;
 
-static void free_message(void *value)
+static void free_batch(void *value)
 {
-    message_t *m = value;
-    sdsfree(m->message);
-    free(m);
+    message_batch *batch = value;
+    if (batch == NULL)
+        return;
+    for (size_t i = 0; i < batch->count; ++i) {
+        sdsfree(batch->messages[i].message);
+    }
+    free(batch);
 }
 
 static void on_logger(const rd_kafka_t *rk, int level, const char *fac, const char *buf)
@@ -34,32 +38,70 @@ static void *thread_routine(void *data)
     consumer->running = true;
     pthread_mutex_unlock(&consumer->lock);
 
-    while (consumer->shutdown == false) {
-        if (consumer->list->len >= consumer->limit) {
+    rd_kafka_message_t **rkmessages = consumer->rkmessages;
+    message_batch *batch = NULL;
+    for (;;) {
+        pthread_mutex_lock(&consumer->lock);
+        bool shutdown = consumer->shutdown;
+        bool full = consumer->pending >= consumer->limit;
+        pthread_mutex_unlock(&consumer->lock);
+        if (shutdown)
+            break;
+        if (full) {
             usleep(100 * 1000);
             continue;
         }
 
+        // allocated before consuming, so a message is never taken without room for it
+        if (batch == NULL) {
+            batch = malloc(sizeof(message_batch) + sizeof(kafka_message) * consumer->batch_num);
+            if (batch == NULL) {
+                log_error("malloc message batch fail, batch_num: %d", consumer->batch_num);
+                usleep(100 * 1000);
+                continue;
+            }
+        }
+
         rd_kafka_poll(consumer->rk, 0);
         rd_kafka_message_t *rkmessage = rd_kafka_consume(consumer->rkt, consumer->partition, 100);
         if (!rkmessage)
             continue;
-        if (rkmessage->err) {
-            if (rkmessage->err != RD_KAFKA_RESP_ERR__PARTITION_EOF) {
-                log_error("Consume error for topic \"%s\" [%"PRId32"] offset %"PRId64": %s", rd_kafka_topic_name(rkmessage->rkt),
-                        rkmessage->partition, rkmessage->offset, rd_kafka_message_errstr(rkmessage));
+
+        // wait for the first message only, then take what is already fetched
+        rkmessages[0] = rkmessage;
+        size_t count = 1;
+        if (consumer->batch_num > 1) {
+            ssize_t ret = rd_kafka_consume_batch(consumer->rkt, consumer->partition, 0, rkmessages + 1, consumer->batch_num - 1);
+            if (ret > 0)
+                count += ret;
+        }
+
+        batch->count = 0;
+        for (size_t i = 0; i < count; ++i) {
+            rkmessage = rkmessages[i];
+            if (rkmessage->err) {
+                if (rkmessage->err != RD_KAFKA_RESP_ERR__PARTITION_EOF) {
+                    log_error("Consume error for topic \"%s\" [%"PRId32"] offset %"PRId64": %s", rd_kafka_topic_name(rkmessage->rkt),
+                            rkmessage->partition, rkmessage->offset, rd_kafka_message_errstr(rkmessage));
+                }
+            } else {
+                kafka_message *m = &batch->messages[batch->count++];
+                m->message = sdsnewlen(rkmessage->payload, rkmessage->len);
+                m->offset = rkmessage->offset;
             }
-        } else {
-            struct message_t *m = malloc(sizeof(message_t));
-            m->message = sdsnewlen(rkmessage->payload, rkmessage->len);
-            m->offset = rkmessage->offset;
-            pthread_mutex_lock(&consumer->lock);
-            list_add_node_head(consumer->list, m);
-            write(consumer->pipefd[1], " ", 1);
-            pthread_mutex_unlock(&consumer->lock);
+            rd_kafka_message_destroy(rkmessage);
         }
-        rd_kafka_message_destroy(rkmessage);
+        if (batch->count == 0)
+            continue;
+
+        pthread_mutex_lock(&consumer->lock);
+        list_add_node_head(consumer->list, batch);
+        consumer->pending += batch->count;
+        write(consumer->pipefd[1], " ", 1);
+        pthread_mutex_unlock(&consumer->lock);
+        batch = NULL;
     }
+    free(batch);
 
     rd_kafka_consume_stop(consumer->rkt, consumer->partition);
     return data;
@@ -82,14 +124,28 @@ static void on_can_read(struct ev_loop *loop, ev_io *watcher, int events)
             break;
         }
         list_node *node = list_tail(consumer->list);
-        message_t *m = node->value;
-        consumer->callback(m->message, m->offset);
+        message_batch *batch = node->value;
+        node->value = NULL;
         list_del(consumer->list, node);
         pthread_mutex_unlock(&consumer->lock);
+
+        // the consumer thread keeps fetching while the batch is handled
+        if (consumer->batch_callback) {
+            consumer->batch_callback(consumer->partition, batch->messages, batch->count);
+        } else {
+            for (size_t i = 0; i < batch->count; ++i) {
+                consumer->callback(batch->messages[i].message, batch->messages[i].offset);
+            }
+        }
+
+        pthread_mutex_lock(&consumer->lock);
+        consumer->pending -= batch->count;
+        pthread_mutex_unlock(&consumer->lock);
+        free_batch(batch);
     }
 }
 
-kafka_consumer_t *kafka_consumer_create(kafka_consumer_cfg *cfg, kafka_message_callback callback)
+static kafka_consumer_t *consumer_create(kafka_consumer_cfg *cfg, kafka_message_callback callback, kafka_batch_callback batch_callback)
 {
     kafka_consumer_t *consumer = malloc(sizeof(kafka_consumer_t));
     if (consumer == NULL)
@@ -99,6 +155,7 @@ kafka_consumer_t *kafka_consumer_create(kafka_consumer_cfg *cfg, kafka_message_c
     nw_loop_init();
     consumer->loop = nw_default_loop;
     consumer->callback = callback;
+    consumer->batch_callback = batch_callback;
 
     if (pipe(consumer->pipefd) != 0) {
         free(consumer);
@@ -112,13 +169,19 @@ kafka_consumer_t *kafka_consumer_create(kafka_consumer_cfg *cfg, kafka_message_c
 
     list_type lt;
     memset(&lt, 0, sizeof(lt));
-    lt.free = free_message;
+    lt.free = free_batch;
     consumer->list = list_create(&lt);
     if (consumer->list == NULL) {
         kafka_consumer_release(consumer);
         return NULL;
     }
     consumer->limit = cfg->limit;
+    consumer->batch_num = cfg->batch_num > 0 ? cfg->batch_num : 1;
+    consumer->rkmessages = malloc(sizeof(rd_kafka_message_t *) * consumer->batch_num);
+    if (consumer->rkmessages == NULL) {
+        kafka_consumer_release(consumer);
+        return NULL;
+    }
 
     char errstr[1024];
     consumer->partition = cfg->partition;
@@ -163,6 +226,16 @@ kafka_consumer_t *kafka_consumer_create(kafka_consumer_cfg *cfg, kafka_message_c
     return consumer;
 }
 
+kafka_consumer_t *kafka_consumer_create(kafka_consumer_cfg *cfg, kafka_message_callback callback)
+{
+    return consumer_create(cfg, callback, NULL);
+}
+
+kafka_consumer_t *kafka_consumer_create_batch(kafka_consumer_cfg *cfg, kafka_batch_callback callback)
+{
+    return consumer_create(cfg, NULL, callback);
+}
+
 void kafka_consumer_release(kafka_consumer_t *consumer)
 {
     pthread_mutex_lock(&consumer->lock);
@@ -193,5 +266,6 @@ void kafka_consumer_release(kafka_consumer_t *consumer)
     if (consumer->rkt) {
         rd_kafka_topic_destroy(consumer->rkt);
     }
+    free(consumer->rkmessages);
 }
 
@@ -16,13 +16,26 @@
 # include "ut_sds.h"
 # include "ut_list.h"
 
+typedef struct kafka_message {
+    sds     message;
+    int64_t offset;
+} kafka_message;
+
 typedef void (*kafka_message_callback)(sds message, int64_t offset);
+/* messages fetched together from one partition, in offset order */
+typedef void (*kafka_batch_callback)(int32_t partition, kafka_message *messages, size_t count);
 
 typedef struct kafka_producer_cfg {
     char    *brokers;
     char    *topic_deals;
     char    *topic_orders;
     char    *topic_balances;
+    char    *topic_depth;
+    bool    partition_deals_by_market;
+    int     linger_ms;
+    int     batch_num;
+    int     queue_max;
+    char    *compression;
 } kafka_producer_cfg;
 
 typedef struct kafka_consumer_cfg {
@@ -30,6 +43,7 @@ typedef struct kafka_consumer_cfg {
     char    *topic;
     int     partition;
     int     limit;
+    int     batch_num;
     int64_t offset;
 } kafka_consumer_cfg;
 
@@ -46,11 +60,16 @@ typedef struct kafka_consumer_t {
     rd_kafka_topic_t *rkt;
     int32_t partition;
     list_t *list;
+    int pending;
     int limit;
+    int batch_num;
+    rd_kafka_message_t **rkmessages;
     kafka_message_callback callback;
+    kafka_batch_callback batch_callback;
 } kafka_consumer_t;
 
 kafka_consumer_t *kafka_consumer_create(kafka_consumer_cfg *cfg, kafka_message_callback callback);
+kafka_consumer_t *kafka_consumer_create_batch(kafka_consumer_cfg *cfg, kafka_batch_callback callback);
 void kafka_consumer_release(kafka_consumer_t *consumer);
 
 # endif
@@ -0,0 +1,351 @@
+/*
+ * Description: compact binary rpc body
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# include <string.h>
+# include <ctype.h>
+# include <inttypes.h>
+
+# include "ut_rpc_bin.h"
+# include "ut_pack.h"
+# include "ut_misc.h"
+
+# define RPC_BIN_DEPTH_MAX      32
+# define RPC_BIN_SCALE_MAX      18
+# define RPC_BIN_DIGITS_MAX     18
+
+static const uint8_t binary_ext = RPC_EXT_BINARY;
+
+static uint64_t zigzag_encode(int64_t num)
+{
+    return ((uint64_t)num << 1) ^ (uint64_t)(num >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t num)
+{
+    return (int64_t)(num >> 1) ^ -(int64_t)(num & 1);
+}
+
+static void put_char(sds *body, uint8_t c)
+{
+    *body = sdscatlen(*body, &c, 1);
+}
+
+static void put_varint(sds *body, uint64_t num)
+{
+    char buf[9];
+    void *p = buf;
+    size_t left = sizeof(buf);
+    pack_varint_le(&p, &left, num);
+    *body = sdscatlen(*body, buf, sizeof(buf) - left);
+}
+
+static void put_varstr(sds *body, const char *str, size_t len)
+{
+    put_varint(body, len);
+    *body = sdscatlen(*body, str, len);
+}
+
+// canonical decimal only, [-]int[.frac] without extra leading zeros, so it formats back to the same string
+static bool decimal_parse(const char *str, size_t len, int64_t *val, int *scale)
+{
+    size_t i = 0;
+    bool neg = false;
+    if (i < len && str[i] == '-') {
+        neg = true;
+        i++;
+    }
+
+    size_t int_start = i;
+    while (i < len && isdigit((unsigned char)str[i]))
+        i++;
+    size_t int_len = i - int_start;
+    if (int_len == 0 || (int_len > 1 && str[int_start] == '0'))
+        return false;
+
+    size_t frac_start = i;
+    size_t frac_len = 0;
+    if (i < len && str[i] == '.') {
+        frac_start = ++i;
+        while (i < len && isdigit((unsigned char)str[i]))
+            i++;
+        frac_len = i - frac_start;
+        if (frac_len == 0)
+            return false;
+    }
+    if (i != len || int_len + frac_len > RPC_BIN_DIGITS_MAX)
+        return false;
+
+    uint64_t num = 0;
+    for (size_t j = int_start; j < int_start + int_len; ++j)
+        num = num * 10 + (str[j] - '0');
+    for (size_t j = frac_start; j < frac_start + frac_len; ++j)
+        num = num * 10 + (str[j] - '0');
+    if (neg && num == 0)
+        return false;
+
+    *val = neg ? -(int64_t)num : (int64_t)num;
+    *scale = frac_len;
+    return true;
+}
+
+static json_t *decimal_format(int64_t val, int scale)
+{
+    char digits[32];
+    uint64_t num = val < 0 ? -(uint64_t)val : (uint64_t)val;
+    int len = snprintf(digits, sizeof(digits), "%0*"PRIu64, scale + 1, num);
+
+    char buf[40];
+    char *p = buf;
+    if (val < 0)
+        *p++ = '-';
+    memcpy(p, digits, len - scale);
+    p += len - scale;
+    if (scale > 0) {
+        *p++ = '.';
+        memcpy(p, digits + len - scale, scale);
+        p += scale;
+    }
+
+    return json_stringn(buf, p - buf);
+}
+
+void rpc_bin_put_string(sds *body, const char *str, size_t len)
+{
+    int64_t val;
+    int scale;
+    if (decimal_parse(str, len, &val, &scale)) {
+        put_char(body, RPC_BIN_DECIMAL);
+        put_varint(body, zigzag_encode(val));
+        put_char(body, scale);
+    } else {
+        put_char(body, RPC_BIN_STR);
+        put_varstr(body, str, len);
+    }
+}
+
+static int encode_value(sds *body, const json_t *value, int depth)
+{
+    if (depth > RPC_BIN_DEPTH_MAX)
+        return -__LINE__;
+
+    switch (json_typeof(value)) {
+    case JSON_NULL:
+        put_char(body, RPC_BIN_NULL);
+        break;
+    case JSON_TRUE:
+        put_char(body, RPC_BIN_TRUE);
+        break;
+    case JSON_FALSE:
+        put_char(body, RPC_BIN_FALSE);
+        break;
+    case JSON_INTEGER:
+        put_char(body, RPC_BIN_INT);
+        put_varint(body, zigzag_encode(json_integer_value(value)));
+        break;
+    case JSON_REAL: {
+        double real = json_real_value(value);
+        uint64_t bits;
+        memcpy(&bits, &real, sizeof(bits));
+        bits = htole64(bits);
+        put_char(body, RPC_BIN_REAL);
+        *body = sdscatlen(*body, &bits, sizeof(bits));
+        break;
+    }
+    case JSON_STRING:
+        rpc_bin_put_string(body, json_string_value(value), json_string_length(value));
+        break;
+    case JSON_ARRAY:
+        put_char(body, RPC_BIN_ARRAY);
+        put_varint(body, json_array_size(value));
+        for (size_t i = 0; i < json_array_size(value); ++i) {
+            int ret = encode_value(body, json_array_get(value, i), depth + 1);
+            if (ret < 0)
+                return ret;
+        }
+        break;
+    case JSON_OBJECT: {
+        put_char(body, RPC_BIN_OBJECT);
+        put_varint(body, json_object_size(value));
+        const char *key;
+        json_t *item;
+        json_object_foreach((json_t *)value, key, item) {
+            put_varstr(body, key, strlen(key));
+            int ret = encode_value(body, item, depth + 1);
+            if (ret < 0)
+                return ret;
+        }
+        break;
+    }
+    default:
+        return -__LINE__;
+    }
+
+    return 0;
+}
+
+int rpc_bin_encode(sds *body, const json_t *value)
+{
+    return encode_value(body, value, 0);
+}
+
+static json_t *decode_value(void **src, size_t *left, int depth)
+{
+    if (depth > RPC_BIN_DEPTH_MAX)
+        return NULL;
+
+    uint8_t tag;
+    if (unpack_char(src, left, &tag) < 0)
+        return NULL;
+
+    uint64_t num;
+    switch (tag) {
+    case RPC_BIN_NULL:
+        return json_null();
+    case RPC_BIN_TRUE:
+        return json_true();
+    case RPC_BIN_FALSE:
+        return json_false();
+    case RPC_BIN_INT:
+        if (unpack_varint_le(src, left, &num) < 0)
+            return NULL;
+        return json_integer(zigzag_decode(num));
+    case RPC_BIN_REAL: {
+        double real;
+        if (unpack_uint64_le(src, left, &num) < 0)
+            return NULL;
+        memcpy(&real, &num, sizeof(real));
+        return json_real(real);
+    }
+    case RPC_BIN_STR: {
+        if (unpack_varint_le(src, left, &num) < 0 || *left < num)
+            return NULL;
+        json_t *str = json_stringn(*src, num);
+        *src  += num;
+        *left -= num;
+        return str;
+    }
+    case RPC_BIN_DECIMAL: {
+        uint8_t scale;
+        if (unpack_varint_le(src, left, &num) < 0 || unpack_char(src, left, &scale) < 0)
+            return NULL;
+        if (scale > RPC_BIN_SCALE_MAX)
+            return NULL;
+        return decimal_format(zigzag_decode(num), scale);
+    }
+    case RPC_BIN_ARRAY: {
+        if (unpack_varint_le(src, left, &num) < 0 || num > *left)
+            return NULL;
+        json_t *array = json_array();
+        for (uint64_t i = 0; i < num; ++i) {
+            json_t *item = decode_value(src, left, depth + 1);
+            if (item == NULL) {
+                json_decref(array);
+                return NULL;
+            }
+            json_array_append_new(array, item);
+        }
+        return array;
+    }
+    case RPC_BIN_OBJECT: {
+        if (unpack_varint_le(src, left, &num) < 0 || num > *left)
+            return NULL;
+        json_t *object = json_object();
+        for (uint64_t i = 0; i < num; ++i) {
+            sds key = NULL;
+            if (unpack_varstr(src, left, &key) < 0) {
+                json_decref(object);
+                return NULL;
+            }
+            json_t *item = decode_value(src, left, depth + 1);
+            if (item == NULL) {
+                sdsfree(key);
+                json_decref(object);
+                return NULL;
+            }
+            json_object_set_new(object, key, item);
+            sdsfree(key);
+        }
+        return object;
+    }
+    }
+
+    return NULL;
+}
+
+json_t *rpc_bin_decode(const void *data, size_t size)
+{
+    void *src = (void *)data;
+    size_t left = size;
+    json_t *value = decode_value(&src, &left, 0);
+    if (value && left != 0) {
+        json_decref(value);
+        return NULL;
+    }
+    return value;
+}
+
+bool rpc_pkg_is_binary(const rpc_pkg *pkg)
+{
+    return pkg->ext_size == 1 && *(uint8_t *)pkg->ext == RPC_EXT_BINARY;
+}
+
+void rpc_pkg_set_binary(rpc_pkg *pkg)
+{
+    pkg->ext = (void *)&binary_ext;
+    pkg->ext_size = sizeof(binary_ext);
+}
+
+json_t *rpc_pkg_body_json(const rpc_pkg *pkg)
+{
+    if (rpc_pkg_is_binary(pkg))
+        return rpc_bin_decode(pkg->body, pkg->body_size);
+    return json_loadb(pkg->body, pkg->body_size, 0, NULL);
+}
+
+sds rpc_pkg_body_text(const rpc_pkg *pkg)
+{
+    if (!rpc_pkg_is_binary(pkg))
+        return sdsnewlen(pkg->body, pkg->body_size);
+
+    json_t *value = rpc_bin_decode(pkg->body, pkg->body_size);
+    if (value == NULL)
+        return NULL;
+    char *str = json_dumps(value, JSON_ENCODE_ANY);
+    json_decref(value);
+    if (str == NULL)
+        return NULL;
+    sds text = sdsnew(str);
+    free(str);
+    return text;
+}
+
+int rpc_clt_send_body(rpc_clt *clt, rpc_pkg *pkg, const json_t *value, bool binary)
+{
+    int ret;
+    if (binary) {
+        sds body = sdsempty();
+        ret = rpc_bin_encode(&body, value);
+        if (ret == 0) {
+            rpc_pkg_set_binary(pkg);
+            pkg->body = body;
+            pkg->body_size = sdslen(body);
+            ret = rpc_clt_send(clt, pkg);
+        }
+        sdsfree(body);
+    } else {
+        char *body = json_dumps(value, 0);
+        if (body == NULL)
+            return -__LINE__;
+        pkg->body = body;
+        pkg->body_size = strlen(body);
+        ret = rpc_clt_send(clt, pkg);
+        free(body);
+    }
+    pkg->body = NULL;
+    pkg->body_size = 0;
+
+    return ret;
+}
+
@@ -0,0 +1,57 @@
+/*
+ * Description: compact binary rpc body
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# ifndef _UT_RPC_BIN_H_
+# define _UT_RPC_BIN_H_
+
+# include <stdbool.h>
+# include <jansson.h>
+
+# include "ut_rpc.h"
+# include "ut_rpc_clt.h"
+# include "ut_sds.h"
+
+/*
+ * A binary body is a tagged encoding of the json value, integers and
+ * lengths are varint, decimal strings are carried as a scaled integer
+ * with its scale and come back as the same string.
+ *
+ * The request is marked with a one byte ext of RPC_EXT_BINARY, the
+ * server replies in the same encoding as the request.
+ */
+
+# define RPC_EXT_BINARY     0x01
+
+enum {
+    RPC_BIN_NULL        = 0,
+    RPC_BIN_TRUE        = 1,
+    RPC_BIN_FALSE       = 2,
+    RPC_BIN_INT         = 3,
+    RPC_BIN_REAL        = 4,
+    RPC_BIN_STR         = 5,
+    RPC_BIN_DECIMAL     = 6,
+    RPC_BIN_ARRAY       = 7,
+    RPC_BIN_OBJECT      = 8,
+};
+
+/* append the encoding of value to body */
+int rpc_bin_encode(sds *body, const json_t *value);
+json_t *rpc_bin_decode(const void *data, size_t size);
+/* append a string value, a decimal string takes the scaled form */
+void rpc_bin_put_string(sds *body, const char *str, size_t len);
+
+bool rpc_pkg_is_binary(const rpc_pkg *pkg);
+void rpc_pkg_set_binary(rpc_pkg *pkg);
+
+/* body of either encoding as json */
+json_t *rpc_pkg_body_json(const rpc_pkg *pkg);
+/* body of either encoding as json text, free with sdsfree */
+sds rpc_pkg_body_text(const rpc_pkg *pkg);
+
+/* send value as the body of pkg, in the binary encoding if binary */
+int rpc_clt_send_body(rpc_clt *clt, rpc_pkg *pkg, const json_t *value, bool binary);
+
+# endif
+
@@ -26,6 +26,9 @@
 # define CMD_ORDER_DETAIL_FINISHED  210
 # define CMD_ORDER_PUT_AON          211
 # define CMD_ORDER_PUT_FOK          212
+# define CMD_ORDER_PUT_BATCH        213
+# define CMD_ORDER_CANCEL_ALL       214
+# define CMD_ORDER_AMEND            215
 
 // market
 # define CMD_MARKET_STATUS          301
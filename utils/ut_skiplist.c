@@ -8,17 +8,22 @@
 
 # include "ut_skiplist.h"
 
-# define SKIPLIST_MAX_LEVEL 16
 # define SKIPLIST_P         0.25
 
 static skiplist_node *skiplist_create_node(skiplist_t *list, int level, void *value)
 {
     size_t size = sizeof(skiplist_node) + level * sizeof(skiplist_node *);
-    skiplist_node *node = malloc(size);
+    skiplist_node *node;
+    if (list->type.node_alloc) {
+        node = list->type.node_alloc(level);
+    } else {
+        node = malloc(size);
+    }
     if (node == NULL) {
         return NULL;
     }
     memset(node, 0, size);
+    node->level = level;
     if (value && list->type.dup) {
         node->value = list->type.dup(value);
     } else {
@@ -47,6 +52,15 @@ skiplist_t *skiplist_create(skiplist_type *type)
     return list;
 }
 
+static void skiplist_free_node(skiplist_t *list, skiplist_node *node)
+{
+    if (list->type.node_free) {
+        list->type.node_free(node, node->level);
+    } else {
+        free(node);
+    }
+}
+
 static int skiplist_random_level(void)
 {
     int level = 1;
@@ -136,7 +150,7 @@ void skiplist_delete(skiplist_t *list, skiplist_node *x)
     if (list->type.free) {
         list->type.free(x->value);
     }
-    free(x);
+    skiplist_free_node(list, x);
     list->len -= 1;
 }
 
@@ -150,10 +164,10 @@ void skiplist_release(skiplist_t *list)
         if (list->type.free) {
             list->type.free(curr->value);
         }
-        free(curr);
+        skiplist_free_node(list, curr);
         curr = next;
     }
-    free(list->header);
+    skiplist_free_node(list, list->header);
     free(list);
 }
 
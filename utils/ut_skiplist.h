@@ -6,8 +6,11 @@
 # ifndef _UT_SKIPLIST_H_
 # define _UT_SKIPLIST_H_
 
+# define SKIPLIST_MAX_LEVEL 16
+
 typedef struct skiplist_node {
     void *value;
+    int level;
     struct skiplist_node *forward[];
 } skiplist_node;
 
@@ -19,6 +22,9 @@ typedef struct skiplist_type {
     void *(*dup)(void *value);
     void (*free)(void *value);
     int (*compare)(const void *value1, const void *value2);
+    /* optional node allocator, level is the number of forward pointers */
+    void *(*node_alloc)(int level);
+    void (*node_free)(void *node, int level);
 } skiplist_type;
 
 typedef struct skiplist_t {
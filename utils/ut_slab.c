@@ -0,0 +1,86 @@
+/*
+ * Description: fixed size object allocator, objects are carved from
+ *              large slabs and recycled through a free list.
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# include <stdlib.h>
+# include <string.h>
+
+# include "ut_slab.h"
+
+# define SLAB_ALIGN 8
+
+slab_t *slab_create(uint32_t size, uint32_t count)
+{
+    if (size == 0 || count == 0)
+        return NULL;
+
+    slab_t *slab = malloc(sizeof(slab_t));
+    if (slab == NULL)
+        return NULL;
+    memset(slab, 0, sizeof(slab_t));
+
+    // a free object stores the next free pointer in place
+    if (size < sizeof(void *))
+        size = sizeof(void *);
+    slab->size  = (size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+    slab->count = count;
+
+    return slab;
+}
+
+static int slab_grow(slab_t *slab)
+{
+    if (slab->slab_num == slab->slab_total) {
+        uint32_t new_total = slab->slab_total ? slab->slab_total * 2 : 16;
+        void **new_slabs = realloc(slab->slabs, new_total * sizeof(void *));
+        if (new_slabs == NULL)
+            return -1;
+        slab->slabs = new_slabs;
+        slab->slab_total = new_total;
+    }
+
+    char *mem = malloc((size_t)slab->size * slab->count);
+    if (mem == NULL)
+        return -1;
+    slab->slabs[slab->slab_num++] = mem;
+
+    for (uint32_t i = 0; i < slab->count; ++i) {
+        void *obj = mem + (size_t)i * slab->size;
+        *(void **)obj = slab->free_list;
+        slab->free_list = obj;
+    }
+
+    return 0;
+}
+
+void *slab_alloc(slab_t *slab)
+{
+    if (slab->free_list == NULL && slab_grow(slab) < 0)
+        return NULL;
+
+    void *obj = slab->free_list;
+    slab->free_list = *(void **)obj;
+    slab->used++;
+    return obj;
+}
+
+void slab_free(slab_t *slab, void *obj)
+{
+    if (obj == NULL)
+        return;
+    *(void **)obj = slab->free_list;
+    slab->free_list = obj;
+    slab->used--;
+}
+
+void slab_release(slab_t *slab)
+{
+    for (uint32_t i = 0; i < slab->slab_num; ++i) {
+        free(slab->slabs[i]);
+    }
+    free(slab->slabs);
+    free(slab);
+}
+
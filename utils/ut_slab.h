@@ -0,0 +1,34 @@
+/*
+ * Description: fixed size object allocator, objects are carved from
+ *              large slabs and recycled through a free list.
+ *     History: yang@haipo.me, 2026/10/16, create
+ */
+
+# ifndef _UT_SLAB_H_
+# define _UT_SLAB_H_
+
+# include <stdint.h>
+# include <stddef.h>
+
+typedef struct slab_t {
+    uint32_t size;
+    uint32_t count;
+    void *free_list;
+    void **slabs;
+    uint32_t slab_num;
+    uint32_t slab_total;
+    uint64_t used;
+} slab_t;
+
+# define slab_used(s)   ((s)->used)
+# define slab_num(s)    ((s)->slab_num)
+# define slab_bytes(s)  ((size_t)(s)->slab_num * (s)->count * (s)->size)
+
+/* size is the object size, count is the number of objects per slab */
+slab_t *slab_create(uint32_t size, uint32_t count);
+void *slab_alloc(slab_t *slab);
+void slab_free(slab_t *slab, void *obj);
+void slab_release(slab_t *slab);
+
+# endif
+
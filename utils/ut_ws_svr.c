@@ -363,6 +363,29 @@ static void on_privdata_free(void *svr, void *privdata)
     nw_cache_free(w_svr->privdata_cache, privdata);
 }
 
+static size_t frame_header(uint8_t *p, uint8_t opcode, size_t payload_len)
+{
+    p[0] = 0;
+    p[0] |= 0x1 << 7;
+    p[0] |= opcode;
+    p[1] = 0;
+    if (payload_len < 126) {
+        uint8_t len = payload_len;
+        p[1] |= len;
+        return 2;
+    } else if (payload_len <= 0xffff) {
+        p[1] |= 126;
+        uint16_t len = htobe16((uint16_t)payload_len);
+        memcpy(p + 2, &len, sizeof(len));
+        return 2 + sizeof(len);
+    } else {
+        p[1] |= 127;
+        uint64_t len = htobe64(payload_len);
+        memcpy(p + 2, &len, sizeof(len));
+        return 2 + sizeof(len);
+    }
+}
+
 static int send_reply(nw_ses *ses, uint8_t opcode, void *payload, size_t payload_len)
 {
     if (payload == NULL)
@@ -384,30 +407,9 @@ static int send_reply(nw_ses *ses, uint8_t opcode, void *payload, size_t payload
         buf_size = require_len;
     }
 
-    size_t pkg_len = 0;
-    uint8_t *p = buf;
-    p[0] = 0;
-    p[0] |= 0x1 << 7;
-    p[0] |= opcode;
-    p[1] = 0;
-    if (payload_len < 126) {
-        uint8_t len = payload_len;
-        p[1] |= len;
-        pkg_len = 2;
-    } else if (payload_len <= 0xffff) {
-        p[1] |= 126;
-        uint16_t len = htobe16((uint16_t)payload_len);
-        memcpy(p + 2, &len, sizeof(len));
-        pkg_len = 2 + sizeof(len);
-    } else {
-        p[1] |= 127;
-        uint64_t len = htobe64(payload_len);
-        memcpy(p + 2, &len, sizeof(len));
-        pkg_len = 2 + sizeof(len);
-    }
-
+    size_t pkg_len = frame_header(buf, opcode, payload_len);
     if (payload) {
-        memcpy(p + pkg_len, payload, payload_len);
+        memcpy(buf + pkg_len, payload, payload_len);
         pkg_len += payload_len;
     }
 
@@ -576,19 +578,63 @@ int ws_send_binary(nw_ses *ses, void *data, size_t size)
     return send_reply(ses, 0x2, data, size);
 }
 
+ws_msg *ws_msg_create(uint8_t opcode, const void *payload, size_t payload_len)
+{
+    ws_msg *msg = malloc(sizeof(ws_msg) + 10 + payload_len);
+    if (msg == NULL)
+        return NULL;
+    msg->refcount = 1;
+    msg->size = frame_header((uint8_t *)msg->data, opcode, payload_len);
+    if (payload_len) {
+        memcpy(msg->data + msg->size, payload, payload_len);
+        msg->size += payload_len;
+    }
+    return msg;
+}
+
+ws_msg *ws_msg_text(const char *message, size_t len)
+{
+    return ws_msg_create(0x1, message, len);
+}
+
+ws_msg *ws_msg_retain(ws_msg *msg)
+{
+    msg->refcount += 1;
+    return msg;
+}
+
+void ws_msg_release(ws_msg *msg)
+{
+    if (msg && --msg->refcount == 0) {
+        free(msg);
+    }
+}
+
+int ws_send_msg(nw_ses *ses, ws_msg *msg)
+{
+    return nw_ses_send(ses, msg->data, msg->size);
+}
+
 static int broadcast_message(ws_svr *svr, uint8_t opcode, void *data, size_t size)
 {
+    ws_msg *msg = ws_msg_create(opcode, data, size);
+    if (msg == NULL)
+        return -1;
+
     nw_ses *curr = svr->raw_svr->clt_list_head;
     while (curr) {
         nw_ses *next = curr->next;
         struct clt_info *info = curr->privdata;
         if (info->upgrade) {
-            int ret = send_reply(curr, opcode, data, size);
-            if (ret < 0)
+            int ret = ws_send_msg(curr, msg);
+            if (ret < 0) {
+                ws_msg_release(msg);
                 return ret;
+            }
         }
         curr = next;
     }
+    ws_msg_release(msg);
 
     return 0;
 }
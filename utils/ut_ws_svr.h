@@ -45,6 +45,17 @@ typedef struct ws_svr {
     ws_svr_type type;
 } ws_svr;
 
+/*
+ * A message framed once and shared by reference, so a broadcast to many
+ * sessions encodes it only once. The frame is written straight to each
+ * session, data is only copied when the socket can not take it at once.
+ */
+typedef struct ws_msg {
+    uint32_t refcount;
+    size_t size;
+    char data[];
+} ws_msg;
+
 ws_svr *ws_svr_create(ws_svr_cfg *cfg, ws_svr_type *type);
 int ws_svr_start(ws_svr *svr);
 int ws_svr_stop(ws_svr *svr);
@@ -52,6 +63,11 @@ ws_svr *ws_svr_from_ses(nw_ses *ses);
 void *ws_ses_privdata(nw_ses *ses);
 int ws_send_text(nw_ses *ses, char *message);
 int ws_send_binary(nw_ses *ses, void *data, size_t size);
+ws_msg *ws_msg_create(uint8_t opcode, const void *payload, size_t payload_len);
+ws_msg *ws_msg_text(const char *message, size_t len);
+ws_msg *ws_msg_retain(ws_msg *msg);
+void ws_msg_release(ws_msg *msg);
+int ws_send_msg(nw_ses *ses, ws_msg *msg);
 int ws_svr_broadcast_text(ws_svr *svr, char *message);
 int ws_svr_broadcast_binary(ws_svr *svr, void *data, size_t size);
 void ws_svr_release(ws_svr *svr);